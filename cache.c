@@ -0,0 +1,525 @@
+/**
+ * @file cache.c
+ * @author BrunchTea
+ * @brief Cache of compiled output
+ */
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <glob.h>
+#include <sys/stat.h>
+
+// Cache of compiled output.
+//
+// If MINIC_CACHE names a directory, each .o or .s file that
+// we make is also saved there. The name of the copy is a
+// SHA-256 digest of the pre-processed source, the compiler
+// binary, the kind of output and the options that change
+// the code. When the same digest comes up again, the copy
+// is used and the file isn't compiled at all. Each use of a
+// copy updates its modification time, so when the cache grows
+// past O_cachesize we remove the least recently used copies.
+
+static struct stat Cachestat;	// Details of a file in the cache
+static glob_t Cacheglob;	// List of the files in the cache
+
+// The key is a SHA-256 digest, so that no two inputs
+// will share a copy. SHA-256 works on 32-bit words,
+// which we keep in longs. Most of these constants
+// don't fit in an int, so each is masked when used
+static long Digestinit[] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static long Digestk[] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Rotate the 32-bit word x right by n bits
+/**
+ * @fn rotr
+ * @brief Rotate a 32-bit word right
+ * @param x The word
+ * @param n The number of bits
+ * @return The rotated word
+ */
+static long rotr(long x, int n)
+{
+  long hi, lo;
+
+  hi = x >> n;
+  lo = x - (hi << n);
+  return (hi + (lo << (32 - n)));
+}
+
+// Start a new digest
+/**
+ * @fn digestnew
+ * @brief Start a new digest
+ * @return The digest
+ */
+static struct digest *digestnew(void)
+{
+  struct digest *d;
+  int i;
+
+  d = (struct digest *)malloc(sizeof(struct digest));
+  if (d == NULL)
+    fatal("Unable to malloc in digestnew()");
+  d->h = (long *)malloc(8 * sizeof(long));
+  d->w = (long *)malloc(64 * sizeof(long));
+  d->block = (char *)malloc(64);
+  if (d->h == NULL || d->w == NULL || d->block == NULL)
+    fatal("Unable to malloc in digestnew()");
+  d->mask = 65535;
+  d->mask = d->mask * 65536 + 65535;
+  for (i = 0; i < 8; i++)
+    d->h[i] = Digestinit[i] & d->mask;
+  d->len = 0;
+  d->total = 0;
+  return (d);
+}
+
+// Free a digest
+/**
+ * @fn digestfree
+ * @brief Free a digest
+ * @param d The digest
+ */
+static void digestfree(struct digest *d)
+{
+  free(d->h);
+  free(d->w);
+  free(d->block);
+  free(d);
+}
+
+// Mix the full block into the digest
+/**
+ * @fn digestblock
+ * @brief Mix the full block into the digest
+ * @param d The digest
+ */
+static void digestblock(struct digest *d)
+{
+  long a, b, c, dd, e, f, g, hh, s0, s1, t1, t2, x;
+  long *w = d->w;
+  int i;
+
+  // Make the schedule for the block
+  for (i = 0; i < 16; i++)
+  {
+    x = d->block[i * 4] & 255;
+    x = x * 256 + (d->block[i * 4 + 1] & 255);
+    x = x * 256 + (d->block[i * 4 + 2] & 255);
+    w[i] = x * 256 + (d->block[i * 4 + 3] & 255);
+  }
+  for (i = 16; i < 64; i++)
+  {
+    x = w[i - 15] >> 3;
+    s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ x;
+    x = w[i - 2] >> 10;
+    s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ x;
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    w[i] = w[i] & d->mask;
+  }
+
+  // Do the 64 rounds
+  a = d->h[0];
+  b = d->h[1];
+  c = d->h[2];
+  dd = d->h[3];
+  e = d->h[4];
+  f = d->h[5];
+  g = d->h[6];
+  hh = d->h[7];
+  for (i = 0; i < 64; i++)
+  {
+    s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+    x = d->mask - e;
+    x = x & g;
+    t1 = e & f;
+    t1 = hh + s1 + (t1 ^ x) + (Digestk[i] & d->mask) + w[i];
+    s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+    x = a & b;
+    x = x ^ (a & c);
+    x = x ^ (b & c);
+    t2 = s0 + x;
+    hh = g;
+    g = f;
+    f = e;
+    e = dd + t1;
+    e = e & d->mask;
+    dd = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+    a = a & d->mask;
+  }
+
+  d->h[0] = d->h[0] + a;
+  d->h[1] = d->h[1] + b;
+  d->h[2] = d->h[2] + c;
+  d->h[3] = d->h[3] + dd;
+  d->h[4] = d->h[4] + e;
+  d->h[5] = d->h[5] + f;
+  d->h[6] = d->h[6] + g;
+  d->h[7] = d->h[7] + hh;
+  for (i = 0; i < 8; i++)
+    d->h[i] = d->h[i] & d->mask;
+  d->len = 0;
+}
+
+// Add a byte to the digest
+/**
+ * @fn hashbyte
+ * @brief Add a byte to the digest
+ * @param d The digest
+ * @param c The byte
+ */
+static void hashbyte(struct digest *d, int c)
+{
+  d->block[d->len] = (char)c;
+  d->len = d->len + 1;
+  d->total = d->total + 1;
+  if (d->len == 64)
+    digestblock(d);
+}
+
+// Finish the digest. The last block is padded
+// with a 1 bit, zeroes and the length in bits
+/**
+ * @fn digestend
+ * @brief Finish the digest
+ * @param d The digest
+ */
+static void digestend(struct digest *d)
+{
+  long bits = d->total * 8;
+  int i;
+
+  hashbyte(d, 128);
+  while (d->len != 56)
+    hashbyte(d, 0);
+  for (i = 56; i >= 0; i = i - 8)
+    hashbyte(d, (int)(bits >> i) & 255);
+}
+
+// Add the eight bytes of a value to the digest
+/**
+ * @fn hashval
+ * @brief Add a value to the digest
+ * @param d The digest
+ * @param v The value
+ */
+static void hashval(struct digest *d, long v)
+{
+  int i;
+
+  for (i = 0; i < 8; i++)
+  {
+    hashbyte(d, (int)v & 255);
+    v = v >> 8;
+  }
+}
+
+// Add a string and its terminating NUL to the digest
+/**
+ * @fn hashstr
+ * @brief Add a string and its terminating NUL to the digest
+ * @param d The digest
+ * @param s The string
+ */
+static void hashstr(struct digest *d, char *s)
+{
+  while (*s != '\0')
+  {
+    hashbyte(d, *s);
+    s++;
+  }
+  hashbyte(d, 0);
+}
+
+// Add the contents of the named file to the digest.
+// A file that can't be read adds nothing, and the
+// compile will fail on it anyway
+/**
+ * @fn hashfile
+ * @brief Add the contents of a file to the digest
+ * @param d The digest
+ * @param name The name of the file
+ */
+static void hashfile(struct digest *d, char *name)
+{
+  char buf[TEXTLEN];
+  int fd, n, i;
+
+  if ((fd = open(name, O_RDONLY)) == -1)
+    return;
+  while ((n = read(fd, buf, TEXTLEN)) > 0)
+    for (i = 0; i < n; i++)
+      hashbyte(d, buf[i]);
+  close(fd);
+}
+
+// Add the input for the current file to the digest.
+// This is the token list from the integrated
+// pre-processor, or the text in the scanner's input
+// buffer, and the contents of any files that it embeds
+/**
+ * @fn hashinput
+ * @brief Add the input for the current file to the digest
+ * @param d The digest
+ */
+static void hashinput(struct digest *d)
+{
+  struct pptoken *p;
+  char *file = NULL;
+  int i;
+
+  if (Ctx->pptokens == NULL)
+  {
+    for (i = 0; i < Ctx->inlen; i++)
+      hashbyte(d, Ctx->inbuf[i]);
+    return;
+  }
+
+  // Any tokens from a snapshot of the headers come
+  // first, up to its T_EOF, so the digest is the same
+  // as if the headers had been preprocessed again
+  p = Ctx->pptokens;
+  if (Ctx->ppsnap != NULL)
+    p = Ctx->ppsnap->ppout->head;
+  while (p != NULL)
+  {
+    if (Ctx->ppsnap != NULL && p == Ctx->ppsnap->ppout->tail)
+    {
+      p = Ctx->pptokens;
+      continue;
+    }
+    hashval(d, p->token);
+    hashval(d, p->intvalue);
+    hashval(d, p->line);
+    hashstr(d, p->text);
+    if (p->token == T_EMBED)
+      hashfile(d, p->text);
+    if (p->file != file)
+    {
+      file = p->file;
+      hashstr(d, file);
+    }
+    p = p->next;
+  }
+}
+
+// Copy the file called from to the file called to.
+// Return 1 on success, 0 on failure
+/**
+ * @fn copyfile
+ * @brief Copy one file to another
+ * @param from The name of the file to copy
+ * @param to The name of the new file
+ * @return 1 on success, 0 on failure
+ */
+static int copyfile(char *from, char *to)
+{
+  char buf[TEXTLEN];
+  int in, out, n, ok = 1;
+
+  if ((in = open(from, O_RDONLY)) == -1)
+    return (0);
+  if ((out = creat(to, 0644)) == -1)
+  {
+    close(in);
+    return (0);
+  }
+  while ((n = read(in, buf, TEXTLEN)) > 0)
+    if (write(out, buf, n) != n)
+      ok = 0;
+  if (n < 0)
+    ok = 0;
+  close(in);
+  if (close(out) == -1)
+    ok = 0;
+  return (ok);
+}
+
+// Look for a cached copy of the output of the current
+// file, whose input has been read in. suffix is 'o' or
+// 's', the kind of output. If there is a copy, copy it
+// to outname and return 1. Otherwise, return 0 and
+// remember where cachestore() should save the output
+/**
+ * @fn cachelookup
+ * @brief Look for a cached copy of the output of the current file
+ * @param filename The name of the source file
+ * @param outname The name of the output file
+ * @param suffix The kind of output, 'o' or 's'
+ * @return 1 if the output was copied from the cache, else 0
+ */
+int cachelookup(char *filename, char *outname, int suffix)
+{
+  struct digest *d;
+  char *cwd;
+  int len, n, i;
+
+  // Hash the compiler, the kind of output,
+  // the options that change the code or
+  // the way the object is written,
+  // and the source file
+  d = digestnew();
+  if (stat("/proc/self/exe", &Cachestat) == 0)
+  {
+    hashval(d, Cachestat.st_size);
+    hashval(d, Cachestat.st_mtime);
+  }
+  hashval(d, suffix);
+  hashval(d, O_nobuiltin);
+  hashval(d, O_intas);
+  hashstr(d, filename);
+
+  // The debug info in an object, from QBE or
+  // from as, names the directory it was made in
+  if (suffix == 'o')
+  {
+    if ((cwd = getcwd(NULL, 0)) == NULL)
+      fatal("Unable to get the current directory");
+    hashstr(d, cwd);
+    free(cwd);
+  }
+  hashinput(d);
+  digestend(d);
+
+  // The copy is named after the digest in hex
+  len = (int)strlen(O_cachedir) + 72;
+  Ctx->cachename = (char *)malloc(len);
+  if (Ctx->cachename == NULL)
+    fatal("Unable to malloc in cachelookup()");
+  n = snprintf(Ctx->cachename, len, "%s/", O_cachedir);
+  for (i = 0; i < 8; i++)
+    n = n + snprintf(Ctx->cachename + n, 9, "%08lx", d->h[i]);
+  snprintf(Ctx->cachename + n, 3, ".%c", suffix);
+  digestfree(d);
+
+  // Use the copy if we have one, and mark it as recently used
+  if (stat(Ctx->cachename, &Cachestat) == 0 &&
+      copyfile(Ctx->cachename, outname))
+  {
+    utime(Ctx->cachename, NULL);
+    if (O_verbose)
+      printf("cache hit for %s\n", filename);
+    return (1);
+  }
+  if (O_verbose)
+    printf("cache miss for %s\n", filename);
+  return (0);
+}
+
+// Remove the least recently used files
+// in the cache until it fits in O_cachesize
+/**
+ * @fn cacheevict
+ * @brief Remove the least recently used files in the cache until it fits
+ */
+static void cacheevict(void)
+{
+  char *pattern;
+  long *mtimes, *sizes;
+  long total = 0;
+  int i, n, oldest, len, evicted = 0;
+
+  len = (int)strlen(O_cachedir) + 8;
+  pattern = (char *)malloc(len);
+  if (pattern == NULL)
+    fatal("Unable to malloc in cacheevict()");
+  snprintf(pattern, len, "%s/*.[os]", O_cachedir);
+  if (glob(pattern, 0, NULL, &Cacheglob) != 0)
+  {
+    free(pattern);
+    return;
+  }
+
+  // Get the age and size of each file
+  n = (int)Cacheglob.gl_pathc;
+  mtimes = (long *)malloc(n * sizeof(long));
+  sizes = (long *)malloc(n * sizeof(long));
+  if (mtimes == NULL || sizes == NULL)
+    fatal("Unable to malloc in cacheevict()");
+  for (i = 0; i < n; i++)
+  {
+    sizes[i] = -1;
+    if (stat(Cacheglob.gl_pathv[i], &Cachestat) == 0)
+    {
+      mtimes[i] = Cachestat.st_mtime;
+      sizes[i] = Cachestat.st_size;
+      total = total + sizes[i];
+    }
+  }
+
+  // Remove the oldest file until the rest fit
+  while (total > O_cachesize)
+  {
+    oldest = -1;
+    for (i = 0; i < n; i++)
+      if (sizes[i] >= 0 && (oldest == -1 || mtimes[i] < mtimes[oldest]))
+        oldest = i;
+    if (oldest == -1)
+      break;
+    unlink(Cacheglob.gl_pathv[oldest]);
+    total = total - sizes[oldest];
+    sizes[oldest] = -1;
+    evicted++;
+  }
+
+  if (O_verbose)
+    printf("cache holds %d files, %ld bytes, %d evicted\n",
+           n - evicted, total, evicted);
+  free(mtimes);
+  free(sizes);
+  free(pattern);
+  globfree(&Cacheglob);
+}
+
+// Save a copy of the output file outname in the cache,
+// where cachelookup() said to put it. Then make sure
+// that the cache hasn't grown too big
+/**
+ * @fn cachestore
+ * @brief Save a copy of the output file in the cache
+ * @param outname The name of the output file
+ */
+void cachestore(char *outname)
+{
+  char *tmpname;
+  int len;
+
+  if (Ctx->cachename == NULL)
+    return;
+
+  // Copy to a temporary name and then rename it, so
+  // that other compilers never see a partial copy
+  mkdir(O_cachedir, 0755);
+  len = (int)strlen(Ctx->cachename) + 16;
+  tmpname = (char *)malloc(len);
+  if (tmpname == NULL)
+    fatal("Unable to malloc in cachestore()");
+  snprintf(tmpname, len, "%s.%d", Ctx->cachename, getpid());
+  if (!copyfile(outname, tmpname) || rename(tmpname, Ctx->cachename) == -1)
+    unlink(tmpname);
+  free(tmpname);
+  cacheevict();
+}
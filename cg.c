@@ -8,6 +8,8 @@
 #include "data.h"
 #include "decl.h"
 
+static void cgctypetable(void);
+
 // Switch to the text segment
 /**
  * @fn cgtextseg
@@ -124,44 +126,217 @@ int cgalign(int type, int offset, int direction)
  * @param void
  * @return int
  */
-static int nexttemp = 0;
 int cgalloctemp(void)
 {
-  return (++nexttemp);
+  Ctx->nexttemp = Ctx->nexttemp + 1;
+  return (Ctx->nexttemp);
+}
+
+// The QBE code for the current declaration is
+// buffered in memory until cgflush() hands it
+// to the QBE back end linked into the compiler.
+// When QBE writes the object file itself, all
+// the QBE code is kept as well, in case there is
+// something that QBE can't encode and we have to
+// run the assembler on the file after all
+
+// Open the in-memory buffer for the QBE code
+/**
+ * @fn cgopenbuf
+ * @brief Open the in-memory buffer for the QBE code
+ * @param void
+ * @return void
+ */
+static void cgopenbuf(void)
+{
+  if ((Ctx->outfile = open_memstream(Ctx->qbebuf, Ctx->qbelen)) == NULL)
+  {
+    fprintf(stderr, "Unable to buffer the QBE code for %s\n", Ctx->infilename);
+    exit(1);
+  }
+}
+
+// Name the source file for the assembler, with
+// a backslash before any quote or backslash in
+// it. We can't scan a \" inside a string literal yet,
+// so this doesn't go through fprintf()
+/**
+ * @fn cgasmfile
+ * @brief Name the source file for the assembler
+ * @param name The name of the source file
+ * @return void
+ */
+void cgasmfile(char *name)
+{
+  fputs(".file ", Ctx->asmfile);
+  fputc('"', Ctx->asmfile);
+  while (*name)
+  {
+    if (*name == '"' || *name == '\\')
+      fputc('\\', Ctx->asmfile);
+    fputc(*name, Ctx->asmfile);
+    name++;
+  }
+  fputc('"', Ctx->asmfile);
+  fputc('\n', Ctx->asmfile);
 }
 
-// Print out the assembly preamble
-// for one output file
+// Set up the QBE back end and the
+// code buffer for one output file.
+// Name the source file, as the assembler
+// may only see a pipe or a temporary file
 /**
  * @fn cgpreamble
- * @brief Print out the assembly preamble for one output file
+ * @brief Set up the QBE back end and the code buffer for one output file
  * @param filename Filename
  * @return void
  */
 void cgpreamble(char *filename)
 {
+  Ctx->qbefunc = NULL;
+  Ctx->usedctype = 0;
+
+  // The whole program is translated at the end
+  if (O_wholeprog)
+  {
+    cgopenbuf();
+    return;
+  }
+
+  // QBE names the source file in the object
+  if (Ctx->elfobj)
+  {
+    qbe_init(NULL);
+    if (!qbe_objbegin(filename))
+      Ctx->needas = 1;
+    Ctx->keepfile = open_memstream(Ctx->keepbuf, Ctx->keeplen);
+    if (Ctx->keepfile == NULL)
+    {
+      fprintf(stderr, "Unable to buffer the QBE code for %s\n",
+              Ctx->infilename);
+      exit(1);
+    }
+    Ctx->keepname = filename;
+    cgopenbuf();
+    return;
+  }
+
+  cgasmfile(filename);
+  qbe_init(NULL);
+  cgopenbuf();
 }
 
-// Nothing to do for the end of a file
+// Translate anything left in the buffer and
+// let QBE finish off the assembly file, or write
+// the object file. If QBE can't write the object,
+// set Ctx->needas and keep the QBE code for cgreplay()
 /**
  * @fn cgpostamble
- * @brief Nothing to do for the end of a file
+ * @brief Translate anything left in the buffer and let QBE finish off the assembly file
  * @param void
  * @return void
  */
 void cgpostamble()
 {
+  cgctypetable();
+  cgflush();
+  fclose(Ctx->outfile);
+  Ctx->outfile = NULL;
+  free(*Ctx->qbebuf);
+  if (O_wholeprog)
+    wpendfile();
+  else if (Ctx->elfobj)
+  {
+    fclose(Ctx->keepfile);
+    if (!Ctx->needas && !qbe_objend(Ctx->asmfile))
+      Ctx->needas = 1;
+    if (!Ctx->needas)
+      free(*Ctx->keepbuf);
+  }
+  else
+    qbe_finish(Ctx->asmfile);
 }
 
-// Boolean flag: has there been a switch statement
-// in this function yet?
+// QBE couldn't write the object file itself, so
+// translate all the kept QBE code into assembly
+// code for the assembler now reading Ctx->asmfile
 /**
- * @fn used_switch
- * @brief Boolean flag: has there been a switch statement in this function yet?
+ * @fn cgreplay
+ * @brief Translate the kept QBE code into assembly code
  * @param void
- * @return int
+ * @return void
+ */
+void cgreplay(void)
+{
+  cgasmfile(Ctx->keepname);
+  qbe_init(NULL);
+  if (*Ctx->keeplen > 0)
+  {
+    if ((Ctx->qbein = fmemopen(*Ctx->keepbuf, *Ctx->keeplen, "r")) == NULL)
+    {
+      fprintf(stderr, "Unable to read the QBE code for %s\n",
+              Ctx->infilename);
+      exit(1);
+    }
+    qbe_translate(Ctx->qbein, Ctx->infilename, Ctx->asmfile);
+    fclose(Ctx->qbein);
+  }
+  free(*Ctx->keepbuf);
+  qbe_finish(Ctx->asmfile);
+}
+
+// Hand the QBE code buffered so far to the
+// QBE back end, which appends the assembly
+// for it to Asmfile. Then start a new buffer
+/**
+ * @fn cgflush
+ * @brief Hand the QBE code buffered so far to the QBE back end
+ * @param void
+ * @return void
  */
-static int used_switch;
+void cgflush(void)
+{
+  // Nothing to do if no code was generated
+  if (ftell(Ctx->outfile) == 0)
+    return;
+
+  // Closing the stream sets the buffer and its length.
+  // Keep the code for the whole program if asked
+  fclose(Ctx->outfile);
+  if (O_wholeprog)
+  {
+    wpadd(*Ctx->qbebuf, (int)*Ctx->qbelen);
+    free(*Ctx->qbebuf);
+    cgopenbuf();
+    return;
+  }
+  if (Ctx->elfobj)
+  {
+    fwrite(*Ctx->qbebuf, 1, *Ctx->qbelen, Ctx->keepfile);
+    if (Ctx->needas)
+    {
+      free(*Ctx->qbebuf);
+      cgopenbuf();
+      return;
+    }
+  }
+  // QBE parses the text back in. We can't build its
+  // structures ourselves, see lib/qbe/main.c
+  if ((Ctx->qbein = fmemopen(*Ctx->qbebuf, *Ctx->qbelen, "r")) == NULL)
+  {
+    fprintf(stderr, "Unable to read the QBE code for %s\n", Ctx->infilename);
+    exit(1);
+  }
+  if (Ctx->qbefunc != NULL)
+    tracebegin(Ctx->qbefunc, "qbe");
+  qbe_translate(Ctx->qbein, Ctx->infilename, Ctx->asmfile);
+  if (Ctx->qbefunc != NULL)
+    traceend();
+  Ctx->qbefunc = NULL;
+  fclose(Ctx->qbein);
+  free(*Ctx->qbebuf);
+  cgopenbuf();
+}
 
 // Print out a function preamble
 /**
@@ -178,20 +353,21 @@ void cgfuncpreamble(struct symtable *sym)
   int label;
 
   // Output the function's name and return type
+  Ctx->qbefunc = name;
   if (sym->class == C_GLOBAL)
-    fprintf(Outfile, "export ");
-  fprintf(Outfile, "function %c $%s(", cgqbetype(sym->type), name);
+    fprintf(Ctx->outfile, "export ");
+  fprintf(Ctx->outfile, "function %c $%s(", cgqbetype(sym->type), name);
 
   // Output the parameter names and types. For any parameters which
   // need addresses, change their name as we copy their value below
   for (parm = sym->member; parm != NULL; parm = parm->next)
   {
     if (parm->st_hasaddr == 1)
-      fprintf(Outfile, "%c %%.p%s, ", cgqbetype(parm->type), parm->name);
+      fprintf(Ctx->outfile, "%c %%.p%s, ", cgqbetype(parm->type), parm->name);
     else
-      fprintf(Outfile, "%c %%%s, ", cgqbetype(parm->type), parm->name);
+      fprintf(Ctx->outfile, "%c %%%s, ", cgqbetype(parm->type), parm->name);
   }
-  fprintf(Outfile, ") {\n");
+  fprintf(Ctx->outfile, ") {\n");
 
   // Get a label for the function start
   label = genlabel();
@@ -208,19 +384,19 @@ void cgfuncpreamble(struct symtable *sym)
     {
       size = cgprimsize(parm->type);
       bigsize = (size == 1) ? 4 : size;
-      fprintf(Outfile, "  %%%s =l alloc%d 1\n", parm->name, bigsize);
+      fprintf(Ctx->outfile, "  %%%s =l alloc%d 1\n", parm->name, bigsize);
 
       // Copy to the allocated memory
       switch (size)
       {
       case 1:
-        fprintf(Outfile, "  storeb %%.p%s, %%%s\n", parm->name, parm->name);
+        fprintf(Ctx->outfile, "  storeb %%.p%s, %%%s\n", parm->name, parm->name);
         break;
       case 4:
-        fprintf(Outfile, "  storew %%.p%s, %%%s\n", parm->name, parm->name);
+        fprintf(Ctx->outfile, "  storew %%.p%s, %%%s\n", parm->name, parm->name);
         break;
       case 8:
-        fprintf(Outfile, "  storel %%.p%s, %%%s\n", parm->name, parm->name);
+        fprintf(Ctx->outfile, "  storel %%.p%s, %%%s\n", parm->name, parm->name);
       }
     }
   }
@@ -230,7 +406,7 @@ void cgfuncpreamble(struct symtable *sym)
   // where their address is used. The second is for char variables
   // We need to do this as QBE can only truncate down to 8 bits
   // for locations in memory
-  for (locvar = Loclhead; locvar != NULL; locvar = locvar->next)
+  for (locvar = Ctx->loclsyms->head; locvar != NULL; locvar = locvar->next)
   {
     if (locvar->st_hasaddr == 1)
     {
@@ -239,16 +415,16 @@ void cgfuncpreamble(struct symtable *sym)
       // pointers are aligned on 8-byte boundaries
       size = locvar->size * locvar->nelems;
       size = (size + 7) >> 3;
-      fprintf(Outfile, "  %%%s =l alloc8 %d\n", locvar->name, size);
+      fprintf(Ctx->outfile, "  %%%s =l alloc8 %d\n", locvar->name, size);
     }
     else if (locvar->type == P_CHAR)
     {
       locvar->st_hasaddr = 1;
-      fprintf(Outfile, "  %%%s =l alloc4 1\n", locvar->name);
+      fprintf(Ctx->outfile, "  %%%s =l alloc4 1\n", locvar->name);
     }
   }
 
-  used_switch = 0; // We haven't output the switch handling code yet
+  Ctx->used_switch = 0; // We haven't output the switch handling code yet
 }
 
 // Print out a function postamble
@@ -264,9 +440,9 @@ void cgfuncpostamble(struct symtable *sym)
 
   // Return a value if the function's type isn't void
   if (sym->type != P_VOID)
-    fprintf(Outfile, "  ret %%.ret\n}\n");
+    fprintf(Ctx->outfile, "  ret %%.ret\n}\n");
   else
-    fprintf(Outfile, "  ret\n}\n");
+    fprintf(Ctx->outfile, "  ret\n}\n");
 }
 
 // Load an integer literal value into a temporary.
@@ -283,7 +459,7 @@ int cgloadint(int value, int type)
   // Get a new temporary
   int t = cgalloctemp();
 
-  fprintf(Outfile, "  %%.t%d =%c copy %d\n", t, cgqbetype(type), value);
+  fprintf(Ctx->outfile, "  %%.t%d =%c copy %d\n", t, cgqbetype(type), value);
   return (t);
 }
 
@@ -332,32 +508,32 @@ int cgloadvar(struct symtable *sym, int op)
       switch (sym->size)
       {
       case 1:
-        fprintf(Outfile, "  %%.t%d =w loadub %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  %%.t%d =w loadub %c%s\n", posttemp, qbeprefix,
                 sym->name);
-        fprintf(Outfile, "  %%.t%d =w add %%.t%d, %d\n", posttemp, posttemp,
+        fprintf(Ctx->outfile, "  %%.t%d =w add %%.t%d, %d\n", posttemp, posttemp,
                 offset);
-        fprintf(Outfile, "  storeb %%.t%d, %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  storeb %%.t%d, %c%s\n", posttemp, qbeprefix,
                 sym->name);
         break;
       case 4:
-        fprintf(Outfile, "  %%.t%d =w loadsw %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  %%.t%d =w loadsw %c%s\n", posttemp, qbeprefix,
                 sym->name);
-        fprintf(Outfile, "  %%.t%d =w add %%.t%d, %d\n", posttemp, posttemp,
+        fprintf(Ctx->outfile, "  %%.t%d =w add %%.t%d, %d\n", posttemp, posttemp,
                 offset);
-        fprintf(Outfile, "  storew %%.t%d, %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  storew %%.t%d, %c%s\n", posttemp, qbeprefix,
                 sym->name);
         break;
       case 8:
-        fprintf(Outfile, "  %%.t%d =l loadl %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  %%.t%d =l loadl %c%s\n", posttemp, qbeprefix,
                 sym->name);
-        fprintf(Outfile, "  %%.t%d =l add %%.t%d, %d\n", posttemp, posttemp,
+        fprintf(Ctx->outfile, "  %%.t%d =l add %%.t%d, %d\n", posttemp, posttemp,
                 offset);
-        fprintf(Outfile, "  storel %%.t%d, %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  storel %%.t%d, %c%s\n", posttemp, qbeprefix,
                 sym->name);
       }
     }
     else
-      fprintf(Outfile, "  %c%s =%c add %c%s, %d\n",
+      fprintf(Ctx->outfile, "  %c%s =%c add %c%s, %d\n",
               qbeprefix, sym->name, cgqbetype(sym->type), qbeprefix,
               sym->name, offset);
   }
@@ -367,19 +543,19 @@ int cgloadvar(struct symtable *sym, int op)
     switch (sym->size)
     {
     case 1:
-      fprintf(Outfile, "  %%.t%d =w loadub %c%s\n", r, qbeprefix,
+      fprintf(Ctx->outfile, "  %%.t%d =w loadub %c%s\n", r, qbeprefix,
               sym->name);
       break;
     case 4:
-      fprintf(Outfile, "  %%.t%d =w loadsw %c%s\n", r, qbeprefix,
+      fprintf(Ctx->outfile, "  %%.t%d =w loadsw %c%s\n", r, qbeprefix,
               sym->name);
       break;
     case 8:
-      fprintf(Outfile, "  %%.t%d =l loadl %c%s\n", r, qbeprefix, sym->name);
+      fprintf(Ctx->outfile, "  %%.t%d =l loadl %c%s\n", r, qbeprefix, sym->name);
     }
   }
   else
-    fprintf(Outfile, "  %%.t%d =%c copy %c%s\n",
+    fprintf(Ctx->outfile, "  %%.t%d =%c copy %c%s\n",
             r, cgqbetype(sym->type), qbeprefix, sym->name);
 
   // If we have a post-operation
@@ -392,32 +568,32 @@ int cgloadvar(struct symtable *sym, int op)
       switch (sym->size)
       {
       case 1:
-        fprintf(Outfile, "  %%.t%d =w loadub %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  %%.t%d =w loadub %c%s\n", posttemp, qbeprefix,
                 sym->name);
-        fprintf(Outfile, "  %%.t%d =w add %%.t%d, %d\n", posttemp, posttemp,
+        fprintf(Ctx->outfile, "  %%.t%d =w add %%.t%d, %d\n", posttemp, posttemp,
                 offset);
-        fprintf(Outfile, "  storeb %%.t%d, %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  storeb %%.t%d, %c%s\n", posttemp, qbeprefix,
                 sym->name);
         break;
       case 4:
-        fprintf(Outfile, "  %%.t%d =w loadsw %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  %%.t%d =w loadsw %c%s\n", posttemp, qbeprefix,
                 sym->name);
-        fprintf(Outfile, "  %%.t%d =w add %%.t%d, %d\n", posttemp, posttemp,
+        fprintf(Ctx->outfile, "  %%.t%d =w add %%.t%d, %d\n", posttemp, posttemp,
                 offset);
-        fprintf(Outfile, "  storew %%.t%d, %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  storew %%.t%d, %c%s\n", posttemp, qbeprefix,
                 sym->name);
         break;
       case 8:
-        fprintf(Outfile, "  %%.t%d =l loadl %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  %%.t%d =l loadl %c%s\n", posttemp, qbeprefix,
                 sym->name);
-        fprintf(Outfile, "  %%.t%d =l add %%.t%d, %d\n", posttemp, posttemp,
+        fprintf(Ctx->outfile, "  %%.t%d =l add %%.t%d, %d\n", posttemp, posttemp,
                 offset);
-        fprintf(Outfile, "  storel %%.t%d, %c%s\n", posttemp, qbeprefix,
+        fprintf(Ctx->outfile, "  storel %%.t%d, %c%s\n", posttemp, qbeprefix,
                 sym->name);
       }
     }
     else
-      fprintf(Outfile, "  %c%s =%c add %c%s, %d\n",
+      fprintf(Ctx->outfile, "  %c%s =%c add %c%s, %d\n",
               qbeprefix, sym->name, cgqbetype(sym->type), qbeprefix,
               sym->name, offset);
   }
@@ -437,7 +613,7 @@ int cgloadglobstr(int label)
 {
   // Get a new temporary
   int r = cgalloctemp();
-  fprintf(Outfile, "  %%.t%d =l copy $L%d\n", r, label);
+  fprintf(Ctx->outfile, "  %%.t%d =l copy $L%d\n", r, label);
   return (r);
 }
 
@@ -453,7 +629,7 @@ int cgloadglobstr(int label)
  */
 int cgadd(int r1, int r2, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c add %%.t%d, %%.t%d\n",
+  fprintf(Ctx->outfile, "  %%.t%d =%c add %%.t%d, %%.t%d\n",
           r1, cgqbetype(type), r1, r2);
   return (r1);
 }
@@ -470,7 +646,7 @@ int cgadd(int r1, int r2, int type)
  */
 int cgsub(int r1, int r2, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c sub %%.t%d, %%.t%d\n",
+  fprintf(Ctx->outfile, "  %%.t%d =%c sub %%.t%d, %%.t%d\n",
           r1, cgqbetype(type), r1, r2);
   return (r1);
 }
@@ -487,7 +663,7 @@ int cgsub(int r1, int r2, int type)
  */
 int cgmul(int r1, int r2, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c mul %%.t%d, %%.t%d\n",
+  fprintf(Ctx->outfile, "  %%.t%d =%c mul %%.t%d, %%.t%d\n",
           r1, cgqbetype(type), r1, r2);
   return (r1);
 }
@@ -506,10 +682,10 @@ int cgmul(int r1, int r2, int type)
 int cgdivmod(int r1, int r2, int op, int type)
 {
   if (op == A_DIVIDE)
-    fprintf(Outfile, "  %%.t%d =%c div %%.t%d, %%.t%d\n",
+    fprintf(Ctx->outfile, "  %%.t%d =%c div %%.t%d, %%.t%d\n",
             r1, cgqbetype(type), r1, r2);
   else
-    fprintf(Outfile, "  %%.t%d =%c rem %%.t%d, %%.t%d\n",
+    fprintf(Ctx->outfile, "  %%.t%d =%c rem %%.t%d, %%.t%d\n",
             r1, cgqbetype(type), r1, r2);
   return (r1);
 }
@@ -525,7 +701,7 @@ int cgdivmod(int r1, int r2, int op, int type)
  */
 int cgand(int r1, int r2, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c and %%.t%d, %%.t%d\n",
+  fprintf(Ctx->outfile, "  %%.t%d =%c and %%.t%d, %%.t%d\n",
           r1, cgqbetype(type), r1, r2);
   return (r1);
 }
@@ -541,7 +717,7 @@ int cgand(int r1, int r2, int type)
  */
 int cgor(int r1, int r2, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c or %%.t%d, %%.t%d\n",
+  fprintf(Ctx->outfile, "  %%.t%d =%c or %%.t%d, %%.t%d\n",
           r1, cgqbetype(type), r1, r2);
   return (r1);
 }
@@ -557,7 +733,7 @@ int cgor(int r1, int r2, int type)
  */
 int cgxor(int r1, int r2, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c xor %%.t%d, %%.t%d\n",
+  fprintf(Ctx->outfile, "  %%.t%d =%c xor %%.t%d, %%.t%d\n",
           r1, cgqbetype(type), r1, r2);
   return (r1);
 }
@@ -573,7 +749,7 @@ int cgxor(int r1, int r2, int type)
  */
 int cgshl(int r1, int r2, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c shl %%.t%d, %%.t%d\n",
+  fprintf(Ctx->outfile, "  %%.t%d =%c shl %%.t%d, %%.t%d\n",
           r1, cgqbetype(type), r1, r2);
   return (r1);
 }
@@ -589,7 +765,7 @@ int cgshl(int r1, int r2, int type)
  */
 int cgshr(int r1, int r2, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c shr %%.t%d, %%.t%d\n",
+  fprintf(Ctx->outfile, "  %%.t%d =%c shr %%.t%d, %%.t%d\n",
           r1, cgqbetype(type), r1, r2);
   return (r1);
 }
@@ -604,7 +780,7 @@ int cgshr(int r1, int r2, int type)
  */
 int cgnegate(int r, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c sub 0, %%.t%d\n", r, cgqbetype(type), r);
+  fprintf(Ctx->outfile, "  %%.t%d =%c sub 0, %%.t%d\n", r, cgqbetype(type), r);
   return (r);
 }
 
@@ -618,7 +794,7 @@ int cgnegate(int r, int type)
  */
 int cginvert(int r, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c xor %%.t%d, -1\n", r, cgqbetype(type), r);
+  fprintf(Ctx->outfile, "  %%.t%d =%c xor %%.t%d, -1\n", r, cgqbetype(type), r);
   return (r);
 }
 
@@ -633,7 +809,7 @@ int cginvert(int r, int type)
 int cglognot(int r, int type)
 {
   char q = cgqbetype(type);
-  fprintf(Outfile, "  %%.t%d =%c ceq%c %%.t%d, 0\n", r, q, q, r);
+  fprintf(Ctx->outfile, "  %%.t%d =%c ceq%c %%.t%d, 0\n", r, q, q, r);
   return (r);
 }
 
@@ -648,7 +824,7 @@ int cglognot(int r, int type)
  */
 void cgloadboolean(int r, int val, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c copy %d\n", r, cgqbetype(type), val);
+  fprintf(Ctx->outfile, "  %%.t%d =%c copy %d\n", r, cgqbetype(type), val);
 }
 
 // Convert an integer value to a boolean value. Jump if
@@ -671,17 +847,17 @@ int cgboolean(int r, int op, int label, int type)
   int r2 = cgalloctemp();
 
   // Convert temporary to boolean value
-  fprintf(Outfile, "  %%.t%d =l cne%c %%.t%d, 0\n", r2, cgqbetype(type), r);
+  fprintf(Ctx->outfile, "  %%.t%d =l cne%c %%.t%d, 0\n", r2, cgqbetype(type), r);
 
   switch (op)
   {
   case A_IF:
   case A_WHILE:
   case A_LOGAND:
-    fprintf(Outfile, "  jnz %%.t%d, @L%d, @L%d\n", r2, label2, label);
+    fprintf(Ctx->outfile, "  jnz %%.t%d, @L%d, @L%d\n", r2, label2, label);
     break;
   case A_LOGOR:
-    fprintf(Outfile, "  jnz %%.t%d, @L%d, @L%d\n", r2, label, label2);
+    fprintf(Ctx->outfile, "  jnz %%.t%d, @L%d, @L%d\n", r2, label, label2);
     break;
   }
 
@@ -711,21 +887,182 @@ int cgcall(struct symtable *sym, int numargs, int *arglist, int *typelist)
 
   // Call the function
   if (sym->type == P_VOID)
-    fprintf(Outfile, "  call $%s(", sym->name);
+    fprintf(Ctx->outfile, "  call $%s(", sym->name);
   else
-    fprintf(Outfile, "  %%.t%d =%c call $%s(", outr, cgqbetype(sym->type),
+    fprintf(Ctx->outfile, "  %%.t%d =%c call $%s(", outr, cgqbetype(sym->type),
             sym->name);
 
   // Output the list of arguments
   for (i = numargs - 1; i >= 0; i--)
   {
-    fprintf(Outfile, "%c %%.t%d, ", cgqbetype(typelist[i]), arglist[i]);
+    fprintf(Ctx->outfile, "%c %%.t%d, ", cgqbetype(typelist[i]), arglist[i]);
   }
-  fprintf(Outfile, ")\n");
+  fprintf(Ctx->outfile, ")\n");
 
   return (outr);
 }
 
+// Copy size bytes from the address in src to the
+// address in dst, for a memcpy() with a constant size.
+// Return the temporary holding dst, as memcpy() does
+/**
+ * @fn cgmemcpy
+ * @brief Copy a constant number of bytes inline
+ * @param dst The temporary with the destination address
+ * @param src The temporary with the source address
+ * @param size The number of bytes
+ * @return The temporary with the destination address
+ */
+int cgmemcpy(int dst, int src, int size)
+{
+  if (size > 0)
+    fprintf(Ctx->outfile, "  blit %%.t%d, %%.t%d, %d\n", src, dst, size);
+  return (dst);
+}
+
+// For each size of memset() store, the store instruction,
+// its QBE type and the number to copy the byte along it with
+static char *storename[] = {
+    NULL, "storeb", "storeh", NULL, "storew", NULL, NULL, NULL, "storel"};
+static char *storetype[] = {
+    NULL, "w", "w", NULL, "w", NULL, NULL, NULL, "l"};
+static char *storecopies[] = {
+    NULL, "1", "257", NULL, "16843009", NULL, NULL, NULL,
+    "72340172838076673"};
+
+// Fill size bytes at the address in dst with the low
+// byte of val, for a memset() with a constant size.
+// The stores are the widest that fit, each with the
+// byte copied into all of the bytes that it stores.
+// Return the temporary holding dst, as memset() does
+/**
+ * @fn cgmemset
+ * @brief Fill a constant number of bytes inline
+ * @param dst The temporary with the destination address
+ * @param val The temporary with the byte value
+ * @param size The number of bytes
+ * @return The temporary with the destination address
+ */
+int cgmemset(int dst, int val, int size)
+{
+  int b, v, addr, off, n, last;
+
+  if (size == 0)
+    return (dst);
+  b = cgalloctemp();
+  fprintf(Ctx->outfile, "  %%.t%d =l extub %%.t%d\n", b, val);
+
+  last = 0;
+  for (off = 0; off < size; off = off + n)
+  {
+    n = 8;
+    while (off + n > size)
+      n = n / 2;
+    if (n != last)
+    {
+      v = cgalloctemp();
+      fprintf(Ctx->outfile, "  %%.t%d =%s mul %%.t%d, %s\n", v,
+              storetype[n], b, storecopies[n]);
+      last = n;
+    }
+    addr = dst;
+    if (off > 0)
+    {
+      addr = cgalloctemp();
+      fprintf(Ctx->outfile, "  %%.t%d =l add %%.t%d, %d\n", addr, dst, off);
+    }
+    fprintf(Ctx->outfile, "  %s %%.t%d, %%.t%d\n", storename[n], v, addr);
+  }
+  return (dst);
+}
+
+// Bits in the table of character classes
+// that the ctype queries are inlined with
+enum
+{
+  CT_UPPER = 1,
+  CT_LOWER = 2,
+  CT_DIGIT = 4,
+  CT_SPACE = 8,
+  CT_PUNCT = 16,
+  CT_CNTRL = 32,
+  CT_XDIGIT = 64,
+  CT_BLANK = 128 // Only the space character
+};
+
+// The ctype queries done inline, and
+// the classes in the table for each one
+static char *ctypename[] = {
+    "isalnum", "isalpha", "iscntrl", "isdigit", "isgraph", "islower",
+    "isprint", "ispunct", "isspace", "isupper", "isxdigit", NULL};
+
+static int ctypemask[] = {
+    CT_UPPER + CT_LOWER + CT_DIGIT,
+    CT_UPPER + CT_LOWER,
+    CT_CNTRL,
+    CT_DIGIT,
+    CT_PUNCT + CT_UPPER + CT_LOWER + CT_DIGIT,
+    CT_LOWER,
+    CT_PUNCT + CT_UPPER + CT_LOWER + CT_DIGIT + CT_BLANK,
+    CT_PUNCT,
+    CT_SPACE,
+    CT_UPPER,
+    CT_XDIGIT};
+
+// Given the name of a function, return the
+// classes that it tests for if it is a ctype
+// query that can be done inline, or zero
+/**
+ * @fn cgctypemask
+ * @brief Get the character classes that a ctype query tests for
+ * @param name The name of the function
+ * @return The classes in the table, or zero
+ */
+int cgctypemask(char *name)
+{
+  int i;
+
+  for (i = 0; ctypename[i] != NULL; i++)
+    if (!strcmp(name, ctypename[i]))
+      return (ctypemask[i]);
+  return (0);
+}
+
+// Look up the character in temporary r in the
+// table of character classes, and return a
+// temporary that is non-zero if the character
+// is in any of the classes in mask. The table
+// covers -128 to 255, so both signed chars and EOF work
+/**
+ * @fn cgctype
+ * @brief Test a character's classes inline
+ * @param r The temporary with the character
+ * @param type The type of the character
+ * @param mask The classes to test for
+ * @return The temporary with the result
+ */
+int cgctype(int r, int type, int mask)
+{
+  int r1, r2, r3, r4;
+
+  Ctx->usedctype = 1;
+  if (cgqbetype(type) != 'l')
+  {
+    r1 = cgalloctemp();
+    fprintf(Ctx->outfile, "  %%.t%d =l extsw %%.t%d\n", r1, r);
+    r = r1;
+  }
+  r1 = cgalloctemp();
+  r2 = cgalloctemp();
+  r3 = cgalloctemp();
+  r4 = cgalloctemp();
+  fprintf(Ctx->outfile, "  %%.t%d =l add %%.t%d, $ctype.minic\n", r1, r);
+  fprintf(Ctx->outfile, "  %%.t%d =l add %%.t%d, 128\n", r2, r1);
+  fprintf(Ctx->outfile, "  %%.t%d =w loadub %%.t%d\n", r3, r2);
+  fprintf(Ctx->outfile, "  %%.t%d =w and %%.t%d, %d\n", r4, r3, mask);
+  return (r4);
+}
+
 // Shift a temporary left by a constant. As we only
 // use this for address calculations, extend the
 // type to be a QBE 'l' if required
@@ -745,11 +1082,11 @@ int cgshlconst(int r, int val, int type)
 
   if (cgprimsize(type) < 8)
   {
-    fprintf(Outfile, "  %%.t%d =l extsw %%.t%d\n", r2, r);
-    fprintf(Outfile, "  %%.t%d =l shl %%.t%d, %d\n", r3, r2, val);
+    fprintf(Ctx->outfile, "  %%.t%d =l extsw %%.t%d\n", r2, r);
+    fprintf(Ctx->outfile, "  %%.t%d =l shl %%.t%d, %d\n", r3, r2, val);
   }
   else
-    fprintf(Outfile, "  %%.t%d =l shl %%.t%d, %d\n", r3, r, val);
+    fprintf(Ctx->outfile, "  %%.t%d =l shl %%.t%d, %d\n", r3, r, val);
   return (r3);
 }
 
@@ -769,7 +1106,7 @@ int cgstorglob(int r, struct symtable *sym)
   if (sym->type == P_CHAR)
     q = 'b';
 
-  fprintf(Outfile, "  store%c %%.t%d, $%s\n", q, r, sym->name);
+  fprintf(Ctx->outfile, "  store%c %%.t%d, $%s\n", q, r, sym->name);
   return (r);
 }
 
@@ -787,17 +1124,155 @@ int cgstorlocal(int r, struct symtable *sym)
   // If the variable is on the stack, use store instructions
   if (sym->st_hasaddr)
   {
-    fprintf(Outfile, "  store%c %%.t%d, %%%s\n",
+    fprintf(Ctx->outfile, "  store%c %%.t%d, %%%s\n",
             cgqbetype(sym->type), r, sym->name);
   }
   else
   {
-    fprintf(Outfile, "  %%%s =%c copy %%.t%d\n",
+    fprintf(Ctx->outfile, "  %%%s =%c copy %%.t%d\n",
             sym->name, cgqbetype(sym->type), r);
   }
   return (r);
 }
 
+// Output a space and then an integer. Big tables
+// of initial values spend most of their time here,
+// so this doesn't go through fprintf()
+/**
+ * @fn cgputint
+ * @brief Output a space and then an integer
+ * @param val The integer
+ */
+static void cgputint(int val)
+{
+  char buf[16];
+  long v = val;
+  int i = 15;
+
+  if (v < 0)
+    v = -v;
+  buf[i] = '\0';
+  while (1)
+  {
+    i--;
+    buf[i] = (char)('0' + v % 10);
+    v = v / 10;
+    if (v == 0)
+      break;
+  }
+  if (val < 0)
+  {
+    i--;
+    buf[i] = '-';
+  }
+  i--;
+  buf[i] = ' ';
+  fputs(buf + i, Ctx->outfile);
+}
+
+// Output n bytes from list as a QBE string, which is
+// much shorter than a number for each one. Anything
+// that isn't plain ASCII goes out as an octal escape,
+// and so does '$', which whole.c would take for the
+// start of a symbol. The string is built up in buf,
+// a block at a time
+/**
+ * @fn cgputbytes
+ * @brief Output bytes as a QBE string
+ * @param list The bytes
+ * @param n The number of bytes
+ */
+static void cgputbytes(char *list, int n)
+{
+  char buf[TEXTLEN];
+  int i, c, len;
+
+  buf[0] = ' ';
+  buf[1] = '"';
+  len = 2;
+  for (i = 0; i < n; i++)
+  {
+    c = list[i] & 0xff;
+    if (c < ' ' || c > '~' || c == '"' || c == '\\' ||
+        c == '$')
+    {
+      buf[len] = '\\';
+      buf[len + 1] = (char)('0' + c / 64);
+      buf[len + 2] = (char)('0' + c / 8 % 8);
+      buf[len + 3] = (char)('0' + c % 8);
+      len = len + 4;
+    }
+    else
+    {
+      buf[len] = (char)c;
+      len++;
+    }
+    if (len > TEXTLEN - 5)
+    {
+      fwrite(buf, 1, len, Ctx->outfile);
+      len = 0;
+    }
+  }
+  buf[len] = '"';
+  fwrite(buf, 1, len + 1, Ctx->outfile);
+}
+
+// Return the classes that the character c is in
+/**
+ * @fn ctypeclasses
+ * @brief Return the classes that a character is in
+ * @param c The character
+ * @return The classes in the table
+ */
+static int ctypeclasses(int c)
+{
+  int bits = 0;
+
+  if (c < ' ' || c == 127)
+    bits = CT_CNTRL;
+  else if (c >= 'A' && c <= 'Z')
+    bits = CT_UPPER;
+  else if (c >= 'a' && c <= 'z')
+    bits = CT_LOWER;
+  else if (c >= '0' && c <= '9')
+    bits = CT_DIGIT;
+  else if (c > ' ')
+    bits = CT_PUNCT;
+
+  if (c == ' ')
+    bits = CT_SPACE + CT_BLANK;
+  if (c >= '\t' && c <= '\r')
+    bits = bits + CT_SPACE;
+  if (c >= '0' && c <= '9')
+    bits = bits + CT_XDIGIT;
+  if (c >= 'A' && c <= 'F')
+    bits = bits + CT_XDIGIT;
+  if (c >= 'a' && c <= 'f')
+    bits = bits + CT_XDIGIT;
+  return (bits);
+}
+
+// Output the table of character classes, if
+// any ctype query used it. Characters from
+// -128 to -1 and from 128 to 255 are in no class
+/**
+ * @fn cgctypetable
+ * @brief Output the table of character classes
+ */
+static void cgctypetable(void)
+{
+  char list[128];
+  int c;
+
+  if (!Ctx->usedctype)
+    return;
+  for (c = 0; c < 128; c++)
+    list[c] = (char)ctypeclasses(c);
+  fprintf(Ctx->outfile, "data $ctype.minic = align 1 { z 128, b");
+  cgputbytes(list, 128);
+  fprintf(Ctx->outfile, ", z 128 }\n");
+}
+
 // Generate a global symbol but not functions
 /**
  * @fn cgglobsym
@@ -809,7 +1284,7 @@ void cgglobsym(struct symtable *node)
 {
   int size, type;
   int initvalue;
-  int i;
+  int i, last;
 
   if (node == NULL)
     return;
@@ -832,43 +1307,58 @@ void cgglobsym(struct symtable *node)
   // Generate the global identity and the label
   cgdataseg();
   if (node->class == C_GLOBAL)
-    fprintf(Outfile, "export ");
+    fprintf(Ctx->outfile, "export ");
   if ((node->type == P_STRUCT) || (node->type == P_UNION))
-    fprintf(Outfile, "data $%s = align 8 { ", node->name);
+    fprintf(Ctx->outfile, "data $%s = align 8 { ", node->name);
   else
-    fprintf(Outfile, "data $%s = align %d { ", node->name, cgprimsize(type));
+    fprintf(Ctx->outfile, "data $%s = align %d { ", node->name, cgprimsize(type));
+
+  // The initial values go out in one run after one
+  // type letter, up to the last one that isn't zero.
+  // The rest of the space is zeroes
+  last = 0;
+  if (node->initlist != NULL && (size == 1 || size == 4 || size == 8))
+    for (i = node->nelems; i > 0; i--)
+      if (getinitval(node->initlist, size, i - 1) != 0)
+      {
+        last = i;
+        break;
+      }
 
-  // Output space for one or more elements
-  for (i = 0; i < node->nelems; i++)
+  if (last > 0 && type == pointer_to(P_CHAR))
   {
-
-    // Get any initial value
-    initvalue = 0;
-    if (node->initlist != NULL)
-      initvalue = node->initlist[i];
-
-    // Generate the space for this type
-    switch (size)
+    // Generate the pointers to string literals. Treat a zero
+    // value as actually zero, not the label L0. QBE only
+    // keeps the name of a label up to the next token,
+    // so each one needs a comma after it
+    for (i = 0; i < last; i++)
     {
-    case 1:
-      fprintf(Outfile, "b %d, ", initvalue);
-      break;
-    case 4:
-      fprintf(Outfile, "w %d, ", initvalue);
-      break;
-    case 8:
-      // Generate the pointer to a string literal. Treat a zero value
-      // as actually zero, not the label L0
-      if (node->initlist != NULL && type == pointer_to(P_CHAR) && initvalue != 0)
-        fprintf(Outfile, "l $L%d, ", initvalue);
+      initvalue = getinitval(node->initlist, size, i);
+      if (initvalue != 0)
+        fprintf(Ctx->outfile, "l $L%d, ", initvalue);
       else
-        fprintf(Outfile, "l %d, ", initvalue);
-      break;
-    default:
-      fprintf(Outfile, "z %d, ", size);
+        fprintf(Ctx->outfile, "l 0, ");
     }
   }
-  fprintf(Outfile, "}\n");
+  else if (last > 0 && size == 1)
+  {
+    fputc('b', Ctx->outfile);
+    cgputbytes(node->initlist, last);
+    fputs(", ", Ctx->outfile);
+  }
+  else if (last > 0)
+  {
+    if (size == 4)
+      fputc('w', Ctx->outfile);
+    else
+      fputc('l', Ctx->outfile);
+    for (i = 0; i < last; i++)
+      cgputint(getinitval(node->initlist, size, i));
+    fputs(", ", Ctx->outfile);
+  }
+  if (last < node->nelems)
+    fprintf(Ctx->outfile, "z %d, ", (node->nelems - last) * size);
+  fprintf(Ctx->outfile, "}\n");
 }
 
 // Generate a global string and its label.
@@ -886,11 +1376,11 @@ void cgglobstr(int l, char *strvalue, int append)
 {
   char *cptr;
   if (!append)
-    fprintf(Outfile, "data $L%d = { ", l);
+    fprintf(Ctx->outfile, "data $L%d = { ", l);
 
   for (cptr = strvalue; *cptr; cptr++)
   {
-    fprintf(Outfile, "b %d, ", *cptr);
+    fprintf(Ctx->outfile, "b %d, ", *cptr);
   }
 }
 
@@ -902,7 +1392,7 @@ void cgglobstr(int l, char *strvalue, int append)
  */
 void cgglobstrend(void)
 {
-  fprintf(Outfile, " b 0 }\n");
+  fprintf(Ctx->outfile, " b 0 }\n");
 }
 
 // List of comparison instructions,
@@ -932,7 +1422,7 @@ int cgcompare_and_set(int ASTop, int r1, int r2, int type)
   // Get a new temporary for the comparison
   r3 = cgalloctemp();
 
-  fprintf(Outfile, "  %%.t%d =%c %s%c %%.t%d, %%.t%d\n",
+  fprintf(Ctx->outfile, "  %%.t%d =%c %s%c %%.t%d, %%.t%d\n",
           r3, q, cmplist[ASTop - A_EQ], q, r1, r2);
   return (r3);
 }
@@ -946,7 +1436,21 @@ int cgcompare_and_set(int ASTop, int r1, int r2, int type)
  */
 void cglabel(int l)
 {
-  fprintf(Outfile, "@L%d\n", l);
+  fprintf(Ctx->outfile, "@L%d\n", l);
+}
+
+// Generate a label for a block that is unlikely to run.
+// QBE puts cold blocks, and the blocks which only they
+// lead to, at the end of the function
+/**
+ * @fn cgcoldlabel
+ * @brief Generate a label for a block that is unlikely to run
+ * @param l
+ * @return
+ */
+void cgcoldlabel(int l)
+{
+  fprintf(Ctx->outfile, "@L%d cold\n", l);
 }
 
 // Generate a jump to a label
@@ -958,7 +1462,7 @@ void cglabel(int l)
  */
 void cgjump(int l)
 {
-  fprintf(Outfile, "  jmp @L%d\n", l);
+  fprintf(Ctx->outfile, "  jmp @L%d\n", l);
 }
 
 // List of inverted jump instructions,
@@ -992,9 +1496,9 @@ int cgcompare_and_jump(int ASTop, int r1, int r2, int label, int type)
   // Get a new temporary for the comparison
   r3 = cgalloctemp();
 
-  fprintf(Outfile, "  %%.t%d =%c %s%c %%.t%d, %%.t%d\n",
+  fprintf(Ctx->outfile, "  %%.t%d =%c %s%c %%.t%d, %%.t%d\n",
           r3, q, invcmplist[ASTop - A_EQ], q, r1, r2);
-  fprintf(Outfile, "  jnz %%.t%d, @L%d, @L%d\n", r3, label, label2);
+  fprintf(Ctx->outfile, "  jnz %%.t%d, @L%d, @L%d\n", r3, label, label2);
   cglabel(label2);
   return (NOREG);
 }
@@ -1021,10 +1525,10 @@ int cgwiden(int r, int oldtype, int newtype)
   switch (oldtype)
   {
   case P_CHAR:
-    fprintf(Outfile, "  %%.t%d =%c extub %%.t%d\n", t, newq, r);
+    fprintf(Ctx->outfile, "  %%.t%d =%c extub %%.t%d\n", t, newq, r);
     break;
   default:
-    fprintf(Outfile, "  %%.t%d =%c exts%c %%.t%d\n", t, newq, oldq, r);
+    fprintf(Ctx->outfile, "  %%.t%d =%c exts%c %%.t%d\n", t, newq, oldq, r);
   }
   return (t);
 }
@@ -1042,7 +1546,7 @@ void cgreturn(int reg, struct symtable *sym)
 
   // Only return a value if we have a value to return
   if (reg != NOREG)
-    fprintf(Outfile, "  %%.ret =%c copy %%.t%d\n", cgqbetype(sym->type), reg);
+    fprintf(Ctx->outfile, "  %%.ret =%c copy %%.t%d\n", cgqbetype(sym->type), reg);
 
   cgjump(sym->st_endlabel);
 }
@@ -1063,7 +1567,7 @@ int cgaddress(struct symtable *sym)
                        ? '$'
                        : '%';
 
-  fprintf(Outfile, "  %%.t%d =l copy %c%s\n", r, qbeprefix, sym->name);
+  fprintf(Ctx->outfile, "  %%.t%d =l copy %c%s\n", r, qbeprefix, sym->name);
   return (r);
 }
 
@@ -1088,13 +1592,13 @@ int cgderef(int r, int type)
   switch (size)
   {
   case 1:
-    fprintf(Outfile, "  %%.t%d =w loadub %%.t%d\n", ret, r);
+    fprintf(Ctx->outfile, "  %%.t%d =w loadub %%.t%d\n", ret, r);
     break;
   case 4:
-    fprintf(Outfile, "  %%.t%d =w loadsw %%.t%d\n", ret, r);
+    fprintf(Ctx->outfile, "  %%.t%d =w loadsw %%.t%d\n", ret, r);
     break;
   case 8:
-    fprintf(Outfile, "  %%.t%d =l loadl %%.t%d\n", ret, r);
+    fprintf(Ctx->outfile, "  %%.t%d =l loadl %%.t%d\n", ret, r);
     break;
   default:
     fatald("Can't cgderef on type:", type);
@@ -1119,13 +1623,13 @@ int cgstorderef(int r1, int r2, int type)
   switch (size)
   {
   case 1:
-    fprintf(Outfile, "  storeb %%.t%d, %%.t%d\n", r1, r2);
+    fprintf(Ctx->outfile, "  storeb %%.t%d, %%.t%d\n", r1, r2);
     break;
   case 4:
-    fprintf(Outfile, "  storew %%.t%d, %%.t%d\n", r1, r2);
+    fprintf(Ctx->outfile, "  storew %%.t%d, %%.t%d\n", r1, r2);
     break;
   case 8:
-    fprintf(Outfile, "  storel %%.t%d, %%.t%d\n", r1, r2);
+    fprintf(Ctx->outfile, "  storel %%.t%d, %%.t%d\n", r1, r2);
     break;
   default:
     fatald("Can't cgstoderef on type:", type);
@@ -1144,21 +1648,25 @@ int cgstorderef(int r1, int r2, int type)
  */
 void cgmove(int r1, int r2, int type)
 {
-  fprintf(Outfile, "  %%.t%d =%c copy %%.t%d\n", r2, cgqbetype(type), r1);
+  fprintf(Ctx->outfile, "  %%.t%d =%c copy %%.t%d\n", r2, cgqbetype(type), r1);
 }
 
-// Output a gdb directive to say on which
-// source code line number the following
-// assembly code came from
+// Tell QBE which source code line the
+// following code came from, for the
+// line numbers that gdb uses
 /**
  * @fn cglinenum
- * @brief Output a gdb directive to say on which source code line number the following assembly code came from
+ * @brief Tell QBE which source code line the following code came from
  * @param line
  * @return
  */
 void cglinenum(int line)
 {
-  // fprintf(Outfile, "\t.loc 1 %d 0\n", line);
+  // QBE only puts the line into the objects that
+  // it writes itself, and it must be in a function.
+  // A whole program mixes the lines of many files
+  if (Ctx->elfobj && Ctx->qbefunc != NULL && !O_wholeprog)
+    fprintf(Ctx->outfile, "  dbgloc %d\n", line);
 }
 
 // Change a temporary value from its old
@@ -1202,8 +1710,8 @@ int cgcast(int t, int oldtype, int newtype)
   // If the new size is smaller, we can copy and QBE will truncate it,
   // otherwise use the QBE cast operation
   if (newsize < oldsize)
-    fprintf(Outfile, " %%.t%d =%c copy %%.t%d\n", ret, qnew, t);
+    fprintf(Ctx->outfile, " %%.t%d =%c copy %%.t%d\n", ret, qnew, t);
   else
-    fprintf(Outfile, " %%.t%d =%c cast %%.t%d\n", ret, qnew, t);
+    fprintf(Ctx->outfile, " %%.t%d =%c cast %%.t%d\n", ret, qnew, t);
   return (ret);
 }
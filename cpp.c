@@ -0,0 +1,1516 @@
+/**
+ * @file cpp.c
+ * @author BrunchTea
+ * @brief Integrated C preprocessor
+ */
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <glob.h>
+
+// Integrated C preprocessor.
+//
+// Each source file is scanned once into a list of tokens, and
+// the headers from the system include directory stay cached
+// for the rest of the run. The directives are then obeyed and
+// the macros expanded to give the list of tokens which scan()
+// hands on to the parser. If a file needs something that we
+// don't support, e.g. '#' or '##' in a macro, preprocess()
+// returns NULL and the caller falls back on the external cpp.
+//
+// A compile server can also keep snapshots: the macros and
+// symbols from parsing a run of system headers. A file that
+// starts by including the same headers starts from those, and
+// the include guards then skip the headers' contents.
+
+static struct ppfile *Ppcache;		// Tokenised system headers
+static glob_t Ppglob;			// Headers found by ppwarm()
+static struct ppsnap *Ppsnaps;		// Parsed runs of system headers
+static int Ppnsnaps;			// Number of snapshots
+
+enum {
+  PPMAXDEPTH = 200,			// Deepest #include nesting
+  PPMAXSNAPS = 16			// Most snapshots that we keep
+};
+
+static char *ppgroup(int active);
+static void ppheader(struct ppfile *f);
+
+// Give up on this file, recording why
+/**
+ * @fn ppfail
+ * @brief Give up on this file, recording why
+ * @param why The reason for giving up
+ */
+static void ppfail(char *why)
+{
+  if (Ctx->ppfailed == NULL)
+    Ctx->ppfailed = why;
+}
+
+// Return a new empty token list
+/**
+ * @fn ppnewlist
+ * @brief Return a new empty token list
+ * @return The new list
+ */
+static struct pplist *ppnewlist(void)
+{
+  struct pplist *l;
+
+  l = (struct pplist *)malloc(sizeof(struct pplist));
+  if (l == NULL)
+    fatal("Unable to malloc in ppnewlist()");
+  l->head = NULL;
+  l->tail = NULL;
+  return (l);
+}
+
+// Return a new position for reading the
+// tokens from cur up to, but not including, end
+/**
+ * @fn ppreader
+ * @brief Return a new position for reading the tokens from cur up to end
+ * @param cur The first token to read
+ * @param end The token after the last one, or NULL
+ * @return The new position
+ */
+static struct ppread *ppreader(struct pptoken *cur, struct pptoken *end)
+{
+  struct ppread *r;
+
+  r = (struct ppread *)malloc(sizeof(struct ppread));
+  if (r == NULL)
+    fatal("Unable to malloc in ppreader()");
+  r->cur = cur;
+  r->end = end;
+  return (r);
+}
+
+// Return a copy of token p. If site isn't NULL,
+// the copy gets the line number and file of site
+/**
+ * @fn ppcopy
+ * @brief Return a copy of token p
+ * @param p The token to copy
+ * @param site Macro call site for the line number, or NULL
+ * @return The new token
+ */
+static struct pptoken *ppcopy(struct pptoken *p, struct pptoken *site)
+{
+  struct pptoken *n;
+
+  n = (struct pptoken *)malloc(sizeof(struct pptoken));
+  if (n == NULL)
+    fatal("Unable to malloc in ppcopy()");
+  n->token = p->token;
+  n->intvalue = p->intvalue;
+  n->text = p->text;
+  n->file = p->file;
+  n->line = p->line;
+  n->bol = p->bol;
+  n->space = p->space;
+  n->noexpand = p->noexpand;
+  n->next = NULL;
+  if (site != NULL)
+  {
+    n->file = site->file;
+    n->line = site->line;
+  }
+  return (n);
+}
+
+// Append the token p to the list l
+/**
+ * @fn ppappend
+ * @brief Append the token p to the list l
+ * @param l The list
+ * @param p The token to append
+ */
+static void ppappend(struct pplist *l, struct pptoken *p)
+{
+  if (l->head == NULL)
+    l->head = p;
+  else
+    l->tail->next = p;
+  l->tail = p;
+}
+
+// Move all the tokens in list l2 on to the end of list l
+/**
+ * @fn ppappendlist
+ * @brief Move all the tokens in list l2 on to the end of list l
+ * @param l The list to append to
+ * @param l2 The list to move
+ */
+static void ppappendlist(struct pplist *l, struct pplist *l2)
+{
+  if (l2->head == NULL)
+    return;
+  ppappend(l, l2->head);
+  l->tail = l2->tail;
+}
+
+// Find a macro by its interned name. Return
+// a pointer to it, or NULL if it isn't defined
+/**
+ * @fn ppfind
+ * @brief Find a macro by name
+ * @param name The interned name of the macro
+ * @return The macro, or NULL if it isn't defined
+ */
+static struct ppmacro *ppfind(char *name)
+{
+  struct ppmacro *m;
+
+  for (m = Ctx->ppmacros; m != NULL; m = m->next)
+    if (m->name == name)
+      return (m);
+  return (NULL);
+}
+
+// Remove any macro with the given name
+/**
+ * @fn ppundef
+ * @brief Remove any macro with the given name
+ * @param name The interned name of the macro
+ */
+static void ppundef(char *name)
+{
+  struct ppmacro *m, *prev = NULL;
+
+  for (m = Ctx->ppmacros; m != NULL; m = m->next)
+  {
+    if (m->name == name)
+    {
+      if (prev == NULL)
+        Ctx->ppmacros = m->next;
+      else
+        prev->next = m->next;
+      return;
+    }
+    prev = m;
+  }
+}
+
+// Return true if name looks like one of the macros that
+// the external cpp predefines, e.g. __LINE__ or __x86_64__.
+// We don't define these, so files using them need cpp
+/**
+ * @fn ppreserved
+ * @brief Return true if name looks like a macro predefined by cpp
+ * @param name The identifier
+ * @return True if the name starts and ends with "__"
+ */
+static int ppreserved(char *name)
+{
+  int len = (int)strlen(name);
+
+  if (len < 5 || name[0] != '_' || name[1] != '_')
+    return (0);
+  return (name[len - 1] == '_' && name[len - 2] == '_');
+}
+
+// Scan the named source file into a list of tokens. If cache
+// is true, keep the list for any later files that include it.
+// Return NULL if we can't open or tokenise the file
+/**
+ * @fn ppload
+ * @brief Scan the named source file into a list of tokens
+ * @param name The name of the file
+ * @param cache If true, keep the tokens for later files
+ * @return The tokenised file, or NULL on failure
+ */
+static struct ppfile *ppload(char *name, int cache)
+{
+  struct ppfile *f;
+  struct pptoken *p, *tail = NULL;
+
+  // Use the cached copy if we have one
+  for (f = Ppcache; f != NULL; f = f->next)
+    if (!strcmp(f->name, name))
+      return (f);
+
+  if (!openinput(name))
+    return (NULL);
+  f = (struct ppfile *)malloc(sizeof(struct ppfile));
+  if (f == NULL)
+    fatal("Unable to malloc in ppload()");
+  f->name = name;
+  f->head = NULL;
+  f->next = NULL;
+
+  // Scan all the tokens in the file
+  Ctx->infilename = name;
+  Ctx->line = 1;
+  Ctx->putback = 0;
+  while (1)
+  {
+    p = scanpp();
+    if (p->token == T_EOF || p->token == T_LEXERR)
+      break;
+    if (tail == NULL)
+    {
+      f->head = p;
+      p->bol = 1;
+    }
+    else
+      tail->next = p;
+    tail = p;
+  }
+  closeinput();
+
+  // Leave any lexical error for cpp and the scanner to report
+  if (p->token == T_LEXERR)
+  {
+    ppfail("lexical error");
+    return (NULL);
+  }
+  f->eof = p;
+
+  if (cache)
+  {
+    f->next = Ppcache;
+    Ppcache = f;
+  }
+  return (f);
+}
+
+// Return the name of the directive that starts with
+// the '#' at Ppsrc, or "" for a '#' on its own
+/**
+ * @fn ppdirective
+ * @brief Return the name of the directive at Ppsrc
+ * @return The name of the directive
+ */
+static char *ppdirective(void)
+{
+  struct pptoken *p = Ctx->ppsrc->cur->next;
+
+  if (p == NULL || p->bol)
+    return ("");
+  return (p->text);
+}
+
+// Return a position for reading the rest of the directive
+// line at Ppsrc, and move Ppsrc on to the line after it
+/**
+ * @fn ppline
+ * @brief Return a position for reading the rest of the directive line at Ppsrc
+ * @return The position of the first token after the directive name
+ */
+static struct ppread *ppline(void)
+{
+  struct pptoken *p, *start;
+
+  // Skip the '#' and the directive name
+  p = Ctx->ppsrc->cur->next;
+  if (p != NULL && !p->bol)
+    p = p->next;
+
+  // Find the start of the next line
+  start = p;
+  while (p != NULL && !p->bol)
+    p = p->next;
+  Ctx->ppsrc->cur = p;
+  return (ppreader(start, p));
+}
+
+static struct pplist *ppexpand(struct pplist *l, struct pptoken *site);
+
+// Read the arguments for a call to the function-like
+// macro m from in, which is at the '('. Return an array
+// of the macro-expanded arguments, or NULL on an error
+/**
+ * @fn ppargs
+ * @brief Read the arguments for a call to a function-like macro
+ * @param m The macro
+ * @param in Position of the '(' after the macro name
+ * @param site The macro call site
+ * @return An array of lists of tokens, one per argument, or NULL
+ */
+static struct pplist **ppargs(struct ppmacro *m, struct ppread *in,
+                              struct pptoken *site)
+{
+  struct pplist **args;
+  struct pplist *arg;
+  struct pptoken *p;
+  int i, n = 0, depth = 0;
+
+  args = (struct pplist **)malloc((m->nparams + 1) * sizeof(struct pplist *));
+  if (args == NULL)
+    fatal("Unable to malloc in ppargs()");
+
+  // Skip the '(' and collect the tokens for each argument
+  // up to a comma or the ')' which isn't nested
+  in->cur = in->cur->next;
+  arg = ppnewlist();
+  while (1)
+  {
+    p = in->cur;
+    if (p == in->end || (p->token == T_HASH && p->bol))
+    {
+      ppfail("unterminated macro call");
+      return (NULL);
+    }
+    in->cur = p->next;
+
+    if (depth == 0 && (p->token == T_COMMA || p->token == T_RPAREN))
+    {
+      if (n <= m->nparams)
+        args[n] = arg;
+      n++;
+      arg = ppnewlist();
+      if (p->token == T_RPAREN)
+        break;
+      continue;
+    }
+    if (p->token == T_LPAREN)
+      depth++;
+    if (p->token == T_RPAREN)
+      depth--;
+    ppappend(arg, ppcopy(p, NULL));
+  }
+
+  // A macro without parameters gets one empty argument
+  if (m->nparams == 0 && n == 1 && args[0]->head == NULL)
+    n = 0;
+  if (n != m->nparams)
+  {
+    ppfail("wrong number of macro arguments");
+    return (NULL);
+  }
+
+  // Expand the arguments before they go into the body
+  for (i = 0; i < n; i++)
+    args[i] = ppexpand(args[i], site);
+  return (args);
+}
+
+// Expand the macro m, which was named by the token p,
+// and append the result to the list out. The arguments for a
+// function-like macro are read from in. Line numbers come
+// from site, or from p if site is NULL
+/**
+ * @fn ppinvoke
+ * @brief Expand a macro and append the result to a list
+ * @param m The macro
+ * @param p The token naming the macro
+ * @param in Position of any arguments
+ * @param out The list to append to
+ * @param site The macro call site, or NULL
+ */
+static void ppinvoke(struct ppmacro *m, struct pptoken *p,
+                     struct ppread *in, struct pplist *out,
+                     struct pptoken *site)
+{
+  struct pplist **args = NULL;
+  struct pplist *body;
+  struct pptoken *b, *a;
+
+  if (site == NULL)
+    site = p;
+  if (m->nparams >= 0)
+  {
+    args = ppargs(m, in, site);
+    if (args == NULL)
+      return;
+  }
+
+  // Copy the body, replacing the parameters with the arguments
+  body = ppnewlist();
+  for (b = m->body; b != NULL; b = b->next)
+  {
+    if (b->token == T_IDENT && b->intvalue != 0)
+    {
+      for (a = args[b->intvalue - 1]->head; a != NULL; a = a->next)
+        ppappend(body, ppcopy(a, site));
+    }
+    else
+      ppappend(body, ppcopy(b, site));
+  }
+
+  // Rescan the result, without expanding m again
+  m->busy = 1;
+  ppappendlist(out, ppexpand(body, site));
+  m->busy = 0;
+}
+
+// Append the token p to the list out, or the expansion of it if
+// p names a macro. The arguments for a function-like macro are
+// read from in. Line numbers come from site, unless it's NULL
+/**
+ * @fn ppsubst
+ * @brief Append a token, or its macro expansion, to a list
+ * @param p The token
+ * @param in Position of the tokens after p
+ * @param out The list to append to
+ * @param site The macro call site, or NULL
+ */
+static void ppsubst(struct pptoken *p, struct ppread *in,
+                    struct pplist *out, struct pptoken *site)
+{
+  struct ppmacro *m;
+  struct pptoken *n;
+
+  if (p->token == T_IDENT && !p->noexpand)
+  {
+    m = ppfind(p->text);
+    if (m == NULL)
+    {
+      if (ppreserved(p->text))
+        ppfail("predefined macro");
+    }
+    else if (m->busy)
+    {
+      // Never expand this name, even later on
+      n = ppcopy(p, site);
+      n->noexpand = 1;
+      ppappend(out, n);
+      return;
+    }
+    else if (m->nparams < 0 ||
+             (in->cur != in->end && in->cur->token == T_LPAREN))
+    {
+      ppinvoke(m, p, in, out, site);
+      return;
+    }
+    else if (in->cur == in->end && site != NULL)
+    {
+      // The arguments might follow the macro that we are in
+      ppfail("function-like macro at end of expansion");
+    }
+  }
+  ppappend(out, ppcopy(p, site));
+}
+
+// Macro-expand the tokens in list l and return the result
+/**
+ * @fn ppexpand
+ * @brief Macro-expand the tokens in a list
+ * @param l The list
+ * @param site The macro call site, or NULL
+ * @return A new list with the result
+ */
+static struct pplist *ppexpand(struct pplist *l, struct pptoken *site)
+{
+  struct pplist *out;
+  struct ppread *in;
+  struct pptoken *p;
+
+  out = ppnewlist();
+  in = ppreader(l->head, NULL);
+  while (in->cur != NULL && Ctx->ppfailed == NULL)
+  {
+    p = in->cur;
+    in->cur = p->next;
+    ppsubst(p, in, out, site);
+  }
+  return (out);
+}
+
+// Return the precedence of a binary
+// operator in an #if, or zero if not one
+/**
+ * @fn ppprec
+ * @brief Return the precedence of a binary operator in an #if
+ * @param token The operator token
+ * @return The precedence, or zero if not a binary operator
+ */
+static int ppprec(int token)
+{
+  switch (token)
+  {
+  case T_LOGOR:
+    return (1);
+  case T_LOGAND:
+    return (2);
+  case T_OR:
+    return (3);
+  case T_XOR:
+    return (4);
+  case T_AMPER:
+    return (5);
+  case T_EQ:
+  case T_NE:
+    return (6);
+  case T_LT:
+  case T_GT:
+  case T_LE:
+  case T_GE:
+    return (7);
+  case T_LSHIFT:
+  case T_RSHIFT:
+    return (8);
+  case T_PLUS:
+  case T_MINUS:
+    return (9);
+  case T_STAR:
+  case T_SLASH:
+  case T_MOD:
+    return (10);
+  }
+  return (0);
+}
+
+static long ppternary(void);
+
+// Evaluate a unary expression in an #if
+/**
+ * @fn ppunary
+ * @brief Evaluate a unary expression in an #if
+ * @return The value of the expression
+ */
+static long ppunary(void)
+{
+  struct pptoken *p = Ctx->ppexpr;
+  long val;
+
+  if (p == NULL)
+  {
+    ppfail("bad #if expression");
+    return (0);
+  }
+  Ctx->ppexpr = p->next;
+  switch (p->token)
+  {
+  case T_INTLIT:
+    return (p->intvalue);
+  case T_IDENT:
+    // Names which aren't macros are zero
+    return (0);
+  case T_PLUS:
+    return (ppunary());
+  case T_MINUS:
+    return (0 - ppunary());
+  case T_LOGNOT:
+    return (!ppunary());
+  case T_INVERT:
+    return (~ppunary());
+  case T_LPAREN:
+    val = ppternary();
+    if (Ctx->ppexpr == NULL || Ctx->ppexpr->token != T_RPAREN)
+      ppfail("bad #if expression");
+    else
+      Ctx->ppexpr = Ctx->ppexpr->next;
+    return (val);
+  }
+  ppfail("bad #if expression");
+  return (0);
+}
+
+// Evaluate a binary expression in an #if
+// with operators of at least precedence minprec
+/**
+ * @fn ppbinary
+ * @brief Evaluate a binary expression in an #if
+ * @param minprec The lowest operator precedence to deal with
+ * @return The value of the expression
+ */
+static long ppbinary(int minprec)
+{
+  long left, right;
+  int op, prec;
+
+  left = ppunary();
+  while (Ctx->ppexpr != NULL && Ctx->ppfailed == NULL)
+  {
+    op = Ctx->ppexpr->token;
+    if (op == T_INTLIT && Ctx->ppexpr->intvalue < 0)
+    {
+      // "a-1" scans as "a" and "-1". Turn
+      // the literal into a minus and a "1"
+      prec = ppprec(T_MINUS);
+      if (prec < minprec)
+        break;
+      op = T_MINUS;
+      Ctx->ppexpr->intvalue = 0 - Ctx->ppexpr->intvalue;
+    }
+    else
+    {
+      prec = ppprec(op);
+      if (prec == 0 || prec < minprec)
+        break;
+      Ctx->ppexpr = Ctx->ppexpr->next;
+    }
+
+    right = ppbinary(prec + 1);
+    switch (op)
+    {
+    case T_LOGOR:
+      left = (left || right);
+      break;
+    case T_LOGAND:
+      left = (left && right);
+      break;
+    case T_OR:
+      left = left | right;
+      break;
+    case T_XOR:
+      left = left ^ right;
+      break;
+    case T_AMPER:
+      left = left & right;
+      break;
+    case T_EQ:
+      left = (left == right);
+      break;
+    case T_NE:
+      left = (left != right);
+      break;
+    case T_LT:
+      left = (left < right);
+      break;
+    case T_GT:
+      left = (left > right);
+      break;
+    case T_LE:
+      left = (left <= right);
+      break;
+    case T_GE:
+      left = (left >= right);
+      break;
+    case T_LSHIFT:
+      left = left << right;
+      break;
+    case T_RSHIFT:
+      left = left >> right;
+      break;
+    case T_PLUS:
+      left = left + right;
+      break;
+    case T_MINUS:
+      left = left - right;
+      break;
+    case T_STAR:
+      left = left * right;
+      break;
+    case T_SLASH:
+    case T_MOD:
+      if (right == 0)
+      {
+        ppfail("division by zero in #if");
+        return (0);
+      }
+      if (op == T_SLASH)
+        left = left / right;
+      else
+        left = left % right;
+      break;
+    }
+  }
+  return (left);
+}
+
+// Evaluate a possibly ternary expression in an #if
+/**
+ * @fn ppternary
+ * @brief Evaluate a possibly ternary expression in an #if
+ * @return The value of the expression
+ */
+static long ppternary(void)
+{
+  long cond, left, right;
+
+  cond = ppbinary(1);
+  if (Ctx->ppexpr == NULL || Ctx->ppexpr->token != T_QUESTION)
+    return (cond);
+  Ctx->ppexpr = Ctx->ppexpr->next;
+  left = ppternary();
+  if (Ctx->ppexpr == NULL || Ctx->ppexpr->token != T_COLON)
+  {
+    ppfail("bad #if expression");
+    return (0);
+  }
+  Ctx->ppexpr = Ctx->ppexpr->next;
+  right = ppternary();
+  if (cond)
+    return (left);
+  return (right);
+}
+
+// Evaluate the condition of an #if or #elif
+/**
+ * @fn ppeval
+ * @brief Evaluate the condition of an #if or #elif
+ * @param line Position of the condition
+ * @return True if the condition is true
+ */
+static int ppeval(struct ppread *line)
+{
+  struct pplist *l;
+  struct pptoken *p, *n;
+  struct ppmacro *m;
+  long val;
+  int paren;
+
+  // Replace each "defined X" and "defined(X)" with 1 or 0
+  l = ppnewlist();
+  p = line->cur;
+  while (p != line->end)
+  {
+    if (p->token == T_IDENT && !strcmp(p->text, "defined"))
+    {
+      p = p->next;
+      paren = 0;
+      if (p != line->end && p->token == T_LPAREN)
+      {
+        paren = 1;
+        p = p->next;
+      }
+      if (p == line->end || p->token != T_IDENT)
+      {
+        ppfail("bad use of defined");
+        return (0);
+      }
+      m = ppfind(p->text);
+      if (m == NULL && ppreserved(p->text))
+        ppfail("predefined macro");
+      n = ppcopy(p, NULL);
+      n->token = T_INTLIT;
+      n->intvalue = 0;
+      if (m != NULL)
+        n->intvalue = 1;
+      ppappend(l, n);
+      p = p->next;
+      if (paren)
+      {
+        if (p == line->end || p->token != T_RPAREN)
+        {
+          ppfail("bad use of defined");
+          return (0);
+        }
+        p = p->next;
+      }
+      continue;
+    }
+    ppappend(l, ppcopy(p, NULL));
+    p = p->next;
+  }
+
+  // Expand the macros, then evaluate what's left
+  l = ppexpand(l, NULL);
+  Ctx->ppexpr = l->head;
+  val = ppternary();
+  if (Ctx->ppexpr != NULL)
+    ppfail("bad #if expression");
+  return (val != 0);
+}
+
+// Deal with an #if, #ifdef or #ifndef and all its groups
+// up to the matching #endif. Only pass on the tokens and
+// obey the directives in a group if active is true
+/**
+ * @fn ppif
+ * @brief Deal with a conditional and all its groups
+ * @param name The directive name
+ * @param active True if in an active group
+ */
+static void ppif(char *name, int active)
+{
+  struct ppread *line;
+  struct ppmacro *m;
+  char *stop;
+  int cond = 0, done;
+
+  line = ppline();
+  if (active)
+  {
+    if (!strcmp(name, "if"))
+      cond = ppeval(line);
+    else
+    {
+      if (line->cur == line->end || line->cur->token != T_IDENT)
+      {
+        ppfail("missing macro name");
+        return;
+      }
+      m = ppfind(line->cur->text);
+      if (m == NULL && ppreserved(line->cur->text))
+        ppfail("predefined macro");
+      cond = (m != NULL);
+      if (!strcmp(name, "ifndef"))
+        cond = !cond;
+    }
+  }
+
+  // Do each group, and stop after the #endif
+  done = cond;
+  stop = ppgroup(active && cond);
+  while (Ctx->ppfailed == NULL)
+  {
+    if (stop == NULL)
+    {
+      ppfail("unterminated conditional");
+      return;
+    }
+    line = ppline();
+    if (!strcmp(stop, "endif"))
+      return;
+    cond = 0;
+    if (!strcmp(stop, "else"))
+      cond = !done;
+    else if (active && !done)
+      cond = ppeval(line);
+    if (cond)
+      done = 1;
+    stop = ppgroup(active && cond);
+  }
+}
+
+// Return the path of the file name in the directory of
+// the file from, or in the system include directory if
+// from is NULL
+/**
+ * @fn pppath
+ * @brief Return the path of a file in a directory
+ * @param name The name of the file
+ * @param from The file in the directory, or NULL for the system directory
+ * @return The new path
+ */
+static char *pppath(char *name, char *from)
+{
+  char *path, *posn;
+
+  if (from == NULL)
+  {
+    path = (char *)malloc(strlen(INCDIR) + strlen(name) + 2);
+    if (path == NULL)
+      fatal("Unable to malloc in pppath()");
+    strcpy(path, INCDIR);
+    strcat(path, "/");
+    strcat(path, name);
+    return (path);
+  }
+
+  path = (char *)malloc(strlen(from) + strlen(name) + 1);
+  if (path == NULL)
+    fatal("Unable to malloc in pppath()");
+  strcpy(path, from);
+  posn = strrchr(path, '/');
+  if (name[0] == '/' || posn == NULL)
+    path[0] = 0;
+  else
+    posn[1] = 0;
+  strcat(path, name);
+  return (path);
+}
+
+// Find a header file and return its tokens, or NULL if we
+// can't. Headers in quotes are looked for first in the
+// directory of the file that includes them. Headers from
+// the system include directory are cached
+/**
+ * @fn ppsearch
+ * @brief Find a header file and return its tokens
+ * @param name The name of the header
+ * @param from The file including it, or NULL for a system header
+ * @return The tokenised header, or NULL if not found
+ */
+static struct ppfile *ppsearch(char *name, char *from)
+{
+  struct ppfile *f;
+  char *path;
+
+  // Use the directory of the including file
+  if (from != NULL)
+  {
+    path = pppath(name, from);
+    if ((f = ppload(path, 0)) != NULL)
+      return (f);
+    free(path);
+  }
+
+  // Then the system include directory
+  path = pppath(name, NULL);
+  if ((f = ppload(path, 1)) != NULL)
+    return (f);
+  free(path);
+  return (NULL);
+}
+
+// Deal with an #include in the file called from
+/**
+ * @fn ppinclude
+ * @brief Deal with an #include
+ * @param line Position of the header name
+ * @param from The file with the directive
+ */
+static void ppinclude(struct ppread *line, char *from)
+{
+  char name[TEXTLEN];
+  struct ppfile *f;
+  struct pptoken *p = line->cur;
+  int len = 0;
+
+  if (p == line->end)
+  {
+    ppfail("missing header name");
+    return;
+  }
+
+  // A "header" is looked for near the including file first
+  if (p->token == T_STRLIT)
+    f = ppsearch(p->text, from);
+  else
+  {
+    // Rebuild a <header> from its tokens
+    if (p->token != T_LT)
+    {
+      ppfail("computed #include");
+      return;
+    }
+    name[0] = 0;
+    for (p = p->next; p != line->end && p->token != T_GT; p = p->next)
+    {
+      if (p->token != T_IDENT && p->token != T_DOT &&
+          p->token != T_SLASH && p->token != T_MINUS)
+      {
+        ppfail("unusual header name");
+        return;
+      }
+      len = len + (int)strlen(p->text);
+      if (len >= TEXTLEN)
+      {
+        ppfail("header name too long");
+        return;
+      }
+      strcat(name, p->text);
+    }
+    if (p == line->end)
+    {
+      ppfail("missing '>'");
+      return;
+    }
+    f = ppsearch(name, NULL);
+  }
+
+  if (f == NULL)
+  {
+    ppfail("header not found");
+    return;
+  }
+  ppheader(f);
+}
+
+// Process the tokens of the header f in place
+// of the #include line that named it
+/**
+ * @fn ppheader
+ * @brief Process the tokens of an included header
+ * @param f The tokenised header
+ */
+static void ppheader(struct ppfile *f)
+{
+  struct ppread *save;
+
+  if (O_makedeps)
+    adddep(f->name);
+  if (Ctx->ppdepth == PPMAXDEPTH)
+  {
+    ppfail("#include nested too deeply");
+    return;
+  }
+
+  // Process the header, then carry on with this file
+  save = Ctx->ppsrc;
+  Ctx->ppsrc = ppreader(f->head, NULL);
+  Ctx->ppdepth = Ctx->ppdepth + 1;
+  if (ppgroup(1) != NULL)
+    ppfail("#else or #endif without #if");
+  Ctx->ppdepth = Ctx->ppdepth - 1;
+  Ctx->ppsrc = save;
+}
+
+// Deal with an #embed "file" in the file called from. The
+// file is found like an #include "header", but its bytes
+// aren't tokenised. The parser gets one T_EMBED token with
+// the file's path and reads the bytes into the initialiser
+/**
+ * @fn ppembed
+ * @brief Deal with an #embed
+ * @param line Position of the file name
+ * @param from The file with the directive
+ */
+static void ppembed(struct ppread *line, char *from)
+{
+  struct pptoken *p = line->cur;
+  struct pptoken *e;
+  char *path;
+  int fd;
+
+  // We don't do <file> or any parameters
+  if (p == line->end || p->token != T_STRLIT || p->next != line->end)
+  {
+    ppfail("unusual #embed");
+    return;
+  }
+
+  path = pppath(p->text, from);
+  if ((fd = open(path, O_RDONLY)) == -1)
+  {
+    free(path);
+    path = pppath(p->text, NULL);
+    if ((fd = open(path, O_RDONLY)) == -1)
+    {
+      free(path);
+      ppfail("#embed file not found");
+      return;
+    }
+  }
+  close(fd);
+  if (strlen(path) >= TEXTLEN)
+  {
+    free(path);
+    ppfail("#embed file name too long");
+    return;
+  }
+  if (O_makedeps)
+    adddep(path);
+
+  e = ppcopy(p, NULL);
+  e->token = T_EMBED;
+  e->text = path;
+  ppappend(Ctx->ppout, e);
+}
+
+// Deal with a #define
+/**
+ * @fn ppdefine
+ * @brief Deal with a #define
+ * @param line Position of the macro name
+ */
+static void ppdefine(struct ppread *line)
+{
+  struct ppmacro *m;
+  struct pplist *params, *body;
+  struct pptoken *p = line->cur;
+  struct pptoken *q, *n;
+  int i;
+
+  if (p == line->end || p->token != T_IDENT)
+  {
+    ppfail("bad macro name");
+    return;
+  }
+  m = (struct ppmacro *)malloc(sizeof(struct ppmacro));
+  if (m == NULL)
+    fatal("Unable to malloc in ppdefine()");
+  m->name = p->text;
+  m->nparams = -1;
+  m->busy = 0;
+  p = p->next;
+
+  // A '(' straight after the name starts a parameter list
+  params = ppnewlist();
+  if (p != line->end && p->token == T_LPAREN && !p->space)
+  {
+    m->nparams = 0;
+    p = p->next;
+    if (p != line->end && p->token == T_RPAREN)
+      p = p->next;
+    else
+    {
+      while (1)
+      {
+        if (p == line->end || p->token != T_IDENT)
+        {
+          ppfail("bad macro parameter list");
+          return;
+        }
+        ppappend(params, ppcopy(p, NULL));
+        m->nparams = m->nparams + 1;
+        p = p->next;
+        if (p != line->end && p->token == T_RPAREN)
+        {
+          p = p->next;
+          break;
+        }
+        if (p == line->end || p->token != T_COMMA)
+        {
+          ppfail("bad macro parameter list");
+          return;
+        }
+        p = p->next;
+      }
+    }
+  }
+
+  // Copy the body, numbering the parameters in it
+  body = ppnewlist();
+  for (; p != line->end; p = p->next)
+  {
+    if (p->token == T_HASH)
+    {
+      ppfail("'#' or '##' in a macro");
+      return;
+    }
+    n = ppcopy(p, NULL);
+    n->bol = 0;
+    if (n->token == T_IDENT && m->nparams > 0)
+    {
+      i = 1;
+      for (q = params->head; q != NULL; q = q->next)
+      {
+        if (q->text == n->text)
+          n->intvalue = i;
+        i++;
+      }
+    }
+    ppappend(body, n);
+  }
+  m->body = body->head;
+
+  // Replace any old definition
+  ppundef(m->name);
+  m->next = Ctx->ppmacros;
+  Ctx->ppmacros = m;
+}
+
+// Obey the directive at Ppsrc in an active group
+/**
+ * @fn ppdo
+ * @brief Obey the directive at Ppsrc in an active group
+ * @param name The directive name
+ */
+static void ppdo(char *name)
+{
+  struct ppread *line;
+  char *from = Ctx->ppsrc->cur->file;
+
+  line = ppline();
+  if (!strcmp(name, "include"))
+    ppinclude(line, from);
+  else if (!strcmp(name, "embed"))
+    ppembed(line, from);
+  else if (!strcmp(name, "define"))
+    ppdefine(line);
+  else if (!strcmp(name, "undef"))
+  {
+    if (line->cur == line->end || line->cur->token != T_IDENT)
+      ppfail("bad macro name");
+    else
+      ppundef(line->cur->text);
+  }
+  else if (name[0] != 0)
+    ppfail("unsupported directive");
+}
+
+// Process the tokens from Ppsrc up to the next #elif, #else
+// or #endif at this level, or to the end of the file. Pass
+// them on to the parser and obey the directives if active is
+// true. Return the name of the directive that stopped us, or
+// NULL at the end of the file. Ppsrc is left at its '#'
+/**
+ * @fn ppgroup
+ * @brief Process the tokens of a group from Ppsrc
+ * @param active True if the group is active
+ * @return The name of the directive that ended the group, or NULL
+ */
+static char *ppgroup(int active)
+{
+  struct pptoken *p;
+  char *name;
+
+  while (Ctx->ppsrc->cur != NULL && Ctx->ppfailed == NULL)
+  {
+    p = Ctx->ppsrc->cur;
+
+    // Deal with a directive
+    if (p->token == T_HASH && p->bol)
+    {
+      name = ppdirective();
+      if (!strcmp(name, "elif") || !strcmp(name, "else") ||
+          !strcmp(name, "endif"))
+        return (name);
+      if (!strcmp(name, "if") || !strcmp(name, "ifdef") ||
+          !strcmp(name, "ifndef"))
+        ppif(name, active);
+      else if (active)
+        ppdo(name);
+      else
+        ppline();
+      continue;
+    }
+
+    // Pass on any other token, expanding macros
+    Ctx->ppsrc->cur = p->next;
+    if (active)
+      ppsubst(p, Ctx->ppsrc, Ctx->ppout, NULL);
+  }
+  return (NULL);
+}
+
+// Return true if the file starting with the token p
+// starts with #include lines for the headers in the
+// snapshot s, in the same order
+/**
+ * @fn ppmatch
+ * @brief Say if a file starts by including the headers in a snapshot
+ * @param p The first token in the file
+ * @param s The snapshot
+ * @return 1 if it does, else 0
+ */
+static int ppmatch(struct pptoken *p, struct ppsnap *s)
+{
+  char name[TEXTLEN];
+  int i, len;
+
+  for (i = 0; i < s->nheaders; i++)
+  {
+    // Look for '#' include '<'
+    if (p == NULL || p->token != T_HASH || !p->bol)
+      return (0);
+    p = p->next;
+    if (p == NULL || p->bol || p->token != T_IDENT ||
+        strcmp(p->text, "include"))
+      return (0);
+    p = p->next;
+    if (p == NULL || p->bol || p->token != T_LT)
+      return (0);
+
+    // Rebuild the header name as ppinclude() does
+    name[0] = 0;
+    len = 0;
+    for (p = p->next; p != NULL && !p->bol && p->token != T_GT; p = p->next)
+    {
+      if (p->token != T_IDENT && p->token != T_DOT &&
+          p->token != T_SLASH && p->token != T_MINUS)
+        return (0);
+      len = len + (int)strlen(p->text);
+      if (len >= TEXTLEN)
+        return (0);
+      strcat(name, p->text);
+    }
+
+    // The line must end with the '>'
+    if (p == NULL || p->bol || strcmp(name, s->headers[i]))
+      return (0);
+    p = p->next;
+    if (p != NULL && !p->bol)
+      return (0);
+  }
+  return (1);
+}
+
+// Start the current file from the snapshot with the
+// most headers that the file starts by including, if
+// there is one. Each snapshot can only be used once
+/**
+ * @fn ppusesnap
+ * @brief Start the current file from a snapshot of its first headers
+ * @param p The first token in the file
+ */
+static void ppusesnap(struct pptoken *p)
+{
+  struct ppsnap *s, *best = NULL;
+  int i;
+
+  for (s = Ppsnaps; s != NULL; s = s->next)
+    if (!s->used && (best == NULL || s->nheaders > best->nheaders) &&
+        ppmatch(p, s))
+      best = s;
+  Ctx->ppsnap = NULL;
+  if (best == NULL)
+    return;
+
+  // The headers that they include are ours too
+  best->used = 1;
+  Ctx->ppsnap = best->ctx;
+  Ctx->ppmacros = best->ctx->ppmacros;
+  if (O_makedeps)
+    for (i = 0; i < best->ctx->ndeps; i++)
+      adddep(best->ctx->deps[i]);
+}
+
+// Preprocess the named source file. Return the list of tokens
+// for the parser, which ends with a T_EOF, or NULL if the file
+// needs the external cpp
+/**
+ * @fn preprocess
+ * @brief Preprocess the named source file
+ * @param filename The name of the source file
+ * @return The list of tokens, or NULL if the external cpp is needed
+ */
+struct pptoken *preprocess(char *filename)
+{
+  struct ppfile *f;
+
+  Ctx->ppmacros = NULL;
+  Ctx->ppout = ppnewlist();
+  Ctx->ppdepth = 0;
+  Ctx->ppfailed = NULL;
+
+  // The source file itself isn't cached
+  f = ppload(filename, 0);
+  if (f != NULL)
+  {
+    ppusesnap(f->head);
+    Ctx->ppsrc = ppreader(f->head, NULL);
+    if (ppgroup(1) != NULL)
+      ppfail("#else or #endif without #if");
+  }
+  else
+    ppfail("can't read file");
+  Ctx->infilename = filename;
+
+  if (Ctx->ppfailed != NULL)
+  {
+    if (O_verbose)
+      printf("%s: %s, using cpp\n", filename, Ctx->ppfailed);
+    Ctx->ppsnap = NULL;
+    return (NULL);
+  }
+  ppappend(Ctx->ppout, f->eof);
+  return (Ctx->ppout->head);
+}
+
+// Tokenise and cache each file matching the pattern
+/**
+ * @fn pploadall
+ * @brief Tokenise and cache each file matching the pattern
+ * @param pattern The pattern for glob()
+ */
+static void pploadall(char *pattern)
+{
+  int i;
+
+  if (glob(pattern, 0, NULL, &Ppglob) != 0)
+    return;
+  for (i = 0; i < Ppglob.gl_pathc; i++)
+    ppload(strdup(Ppglob.gl_pathv[i]), 1);
+  globfree(&Ppglob);
+}
+
+// Tokenise all the system headers now, so that a
+// compile server has them ready for every request
+/**
+ * @fn ppwarm
+ * @brief Tokenise and cache all the system headers
+ */
+void ppwarm(void)
+{
+  char *pattern;
+  int len;
+
+  Ctx = new_context();
+  len = (int)strlen(INCDIR) + 16;
+  pattern = (char *)malloc(len);
+  if (pattern == NULL)
+    fatal("Unable to malloc in ppwarm()");
+  snprintf(pattern, len, "%s/*.h", INCDIR);
+  pploadall(pattern);
+  snprintf(pattern, len, "%s/sys/*.h", INCDIR);
+  pploadall(pattern);
+  free(pattern);
+  free_context(Ctx);
+  Ctx = NULL;
+}
+
+// Return true if a snapshot of the system headers in
+// names would be new, and there is room to keep it
+/**
+ * @fn ppwantsnap
+ * @brief Say if a snapshot of some headers would be new and has room
+ * @param names The names of the headers
+ * @param n The number of headers
+ * @return 1 if ppsnapshot() should be called, else 0
+ */
+int ppwantsnap(char **names, int n)
+{
+  struct ppsnap *s;
+  int i;
+
+  if (Ppnsnaps == PPMAXSNAPS)
+    return (0);
+  for (s = Ppsnaps; s != NULL; s = s->next)
+    if (s->nheaders == n)
+    {
+      i = 0;
+      while (i < n && !strcmp(s->headers[i], names[i]))
+        i++;
+      if (i == n)
+        return (0);
+    }
+  return (1);
+}
+
+// Preprocess and parse the n system headers in names,
+// in order, and keep the macros and symbols that they
+// give for the files that start by including them.
+// Return 1 if the snapshot was made, and keep names.
+// Return 0 if the headers need the external cpp
+/**
+ * @fn ppsnapshot
+ * @brief Parse some system headers and keep their macros and symbols
+ * @param names The names of the headers, kept on success
+ * @param n The number of headers
+ * @return 1 if the snapshot was made, 0 if not
+ */
+int ppsnapshot(char **names, int n)
+{
+  struct ppsnap *s;
+  struct ppfile *f = NULL;
+  int i, makedeps, syntaxonly;
+
+  // Preprocess the headers, noting every file
+  // that they include for the dependencies
+  Ctx = new_context();
+  Ctx->ppout = ppnewlist();
+  makedeps = O_makedeps;
+  O_makedeps = 1;
+  for (i = 0; i < n && Ctx->ppfailed == NULL; i++)
+  {
+    f = ppsearch(names[i], NULL);
+    if (f == NULL)
+      ppfail("header not found");
+    else
+      ppheader(f);
+  }
+  O_makedeps = makedeps;
+  if (f == NULL || Ctx->ppfailed != NULL)
+  {
+    free_context(Ctx);
+    Ctx = NULL;
+    return (0);
+  }
+
+  s = (struct ppsnap *)calloc(1, sizeof(struct ppsnap));
+  if (s == NULL)
+    fatal("Unable to malloc in ppsnapshot()");
+  s->headers = names;
+  s->nheaders = n;
+  s->ctx = Ctx;
+  ppappend(Ctx->ppout, ppcopy(f->eof, NULL));
+
+  // Parse the tokens, making no code
+  syntaxonly = O_syntaxonly;
+  O_syntaxonly = 1;
+  Ctx->pptokens = Ctx->ppout->head;
+  scan(Ctx->token);
+  Ctx->peektoken->token = 0;
+  global_declarations();
+  Ctx->pptokens = NULL;
+  O_syntaxonly = syntaxonly;
+
+  s->next = Ppsnaps;
+  Ppsnaps = s;
+  Ppnsnaps = Ppnsnaps + 1;
+  Ctx = NULL;
+  return (1);
+}
+
+// Forget the cached system headers
+// and the snapshots made from them
+/**
+ * @fn ppforget
+ * @brief Forget the cached system headers
+ */
+void ppforget(void)
+{
+  Ppcache = NULL;
+  Ppsnaps = NULL;
+  Ppnsnaps = 0;
+}
@@ -11,79 +11,15 @@
 
 /**
  * @brief Global variables
- * @var int Line
- * Current line number
- * @var int Linestart
- * True if at start of a line
- * @var int Putback
- * Character put back by scanner
- * @var struct symtable *Functionid
- * Symbol ptr of the current function
- * @var FILE *Infile
- * Input files
- * @var FILE *Outfile
- * Output files
- * @var char *Infilename
- * Name of file we are parsing
- * @var char *Outfilename
- * Name of file we opened as Outfile
- * @var struct token
- * Token Last token scanned
- * @var struct token
- * Peektoken A look-ahead token
- * @var char Text[TEXTLEN + 1]
- * Last identifier scanned
- * @var int Looplevel
- * Depth of nested loops
- * @var int Switchlevel
- * Depth of nested switches
+ * @var struct context *Ctx
+ * State of the compiler for the file being compiled
  * @var char *Tstring[]
  * List of token strings
  *
  */
-extern_ int Line;
-extern_ int Linestart;
-extern_ int Putback;
-extern_ struct symtable *Functionid;
-extern_ FILE *Infile;
-extern_ FILE *Outfile;
-extern_ char *Infilename;
-extern_ char *Outfilename;
-extern_ struct token Token;
-extern_ struct token Peektoken;
-extern_ char Text[TEXTLEN + 1];
-extern_ int Looplevel;
-extern_ int Switchlevel;
+extern_ struct context *Ctx;
 extern char *Tstring[];
 
-/**
- * @brief Symbol table lists
- * @var struct symtable *Globhead, *Globtail
- * Global variables and functions
- * @var struct symtable *Loclhead, *Locltail
- * Local variables
- * @var struct symtable *Parmhead, *Parmtail
- * Local parameters
- * @var struct symtable *Membhead, *Membtail
- * Temp list of struct/union members
- * @var struct symtable *Structhead, *Structtail
- * List of struct types
- * @var struct symtable *Unionhead, *Uniontail
- * List of union types
- * @var struct symtable *Enumhead, *Enumtail
- * List of enum types and values
- * @var struct symtable *Typehead, *Typetail
- * List of typedefs
- */
-extern_ struct symtable *Globhead, *Globtail;
-extern_ struct symtable *Loclhead, *Locltail;
-extern_ struct symtable *Parmhead, *Parmtail;
-extern_ struct symtable *Membhead, *Membtail;
-extern_ struct symtable *Structhead, *Structtail;
-extern_ struct symtable *Unionhead, *Uniontail;
-extern_ struct symtable *Enumhead, *Enumtail;
-extern_ struct symtable *Typehead, *Typetail;
-
 // Command-line flags
 /**
  * @brief Command-line flags
@@ -99,6 +35,28 @@ extern_ struct symtable *Typehead, *Typetail;
  * If true, link the object files
  * @var int O_verbose
  * If true, print info on compilation stages
+ * @var int O_jobs
+ * Number of files to compile at the same time
+ * @var int O_syntaxonly
+ * If true, only check the syntax and types, with no code generated
+ * @var int O_wholeprog
+ * If true, compile all the files as one program and drop unused code
+ * @var int O_intas
+ * If true, QBE writes object files itself instead of running as
+ * @var int O_makedeps
+ * If true, write a dependency file for make
+ * @var char *O_depfile
+ * Name of the dependency file, or NULL to use the source file's name
+ * @var char *O_tracefile
+ * File to write a trace of the compile into, or NULL
+ * @var int O_static
+ * If true, link statically against MINIC's own runtime
+ * @var char *O_cachedir
+ * Directory to cache compiled output in, or NULL
+ * @var long O_cachesize
+ * Most bytes to keep in the cache
+ * @var int O_nobuiltin
+ * If true, always call memcpy(), memset(), strlen() and the ctype queries
  */
 extern_ int O_dumpAST;
 extern_ int O_dumpsym;
@@ -106,3 +64,14 @@ extern_ int O_keepasm;
 extern_ int O_assemble;
 extern_ int O_dolink;
 extern_ int O_verbose;
+extern_ int O_jobs;
+extern_ int O_syntaxonly;
+extern_ int O_wholeprog;
+extern_ int O_intas;
+extern_ int O_makedeps;
+extern_ char *O_depfile;
+extern_ char *O_tracefile;
+extern_ int O_static;
+extern_ char *O_cachedir;
+extern_ long O_cachesize;
+extern_ int O_nobuiltin;
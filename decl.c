@@ -7,6 +7,8 @@
 #include "defs.h"
 #include "data.h"
 #include "decl.h"
+#include <fcntl.h>
+#include <unistd.h>
 
 // Parsing of declarations
 static struct symtable *composite_declaration(int type);
@@ -31,13 +33,13 @@ int parse_type(struct symtable **ctype, int *class)
   // See if the class has been changed to extern or static
   while (exstatic)
   {
-    switch (Token.token)
+    switch (Ctx->token->token)
     {
     case T_EXTERN:
       if (*class == C_STATIC)
         fatal("Illegal to have extern and static at the same time");
       *class = C_EXTERN;
-      scan(&Token);
+      scan(Ctx->token);
       break;
     case T_STATIC:
       if (*class == C_LOCAL)
@@ -45,7 +47,7 @@ int parse_type(struct symtable **ctype, int *class)
       if (*class == C_EXTERN)
         fatal("Illegal to have extern and static at the same time");
       *class = C_STATIC;
-      scan(&Token);
+      scan(Ctx->token);
       break;
     default:
       exstatic = 0;
@@ -53,23 +55,23 @@ int parse_type(struct symtable **ctype, int *class)
   }
 
   // Now work on the actual type keyword
-  switch (Token.token)
+  switch (Ctx->token->token)
   {
   case T_VOID:
     type = P_VOID;
-    scan(&Token);
+    scan(Ctx->token);
     break;
   case T_CHAR:
     type = P_CHAR;
-    scan(&Token);
+    scan(Ctx->token);
     break;
   case T_INT:
     type = P_INT;
-    scan(&Token);
+    scan(Ctx->token);
     break;
   case T_LONG:
     type = P_LONG;
-    scan(&Token);
+    scan(Ctx->token);
     break;
 
     // For the following, if we have a ';' after the
@@ -78,31 +80,31 @@ int parse_type(struct symtable **ctype, int *class)
   case T_STRUCT:
     type = P_STRUCT;
     *ctype = composite_declaration(P_STRUCT);
-    if (Token.token == T_SEMI)
+    if (Ctx->token->token == T_SEMI)
       type = -1;
     break;
   case T_UNION:
     type = P_UNION;
     *ctype = composite_declaration(P_UNION);
-    if (Token.token == T_SEMI)
+    if (Ctx->token->token == T_SEMI)
       type = -1;
     break;
   case T_ENUM:
     type = P_INT; // Enums are really ints
     enum_declaration();
-    if (Token.token == T_SEMI)
+    if (Ctx->token->token == T_SEMI)
       type = -1;
     break;
   case T_TYPEDEF:
     type = typedef_declaration(ctype);
-    if (Token.token == T_SEMI)
+    if (Ctx->token->token == T_SEMI)
       type = -1;
     break;
   case T_IDENT:
-    type = type_of_typedef(Text, ctype);
+    type = type_of_typedef(Ctx->ident, ctype);
     break;
   default:
-    fatals("Illegal type, token", Token.tokstr);
+    fatals("Illegal type, token", Ctx->token->tokstr);
   }
   return (type);
 }
@@ -120,10 +122,10 @@ int parse_stars(int type)
 
   while (1)
   {
-    if (Token.token != T_STAR)
+    if (Ctx->token->token != T_STAR)
       break;
     type = pointer_to(type);
-    scan(&Token);
+    scan(Ctx->token);
   }
   return (type);
 }
@@ -259,6 +261,7 @@ static struct symtable *scalar_declaration(char *varname, int type,
 {
   struct symtable *sym = NULL;
   struct ASTnode *varnode, *exprnode;
+  int size;
   *tree = NULL;
 
   // Add this as a known scalar
@@ -284,20 +287,21 @@ static struct symtable *scalar_declaration(char *varname, int type,
   }
 
   // The variable is being initialised
-  if (Token.token == T_ASSIGN)
+  if (Ctx->token->token == T_ASSIGN)
   {
     // Only possible for a global or local
     if (class != C_GLOBAL && class != C_LOCAL && class != C_STATIC)
       fatals("Variable can not be initialised", varname);
-    scan(&Token);
+    scan(Ctx->token);
 
     // Globals must be assigned a literal value
     if (class == C_GLOBAL || class == C_STATIC)
     {
       // Create one initial value for the variable and
       // parse this value
-      sym->initlist = (int *)malloc(sizeof(int));
-      sym->initlist[0] = parse_literal(type);
+      size = typesize(type, ctype);
+      sym->initlist = (char *)arenaalloc(Ctx->tuarena, size);
+      setinitval(sym->initlist, size, 0, parse_literal(type));
     }
     if (class == C_LOCAL)
     {
@@ -325,6 +329,98 @@ static struct symtable *scalar_declaration(char *varname, int type,
   return (sym);
 }
 
+// An initial value which is just an integer literal,
+// followed by a ',' or '}', needs no expression tree.
+// Return true if the current token is one that can go
+// into an element of the given type as it is
+/**
+ * @fn plain_literal
+ * @brief Return true if the current token is a plain integer literal initial value
+ * @param type The type of the element
+ * @return True if the literal needs no expression tree
+ */
+static int plain_literal(int type)
+{
+  int val = Ctx->token->intvalue;
+
+  // Anything that parse_literal() would
+  // reject is left for it to report
+  if (Ctx->token->token != T_INTLIT || !inttype(type))
+    return (0);
+  if (type == P_CHAR && (val < 0 || val > 255))
+    return (0);
+
+  // Look at the token after the literal
+  if (Ctx->peektoken->token == 0)
+    scan(Ctx->peektoken);
+  return (Ctx->peektoken->token == T_COMMA ||
+          Ctx->peektoken->token == T_RBRACE);
+}
+
+// Read the bytes of the file named by a T_EMBED token
+// into the initialisation list, one byte to each element,
+// from element *count on. The list has room for *maxelems
+// elements and can grow unless the array has nelems.
+// Update *count and *maxelems, and return the list
+/**
+ * @fn embed_file
+ * @brief Read the bytes of an #embed file into an initialisation list
+ * @param list The initialisation list
+ * @param size The size of each element
+ * @param count Pointer to the number of elements in the list
+ * @param maxelems Pointer to the room in the list
+ * @param nelems The number of elements in the array, or -1
+ * @return The list, which may have moved
+ */
+static char *embed_file(char *list, int size, int *count, int *maxelems,
+                        int nelems)
+{
+  char buf[TEXTLEN];
+  long filesize;
+  int fd, len, n, i, j;
+
+  if ((fd = open(Ctx->text, O_RDONLY)) == -1)
+    fatals("Unable to open #embed file", Ctx->text);
+  filesize = lseek(fd, 0, SEEK_END);
+  lseek(fd, 0, SEEK_SET);
+  if (filesize < 0 || filesize > 0x10000000)
+    fatals("Unusable #embed file", Ctx->text);
+  len = (int)filesize;
+
+  // Make room for all the bytes and one more element
+  if (nelems != -1 && *count + len > nelems)
+    fatal("Too many values in initialisation list");
+  if (nelems == -1 && *count + len >= *maxelems)
+  {
+    while (*count + len >= *maxelems)
+      *maxelems = *maxelems * 2;
+    list = (char *)realloc(list, *maxelems * size);
+    if (list == NULL)
+      fatal("Unable to realloc in embed_file()");
+  }
+
+  // Chars go straight into the list
+  for (i = 0; i < len; i = i + n)
+  {
+    if (size == 1)
+      n = read(fd, list + *count + i, len - i);
+    else
+    {
+      n = len - i;
+      if (n > TEXTLEN)
+        n = TEXTLEN;
+      n = read(fd, buf, n);
+      for (j = 0; j < n; j++)
+        setinitval(list, size, *count + i + j, buf[j] & 0xff);
+    }
+    if (n <= 0)
+      fatals("Unable to read #embed file", Ctx->text);
+  }
+  close(fd);
+  *count = *count + len;
+  return (list);
+}
+
 // Given the type, name and class of an array variable, parse
 // the size of the array, if any. Then parse any initialisation
 // value and allocate storage for it.
@@ -345,14 +441,15 @@ static struct symtable *array_declaration(char *varname, int type,
   struct symtable *sym = NULL; // New symbol table entry
   int nelems = -1;             // Assume the number of elements won't be given
   int maxelems;                // The maximum number of elements in the init list
-  int *initlist;               // The list of initial elements
+  char *initlist;              // The list of initial elements
+  int size;                    // The size of each element
   int i = 0, j;
 
   // Skip past the '['
-  scan(&Token);
+  scan(Ctx->token);
 
   // See if we have an array size
-  if (Token.token != T_RBRACKET)
+  if (Ctx->token->token != T_RBRACKET)
   {
     nelems = parse_literal(P_INT);
     if (nelems <= 0)
@@ -383,46 +480,72 @@ static struct symtable *array_declaration(char *varname, int type,
   }
 
   // Array initialisation
-  if (Token.token == T_ASSIGN)
+  if (Ctx->token->token == T_ASSIGN)
   {
     if (class != C_GLOBAL && class != C_STATIC)
       fatals("Variable can not be initialised", varname);
-    scan(&Token);
+    scan(Ctx->token);
 
     // Get the following left curly bracket
     match(T_LBRACE, "{");
 
-#define TABLE_INCREMENT 10
+#define TABLE_INCREMENT 16
 
     // If the array already has nelems, allocate that many elements
-    // in the list. Otherwise, start with TABLE_INCREMENT.
+    // in the list. Otherwise, start with TABLE_INCREMENT. The
+    // values are packed at the size of one element
     if (nelems != -1)
       maxelems = nelems;
     else
       maxelems = TABLE_INCREMENT;
-    initlist = (int *)malloc(maxelems * sizeof(int));
+    size = typesize(type, ctype);
+    initlist = (char *)malloc(maxelems * size);
+    if (initlist == NULL)
+      fatal("Unable to malloc in array_declaration()");
 
     // Loop getting a new literal value from the list
     while (1)
     {
 
-      // Check we can add the next value, then parse and add it
+      // Check we can add the next value, then parse and add it.
+      // Lookup tables can have millions of plain literals,
+      // so store those without building a tree for each one
       if (nelems != -1 && i == maxelems)
         fatal("Too many values in initialisation list");
 
-      initlist[i++] = parse_literal(type);
+      if (Ctx->token->token == T_EMBED)
+      {
+        // The bytes of an #embed file are integers
+        if (!inttype(type))
+          fatals("#embed into an array which isn't integers", varname);
+        initlist = embed_file(initlist, size, &i, &maxelems, nelems);
+        scan(Ctx->token);
+      }
+      else if (plain_literal(type))
+      {
+        setinitval(initlist, size, i, Ctx->token->intvalue);
+        scan(Ctx->token);
+        i++;
+      }
+      else
+      {
+        setinitval(initlist, size, i, parse_literal(type));
+        i++;
+      }
 
-      // Increase the list size if the original size was
+      // Double the list size if the original size was
       // not set and we have hit the end of the current list
       if (nelems == -1 && i == maxelems)
       {
-        maxelems += TABLE_INCREMENT;
-        initlist = (int *)realloc(initlist, maxelems * sizeof(int));
+        maxelems = maxelems * 2;
+        initlist = (char *)realloc(initlist, maxelems * size);
+        if (initlist == NULL)
+          fatal("Unable to realloc in array_declaration()");
       }
       // Leave when we hit the right curly bracket
-      if (Token.token == T_RBRACE)
+      if (Ctx->token->token == T_RBRACE)
       {
-        scan(&Token);
+        scan(Ctx->token);
         break;
       }
       // Next token must be a comma, then
@@ -431,8 +554,8 @@ static struct symtable *array_declaration(char *varname, int type,
 
     // Zero any unused elements in the initlist.
     // Attach the list to the symbol table entry
-    for (j = i; j < sym->nelems; j++)
-      initlist[j] = 0;
+    for (j = i; j < nelems; j++)
+      setinitval(initlist, size, j, 0);
 
     if (i > nelems)
       nelems = i;
@@ -475,20 +598,20 @@ static int param_declaration_list(struct symtable *oldfuncsym,
     protoptr = oldfuncsym->member;
 
   // Loop getting any parameters
-  while (Token.token != T_RPAREN)
+  while (Ctx->token->token != T_RPAREN)
   {
 
     // If the first token is 'void'
-    if (Token.token == T_VOID)
+    if (Ctx->token->token == T_VOID)
     {
       // Peek at the next token. If a ')', the function
       // has no parameters, so leave the loop.
-      scan(&Peektoken);
-      if (Peektoken.token == T_RPAREN)
+      scan(Ctx->peektoken);
+      if (Ctx->peektoken->token == T_RPAREN)
       {
         // Move the Peektoken into the Token
         paramcnt = 0;
-        scan(&Token);
+        scan(Ctx->token);
         break;
       }
     }
@@ -507,7 +630,7 @@ static int param_declaration_list(struct symtable *oldfuncsym,
     paramcnt++;
 
     // Stop when we hit the right parenthesis
-    if (Token.token == T_RPAREN)
+    if (Ctx->token->token == T_RPAREN)
       break;
     // We need a comma as separator
     comma();
@@ -541,7 +664,7 @@ static struct symtable *function_declaration(char *funcname, int type,
   struct ASTnode *tree, *finalstmt;
   struct symtable *oldfuncsym, *newfuncsym = NULL;
   int endlabel = 0, paramcnt;
-  int linenum = Line;
+  int linenum = Ctx->line;
 
   // Text has the identifier's name. If this exists and is a
   // function, get the id. Otherwise, set oldfuncsym to NULL.
@@ -571,27 +694,36 @@ static struct symtable *function_declaration(char *funcname, int type,
   if (newfuncsym)
   {
     newfuncsym->nelems = paramcnt;
-    newfuncsym->member = Parmhead;
+    newfuncsym->member = Ctx->parmsyms->head;
     oldfuncsym = newfuncsym;
   }
   // Clear out the parameter list
-  Parmhead = Parmtail = NULL;
+  clearparms();
 
   // If the declaration ends in a semicolon, only a prototype.
-  if (Token.token == T_SEMI)
+  if (Ctx->token->token == T_SEMI)
     return (oldfuncsym);
 
-  // This is not just a prototype.
-  // Set the Functionid global to the function's symbol pointer
-  Functionid = oldfuncsym;
+  // This is not just a prototype, so it has to be at the
+  // global level. Say so now, while the scanner is still on
+  // the line where the body starts, not after the body
+  if (class != C_GLOBAL && class != C_STATIC)
+    fatal("Function definition not at global level");
+
+  // Start the function's scope, which also sets
+  // Functionid to the function's symbol pointer
+  tracebegin(funcname, "function");
+  pushscope(oldfuncsym);
 
   // Get the AST tree for the compound statement and mark
   // that we have parsed no loops or switches yet
-  Looplevel = 0;
-  Switchlevel = 0;
+  Ctx->looplevel = 0;
+  Ctx->switchlevel = 0;
+  tracebegin("parse", "stage");
   lbrace();
   tree = compound_statement(0);
   rbrace();
+  traceend();
 
   // If the function type isn't P_VOID ...
   if (type != P_VOID)
@@ -613,7 +745,9 @@ static struct symtable *function_declaration(char *funcname, int type,
   tree->linenum = linenum;
 
   // Do optimisations on the AST tree
+  tracebegin("optimise", "stage");
   tree = optimise(tree);
+  traceend();
 
   // Dump the AST tree if requested
   if (O_dumpAST)
@@ -622,10 +756,17 @@ static struct symtable *function_declaration(char *funcname, int type,
     fprintf(stdout, "\n\n");
   }
   // Generate the assembly code for it
-  genAST(tree, NOLABEL, NOLABEL, NOLABEL, 0);
+  if (!O_syntaxonly)
+  {
+    tracebegin("genAST", "stage");
+    genAST(tree, NOLABEL, NOLABEL, NOLABEL, 0);
+    traceend();
+  }
 
-  // Now free the symbols associated with this function
-  freeloclsyms();
+  // Now free the symbols and AST nodes of this function
+  popscope();
+  resetarena(Ctx->funcarena);
+  traceend();
   return (oldfuncsym);
 }
 
@@ -647,38 +788,38 @@ static struct symtable *composite_declaration(int type)
   int t;
 
   // Skip the struct/union keyword
-  scan(&Token);
+  scan(Ctx->token);
 
   // See if there is a following struct/union name
-  if (Token.token == T_IDENT)
+  if (Ctx->token->token == T_IDENT)
   {
     // Find any matching composite type
     if (type == P_STRUCT)
-      ctype = findstruct(Text);
+      ctype = findstruct(Ctx->ident);
     else
-      ctype = findunion(Text);
-    scan(&Token);
+      ctype = findunion(Ctx->ident);
+    scan(Ctx->token);
   }
   // If the next token isn't an LBRACE , this is
   // the usage of an existing struct/union type.
   // Return the pointer to the type.
-  if (Token.token != T_LBRACE)
+  if (Ctx->token->token != T_LBRACE)
   {
     if (ctype == NULL)
-      fatals("unknown struct/union type", Text);
+      fatals("unknown struct/union type", Ctx->text);
     return (ctype);
   }
   // Ensure this struct/union type hasn't been
   // previously defined
   if (ctype)
-    fatals("previously defined struct/union", Text);
+    fatals("previously defined struct/union", Ctx->text);
 
   // Build the composite type and skip the left brace
   if (type == P_STRUCT)
-    ctype = addstruct(Text);
+    ctype = addstruct(Ctx->ident);
   else
-    ctype = addunion(Text);
-  scan(&Token);
+    ctype = addunion(Ctx->ident);
+  scan(Ctx->token);
 
   // Scan in the list of members
   while (1)
@@ -687,18 +828,18 @@ static struct symtable *composite_declaration(int type)
     t = declaration_list(&m, C_MEMBER, T_SEMI, T_RBRACE, &unused);
     if (t == -1)
       fatal("Bad type in member list");
-    if (Token.token == T_SEMI)
-      scan(&Token);
-    if (Token.token == T_RBRACE)
+    if (Ctx->token->token == T_SEMI)
+      scan(Ctx->token);
+    if (Ctx->token->token == T_RBRACE)
       break;
   }
 
   // Attach to the struct type's node
   rbrace();
-  if (Membhead == NULL)
+  if (Ctx->membsyms->head == NULL)
     fatals("No members in struct", ctype->name);
-  ctype->member = Membhead;
-  Membhead = Membtail = NULL;
+  ctype->member = Ctx->membsyms->head;
+  clearmembs();
 
   // Set the offset of the initial member
   // and find the first free byte after it
@@ -737,26 +878,26 @@ static void enum_declaration(void)
   int intval = 0;
 
   // Skip the enum keyword.
-  scan(&Token);
+  scan(Ctx->token);
 
   // If there's a following enum type name, get a
   // pointer to any existing enum type node.
-  if (Token.token == T_IDENT)
+  if (Ctx->token->token == T_IDENT)
   {
-    etype = findenumtype(Text);
-    name = strdup(Text); // As it gets tromped soon
-    scan(&Token);
+    etype = findenumtype(Ctx->ident);
+    name = Ctx->ident;
+    scan(Ctx->token);
   }
   // If the next token isn't a LBRACE, check
   // that we have an enum type name, then return
-  if (Token.token != T_LBRACE)
+  if (Ctx->token->token != T_LBRACE)
   {
     if (etype == NULL)
       fatals("undeclared enum type:", name);
     return;
   }
   // We do have an LBRACE. Skip it
-  scan(&Token);
+  scan(Ctx->token);
 
   // If we have an enum type name, ensure that it
   // hasn't been declared before.
@@ -769,36 +910,35 @@ static void enum_declaration(void)
   // Loop to get all the enum values
   while (1)
   {
-    // Ensure we have an identifier
-    // Copy it in case there's an int literal coming up
+    // Ensure we have an identifier and get its name
     ident();
-    name = strdup(Text);
+    name = Ctx->ident;
 
     // Ensure this enum value hasn't been declared before
     etype = findenumval(name);
     if (etype != NULL)
-      fatals("enum value redeclared:", Text);
+      fatals("enum value redeclared:", Ctx->text);
 
     // If the next token is an '=', skip it and
     // get the following int literal
-    if (Token.token == T_ASSIGN)
+    if (Ctx->token->token == T_ASSIGN)
     {
-      scan(&Token);
-      if (Token.token != T_INTLIT)
+      scan(Ctx->token);
+      if (Ctx->token->token != T_INTLIT)
         fatal("Expected int literal after '='");
-      intval = Token.intvalue;
-      scan(&Token);
+      intval = Ctx->token->intvalue;
+      scan(Ctx->token);
     }
     // Build an enum value node for this identifier.
     // Increment the value for the next enum identifier.
     etype = addenum(name, C_ENUMVAL, intval++);
 
     // Bail out on a right curly bracket, else get a comma
-    if (Token.token == T_RBRACE)
+    if (Ctx->token->token == T_RBRACE)
       break;
     comma();
   }
-  scan(&Token); // Skip over the right curly bracket
+  scan(Ctx->token); // Skip over the right curly bracket
 }
 
 // Parse a typedef declaration and return the type
@@ -814,23 +954,23 @@ static int typedef_declaration(struct symtable **ctype)
   int type, class = 0;
 
   // Skip the typedef keyword.
-  scan(&Token);
+  scan(Ctx->token);
 
   // Get the actual type following the keyword
   type = parse_type(ctype, &class);
   if (class != 0)
     fatal("Can't have static/extern in a typedef declaration");
 
-  // See if the typedef identifier already exists
-  if (findtypedef(Text) != NULL)
-    fatals("redefinition of typedef", Text);
-
   // Get any following '*' tokens
   type = parse_stars(type);
 
+  // See if the typedef identifier already exists
+  if (findtypedef(Ctx->ident) != NULL)
+    fatals("redefinition of typedef", Ctx->text);
+
   // It doesn't exist so add it to the typedef list
-  addtypedef(Text, type, *ctype);
-  scan(&Token);
+  addtypedef(Ctx->ident, type, *ctype);
+  scan(Ctx->token);
   return (type);
 }
 
@@ -850,7 +990,7 @@ static int type_of_typedef(char *name, struct symtable **ctype)
   t = findtypedef(name);
   if (t == NULL)
     fatals("unknown type", name);
-  scan(&Token);
+  scan(Ctx->token);
   *ctype = t->ctype;
   return (t->type);
 }
@@ -873,7 +1013,7 @@ static struct symtable *symbol_declaration(int type, struct symtable *ctype,
                                            int class, struct ASTnode **tree)
 {
   struct symtable *sym = NULL;
-  char *varname = strdup(Text);
+  char *varname = Ctx->ident;
 
   // Ensure that we have an identifier.
   // We copied it above so we can scan more tokens in, e.g.
@@ -881,7 +1021,7 @@ static struct symtable *symbol_declaration(int type, struct symtable *ctype,
   ident();
 
   // Deal with function declarations
-  if (Token.token == T_LPAREN)
+  if (Ctx->token->token == T_LPAREN)
   {
     return (function_declaration(varname, type, ctype, class));
   }
@@ -901,7 +1041,7 @@ static struct symtable *symbol_declaration(int type, struct symtable *ctype,
   }
 
   // Add the array or scalar variable to the symbol table
-  if (Token.token == T_LBRACKET)
+  if (Ctx->token->token == T_LBRACKET)
   {
     sym = array_declaration(varname, type, ctype, class);
     *tree = NULL; // Local arrays are not initialised
@@ -961,7 +1101,7 @@ int declaration_list(struct symtable **ctype, int class, int et1, int et2,
           mkastnode(A_GLUE, P_NONE, NULL, *gluetree, NULL, tree, NULL, 0);
 
     // We are at the end of the list, leave
-    if (Token.token == et1 || Token.token == et2)
+    if (Ctx->token->token == et1 || Ctx->token->token == et2)
       return (type);
 
     // Otherwise, we need a comma as separator
@@ -983,12 +1123,15 @@ void global_declarations(void)
   struct ASTnode *unused;
 
   // Loop parsing one declaration list until the end of file
-  while (Token.token != T_EOF)
+  while (Ctx->token->token != T_EOF)
   {
     declaration_list(&ctype, C_GLOBAL, T_SEMI, T_EOF, &unused);
 
+    // Pass the code for this declaration on to the back end
+    genflush();
+
     // Skip any separating semicolons
-    if (Token.token == T_SEMI)
-      scan(&Token);
+    if (Ctx->token->token == T_SEMI)
+      scan(Ctx->token);
   }
 }
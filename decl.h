@@ -22,6 +22,122 @@ void reject_token(struct token *t);
  * @note This function is used to scan a token
  */
 int scan(struct token *t);
+/**
+ * @fn scanpp
+ * @brief Scan a token from the input for the preprocessor
+ * @return struct pptoken *
+ * @note The token is T_LEXERR if there was a lexical error
+ */
+struct pptoken *scanpp(void);
+/**
+ * @fn lexinit
+ * @brief Build the lexer's character class and keyword tables
+ * @return void
+ */
+void lexinit(void);
+/**
+ * @fn openinput
+ * @brief Map a file in as the scanner's input
+ * @param name The name of the file
+ * @return int
+ * @note Returns 0 if the file can't be opened
+ */
+int openinput(char *name);
+/**
+ * @fn readinput
+ * @brief Read everything from a file descriptor in as the scanner's input
+ * @param fd The file descriptor to read
+ * @return void
+ */
+void readinput(int fd);
+/**
+ * @fn closeinput
+ * @brief Release the scanner's input
+ * @return void
+ */
+void closeinput(void);
+
+// cache.c
+/**
+ * @fn cachelookup
+ * @brief Look for a cached copy of the output of the current file
+ * @param filename The name of the source file
+ * @param outname The name of the output file
+ * @param suffix The kind of output, 'o' or 's'
+ * @return int
+ * @note Returns 1 if the output was copied from the cache
+ */
+int cachelookup(char *filename, char *outname, int suffix);
+/**
+ * @fn cachestore
+ * @brief Save a copy of the output file in the cache
+ * @param outname The name of the output file
+ * @return void
+ */
+void cachestore(char *outname);
+
+// cpp.c
+/**
+ * @fn preprocess
+ * @brief Preprocess a source file with the integrated preprocessor
+ * @param filename Name of the source file
+ * @return struct pptoken *
+ * @note Returns NULL if the file needs the external cpp
+ */
+struct pptoken *preprocess(char *filename);
+
+/**
+ * @fn ppwarm
+ * @brief Tokenise and cache all the system headers
+ */
+void ppwarm(void);
+
+/**
+ * @fn ppwantsnap
+ * @brief Say if a snapshot of some headers would be new and has room
+ * @param names The names of the headers
+ * @param n The number of headers
+ * @return 1 if ppsnapshot() should be called, else 0
+ */
+int ppwantsnap(char **names, int n);
+
+/**
+ * @fn ppsnapshot
+ * @brief Parse some system headers and keep their macros and symbols
+ * @param names The names of the headers, kept on success
+ * @param n The number of headers
+ * @return 1 if the snapshot was made, 0 if not
+ */
+int ppsnapshot(char **names, int n);
+
+/**
+ * @fn ppforget
+ * @brief Forget the cached system headers
+ */
+void ppforget(void);
+
+// deps.c
+/**
+ * @fn adddep
+ * @brief Add a file to the dependencies of the current source file
+ * @param name The name of the file
+ */
+void adddep(char *name);
+
+/**
+ * @fn scandeps
+ * @brief Add the files named in the line markers in the input
+ */
+void scandeps(void);
+
+/**
+ * @fn writedeps
+ * @brief Write the make rule for the current source file
+ * @param depname The name of the dependency file
+ * @param target The target of the rule
+ * @param filename The name of the source file
+ */
+void writedeps(char *depname, char *target, char *filename);
 
 // tree.c
 /**
@@ -77,6 +193,28 @@ struct ASTnode *mkastunary(int op, int type,
 						   struct ASTnode *left,
 						   struct symtable *sym, int intvalue);
 
+/**
+ * @fn pushnode
+ * @brief Push an AST node on the tree walkers' stack
+ * @param n AST node
+ * @return void
+ */
+void pushnode(struct ASTnode *n);
+
+/**
+ * @fn popnode
+ * @brief Pop an AST node off the tree walkers' stack
+ * @return struct ASTnode
+ */
+struct ASTnode *popnode(void);
+
+/**
+ * @fn nodedepth
+ * @brief Return the number of nodes on the tree walkers' stack
+ * @return int
+ */
+int nodedepth(void);
+
 /**
  * @fn dumpAST
  * @brief Dump an AST node
@@ -127,6 +265,14 @@ void genpreamble(char *filename);
  */
 void genpostamble();
 
+/**
+ * @fn genflush
+ * @brief Flush the code generated so far
+ * @return void
+ * @note This function hands the code for the declarations parsed so far to the back end.
+ */
+void genflush(void);
+
 /**
  * @fn genfreeregs
  * @brief Generate free registers
@@ -203,8 +349,11 @@ int cgalloctemp(void);
 void cgfreeallregs(int keepreg);
 void cgfreereg(int reg);
 void cgspillregs(void);
+void cgasmfile(char *name);
 void cgpreamble(char *filename);
 void cgpostamble();
+void cgflush(void);
+void cgreplay(void);
 void cgfuncpreamble(struct symtable *sym);
 void cgfuncpostamble(struct symtable *sym);
 int cgloadint(int value, int type);
@@ -216,6 +365,10 @@ int cgmul(int r1, int r2, int type);
 int cgdivmod(int r1, int r2, int op, int type);
 int cgshlconst(int r, int val, int type);
 int cgcall(struct symtable *sym, int numargs, int *arglist, int *typelist);
+int cgmemcpy(int dst, int src, int size);
+int cgmemset(int dst, int val, int size);
+int cgctypemask(char *name);
+int cgctype(int r, int type, int mask);
 void cgcopyarg(int r, int argposn);
 int cgstorglob(int r, struct symtable *sym);
 int cgstorlocal(int r, struct symtable *sym);
@@ -225,6 +378,7 @@ void cgglobstrend(void);
 int cgcompare_and_set(int ASTop, int r1, int r2, int type);
 int cgcompare_and_jump(int ASTop, int r1, int r2, int label, int type);
 void cglabel(int l);
+void cgcoldlabel(int l);
 void cgjump(int l);
 int cgwiden(int r, int oldtype, int newtype);
 void cgreturn(int reg, struct symtable *sym);
@@ -250,6 +404,7 @@ int cgcast(int t, int oldtype, int newtype);
 // expr.c
 struct ASTnode *expression_list(int endtoken);
 struct ASTnode *binexpr(int ptp);
+struct ASTnode *expecthint(struct ASTnode *tree, int *hint);
 
 // stmt.c
 struct ASTnode *compound_statement(int inswitch);
@@ -267,12 +422,63 @@ void fatal(char *s);
 void fatals(char *s1, char *s2);
 void fatald(char *s, int d);
 void fatalc(char *s, int c);
+struct arena *newarena(void);
+void *arenaalloc(struct arena *a, int size);
+void resetarena(struct arena *a);
+void freearena(struct arena *a);
+struct context *new_context(void);
+void free_context(struct context *c);
+void use_symtables(struct context *c);
+
+// main.c
+/**
+ * @fn remove_tmpobjs
+ * @brief Remove any temporary object files
+ * @return void
+ */
+void remove_tmpobjs(void);
+
+/**
+ * @fn do_command
+ * @brief Run the compiler with the given arguments
+ * @param argc The number of arguments
+ * @param **argv The arguments
+ * @return 0
+ */
+int do_command(int argc, char **argv);
+
+/**
+ * @fn outputs
+ * @brief Return the files that do_command() has written
+ * @return The NULL-terminated list of file names, or NULL
+ */
+char **outputs(void);
+
+// server.c
+/**
+ * @fn serve
+ * @brief Run a compile server on a Unix domain socket
+ * @param path The socket's path
+ */
+void serve(char *path);
+
+/**
+ * @fn forward
+ * @brief Send the arguments to a compile server
+ * @param path The server's socket
+ * @param argc The number of arguments
+ * @param argv The arguments, including the program name
+ * @return The exit status of the compile, or -1
+ */
+int forward(char *path, int argc, char **argv);
 
 // sym.c
-void appendsym(struct symtable **head, struct symtable **tail,
-			   struct symtable *node);
+char *internid(char *s);
+void appendsym(struct symlist *list, struct symtable *node);
 struct symtable *newsym(char *name, int type, struct symtable *ctype,
 						int stype, int class, int nelems, int posn);
+void setinitval(char *list, int size, int i, int val);
+int getinitval(char *list, int size, int i);
 struct symtable *addglob(char *name, int type, struct symtable *ctype,
 						 int stype, int class, int nelems, int posn);
 struct symtable *addlocl(char *name, int type, struct symtable *ctype,
@@ -295,7 +501,10 @@ struct symtable *findenumtype(char *s);
 struct symtable *findenumval(char *s);
 struct symtable *findtypedef(char *s);
 void clear_symtable(void);
-void freeloclsyms(void);
+void clearparms(void);
+void clearmembs(void);
+void pushscope(struct symtable *func);
+void popscope(void);
 void freestaticsyms(void);
 void dumptable(struct symtable *head, char *name, int indent);
 void dumpsymtables(void);
@@ -319,3 +528,86 @@ struct ASTnode *modify_type(struct ASTnode *tree, int rtype,
 
 // opt.c
 struct ASTnode *optimise(struct ASTnode *n);
+
+// whole.c
+/**
+ * @fn wpadd
+ * @brief Keep the QBE code for a declaration in the current file
+ * @param text The QBE code
+ * @param len The length of the QBE code
+ */
+void wpadd(char *text, int len);
+
+/**
+ * @fn wpendfile
+ * @brief Give the current file's items their names in the program
+ */
+void wpendfile(void);
+
+/**
+ * @fn wpfinish
+ * @brief Translate the reachable items in the program into assembly code
+ * @param keepexports If true, keep everything that is exported
+ * @return 1, or 0 if QBE couldn't write the object itself
+ */
+int wpfinish(int keepexports);
+
+// trace.c
+/**
+ * @fn traceopen
+ * @brief Create the trace file
+ * @param name The name of the trace file
+ */
+void traceopen(char *name);
+
+/**
+ * @fn traceprocess
+ * @brief Name our process in the trace
+ * @param name The name for the process
+ * @param last True if this is the last event
+ */
+void traceprocess(char *name, int last);
+
+/**
+ * @fn traceclose
+ * @brief Close the trace file
+ */
+void traceclose(void);
+
+/**
+ * @fn tracebegin
+ * @brief Note that a stage of the compile begins
+ * @param name The name of the stage
+ * @param cat The kind of stage, e.g. "file" or "function"
+ */
+void tracebegin(char *name, char *cat);
+
+/**
+ * @fn traceend
+ * @brief Note that the most recent stage of the compile ends
+ */
+void traceend(void);
+
+/**
+ * @fn tracespawn
+ * @brief Note that we started a command
+ * @param pid The command's process id
+ * @param args The command and its arguments, ending with NULL
+ */
+void tracespawn(int pid, char **args);
+
+/**
+ * @fn tracewait
+ * @brief Write an event for a command that has finished
+ * @param pid The command's process id
+ * @param wstatus The command's wait status
+ * @param maxrss The command's peak memory use in kilobytes
+ */
+void tracewait(int pid, int wstatus, long maxrss);
+
+// lib/qbe/main.c
+int qbe_init(char *tgt);
+void qbe_translate(FILE *inf, char *path, FILE *outf);
+void qbe_finish(FILE *outf);
+int qbe_objbegin(char *file);
+int qbe_objend(FILE *outf);
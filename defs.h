@@ -16,15 +16,20 @@
 
 
 enum {
-  TEXTLEN = 512			// Length of identifiers in input
+  TEXTLEN = 512,		// Length of identifiers in input
+  BUILTINMAX = 128		// Biggest memcpy() or memset() done inline
 };
 
-// Commands and default filenames
+// Commands and default filenames. The commands are
+// run without a shell, split into words at the spaces
 #define AOUT "a.out"
 #define ASCMD "as -g -o "
-#define QBECMD "qbe -o "
 #define LDCMD "cc -g -no-pie -o "
+#define RTLDCMD "ld -u _start -o "	// -static, with RTLIB after the objects
 #define CPPCMD "cpp -nostdinc -isystem "
+#define TMPOBJ "/tmp/minicXXXXXX.o"
+#define TMPRSP "/tmp/minicXXXXXX.rsp"
+#define CACHESIZE 104857600	// Default cache size, 100MB
 
 // Token types
 enum {
@@ -56,7 +61,13 @@ enum {
   T_INTLIT, T_STRLIT, T_SEMI, T_IDENT,		// 51
   T_LBRACE, T_RBRACE, T_LPAREN, T_RPAREN,	// 55
   T_LBRACKET, T_RBRACKET, T_COMMA, T_DOT,	// 59
-  T_ARROW, T_COLON				// 63
+  T_ARROW, T_COLON,				// 63
+
+  // File named by an #embed, made by the preprocessor
+  T_EMBED,					// 65
+
+  // Only seen by the preprocessor
+  T_HASH, T_LEXERR				// 66
 };
 
 // Token structure
@@ -64,6 +75,86 @@ struct token {
   int token;			// Token type, from the enum list above
   char *tokstr;			// String version of the token
   int intvalue;			// For T_INTLIT, the integer value
+  char *name;			// For T_IDENT, the interned name
+};
+
+// Token from the integrated preprocessor
+struct pptoken {
+  int token;			// Token type, from the enum list above
+  int intvalue;			// For T_INTLIT, the integer value. In a
+				// macro body, a T_IDENT's parameter
+				// number, or zero if not a parameter
+  char *text;			// Identifier or string text, else tokstr.
+				// For T_LEXERR, the error message
+  char *file;			// File and line number of the token
+  int line;
+  int bol;			// True if first token on its line
+  int space;			// True if whitespace came before it
+  int noexpand;			// True if never to be macro expanded
+  struct pptoken *next;		// Next token in the list
+};
+
+// List of preprocessor tokens
+struct pplist {
+  struct pptoken *head;
+  struct pptoken *tail;
+};
+
+// Position in a list of preprocessor tokens
+struct ppread {
+  struct pptoken *cur;		// Next token to read
+  struct pptoken *end;		// Token after the last one, or NULL
+};
+
+// Preprocessor macro
+struct ppmacro {
+  char *name;			// Name of the macro
+  int nparams;			// Number of parameters, or -1 if
+				// not a function-like macro
+  struct pptoken *body;		// Replacement tokens
+  int busy;			// True while being expanded
+  struct ppmacro *next;		// Next macro in the list
+};
+
+// Source file tokenised by the preprocessor
+struct ppfile {
+  char *name;			// Name of the file
+  struct pptoken *head;		// Tokens in the file
+  struct pptoken *eof;		// T_EOF token at its end
+  struct ppfile *next;		// Next file in the cache
+};
+
+// A function or piece of data in the QBE
+// code for the whole program, with -fwhole-program
+struct wpitem {
+  char *name;			// The name that it defines
+  char *text;			// Its QBE code
+  int len;			// Length of the QBE code
+  char *file;			// Source file that it came from
+  int exported;			// True if other files can use it
+  int live;			// True if it can be reached from main()
+  struct wpitem *next;		// Next item in the program
+  struct wpitem *hnext;		// Next item in the same hash chain
+  struct wpitem *work;		// Next item to look at when marking
+};
+
+// A command that we started, with --trace
+struct tracecmd {
+  int pid;			// Its process id
+  long start;			// When it started, in microseconds
+  char *name;			// The program that it runs
+  char *cmd;			// Its command line
+  struct tracecmd *next;	// Next command still running
+};
+
+// A SHA-256 digest being built, for the cache key
+struct digest {
+  long *h;			// The eight 32-bit words of the hash
+  long *w;			// The schedule for the current block
+  char *block;			// The block being filled
+  int len;			// Number of bytes in the block
+  long total;			// Number of bytes added so far
+  long mask;			// 0xffffffff, which an int can't hold
 };
 
 // AST node types. The first few line up
@@ -79,7 +170,16 @@ enum {
   A_FUNCCALL, A_DEREF, A_ADDR, A_SCALE,				// 35
   A_PREINC, A_PREDEC, A_POSTINC, A_POSTDEC,			// 39
   A_NEGATE, A_INVERT, A_LOGNOT, A_TOBOOL, A_BREAK,		// 43
-  A_CONTINUE, A_SWITCH, A_CASE, A_DEFAULT, A_CAST		// 48
+  A_CONTINUE, A_SWITCH, A_CASE, A_DEFAULT, A_CAST,		// 48
+  A_EXPECT							// 53
+};
+
+// Branch hints from __builtin_expect(), kept
+// in the a_intvalue of A_IF, A_WHILE and
+// A_TERNARY nodes. H_UNLIKELY means that the
+// condition is expected to be false
+enum {
+  H_NONE, H_LIKELY, H_UNLIKELY
 };
 
 // Primitive types. The bottom 4 bits is an integer
@@ -123,25 +223,33 @@ struct symtable {
 #define st_hasaddr  st_posn	// For locals, 1 if any A_ADDR operation
   int st_posn;			// For struct members, the offset of
     				// the member from the base of the struct
-  int *initlist;		// List of initial values
+  char *initlist;		// List of initial values, packed at
+  				// the size of one element
   struct symtable *next;	// Next symbol in one list
+  struct symtable *hnext;	// Next symbol in the same hash chain
   struct symtable *member;	// First member of a function, struct,
 };				// union or enum
 
-// Abstract Syntax Tree structure
+// Abstract Syntax Tree structure. The child pointers come
+// last and a node is only allocated with as many of them
+// as it has: leaves have none, unary nodes only a left,
+// binary nodes a left and a right, and only A_IF and
+// A_TERNARY nodes have a mid. Use nkids to walk a node
+// whose op isn't known
 struct ASTnode {
-  int op;			// "Operation" to be performed on this tree
+  char op;			// "Operation" to be performed on this tree
+  char rvalue;			// True if the node is an rvalue
+  char nkids;			// Number of child pointers in this node
   int type;			// Type of any expression this tree generates
-  struct symtable *ctype;	// If struct/union, ptr to that type
-  int rvalue;			// True if the node is an rvalue
-  struct ASTnode *left;		// Left, middle and right child trees
-  struct ASTnode *mid;
-  struct ASTnode *right;
-  struct symtable *sym;		// For many AST nodes, the pointer to
-  				// the symbol in the symbol table
 #define a_intvalue a_size	// For A_INTLIT, the integer value
   int a_size;			// For A_SCALE, the size to scale by
   int linenum;			// Line number from where this node comes
+  struct symtable *ctype;	// If struct/union, ptr to that type
+  struct symtable *sym;		// For many AST nodes, the pointer to
+  				// the symbol in the symbol table
+  struct ASTnode *left;		// Left, right and middle child trees
+  struct ASTnode *right;
+  struct ASTnode *mid;
 };
 
 enum {
@@ -150,3 +258,131 @@ enum {
   NOLABEL = 0			// Use NOLABEL when we have no label to
     				// pass to genAST()
 };
+
+// A block of memory in an arena
+struct arenablock {
+  char *mem;			// The memory in the block
+  struct arenablock *next;	// The block allocated before this one
+};
+
+// An arena hands out memory in pieces from big blocks,
+// and all of it is freed at once when the arena is reset
+struct arena {
+  struct arenablock *blocks;	// The blocks, newest first
+  int used;			// Bytes used in the newest block
+  int size;			// Size of the newest block
+};
+
+// A list of symbols, kept in the order they were added,
+// with a hash table on the symbol names to find them by
+struct symlist {
+  struct symtable *head;	// First symbol in the list
+  struct symtable *tail;	// Last symbol in the list
+  struct symtable **hash;	// Hash chains, or NULL if not made yet
+  int nbuckets;			// Number of hash chains, a power of 2
+  int count;			// Number of symbols in the list
+};
+
+// The state of the compiler while it compiles one
+// translation unit. All the parsing, scanning and
+// code generation work on the context in Ctx, so
+// each file gets a fresh one from new_context()
+struct context {
+  // Input and output
+  char *infilename;		// Name of file we are parsing
+  char *outfilename;		// Output file to remove on an error
+  FILE *outfile;		// QBE code for the current declaration
+  FILE *asmfile;		// Assembly output written by QBE
+  int aspid;			// Assembler reading asmfile, or zero
+  int elfobj;			// True if QBE writes asmfile as an object
+  int needas;			// True if QBE couldn't, so run as after all
+  char *cachename;		// Where to cache the output, or NULL
+  char **deps;			// Files included by the source file
+  int ndeps;			// Number of files in deps
+  int depsize;			// Number of entries allocated in deps
+  struct pptoken *pptokens;	// Tokens from the integrated pre-processor
+
+  // Scanner
+  char *inbuf;			// The whole input, read in or mapped
+  int inpos;			// Position of the next character in inbuf
+  int inlen;			// Number of characters in inbuf
+  int inmapped;			// True if inbuf was mmap()ed
+  int line;			// Current line number
+  int linestart;		// True if at start of a line
+  int putback;			// Character put back by scanner
+  struct token *token;		// Last token scanned
+  struct token *peektoken;	// A look-ahead token
+  char *text;			// Last identifier or string scanned
+  char *ident;			// Last identifier scanned, interned
+  int rawscan;			// True if scanning for the pre-processor
+  int sawnewline;		// Skipped a newline before this token
+  int sawspace;			// Skipped whitespace before this token
+  int tokline;			// Line that this token started on
+  char *lexerrmsg;		// First lexical error found, or NULL
+  int lexerrchar;		// Character for the error, or zero
+  int lexerrline;		// Line number of the error
+  struct pptoken *lastpp;	// Last pp token if it read ahead
+  struct token *rawtoken;	// Token scanned for the pre-processor
+
+  // Integrated pre-processor
+  struct ppmacro *ppmacros;	// Macros defined so far
+  struct ppread *ppsrc;		// Position in the current file
+  struct pplist *ppout;		// Tokens for the parser
+  struct pptoken *ppexpr;	// Position in an #if expression
+  int ppdepth;			// Depth of nested #includes
+  char *ppfailed;		// Why we need the external cpp
+  struct context *ppsnap;	// Context that parsed the headers
+				// that the file starts from
+
+  // Parser
+  struct symtable *functionid;	// Symbol ptr of the current function
+  int looplevel;		// Depth of nested loops
+  int switchlevel;		// Depth of nested switches
+  int strlabel;			// Label of the last string literal
+  int strlength;		// Length of the last string literal
+
+  // Symbol table lists
+  struct symlist *globsyms;	// Global variables and functions
+  struct symlist *loclsyms;	// Local variables
+  struct symlist *parmsyms;	// Local parameters
+  struct symlist *membsyms;	// Temp list of struct/union members
+  struct symlist *structsyms;	// List of struct types
+  struct symlist *unionsyms;	// List of union types
+  struct symlist *enumsyms;	// List of enum types and values
+  struct symlist *typesyms;	// List of typedefs
+
+  // Memory
+  struct arena *funcarena;	// AST nodes and locals of this function
+  struct arena *tuarena;	// Other symbols for the whole file
+  struct ASTnode **nodestack;	// Stack for the AST tree walkers
+  int nodecount;		// Number of nodes on the stack
+  int nodemax;			// Room on the stack
+
+  // Code generation
+  int labelid;			// Next label number
+  int nexttemp;			// Last QBE temporary allocated
+  int genline;			// Line of the code being generated
+  int used_switch;		// Has this function used a switch yet?
+  int usedctype;		// Has this file used the ctype table?
+  char **qbebuf;		// QBE code for the current declaration,
+  size_t *qbelen;		// and its length, kept by outfile
+  FILE *qbein;			// The buffer being read by QBE
+  char *qbefunc;		// Function in the buffer, for --trace
+  FILE *keepfile;		// All the QBE code, in case we need as
+  char **keepbuf;		// The code kept by keepfile,
+  size_t *keeplen;		// and its length
+  char *keepname;		// Source file name for the assembler
+  int dumpid;			// Next label number for AST dumps
+};
+
+// The macros and symbols from parsing a run of system
+// headers, kept by the compile server for the files
+// that start by including them
+struct ppsnap {
+  char **headers;		// Names of the headers, in order
+  int nheaders;			// Number of headers
+  struct context *ctx;		// The context that parsed them, with
+				// their tokens and a T_EOF in ppout
+  int used;			// True once a file has started from it
+  struct ppsnap *next;		// Next snapshot in the list
+};
@@ -0,0 +1,179 @@
+/**
+ * @file deps.c
+ * @author BrunchTea
+ * @brief Dependency files for make
+ */
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+// Dependency files for make.
+//
+// With -MD, we note each file that a source file includes as
+// it is pre-processed. The integrated pre-processor tells us
+// about each #include. With cpp, we find the files from the
+// line markers in its output. After the file is
+// compiled, we write a rule like "foo.o: foo.c foo.h" to a .d
+// file, so make can rebuild only what a header change affects.
+
+// Add a file to the list of files that
+// the current source file depends on
+/**
+ * @fn adddep
+ * @brief Add a file to the dependencies of the current source file
+ * @param name The name of the file
+ */
+void adddep(char *name)
+{
+  int i;
+
+  for (i = 0; i < Ctx->ndeps; i++)
+    if (!strcmp(Ctx->deps[i], name))
+      return;
+  if (Ctx->ndeps == Ctx->depsize)
+  {
+    Ctx->depsize = Ctx->depsize * 2 + 16;
+    Ctx->deps =
+      (char **)realloc(Ctx->deps, Ctx->depsize * sizeof(char *));
+    if (Ctx->deps == NULL)
+      fatal("Unable to malloc in adddep()");
+  }
+  Ctx->deps[Ctx->ndeps] = name;
+  Ctx->ndeps = Ctx->ndeps + 1;
+}
+
+// If the line at s, with len characters left in the
+// input, is a line marker from cpp, add the file that
+// it names. These look like: # 12 "file.h" 2
+/**
+ * @fn depmarker
+ * @brief Add the file named by a line marker
+ * @param s The start of the line
+ * @param len The number of characters left in the input
+ */
+static void depmarker(char *s, int len)
+{
+  char *name;
+  int i = 1, start;
+
+  while (i < len && s[i] == ' ')
+    i++;
+  if (i == len || s[i] < '0' || s[i] > '9')
+    return;
+  while (i < len && s[i] >= '0' && s[i] <= '9')
+    i++;
+  while (i < len && s[i] == ' ')
+    i++;
+  if (i == len || s[i] != '"')
+    return;
+  start = i + 1;
+  i = start;
+  while (i < len && s[i] != '"' && s[i] != '\n')
+    i++;
+
+  // Skip names like <built-in>
+  if (i == len || s[i] != '"' || i == start || s[start] == '<')
+    return;
+  name = (char *)arenaalloc(Ctx->tuarena, i - start + 1);
+  for (len = 0; start + len < i; len++)
+    name[len] = s[start + len];
+  name[len] = '\0';
+  adddep(name);
+}
+
+// Find the files named in the line markers
+// that cpp left in the scanner's input buffer
+/**
+ * @fn scandeps
+ * @brief Add the files named in the line markers in the input
+ */
+void scandeps(void)
+{
+  int i = 0;
+
+  while (i < Ctx->inlen)
+  {
+    if (Ctx->inbuf[i] == '#')
+      depmarker(Ctx->inbuf + i, Ctx->inlen - i);
+
+    // Move up to the next line
+    while (i < Ctx->inlen && Ctx->inbuf[i] != '\n')
+      i++;
+    i++;
+  }
+}
+
+// Copy a file name into buf at posn, escaped for
+// make. Return the new position in buf
+/**
+ * @fn depcopy
+ * @brief Copy a file name into a buffer, escaped for make
+ * @param buf The buffer
+ * @param posn Where to put the name in the buffer
+ * @param name The file name
+ * @return The position after the name
+ */
+static int depcopy(char *buf, int posn, char *name)
+{
+  char *s;
+
+  for (s = name; *s != '\0'; s++)
+  {
+    if (*s == ' ' || *s == '\t' || *s == '#' || *s == '\\')
+      buf[posn++] = '\\';
+    else if (*s == '$')
+      buf[posn++] = '$';
+    buf[posn++] = *s;
+  }
+  return (posn);
+}
+
+// Write the make rule for the current source file to the
+// file depname: the target depends on the source file and
+// on each file that it included
+/**
+ * @fn writedeps
+ * @brief Write the make rule for the current source file
+ * @param depname The name of the dependency file
+ * @param target The target of the rule
+ * @param filename The name of the source file
+ */
+void writedeps(char *depname, char *target, char *filename)
+{
+  char *buf;
+  int i, fd, len;
+
+  // Each character may need escaping, and each
+  // name needs a space and a line continuation
+  len = 2 * (int)strlen(target) + 2 * (int)strlen(filename) + 8;
+  for (i = 0; i < Ctx->ndeps; i++)
+    len = len + 2 * (int)strlen(Ctx->deps[i]) + 4;
+  buf = (char *)malloc(len);
+  if (buf == NULL)
+    fatal("Unable to malloc in writedeps()");
+
+  len = depcopy(buf, 0, target);
+  buf[len++] = ':';
+  buf[len++] = ' ';
+  len = depcopy(buf, len, filename);
+  for (i = 0; i < Ctx->ndeps; i++)
+  {
+    if (strcmp(Ctx->deps[i], filename))
+    {
+      buf[len++] = ' ';
+      buf[len++] = '\\';
+      buf[len++] = '\n';
+      buf[len++] = ' ';
+      len = depcopy(buf, len, Ctx->deps[i]);
+    }
+  }
+  buf[len++] = '\n';
+
+  if ((fd = creat(depname, 0644)) == -1)
+    fatals("Unable to create", depname);
+  if (write(fd, buf, len) != len || close(fd) == -1)
+    fatals("Unable to write", depname);
+  free(buf);
+}
@@ -34,7 +34,7 @@ struct ASTnode *expression_list(int endtoken) {
   int exprcount = 0;
 
   // Loop until the end token
-  while (Token.token != endtoken) {
+  while (Ctx->token->token != endtoken) {
 
     // Parse the next expression and increment the expression count
     child = binexpr(0);
@@ -46,7 +46,7 @@ struct ASTnode *expression_list(int endtoken) {
       mkastnode(A_GLUE, P_NONE, NULL, tree, NULL, child, NULL, exprcount);
 
     // Stop when we reach the end token
-    if (Token.token == endtoken)
+    if (Ctx->token->token == endtoken)
       break;
 
     // Must have a ',' at this point
@@ -69,8 +69,8 @@ static struct ASTnode *funccall(void) {
 
   // Check that the identifier has been defined as a function,
   // then make a leaf node for it.
-  if ((funcptr = findsymbol(Text)) == NULL || funcptr->stype != S_FUNCTION) {
-    fatals("Undeclared function", Text);
+  if ((funcptr = findsymbol(Ctx->ident)) == NULL || funcptr->stype != S_FUNCTION) {
+    fatals("Undeclared function", Ctx->text);
   }
   // Get the '('
   lparen();
@@ -80,6 +80,15 @@ static struct ASTnode *funccall(void) {
 
   // XXX Check type of each argument against the function's prototype
 
+  // strlen() of a string literal is a builtin,
+  // and it is the length of the last literal
+  if (!O_nobuiltin && !strcmp(funcptr->name, "strlen") && tree != NULL &&
+      tree->left == NULL && tree->right->op == A_STRLIT &&
+      tree->right->a_intvalue == Ctx->strlabel) {
+    rparen();
+    return (mkastleaf(A_INTLIT, funcptr->type, NULL, NULL, Ctx->strlength));
+  }
+
   // Build the function call AST node. Store the
   // function's return type as this node's type.
   // Also record the function's symbol-id
@@ -91,6 +100,60 @@ static struct ASTnode *funccall(void) {
   return (tree);
 }
 
+// Parse a __builtin_expect(expression, value) call and
+// return an A_EXPECT node with the expression as its child.
+// The value, which the expression is most likely to have,
+// has to be an integer constant. The identifier is in Text
+/**
+ * @fn builtin_expect
+ * @brief Parse a __builtin_expect() call
+ * @return An AST node for the call
+*/
+static struct ASTnode *builtin_expect(void) {
+  struct ASTnode *tree, *value;
+
+  // Skip the name and get the '('
+  scan(Ctx->token);
+  lparen();
+
+  // Get the expression, the ',' and the value
+  tree = binexpr(0);
+  comma();
+  value = optimise(binexpr(0));
+  if (value->op != A_INTLIT)
+    fatal("__builtin_expect() needs an integer constant");
+
+  // Get the ')'
+  rparen();
+  tree = mkastunary(A_EXPECT, tree->type, tree->ctype, tree, NULL,
+		    value->a_intvalue);
+  tree->rvalue = 1;
+  return (tree);
+}
+
+// If the condition tree is a __builtin_expect() call,
+// set *hint to the branch hint that it gives and return
+// the expression in the call. Otherwise set *hint to
+// H_NONE and return the tree as it is
+/**
+ * @fn expecthint
+ * @brief Get the branch hint for a condition
+ * @param tree The AST tree for the condition
+ * @param hint Where to put the hint
+ * @return The AST tree for the condition without any hint
+*/
+struct ASTnode *expecthint(struct ASTnode *tree, int *hint) {
+  if (tree->op != A_EXPECT) {
+    *hint = H_NONE;
+    return (tree);
+  }
+  if (tree->a_intvalue == 0)
+    *hint = H_UNLIKELY;
+  else
+    *hint = H_LIKELY;
+  return (tree->left);
+}
+
 // Parse the index into an array and return an AST tree for it
 /**
  * @fn array_access
@@ -106,7 +169,7 @@ static struct ASTnode *array_access(struct ASTnode *left) {
     fatal("Not an array or pointer");
 
   // Get the '['
-  scan(&Token);
+  scan(Ctx->token);
 
   // Parse the following expression
   right = binexpr(0);
@@ -158,7 +221,7 @@ static struct ASTnode *member_access(struct ASTnode *left, int withpointer) {
   // we get the base address, not the value at this address.
   if (!withpointer) {
     if (left->type == P_STRUCT || left->type == P_UNION)
-      left->op = A_ADDR;
+      left->op = (char) A_ADDR;
     else
       fatal("Expression is not a struct/union");
   }
@@ -166,16 +229,16 @@ static struct ASTnode *member_access(struct ASTnode *left, int withpointer) {
   typeptr = left->ctype;
 
   // Skip the '.' or '->' token and get the member's name
-  scan(&Token);
+  scan(Ctx->token);
   ident();
 
   // Find the matching member's name in the type
   // Die if we can't find it
   for (m = typeptr->member; m != NULL; m = m->next)
-    if (!strcmp(m->name, Text))
+    if (m->name == Ctx->ident)
       break;
   if (m == NULL)
-    fatals("No member found in struct/union: ", Text);
+    fatals("No member found in struct/union: ", Ctx->text);
 
   // Make the left tree an rvalue
   left->rvalue = 1;
@@ -206,14 +269,14 @@ static struct ASTnode *paren_expression(int ptp) {
   struct symtable *ctype = NULL;
 
   // Beginning of a parenthesised expression, skip the '('.
-  scan(&Token);
+  scan(Ctx->token);
 
   // If the token after is a type identifier, this is a cast expression
-  switch (Token.token) {
+  switch (Ctx->token->token) {
     case T_IDENT:
       // We have to see if the identifier matches a typedef.
       // If not, treat it as an expression.
-      if (findtypedef(Text) == NULL) {
+      if (findtypedef(Ctx->ident) == NULL) {
 	n = binexpr(0);		// ptp is zero as expression inside ( )
 	break;
       }
@@ -263,16 +326,16 @@ static struct ASTnode *primary(int ptp) {
   int size, class;
   struct symtable *ctype;
 
-  switch (Token.token) {
+  switch (Ctx->token->token) {
     case T_STATIC:
     case T_EXTERN:
       fatal("Compiler doesn't support static or extern local declarations");
     case T_SIZEOF:
       // Skip the T_SIZEOF and ensure we have a left parenthesis
-      scan(&Token);
-      if (Token.token != T_LPAREN)
+      scan(Ctx->token);
+      if (Ctx->token->token != T_LPAREN)
 	fatal("Left parenthesis expected after sizeof");
-      scan(&Token);
+      scan(Ctx->token);
 
       // Get the type inside the parentheses
       type = parse_stars(parse_type(&ctype, &class));
@@ -287,24 +350,28 @@ static struct ASTnode *primary(int ptp) {
     case T_INTLIT:
       // For an INTLIT token, make a leaf AST node for it.
       // Make it a P_CHAR if it's within the P_CHAR range
-      if (Token.intvalue >= 0 && Token.intvalue < 256)
-	n = mkastleaf(A_INTLIT, P_CHAR, NULL, NULL, Token.intvalue);
+      if (Ctx->token->intvalue >= 0 && Ctx->token->intvalue < 256)
+	n = mkastleaf(A_INTLIT, P_CHAR, NULL, NULL, Ctx->token->intvalue);
       else
-	n = mkastleaf(A_INTLIT, P_INT, NULL, NULL, Token.intvalue);
+	n = mkastleaf(A_INTLIT, P_INT, NULL, NULL, Ctx->token->intvalue);
       break;
 
     case T_STRLIT:
       // For a STRLIT token, generate the assembly for it.
-      id = genglobstr(Text, 0);
+      // Remember its label and length for strlen()
+      id = genglobstr(Ctx->text, 0);
+      Ctx->strlabel = id;
+      Ctx->strlength = (int) strlen(Ctx->text);
 
       // For successive STRLIT tokens, append their contents
       // to this one
       while (1) {
-	scan(&Peektoken);
-	if (Peektoken.token != T_STRLIT)
+	scan(Ctx->peektoken);
+	if (Ctx->peektoken->token != T_STRLIT)
 	  break;
-	genglobstr(Text, 1);
-	scan(&Token);		// To skip it properly
+	genglobstr(Ctx->text, 1);
+	Ctx->strlength = Ctx->strlength + (int) strlen(Ctx->text);
+	scan(Ctx->token);		// To skip it properly
       }
 
       // Now make a leaf AST node for it. id is the string's label.
@@ -315,13 +382,16 @@ static struct ASTnode *primary(int ptp) {
     case T_IDENT:
       // If the identifier matches an enum value,
       // return an A_INTLIT node
-      if ((enumptr = findenumval(Text)) != NULL) {
+      if ((enumptr = findenumval(Ctx->ident)) != NULL) {
 	n = mkastleaf(A_INTLIT, P_INT, NULL, NULL, enumptr->st_posn);
 	break;
       }
       // See if this identifier exists as a symbol. For arrays, set rvalue to 1.
-      if ((varptr = findsymbol(Text)) == NULL)
-	fatals("Unknown variable or function", Text);
+      if ((varptr = findsymbol(Ctx->ident)) == NULL) {
+	if (!strcmp(Ctx->ident, "__builtin_expect"))
+	  return (builtin_expect());
+	fatals("Unknown variable or function", Ctx->text);
+      }
       switch (varptr->stype) {
 	case S_VARIABLE:
 	  n = mkastleaf(A_IDENT, varptr->type, varptr->ctype, varptr, 0);
@@ -332,12 +402,12 @@ static struct ASTnode *primary(int ptp) {
 	  break;
 	case S_FUNCTION:
 	  // Function call, see if the next token is a left parenthesis
-	  scan(&Token);
-	  if (Token.token != T_LPAREN)
-	    fatals("Function name used without parentheses", Text);
+	  scan(Ctx->token);
+	  if (Ctx->token->token != T_LPAREN)
+	    fatals("Function name used without parentheses", Ctx->text);
 	  return (funccall());
 	default:
-	  fatals("Identifier not a scalar or array variable", Text);
+	  fatals("Identifier not a scalar or array variable", Ctx->text);
       }
 
       break;
@@ -346,11 +416,11 @@ static struct ASTnode *primary(int ptp) {
       return (paren_expression(ptp));
 
     default:
-      fatals("Expecting a primary expression, got token", Token.tokstr);
+      fatals("Expecting a primary expression, got token", Ctx->token->tokstr);
   }
 
   // Scan in the next token and return the leaf node
-  scan(&Token);
+  scan(Ctx->token);
   return (n);
 }
 
@@ -371,7 +441,7 @@ static struct ASTnode *postfix(int ptp) {
 
   // Loop until there are no more postfix operators
   while (1) {
-    switch (Token.token) {
+    switch (Ctx->token->token) {
       case T_LBRACKET:
 	// An array reference
 	n = array_access(n);
@@ -391,28 +461,28 @@ static struct ASTnode *postfix(int ptp) {
 	// Post-increment: skip over the token
 	if (n->rvalue == 1)
 	  fatal("Cannot ++ on rvalue");
-	scan(&Token);
+	scan(Ctx->token);
 
 	// Can't do it twice
 	if (n->op == A_POSTINC || n->op == A_POSTDEC)
 	  fatal("Cannot ++ and/or -- more than once");
 
 	// and change the AST operation
-	n->op = A_POSTINC;
+	n->op = (char) A_POSTINC;
 	break;
 
       case T_DEC:
 	// Post-decrement: skip over the token
 	if (n->rvalue == 1)
 	  fatal("Cannot -- on rvalue");
-	scan(&Token);
+	scan(Ctx->token);
 
 	// Can't do it twice
 	if (n->op == A_POSTINC || n->op == A_POSTDEC)
 	  fatal("Cannot ++ and/or -- more than once");
 
 	// and change the AST operation
-	n->op = A_POSTDEC;
+	n->op = (char) A_POSTDEC;
 	break;
 
       default:
@@ -509,11 +579,11 @@ static int op_precedence(int tokentype) {
 */
 static struct ASTnode *prefix(int ptp) {
   struct ASTnode *tree = NULL;
-  switch (Token.token) {
+  switch (Ctx->token->token) {
     case T_AMPER:
       // Get the next token and parse it
       // recursively as a prefix expression
-      scan(&Token);
+      scan(Ctx->token);
       tree = prefix(ptp);
 
       // Ensure that it's an identifier
@@ -527,7 +597,7 @@ static struct ASTnode *prefix(int ptp) {
       // Now change the operator to A_ADDR and the type to
       // a pointer to the original type. Mark the identifier
       // as needing a real memory address
-      tree->op = A_ADDR;
+      tree->op = (char) A_ADDR;
       tree->type = pointer_to(tree->type);
       tree->sym->st_hasaddr = 1;
       break;
@@ -535,7 +605,7 @@ static struct ASTnode *prefix(int ptp) {
       // Get the next token and parse it
       // recursively as a prefix expression.
       // Make it an rvalue
-      scan(&Token);
+      scan(Ctx->token);
       tree = prefix(ptp);
       tree->rvalue = 1;
 
@@ -550,7 +620,7 @@ static struct ASTnode *prefix(int ptp) {
     case T_MINUS:
       // Get the next token and parse it
       // recursively as a prefix expression
-      scan(&Token);
+      scan(Ctx->token);
       tree = prefix(ptp);
 
       // Prepend a A_NEGATE operation to the tree and
@@ -564,7 +634,7 @@ static struct ASTnode *prefix(int ptp) {
     case T_INVERT:
       // Get the next token and parse it
       // recursively as a prefix expression
-      scan(&Token);
+      scan(Ctx->token);
       tree = prefix(ptp);
 
       // Prepend a A_INVERT operation to the tree and
@@ -575,7 +645,7 @@ static struct ASTnode *prefix(int ptp) {
     case T_LOGNOT:
       // Get the next token and parse it
       // recursively as a prefix expression
-      scan(&Token);
+      scan(Ctx->token);
       tree = prefix(ptp);
 
       // Prepend a A_LOGNOT operation to the tree and
@@ -586,7 +656,7 @@ static struct ASTnode *prefix(int ptp) {
     case T_INC:
       // Get the next token and parse it
       // recursively as a prefix expression
-      scan(&Token);
+      scan(Ctx->token);
       tree = prefix(ptp);
 
       // For now, ensure it's an identifier
@@ -599,7 +669,7 @@ static struct ASTnode *prefix(int ptp) {
     case T_DEC:
       // Get the next token and parse it
       // recursively as a prefix expression
-      scan(&Token);
+      scan(Ctx->token);
       tree = prefix(ptp);
 
       // For now, ensure it's an identifier
@@ -628,13 +698,14 @@ struct ASTnode *binexpr(int ptp) {
   struct ASTnode *ltemp, *rtemp;
   int ASTop;
   int tokentype;
+  int hint;
 
   // Get the tree on the left.
   // Fetch the next token at the same time.
   left = prefix(ptp);
 
   // If we hit one of several terminating tokens, return just the left node
-  tokentype = Token.token;
+  tokentype = Ctx->token->token;
   if (tokentype == T_SEMI || tokentype == T_RPAREN ||
       tokentype == T_RBRACKET || tokentype == T_COMMA ||
       tokentype == T_COLON || tokentype == T_RBRACE) {
@@ -647,7 +718,7 @@ struct ASTnode *binexpr(int ptp) {
   while ((op_precedence(tokentype) > ptp) ||
 	 (rightassoc(tokentype) && op_precedence(tokentype) == ptp)) {
     // Fetch in the next integer literal
-    scan(&Token);
+    scan(Ctx->token);
 
     // Recursively call binexpr() with the
     // precedence of our token to build a sub-tree
@@ -664,10 +735,11 @@ struct ASTnode *binexpr(int ptp) {
 
 	// Build and return the AST for this statement. Use the middle
 	// expression's type as the return type. XXX We should also
-	// consider the third expression's type.
+	// consider the third expression's type. Keep any branch hint
+	left = expecthint(left, &hint);
 	return (mkastnode
 		(A_TERNARY, right->type, right->ctype, left, right, ltemp,
-		 NULL, 0));
+		 NULL, hint));
 
       case A_ASSIGN:
 	// Assignment
@@ -726,7 +798,7 @@ struct ASTnode *binexpr(int ptp) {
 
     // Update the details of the current token.
     // If we hit a terminating token, return just the left node
-    tokentype = Token.token;
+    tokentype = Ctx->token->token;
     if (tokentype == T_SEMI || tokentype == T_RPAREN ||
 	tokentype == T_RBRACKET || tokentype == T_COMMA ||
 	tokentype == T_COLON || tokentype == T_RBRACE) {
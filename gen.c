@@ -15,10 +15,10 @@
  * @brief Generate and return a new label number
  * @return A new label number
  */
-static int labelid = 1;
 int genlabel(void)
 {
-  return (labelid++);
+  Ctx->labelid = Ctx->labelid + 1;
+  return (Ctx->labelid - 1);
 }
 
 /**
@@ -30,11 +30,13 @@ int genlabel(void)
 static void update_line(struct ASTnode *n)
 {
   // Output the line into the assembly if we've
-  // changed the line number in the AST node
-  if (n->linenum != 0 && Line != n->linenum)
+  // changed the line number in the AST node.
+  // Ctx->line belongs to the scanner, which has
+  // moved on past the function by now
+  if (n->linenum != 0 && Ctx->genline != n->linenum)
   {
-    Line = n->linenum;
-    cglinenum(Line);
+    Ctx->genline = n->linenum;
+    cglinenum(Ctx->genline);
   }
 }
 
@@ -68,7 +70,10 @@ static int genIF(struct ASTnode *n, int looptoplabel, int loopendlabel)
   r2 = cgloadint(1, P_INT);
   cgcompare_and_jump(A_EQ, r, r2, Lfalse, P_INT);
 
-  // Generate the true compound statement
+  // Generate the true compound statement,
+  // out of line if it is unlikely to run
+  if (n->a_intvalue == H_UNLIKELY)
+    cgcoldlabel(genlabel());
   genAST(n->mid, NOLABEL, looptoplabel, loopendlabel, n->op);
 
   // If there is an optional ELSE clause,
@@ -81,8 +86,12 @@ static int genIF(struct ASTnode *n, int looptoplabel, int loopendlabel)
     cglabel(genlabel());
     cgjump(Lend);
   }
-  // Now the false label
-  cglabel(Lfalse);
+  // Now the false label. The ELSE clause is
+  // unlikely to run if the condition is likely
+  if (n->right && n->a_intvalue == H_LIKELY)
+    cgcoldlabel(Lfalse);
+  else
+    cglabel(Lfalse);
 
   // Optional ELSE clause: generate the
   // false compound statement and the
@@ -120,7 +129,10 @@ static int genWHILE(struct ASTnode *n)
   r2 = cgloadint(1, P_INT);
   cgcompare_and_jump(A_EQ, r, r2, Lend, P_INT);
 
-  // Generate the compound statement for the body
+  // Generate the compound statement for the body,
+  // out of line if it is unlikely to run
+  if (n->a_intvalue == H_UNLIKELY)
+    cgcoldlabel(genlabel());
   genAST(n->right, NOLABEL, Lstart, Lend, n->op);
 
   // Finally output the jump back to the condition,
@@ -146,9 +158,8 @@ static int genSWITCH(struct ASTnode *n)
   struct ASTnode *c;
 
   // Create an array for the case labels
-  caselabel = (int *)malloc((n->a_intvalue + 1) * sizeof(int));
-  if (caselabel == NULL)
-    fatal("malloc failed in genSWITCH");
+  caselabel = (int *)arenaalloc(Ctx->funcarena,
+                                (n->a_intvalue + 1) * sizeof(int));
 
   // Because QBE doesn't yet support jump tables,
   // we simply evaluate the switch condition and
@@ -253,6 +264,54 @@ static int gen_logandor(struct ASTnode *n)
   return (reg);
 }
 
+// Some library functions are builtins which are done
+// inline: memcpy() and memset() of a small constant
+// size, and the ctype queries. Given a function call
+// whose arguments are in arglist, last one first, do
+// the call inline and return its result if it is one
+// of these. Otherwise return NOREG
+/**
+ * @fn static int gen_builtin(struct ASTnode *n, int numargs, int *arglist, int *typelist)
+ * @brief Do a call to a builtin function inline
+ * @param n The AST node for the call
+ * @param numargs The number of arguments
+ * @param arglist The temporaries with the arguments, last one first
+ * @param typelist The types of the arguments
+ * @return The temporary with the result, or NOREG
+ */
+static int gen_builtin(struct ASTnode *n, int numargs, int *arglist,
+                       int *typelist)
+{
+  char *name = n->sym->name;
+  int mask, size;
+
+  if (O_nobuiltin)
+    return (NOREG);
+
+  // The ctype queries look the character up in a table
+  if (numargs == 1 && inttype(typelist[0]))
+  {
+    mask = cgctypemask(name);
+    if (mask != 0)
+      return (cgctype(arglist[0], typelist[0], mask));
+    return (NOREG);
+  }
+
+  // memcpy() and memset() need a small constant size
+  // and a pointer to the bytes to write
+  if (numargs != 3 || n->left->right->op != A_INTLIT ||
+      !ptrtype(typelist[2]))
+    return (NOREG);
+  size = n->left->right->a_intvalue;
+  if (size < 0 || size > BUILTINMAX)
+    return (NOREG);
+  if (!strcmp(name, "memcpy") && ptrtype(typelist[1]))
+    return (cgmemcpy(arglist[2], arglist[1], size));
+  if (!strcmp(name, "memset") && inttype(typelist[1]))
+    return (cgmemset(arglist[2], arglist[1], size));
+  return (NOREG);
+}
+
 // Generate the code to calculate the arguments of a
 // function call, then call the function with these
 // arguments. Return the temoprary that holds
@@ -266,7 +325,7 @@ static int gen_logandor(struct ASTnode *n)
 static int gen_funccall(struct ASTnode *n)
 {
   struct ASTnode *gluetree;
-  int i = 0, numargs = 0;
+  int i = 0, numargs = 0, reg;
   int *arglist = NULL;
   int *typelist = NULL;
 
@@ -283,12 +342,8 @@ static int gen_funccall(struct ASTnode *n)
 
   if (i != 0)
   {
-    arglist = (int *)malloc(i * sizeof(int));
-    if (arglist == NULL)
-      fatal("malloc failed in gen_funccall");
-    typelist = (int *)malloc(i * sizeof(int));
-    if (typelist == NULL)
-      fatal("malloc failed in gen_funccall");
+    arglist = (int *)arenaalloc(Ctx->funcarena, i * sizeof(int));
+    typelist = (int *)arenaalloc(Ctx->funcarena, i * sizeof(int));
   }
   // If there is a list of arguments, walk this list
   // from the last argument (right-hand child) to the first.
@@ -301,7 +356,11 @@ static int gen_funccall(struct ASTnode *n)
     typelist[i++] = gluetree->right->type;
   }
 
-  // Call the function and return its result
+  // Do the call inline if it is a builtin,
+  // otherwise call the function. Return its result
+  reg = gen_builtin(n, numargs, arglist, typelist);
+  if (reg != NOREG)
+    return (reg);
   return (cgcall(n->sym, numargs, arglist, typelist));
 }
 
@@ -335,10 +394,16 @@ static int gen_ternary(struct ASTnode *n)
 
   // Generate the true expression and the false label.
   // Move the expression result into the known temporary.
+  // Put whichever expression is unlikely out of line
+  if (n->a_intvalue == H_UNLIKELY)
+    cgcoldlabel(genlabel());
   expreg = genAST(n->mid, NOLABEL, NOLABEL, NOLABEL, n->op);
   cgmove(expreg, reg, n->mid->type);
   cgjump(Lend);
-  cglabel(Lfalse);
+  if (n->a_intvalue == H_LIKELY)
+    cgcoldlabel(Lfalse);
+  else
+    cglabel(Lfalse);
 
   // Generate the false expression and the end label.
   // Move the expression result into the known temporary.
@@ -348,78 +413,60 @@ static int gen_ternary(struct ASTnode *n)
   return (reg);
 }
 
-// Given an AST, an optional label, and the AST op
-// of the parent, generate assembly code recursively.
-// Return the temporary id with the tree's final value.
+// Return true if genAST() handles the AST op
+// itself rather than with gen_op()
 /**
- * @fn int genAST(struct ASTnode *n, int iflabel, int looptoplabel, int loopendlabel, int parentASTop)
- * @brief Given an AST, an optional label, and the AST op of the parent, generate assembly code recursively.
- * @param n The AST node
- * @param iflabel The label
- * @param looptoplabel The label
- * @param loopendlabel The label
- * @param parentASTop The AST op of the parent
- * @return The temporary id with the tree's final value.
+ * @fn int genspecial(int op)
+ * @brief Return true if genAST() handles the AST op itself rather than with gen_op()
+ * @param op The AST op
+ * @return True or false
  */
-int genAST(struct ASTnode *n, int iflabel, int looptoplabel,
-           int loopendlabel, int parentASTop)
+static int genspecial(int op)
 {
-  int leftreg = NOREG, rightreg = NOREG;
-  int lefttype = P_VOID, type = P_VOID;
-  struct symtable *leftsym = NULL;
-
-  // Empty tree, do nothing
-  if (n == NULL)
-    return (NOREG);
-
-  // Update the line number in the output
-  update_line(n);
-
-  // We have some specific AST node handling at the top
-  // so that we don't evaluate the child sub-trees immediately
-  switch (n->op)
+  switch (op)
   {
   case A_IF:
-    return (genIF(n, looptoplabel, loopendlabel));
   case A_WHILE:
-    return (genWHILE(n));
   case A_SWITCH:
-    return (genSWITCH(n));
   case A_FUNCCALL:
-    return (gen_funccall(n));
   case A_TERNARY:
-    return (gen_ternary(n));
   case A_LOGOR:
-    return (gen_logandor(n));
   case A_LOGAND:
-    return (gen_logandor(n));
   case A_GLUE:
-    // Do each child statement, and free the
-    // temporaries after each child
-    if (n->left != NULL)
-      genAST(n->left, iflabel, looptoplabel, loopendlabel, n->op);
-    if (n->right != NULL)
-      genAST(n->right, iflabel, looptoplabel, loopendlabel, n->op);
-    return (NOREG);
   case A_FUNCTION:
-    // Generate the function's preamble before the code
-    // in the child sub-tree
-    cgfuncpreamble(n->sym);
-    genAST(n->left, NOLABEL, NOLABEL, NOLABEL, n->op);
-    cgfuncpostamble(n->sym);
-    return (NOREG);
+    return (1);
   }
+  return (0);
+}
 
-  // General AST node handling below
+// Generate the code for a general AST node n, given
+// the temporary with its left child's value. Return
+// the temporary id with the node's final value.
+/**
+ * @fn int gen_op(struct ASTnode *n, int leftreg, int iflabel, int looptoplabel, int loopendlabel, int parentASTop)
+ * @brief Generate the code for a general AST node, given its left child's value.
+ * @param n The AST node
+ * @param leftreg The temporary with the left child's value
+ * @param iflabel The label
+ * @param looptoplabel The label
+ * @param loopendlabel The label
+ * @param parentASTop The AST op of the parent
+ * @return The temporary id with the node's final value.
+ */
+static int gen_op(struct ASTnode *n, int leftreg, int iflabel,
+                  int looptoplabel, int loopendlabel, int parentASTop)
+{
+  int rightreg = NOREG;
+  int lefttype = P_VOID, type = P_VOID;
+  struct symtable *leftsym = NULL;
 
-  // Get the left and right sub-tree values. Also get the type
-  if (n->left)
+  // Get the right sub-tree value. Also get the type
+  if (n->nkids > 0 && n->left)
   {
     lefttype = type = n->left->type;
     leftsym = n->left->sym;
-    leftreg = genAST(n->left, NOLABEL, NOLABEL, NOLABEL, n->op);
   }
-  if (n->right)
+  if (n->nkids > 1 && n->right)
   {
     type = n->right->type;
     rightreg = genAST(n->right, NOLABEL, NOLABEL, NOLABEL, n->op);
@@ -521,7 +568,7 @@ int genAST(struct ASTnode *n, int iflabel, int looptoplabel,
     // Widen the child's type to the parent's type
     return (cgwiden(leftreg, lefttype, n->type));
   case A_RETURN:
-    cgreturn(leftreg, Functionid);
+    cgreturn(leftreg, Ctx->functionid);
     return (NOREG);
   case A_ADDR:
     // If we have a symbol, get its address. Otherwise,
@@ -584,12 +631,117 @@ int genAST(struct ASTnode *n, int iflabel, int looptoplabel,
     return (NOREG);
   case A_CAST:
     return (cgcast(leftreg, lefttype, n->type));
+  case A_EXPECT:
+    // A hint outside a condition is just its value
+    return (leftreg);
   default:
     fatald("Unknown AST operator", n->op);
   }
   return (NOREG); // Keep -Wall happy
 }
 
+// Given an AST, an optional label, and the AST op
+// of the parent, generate assembly code recursively.
+// Return the temporary id with the tree's final value.
+/**
+ * @fn int genAST(struct ASTnode *n, int iflabel, int looptoplabel, int loopendlabel, int parentASTop)
+ * @brief Given an AST, an optional label, and the AST op of the parent, generate assembly code recursively.
+ * @param n The AST node
+ * @param iflabel The label
+ * @param looptoplabel The label
+ * @param loopendlabel The label
+ * @param parentASTop The AST op of the parent
+ * @return The temporary id with the tree's final value.
+ */
+int genAST(struct ASTnode *n, int iflabel, int looptoplabel,
+           int loopendlabel, int parentASTop)
+{
+  struct ASTnode *parent;
+  int leftreg = NOREG;
+  int base;
+
+  // Empty tree, do nothing
+  if (n == NULL)
+    return (NOREG);
+
+  // Update the line number in the output
+  update_line(n);
+
+  // We have some specific AST node handling at the top
+  // so that we don't evaluate the child sub-trees immediately
+  switch (n->op)
+  {
+  case A_IF:
+    return (genIF(n, looptoplabel, loopendlabel));
+  case A_WHILE:
+    return (genWHILE(n));
+  case A_SWITCH:
+    return (genSWITCH(n));
+  case A_FUNCCALL:
+    return (gen_funccall(n));
+  case A_TERNARY:
+    return (gen_ternary(n));
+  case A_LOGOR:
+    return (gen_logandor(n));
+  case A_LOGAND:
+    return (gen_logandor(n));
+  case A_GLUE:
+    // Statement lists lean to the left. Walk down
+    // them on the node stack, then do each child
+    // statement in turn on the way back up
+    base = nodedepth();
+    while (n != NULL && n->op == A_GLUE)
+    {
+      update_line(n);
+      pushnode(n);
+      n = n->left;
+    }
+    if (n != NULL)
+      genAST(n, iflabel, looptoplabel, loopendlabel, A_GLUE);
+    while (nodedepth() > base)
+    {
+      n = popnode();
+      if (n->right != NULL)
+        genAST(n->right, iflabel, looptoplabel, loopendlabel, A_GLUE);
+    }
+    return (NOREG);
+  case A_FUNCTION:
+    // Generate the function's preamble before the code
+    // in the child sub-tree. Its first line goes
+    // to QBE even if it's the line we're on
+    cgfuncpreamble(n->sym);
+    Ctx->genline = 0;
+    genAST(n->left, NOLABEL, NOLABEL, NOLABEL, n->op);
+    cgfuncpostamble(n->sym);
+    return (NOREG);
+  }
+
+  // General AST node handling below. Expressions such as
+  // a + b + c lean to the left, so walk down the left
+  // children that are also general nodes on the node stack
+  base = nodedepth();
+  while (n->nkids > 0 && n->left != NULL && !genspecial(n->left->op))
+  {
+    pushnode(n);
+    n = n->left;
+    update_line(n);
+  }
+
+  // Get the lowest node's left sub-tree value, then generate
+  // each node back up the stack, with the value of the
+  // node below as its left value
+  if (n->nkids > 0 && n->left)
+    leftreg = genAST(n->left, NOLABEL, NOLABEL, NOLABEL, n->op);
+  while (nodedepth() > base)
+  {
+    parent = popnode();
+    leftreg = gen_op(n, leftreg, NOLABEL, NOLABEL, NOLABEL, parent->op);
+    n = parent;
+  }
+  return (gen_op(n, leftreg, iflabel, looptoplabel, loopendlabel,
+                 parentASTop));
+}
+
 /**
  * @fn void genpreamble(char *filename)
  * @brief Generate the preamble for the assembly file.
@@ -598,6 +750,8 @@ int genAST(struct ASTnode *n, int iflabel, int looptoplabel,
 
 void genpreamble(char *filename)
 {
+  if (O_syntaxonly)
+    return;
   cgpreamble(filename);
 }
 
@@ -607,15 +761,30 @@ void genpreamble(char *filename)
  */
 void genpostamble()
 {
+  if (O_syntaxonly)
+    return;
   cgpostamble();
 }
 
+/**
+ * @fn void genflush(void)
+ * @brief Hand the code generated so far to the back end.
+ */
+void genflush(void)
+{
+  if (O_syntaxonly)
+    return;
+  cgflush();
+}
+
 /**
  * @fn void genfreeregs(void)
  * @brief Generate code to free all registers.
  */
 void genglobsym(struct symtable *node)
 {
+  if (O_syntaxonly)
+    return;
   cgglobsym(node);
 }
 
@@ -632,7 +801,8 @@ void genglobsym(struct symtable *node)
 int genglobstr(char *strvalue, int append)
 {
   int l = genlabel();
-  cgglobstr(l, strvalue, append);
+  if (!O_syntaxonly)
+    cgglobstr(l, strvalue, append);
   return (l);
 }
 
@@ -643,6 +813,8 @@ int genglobstr(char *strvalue, int append)
  */
 void genglobstrend(void)
 {
+  if (O_syntaxonly)
+    return;
   cgglobstrend();
 }
 /**
@@ -1 +1,2 @@
 #define INCDIR "./build/include"
+#define RTLIB "./build/lib/libminic.a"
@@ -4,7 +4,9 @@
 #define O_RDONLY 00
 #define O_WRONLY 01
 #define O_RDWR   02
+#define O_APPEND 02000
 
 int open(char *pathname, int flags);
+int creat(char *pathname, int mode);
 
 #endif // _FCNTL_H_
@@ -0,0 +1,24 @@
+#ifndef _GLOB_H_
+# define _GLOB_H_
+
+#include <stddef.h>
+
+// The glibc glob_t. The function pointers
+// are only used with GLOB_ALTDIRFUNC
+struct __glob {
+  size_t gl_pathc;
+  char **gl_pathv;
+  size_t gl_offs;
+  long gl_flags;
+  char *gl_closedir;
+  char *gl_readdir;
+  char *gl_opendir;
+  char *gl_lstat;
+  char *gl_stat;
+};
+typedef struct __glob glob_t;
+
+int glob(char *pattern, int flags, void *errfunc, glob_t *pglob);
+void globfree(glob_t *pglob);
+
+#endif	// _GLOB_H_
@@ -0,0 +1,11 @@
+#ifndef _POLL_H_
+# define _POLL_H_
+
+// We can't declare struct pollfd, which has shorts in it.
+// Each one is two ints: the fd, then the events in the low
+// half and the returned events in the high half of the other
+#define POLLIN 1
+
+int poll(void *fds, long nfds, int timeout);
+
+#endif	// _POLL_H_
@@ -0,0 +1,14 @@
+#ifndef _SIGNAL_H_
+# define _SIGNAL_H_
+
+#define SIGKILL 9
+#define SIGPIPE 13
+#define SIGCHLD 17
+
+#define SIG_DFL ((void *) 0)
+#define SIG_IGN ((void *) 1)
+
+void *signal(int signum, void *handler);
+int kill(int pid, int sig);
+
+#endif	// _SIGNAL_H_
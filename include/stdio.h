@@ -28,9 +28,17 @@ int fputs(char *s, FILE *stream);
 int putc(int c, FILE *stream);
 int putchar(int c);
 int puts(char *s);
+FILE *fdopen(int fd, char *mode);
+FILE *fmemopen(void *buf, size_t size, char *mode);
+FILE *open_memstream(char **ptr, size_t *sizeloc);
+long ftell(FILE *stream);
 FILE *popen(char *command, char *type);
 int pclose(FILE *stream);
 int fflush(FILE *stream);
+int rename(char *oldpath, char *newpath);
+FILE *tmpfile(void);
+int fileno(FILE *stream);
+void rewind(FILE *stream);
 
 extern FILE *stdin;
 extern FILE *stdout;
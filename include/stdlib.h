@@ -9,5 +9,10 @@ void free(void *ptr);
 void *calloc(int nmemb, int size);
 void *realloc(void *ptr, int size);
 int system(char *command);
+int atoi(char *nptr);
+long atol(char *nptr);
+char *getenv(char *name);
+int mkstemp(char *template);
+int mkstemps(char *template, int suffixlen);
 
 #endif	// _STDLIB_H_
@@ -2,10 +2,16 @@
 # define _STRING_H_
 
 char *strdup(char *s);
+size_t strlen(char *s);
+char *strcpy(char *dest, char *src);
+char *strncpy(char *dest, char *src, size_t n);
+char *strcat(char *dest, char *src);
 char *strchr(char *s, int c);
 char *strrchr(char *s, int c);
 int strcmp(char *s1, char *s2);
 int strncmp(char *s1, char *s2, size_t n);
 char *strerror(int errnum);
+void *memcpy(void *dest, void *src, size_t n);
+void *memset(void *s, int c, size_t n);
 
 #endif	// _STRING_H_
@@ -0,0 +1,13 @@
+#ifndef _SYS_MMAN_H_
+# define _SYS_MMAN_H_
+
+#include <stddef.h>
+
+#define PROT_READ   1
+#define MAP_PRIVATE 2
+#define MAP_FAILED  ((void *) -1)
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+int munmap(void *addr, size_t length);
+
+#endif	// _SYS_MMAN_H_
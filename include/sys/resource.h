@@ -0,0 +1,31 @@
+#ifndef _SYS_RESOURCE_H_
+# define _SYS_RESOURCE_H_
+
+#define RUSAGE_SELF 0
+
+// The x86-64 Linux struct rusage,
+// with its two struct timevals flattened
+struct rusage {
+  long ru_utime_sec;
+  long ru_utime_usec;
+  long ru_stime_sec;
+  long ru_stime_usec;
+  long ru_maxrss;
+  long ru_ixrss;
+  long ru_idrss;
+  long ru_isrss;
+  long ru_minflt;
+  long ru_majflt;
+  long ru_nswap;
+  long ru_inblock;
+  long ru_oublock;
+  long ru_msgsnd;
+  long ru_msgrcv;
+  long ru_nsignals;
+  long ru_nvcsw;
+  long ru_nivcsw;
+};
+
+int getrusage(int who, struct rusage *usage);
+
+#endif	// _SYS_RESOURCE_H_
@@ -0,0 +1,18 @@
+#ifndef _SYS_SOCKET_H_
+# define _SYS_SOCKET_H_
+
+#define AF_UNIX 1
+#define SOCK_STREAM 1
+#define SHUT_WR 1
+#define SOL_SOCKET 1
+#define SO_RCVTIMEO 20
+
+int socket(int domain, int type, int protocol);
+int bind(int sockfd, void *addr, int addrlen);
+int listen(int sockfd, int backlog);
+int accept(int sockfd, void *addr, void *addrlen);
+int connect(int sockfd, void *addr, int addrlen);
+int shutdown(int sockfd, int how);
+int setsockopt(int sockfd, int level, int optname, void *optval, int optlen);
+
+#endif	// _SYS_SOCKET_H_
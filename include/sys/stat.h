@@ -0,0 +1,32 @@
+#ifndef _SYS_STAT_H_
+# define _SYS_STAT_H_
+
+// The x86-64 Linux struct stat
+struct stat {
+  long st_dev;
+  long st_ino;
+  long st_nlink;
+  int st_mode;
+  int st_uid;
+  int st_gid;
+  int __pad0;
+  long st_rdev;
+  long st_size;
+  long st_blksize;
+  long st_blocks;
+  long st_atime;
+  long st_atime_nsec;
+  long st_mtime;
+  long st_mtime_nsec;
+  long st_ctime;
+  long st_ctime_nsec;
+  long __unused1;
+  long __unused2;
+  long __unused3;
+};
+
+int stat(char *pathname, struct stat *statbuf);
+int mkdir(char *pathname, int mode);
+int chmod(char *pathname, int mode);
+
+#endif	// _SYS_STAT_H_
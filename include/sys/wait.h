@@ -0,0 +1,13 @@
+#ifndef _SYS_WAIT_H_
+# define _SYS_WAIT_H_
+
+#include <sys/resource.h>
+
+#define WIFEXITED(status) (((status) & 0x7f) == 0)
+#define WEXITSTATUS(status) (((status) >> 8) & 0xff)
+
+int wait(int *wstatus);
+int waitpid(int pid, int *wstatus, int options);
+int wait4(int pid, int *wstatus, int options, struct rusage *rusage);
+
+#endif	// _SYS_WAIT_H_
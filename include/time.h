@@ -0,0 +1,13 @@
+#ifndef _TIME_H_
+# define _TIME_H_
+
+#define CLOCK_MONOTONIC 1
+
+struct timespec {
+  long tv_sec;
+  long tv_nsec;
+};
+
+int clock_gettime(int clockid, struct timespec *tp);
+
+#endif	// _TIME_H_
@@ -1,7 +1,24 @@
 #ifndef _UNISTD_H_
 # define _UNISTD_H_
 
+#include <stddef.h>
+
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
 void _exit(int status);
 int unlink(char *pathname);
+int fork(void);
+int dup2(int oldfd, int newfd);
+int pipe(int *pipefd);
+int execvp(char *file, char **argv);
+int close(int fd);
+int read(int fd, void *buf, size_t count);
+int write(int fd, void *buf, size_t count);
+int getpid(void);
+int chdir(char *path);
+char *getcwd(char *buf, size_t size);
+long lseek(int fd, long offset, int whence);
 
 #endif	// _UNISTD_H_
@@ -0,0 +1,6 @@
+#ifndef _UTIME_H_
+# define _UTIME_H_
+
+int utime(char *filename, void *times);
+
+#endif	// _UTIME_H_
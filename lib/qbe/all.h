@@ -59,6 +59,7 @@ struct Target {
 	void (*isel)(Fn *);
 	void (*emitfn)(Fn *, FILE *);
 	void (*emitfin)(FILE *);
+	int (*objfn)(Fn *); /* encode for elf.c, 0 if unable */
 	char asloc[4];
 	char assym[4];
 };
@@ -256,6 +257,7 @@ struct Blk {
 	BSet in[1], out[1], gen[1];
 	int nlive[2];
 	int loop;
+	int cold;
 	char name[NString];
 };
 
@@ -441,6 +443,11 @@ struct Dat {
 /* main.c */
 extern Target T;
 extern char debug['Z'+1];
+int qbe_init(char *);
+void qbe_translate(FILE *, char *, FILE *);
+void qbe_finish(FILE *);
+int qbe_objbegin(char *);
+int qbe_objend(FILE *);
 
 /* util.c */
 typedef enum {
@@ -522,6 +529,7 @@ void fillfron(Fn *);
 void loopiter(Fn *, void (*)(Blk *, Blk *));
 void fillloop(Fn *);
 void simpljmp(Fn *);
+void sinkcold(Fn *);
 
 /* mem.c */
 void promote(Fn *);
@@ -572,3 +580,29 @@ int stashbits(void *, int);
 void elf_emitfnfin(char *, FILE *);
 void elf_emitfin(FILE *);
 void macho_emitfin(FILE *);
+
+/* elf.c */
+enum {
+	ObjText,
+	ObjData,
+	ObjBss,
+	NObjSec,
+};
+
+enum {
+	RelAbs64,
+	RelAbs32,
+	RelAbs32S,
+	RelPc32,
+	RelPlt32,
+};
+
+void elf_objinit(char *);
+uint64_t elf_objpos(int);
+void elf_objbytes(int, uchar *, uint);
+void elf_objrel(int, uint64_t, char *, int, int64_t);
+int elf_objlnk(char *, Lnk *, int);
+void elf_objfnfin(char *);
+void elf_objline(uint64_t, int);
+int elf_objdat(Dat *);
+void elf_objwrite(FILE *);
@@ -67,4 +67,9 @@ void amd64_sysv_abi(Fn *);
 void amd64_isel(Fn *);
 
 /* emit.c */
+int amd64_slot(Ref, Fn *);
+uint64_t amd64_framesz(Fn *);
 void amd64_emitfn(Fn *, FILE *);
+
+/* encode.c */
+int amd64_objfn(Fn *);
@@ -141,8 +141,8 @@ static char *rname[][4] = {
 };
 
 
-static int
-slot(Ref r, Fn *fn)
+int
+amd64_slot(Ref r, Fn *fn)
 {
 	int s;
 
@@ -285,14 +285,14 @@ Next:
 			fprintf(f, "%%%s", regtoa(ref.val, sz));
 			break;
 		case RSlot:
-			fprintf(f, "%d(%%rbp)", slot(ref, fn));
+			fprintf(f, "%d(%%rbp)", amd64_slot(ref, fn));
 			break;
 		case RMem:
 		Mem:
 			m = &fn->mem[ref.val];
 			if (rtype(m->base) == RSlot) {
 				off.type = CBits;
-				off.bits.i = slot(m->base, fn);
+				off.bits.i = amd64_slot(m->base, fn);
 				addcon(&m->offset, &off);
 				m->base = TMP(RBP);
 			}
@@ -337,7 +337,7 @@ Next:
 		case RMem:
 			goto Mem;
 		case RSlot:
-			fprintf(f, "%d(%%rbp)", slot(ref, fn));
+			fprintf(f, "%d(%%rbp)", amd64_slot(ref, fn));
 			break;
 		case RCon:
 			off = fn->con[ref.val];
@@ -398,6 +398,8 @@ emitins(Ins i, Fn *fn, FILE *f)
 	case Onop:
 		/* just do nothing for nops, they are inserted
 		 * by some passes */
+	case Odbgloc:
+		/* only objects get line info, see elf.c */
 		break;
 	case Omul:
 		/* here, we try to use the 3-addresss form
@@ -550,8 +552,8 @@ emitins(Ins i, Fn *fn, FILE *f)
 	}
 }
 
-static uint64_t
-framesz(Fn *fn)
+uint64_t
+amd64_framesz(Fn *fn)
 {
 	uint64_t i, o, f;
 
@@ -579,7 +581,7 @@ amd64_emitfn(Fn *fn, FILE *f)
 
 	emitfnlnk(fn->name, &fn->lnk, f);
 	fputs("\tpushq %rbp\n\tmovq %rsp, %rbp\n", f);
-	fs = framesz(fn);
+	fs = amd64_framesz(fn);
 	if (fs)
 		fprintf(f, "\tsubq $%"PRIu64", %%rsp\n", fs);
 	if (fn->vararg) {
@@ -0,0 +1,1013 @@
+#include "all.h"
+
+/* Machine code for the object writer in
+ * ../elf.c: the instructions that emit.c
+ * prints, encoded as the assembler would;
+ * amd64_objfn() returns 0 for anything it
+ * does not handle (floating point, thread
+ * locals, quoted names) and the caller
+ * falls back to the assembler
+ */
+
+enum {
+	OReg,
+	OMem,
+	OImm,
+};
+
+enum {
+	NoJmp = -1,
+	Jmp = -2,
+};
+
+typedef struct Opnd Opnd;
+typedef struct Frag Frag;
+typedef struct Fix Fix;
+typedef struct Loc Loc;
+
+struct Opnd {
+	int kind;
+	int reg;      /* register, or base of OMem (RXX if none) */
+	int index;    /* RXX if none */
+	int scale;
+	int rip;
+	int64_t val;  /* displacement or immediate */
+	char *sym;    /* added to val if not 0 */
+};
+
+struct Frag { /* code up to end, then a jump */
+	uint end;
+	int cc;       /* condition code, NoJmp or Jmp */
+	int blk;
+	int len;      /* of the jump */
+	uint addr;
+};
+
+struct Fix { /* relocation of code[off] */
+	uint off;
+	int type;
+	char *sym;
+	int64_t add;
+};
+
+struct Loc { /* source line of code[off] on */
+	uint off;
+	int line;
+};
+
+static int hwreg[] = {
+	[RAX] = 0, [RCX] = 1, [RDX] = 2, [RBX] = 3,
+	[RSP] = 4, [RBP] = 5, [RSI] = 6, [RDI] = 7,
+	[R8] = 8, [R9] = 9, [R10] = 10, [R11] = 11,
+	[R12] = 12, [R13] = 13, [R14] = 14, [R15] = 15,
+};
+
+static int ccode[] = {
+	[Ciule] = 0x6,
+	[Ciult] = 0x2,
+	[Cisle] = 0xe,
+	[Cislt] = 0xc,
+	[Cisgt] = 0xf,
+	[Cisge] = 0xd,
+	[Ciugt] = 0x7,
+	[Ciuge] = 0x3,
+	[Cieq] = 0x4,
+	[Cine] = 0x5,
+	[NCmpI+Cfle] = 0x6,
+	[NCmpI+Cflt] = 0x2,
+	[NCmpI+Cfgt] = 0x7,
+	[NCmpI+Cfge] = 0x3,
+	[NCmpI+Cfeq] = 0x4,
+	[NCmpI+Cfne] = 0x5,
+	[NCmpI+Cfo] = 0xb,
+	[NCmpI+Cfuo] = 0xa,
+};
+
+static uchar *code;
+static uint ncode;
+static Frag *frag;
+static uint nfrag;
+static Fix *fix;
+static uint nfix;
+static Loc *loc;
+static uint nloc;
+static int bad;
+
+static int
+hw(int r)
+{
+	if (r >= XMM0)
+		return r - XMM0;
+	return hwreg[r];
+}
+
+static void
+b1(int c)
+{
+	vgrow(&code, ncode+1);
+	code[ncode++] = c;
+}
+
+static void
+bn(int64_t v, int n)
+{
+	while (n--) {
+		b1(v);
+		v >>= 8;
+	}
+}
+
+static void
+addfix(int type, char *sym, int64_t add)
+{
+	vgrow(&fix, nfix+1);
+	fix[nfix++] = (Fix){ncode, type, sym, add};
+}
+
+static char *
+symname(Con *c)
+{
+	char *s;
+
+	s = str(c->sym.id);
+	if (s[0] == '"' || c->sym.type == SThr) {
+		bad = 1;
+		return 0;
+	}
+	return s;
+}
+
+/* the operand for r, as emitf() prints it;
+ * with mem, the operand is the memory at r
+ */
+static Opnd
+opnd(Ref r, Fn *fn, int mem)
+{
+	Opnd o;
+	Mem *m;
+	Con *c;
+
+	memset(&o, 0, sizeof o);
+	switch (rtype(r)) {
+	case RTmp:
+		if (!isreg(r))
+			die("unreachable");
+		o.kind = mem ? OMem : OReg;
+		o.reg = r.val;
+		break;
+	case RSlot:
+		o.kind = OMem;
+		o.reg = RBP;
+		o.val = amd64_slot(r, fn);
+		break;
+	case RMem:
+		m = &fn->mem[r.val];
+		o.kind = OMem;
+		o.scale = m->scale;
+		if (rtype(m->base) == RSlot) {
+			o.reg = RBP;
+			o.val = amd64_slot(m->base, fn);
+		} else if (!req(m->base, R))
+			o.reg = m->base.val;
+		if (!req(m->index, R))
+			o.index = m->index.val;
+		if (m->offset.type != CUndef)
+			o.val += m->offset.bits.i;
+		if (m->offset.type == CAddr) {
+			o.sym = symname(&m->offset);
+			o.rip = o.reg == RXX;
+			if (o.rip && o.index != RXX)
+				bad = 1;
+		}
+		break;
+	case RCon:
+		c = &fn->con[r.val];
+		o.kind = mem ? OMem : OImm;
+		o.val = c->bits.i;
+		if (c->type == CAddr) {
+			o.sym = symname(c);
+			o.rip = mem;
+		}
+		break;
+	default:
+		die("unreachable");
+	}
+	return o;
+}
+
+static Opnd
+oreg(int r)
+{
+	Opnd o;
+
+	memset(&o, 0, sizeof o);
+	o.kind = OReg;
+	o.reg = r;
+	return o;
+}
+
+static Opnd
+oimm(int64_t v)
+{
+	Opnd o;
+
+	memset(&o, 0, sizeof o);
+	o.kind = OImm;
+	o.val = v;
+	return o;
+}
+
+static void
+imm(Opnd *o, int n, int w)
+{
+	if (o->kind != OImm)
+		die("unreachable");
+	if (o->sym) {
+		addfix(w ? RelAbs32S : RelAbs32, o->sym, o->val);
+		bn(0, n);
+		return;
+	}
+	if (n == 4 && (o->val < INT32_MIN
+	|| o->val > (w ? INT32_MAX : UINT32_MAX)))
+		bad = 1;
+	bn(o->val, n);
+}
+
+static void
+opc(int pfx, int rex, uint op)
+{
+	if (pfx)
+		b1(pfx);
+	if (rex)
+		b1(rex);
+	if (op > 0xff)
+		b1(op >> 8);
+	b1(op);
+}
+
+/* an instruction with a ModRM byte: r
+ * goes in the reg field, and m is the
+ * other operand; byt says if r (1) or
+ * m (2) are byte registers, n is the
+ * size of any immediate after it
+ */
+static void
+rm(int pfx, int w, uint op, int r, Opnd *m, int n, int byt)
+{
+	int rex, rl, base, idx, mod, sib, dsz;
+	int64_t d;
+
+	rex = w ? 0x48 : 0;
+	if (r & 8)
+		rex |= 0x44;
+	if ((byt & 1) && r >= 4)
+		rex |= 0x40;
+	rl = (r & 7) << 3;
+
+	if (m->kind == OReg) {
+		base = hw(m->reg);
+		if (base & 8)
+			rex |= 0x41;
+		if ((byt & 2) && base >= 4)
+			rex |= 0x40;
+		opc(pfx, rex, op);
+		b1(0xc0 | rl | (base & 7));
+		return;
+	}
+	if (m->kind != OMem)
+		die("unreachable");
+
+	d = m->val;
+	if (d < INT32_MIN || d > INT32_MAX)
+		bad = 1;
+	if (m->rip) {
+		opc(pfx, rex, op);
+		b1(rl | 5);
+		addfix(RelPc32, m->sym, d - 4 - n);
+		bn(0, 4);
+		return;
+	}
+
+	idx = m->index != RXX ? hw(m->index) : 4;
+	if (idx & 8)
+		rex |= 0x42;
+	sib = -1;
+	if (m->reg == RXX) {
+		/* absolute, or index only */
+		mod = 0;
+		dsz = 4;
+		sib = (idx & 7) << 3 | 5;
+	} else {
+		base = hw(m->reg);
+		if (base & 8)
+			rex |= 0x41;
+		if (m->sym) {
+			mod = 2;
+			dsz = 4;
+		} else if (d == 0 && (base & 7) != 5) {
+			mod = 0;
+			dsz = 0;
+		} else if (-128 <= d && d <= 127) {
+			mod = 1;
+			dsz = 1;
+		} else {
+			mod = 2;
+			dsz = 4;
+		}
+		if (m->index != RXX || (base & 7) == 4)
+			sib = (idx & 7) << 3 | (base & 7);
+		else
+			rl |= base & 7;
+	}
+	if (sib != -1) {
+		switch (m->index != RXX ? m->scale : 1) {
+		case 1: break;
+		case 2: sib |= 0x40; break;
+		case 4: sib |= 0x80; break;
+		case 8: sib |= 0xc0; break;
+		default: die("unreachable");
+		}
+	}
+	opc(pfx, rex, op);
+	b1(mod << 6 | rl | (sib != -1 ? 4 : 0));
+	if (sib != -1)
+		b1(sib);
+	if (m->sym)
+		addfix(RelAbs32S, m->sym, d);
+	bn(m->sym ? 0 : d, dsz);
+}
+
+/* add, or, and, sub, xor and cmp, numbered
+ * as in the opcode map; src to dst
+ */
+static void
+alu(int n, int w, Opnd *src, Opnd *dst)
+{
+	Opnd o;
+
+	if (src->kind == OImm && !w) {
+		/* as 32 bits, like the assembler */
+		o = *src;
+		o.val = (int32_t)o.val;
+		src = &o;
+	}
+	if (src->kind == OImm) {
+		if (!src->sym && -128 <= src->val && src->val <= 127) {
+			rm(0, w, 0x83, n, dst, 1, 0);
+			bn(src->val, 1);
+		} else if (dst->kind == OReg && dst->reg == RAX) {
+			opc(0, w ? 0x48 : 0, 8*n + 5);
+			imm(src, 4, w);
+		} else {
+			rm(0, w, 0x81, n, dst, 4, 0);
+			imm(src, 4, w);
+		}
+	} else if (src->kind == OReg)
+		rm(0, w, 8*n + 1, hw(src->reg), dst, 0, 0);
+	else if (dst->kind == OReg)
+		rm(0, w, 8*n + 3, hw(dst->reg), src, 0, 0);
+	else
+		bad = 1;
+}
+
+/* mov of class k from src to dst */
+static void
+mov(int k, Opnd *src, Opnd *dst)
+{
+	int w, r, pfx;
+
+	if (KBASE(k) == 1) {
+		pfx = k == Kd ? 0xf2 : 0xf3;
+		if (src->kind == OImm)
+			bad = 1;
+		else if (dst->kind == OReg)
+			rm(pfx, 0, 0x0f10, hw(dst->reg), src, 0, 0);
+		else if (src->kind == OReg)
+			rm(pfx, 0, 0x0f11, hw(src->reg), dst, 0, 0);
+		else
+			bad = 1;
+		return;
+	}
+	w = KWIDE(k);
+	switch (src->kind) {
+	case OReg:
+		rm(0, w, 0x89, hw(src->reg), dst, 0, 0);
+		break;
+	case OMem:
+		if (dst->kind != OReg) {
+			bad = 1;
+			break;
+		}
+		rm(0, w, 0x8b, hw(dst->reg), src, 0, 0);
+		break;
+	case OImm:
+		if (dst->kind == OReg && !w) {
+			r = hw(dst->reg);
+			opc(0, r & 8 ? 0x41 : 0, 0xb8 + (r & 7));
+			imm(src, 4, 0);
+		} else if (dst->kind == OReg && !src->sym
+		&& (src->val < INT32_MIN || src->val > INT32_MAX)) {
+			/* movabsq */
+			r = hw(dst->reg);
+			opc(0, r & 8 ? 0x49 : 0x48, 0xb8 + (r & 7));
+			bn(src->val, 8);
+		} else {
+			rm(0, w, 0xc7, 0, dst, 4, 0);
+			imm(src, 4, w);
+		}
+		break;
+	}
+}
+
+static void encins(Ins, Fn *);
+
+static void
+enccopy(Ref r1, Ref r2, int k, Fn *fn)
+{
+	Ins icp;
+
+	icp.op = Ocopy;
+	icp.arg[0] = r2;
+	icp.to = r1;
+	icp.cls = k;
+	encins(icp, fn);
+}
+
+/* put a 3-address instruction in 2-address
+ * form, as the + and - of emitf() do
+ */
+static void
+twoaddr(Ins *i, Fn *fn, int commut)
+{
+	Ref r;
+
+	if (commut && req(i->arg[1], i->to)) {
+		r = i->arg[0];
+		i->arg[0] = i->arg[1];
+		i->arg[1] = r;
+	}
+	assert((!req(i->arg[1], i->to) || req(i->arg[0], i->to)) &&
+		"cannot convert to 2-address");
+	enccopy(i->to, i->arg[0], i->cls, fn);
+}
+
+static void
+encins(Ins i, Fn *fn)
+{
+	static int alun[NOp] = {
+		[Oadd] = 0, [Oor] = 1, [Oand] = 4,
+		[Osub] = 5, [Oxor] = 6,
+	};
+	static int shn[NOp] = {[Oshl] = 4, [Oshr] = 5, [Osar] = 7};
+	static uint ldop[NOp] = {
+		[Oloadsh] = 0x0fbf, [Oloaduh] = 0x0fb7,
+		[Oloadsb] = 0x0fbe, [Oloadub] = 0x0fb6,
+		[Oextsh] = 0x0fbf, [Oextuh] = 0x0fb7,
+		[Oextsb] = 0x0fbe, [Oextub] = 0x0fb6,
+	};
+	static int stsz[NOp] = {
+		[Ostoreb] = 1, [Ostoreh] = 2,
+		[Ostorew] = 4, [Ostorel] = 8,
+	};
+	Opnd a0, a1, to;
+	int64_t val;
+	int w, n, t0;
+	Ref r;
+	Con *con;
+
+	w = KWIDE(i.cls);
+	switch (i.op) {
+	default:
+		bad = 1;
+		break;
+	case Onop:
+		break;
+	case Odbgloc:
+		/* the first line takes in the prologue */
+		vgrow(&loc, nloc+1);
+		loc[nloc] = (Loc){nloc ? ncode : 0, rsval(i.arg[0])};
+		nloc++;
+		break;
+	case Osub:
+		/* the negation trick of emitins() */
+		if (req(i.to, i.arg[1]) && !req(i.arg[0], i.to)) {
+			if (KBASE(i.cls) != 0) {
+				bad = 1;
+				break;
+			}
+			to = opnd(i.to, fn, 0);
+			rm(0, w, 0xf7, 3, &to, 0, 0);
+			a0 = opnd(i.arg[0], fn, 0);
+			alu(0, w, &a0, &to);
+			break;
+		}
+		/* fall through */
+	case Oadd:
+	case Oand:
+	case Oor:
+	case Oxor:
+		if (KBASE(i.cls) != 0) {
+			bad = 1;
+			break;
+		}
+		twoaddr(&i, fn, i.op != Osub);
+		a1 = opnd(i.arg[1], fn, 0);
+		to = opnd(i.to, fn, 0);
+		alu(alun[i.op], w, &a1, &to);
+		break;
+	case Oneg:
+		if (KBASE(i.cls) != 0) {
+			bad = 1;
+			break;
+		}
+		to = opnd(i.to, fn, 0);
+		if (!req(i.to, i.arg[0])) {
+			a0 = opnd(i.arg[0], fn, 0);
+			mov(i.cls, &a0, &to);
+		}
+		rm(0, w, 0xf7, 3, &to, 0, 0);
+		break;
+	case Osar:
+	case Oshr:
+	case Oshl:
+		twoaddr(&i, fn, 0);
+		a1 = opnd(i.arg[1], fn, 0);
+		to = opnd(i.to, fn, 0);
+		if (a1.kind == OImm && !a1.sym) {
+			if (a1.val == 1)
+				rm(0, w, 0xd1, shn[i.op], &to, 0, 0);
+			else {
+				rm(0, w, 0xc1, shn[i.op], &to, 1, 0);
+				bn(a1.val, 1);
+			}
+		} else if (a1.kind == OReg && a1.reg == RCX)
+			rm(0, w, 0xd3, shn[i.op], &to, 0, 0);
+		else
+			bad = 1;
+		break;
+	case Omul:
+		if (KBASE(i.cls) != 0) {
+			bad = 1;
+			break;
+		}
+		if (rtype(i.arg[1]) == RCon) {
+			r = i.arg[0];
+			i.arg[0] = i.arg[1];
+			i.arg[1] = r;
+		}
+		if (rtype(i.arg[0]) == RCon && rtype(i.arg[1]) == RTmp) {
+			a0 = opnd(i.arg[0], fn, 0);
+			a1 = opnd(i.arg[1], fn, 0);
+			to = opnd(i.to, fn, 0);
+			if (to.kind != OReg) {
+				bad = 1;
+				break;
+			}
+			if (!w)
+				a0.val = (int32_t)a0.val;
+			if (!a0.sym && -128 <= a0.val && a0.val <= 127) {
+				rm(0, w, 0x6b, hw(to.reg), &a1, 1, 0);
+				bn(a0.val, 1);
+			} else {
+				rm(0, w, 0x69, hw(to.reg), &a1, 4, 0);
+				imm(&a0, 4, w);
+			}
+			break;
+		}
+		twoaddr(&i, fn, 1);
+		a1 = opnd(i.arg[1], fn, 0);
+		if (a1.kind == OImm || !isreg(i.to)) {
+			bad = 1;
+			break;
+		}
+		rm(0, w, 0x0faf, hw(i.to.val), &a1, 0, 0);
+		break;
+	case Ostoreb:
+	case Ostoreh:
+	case Ostorew:
+	case Ostorel:
+		n = stsz[i.op];
+		a0 = opnd(i.arg[0], fn, 0);
+		a1 = opnd(i.arg[1], fn, 1);
+		if (a0.kind == OReg)
+			rm(n == 2 ? 0x66 : 0, n == 8, n == 1 ? 0x88 : 0x89,
+				hw(a0.reg), &a1, 0, n == 1);
+		else if (a0.kind == OImm) {
+			rm(n == 2 ? 0x66 : 0, n == 8, n == 1 ? 0xc6 : 0xc7,
+				0, &a1, n > 4 ? 4 : n, 0);
+			if (n < 4 && !a0.sym)
+				bn(a0.val, n);
+			else
+				imm(&a0, 4, n == 8);
+		} else
+			bad = 1;
+		break;
+	case Ostores:
+	case Ostored:
+		a0 = opnd(i.arg[0], fn, 0);
+		a1 = opnd(i.arg[1], fn, 1);
+		if (a0.kind != OReg) {
+			bad = 1;
+			break;
+		}
+		mov(i.op == Ostored ? Kd : Ks, &a0, &a1);
+		break;
+	case Oload:
+		a0 = opnd(i.arg[0], fn, 1);
+		to = opnd(i.to, fn, 0);
+		mov(i.cls, &a0, &to);
+		break;
+	case Oloadsw:
+	case Oloaduw:
+	case Oextsw:
+	case Oextuw:
+		if (KBASE(i.cls) != 0) {
+			bad = 1;
+			break;
+		}
+		a0 = opnd(i.arg[0], fn, i.op == Oloadsw || i.op == Oloaduw);
+		to = opnd(i.to, fn, 0);
+		if (to.kind != OReg || a0.kind == OImm)
+			bad = 1;
+		else if (i.cls == Kl && (i.op == Oloadsw || i.op == Oextsw))
+			rm(0, 1, 0x63, hw(to.reg), &a0, 0, 0);
+		else if (a0.kind == OReg)
+			rm(0, 0, 0x89, hw(a0.reg), &to, 0, 0);
+		else
+			rm(0, 0, 0x8b, hw(to.reg), &a0, 0, 0);
+		break;
+	case Oloadsh:
+	case Oloaduh:
+	case Oloadsb:
+	case Oloadub:
+	case Oextsh:
+	case Oextuh:
+	case Oextsb:
+	case Oextub:
+		if (KBASE(i.cls) != 0) {
+			bad = 1;
+			break;
+		}
+		a0 = opnd(i.arg[0], fn, isload(i.op));
+		to = opnd(i.to, fn, 0);
+		if (to.kind != OReg || a0.kind == OImm) {
+			bad = 1;
+			break;
+		}
+		n = i.op == Oextsb || i.op == Oextub;
+		rm(0, w, ldop[i.op], hw(to.reg), &a0, 0, n ? 2 : 0);
+		break;
+	case Oaddr:
+		a0 = opnd(i.arg[0], fn, 1);
+		to = opnd(i.to, fn, 0);
+		if (to.kind != OReg || KBASE(i.cls) != 0) {
+			bad = 1;
+			break;
+		}
+		rm(0, w, 0x8d, hw(to.reg), &a0, 0, 0);
+		break;
+	case Oswap:
+		if (KBASE(i.cls) != 0) {
+			enccopy(TMP(XMM0+15), i.arg[0], i.cls, fn);
+			enccopy(i.arg[0], i.arg[1], i.cls, fn);
+			enccopy(i.arg[1], TMP(XMM0+15), i.cls, fn);
+			break;
+		}
+		a0 = opnd(i.arg[0], fn, 0);
+		a1 = opnd(i.arg[1], fn, 0);
+		if (a0.kind == OReg && a1.kind == OReg
+		&& (a0.reg == RAX || a1.reg == RAX)
+		&& a0.reg != a1.reg) {
+			/* the short form with the accumulator */
+			n = hw(a0.reg == RAX ? a1.reg : a0.reg);
+			opc(0, (w ? 0x48 : 0) | (n & 8 ? 0x41 : 0), 0x90 + (n & 7));
+		} else if (a0.kind == OReg)
+			rm(0, w, 0x87, hw(a0.reg), &a1, 0, 0);
+		else if (a1.kind == OReg)
+			rm(0, w, 0x87, hw(a1.reg), &a0, 0, 0);
+		else
+			bad = 1;
+		break;
+	case Osign:
+		opc(0, w ? 0x48 : 0, 0x99);
+		break;
+	case Oxdiv:
+	case Oxidiv:
+		a0 = opnd(i.arg[0], fn, 0);
+		if (a0.kind == OImm || KBASE(i.cls) != 0) {
+			bad = 1;
+			break;
+		}
+		rm(0, w, 0xf7, i.op == Oxdiv ? 6 : 7, &a0, 0, 0);
+		break;
+	case Oxcmp:
+		if (KBASE(i.cls) != 0) {
+			bad = 1;
+			break;
+		}
+		a0 = opnd(i.arg[0], fn, 0);
+		a1 = opnd(i.arg[1], fn, 0);
+		alu(7, w, &a0, &a1);
+		break;
+	case Oxtest:
+		a0 = opnd(i.arg[0], fn, 0);
+		a1 = opnd(i.arg[1], fn, 0);
+		if (a0.kind == OImm && a1.kind == OReg && a1.reg == RAX) {
+			opc(0, w ? 0x48 : 0, 0xa9);
+			imm(&a0, 4, w);
+		} else if (a0.kind == OImm) {
+			rm(0, w, 0xf7, 0, &a1, 4, 0);
+			imm(&a0, 4, w);
+		} else if (a0.kind == OReg)
+			rm(0, w, 0x85, hw(a0.reg), &a1, 0, 0);
+		else if (a1.kind == OReg)
+			rm(0, w, 0x85, hw(a1.reg), &a0, 0, 0);
+		else
+			bad = 1;
+		break;
+	case Oflagieq:
+	case Oflagine:
+	case Oflagisge:
+	case Oflagisgt:
+	case Oflagisle:
+	case Oflagislt:
+	case Oflagiuge:
+	case Oflagiugt:
+	case Oflagiule:
+	case Oflagiult:
+	case Oflagfeq:
+	case Oflagfge:
+	case Oflagfgt:
+	case Oflagfle:
+	case Oflagflt:
+	case Oflagfne:
+	case Oflagfo:
+	case Oflagfuo:
+		to = opnd(i.to, fn, 0);
+		if (to.kind != OReg || KBASE(i.cls) != 0) {
+			bad = 1;
+			break;
+		}
+		rm(0, 0, 0x0f90 + ccode[i.op - Oflag], 0, &to, 0, 2);
+		rm(0, w, 0x0fb6, hw(to.reg), &to, 0, 2);
+		break;
+	case Ocall:
+		switch (rtype(i.arg[0])) {
+		case RCon:
+			con = &fn->con[i.arg[0].val];
+			if (con->type != CAddr) {
+				bad = 1;
+				break;
+			}
+			b1(0xe8);
+			addfix(RelPlt32, symname(con), con->bits.i - 4);
+			bn(0, 4);
+			break;
+		case RTmp:
+			a0 = opnd(i.arg[0], fn, 0);
+			rm(0, 0, 0xff, 2, &a0, 0, 0);
+			break;
+		default:
+			die("invalid call argument");
+		}
+		break;
+	case Osalloc:
+		a0 = opnd(i.arg[0], fn, 0);
+		to = oreg(RSP);
+		alu(5, 1, &a0, &to);
+		if (!req(i.to, R))
+			enccopy(i.to, TMP(RSP), Kl, fn);
+		break;
+	case Ocopy:
+		/* the same choices as emitins() */
+		assert(rtype(i.to) != RMem);
+		if (req(i.to, R) || req(i.arg[0], R))
+			break;
+		if (req(i.to, i.arg[0]))
+			break;
+		t0 = rtype(i.arg[0]);
+		con = t0 == RCon ? &fn->con[i.arg[0].val] : 0;
+		to = opnd(i.to, fn, 0);
+		if (i.cls == Kl && con && con->type == CBits) {
+			val = con->bits.i;
+			if (isreg(i.to))
+			if (val >= 0 && val <= UINT32_MAX) {
+				a0 = oimm(val);
+				mov(Kw, &a0, &to);
+				break;
+			}
+			if (rtype(i.to) == RSlot)
+			if (val < INT32_MIN || val > INT32_MAX) {
+				a0 = oimm((int32_t)val);
+				mov(Kw, &a0, &to);
+				a0 = oimm((int32_t)(val >> 32));
+				to.val += 4;
+				mov(Kw, &a0, &to);
+				break;
+			}
+		}
+		if (isreg(i.to) && con && con->type == CAddr) {
+			a0 = opnd(i.arg[0], fn, 1);
+			rm(0, w, 0x8d, hw(to.reg), &a0, 0, 0);
+			break;
+		}
+		if (rtype(i.to) == RSlot && (t0 == RSlot || t0 == RMem)) {
+			a0 = opnd(i.arg[0], fn, 0);
+			a1 = oreg(XMM0+15);
+			mov(w ? Kd : Ks, &a0, &a1);
+			mov(w ? Kd : Ks, &a1, &to);
+			break;
+		}
+		a0 = opnd(i.arg[0], fn, 0);
+		mov(i.cls, &a0, &to);
+		break;
+	}
+}
+
+static void
+endfrag(int cc, int blk)
+{
+	vgrow(&frag, nfrag+1);
+	frag[nfrag++] = (Frag){ncode, cc, blk, cc == NoJmp ? 0 : 2, 0};
+}
+
+static void
+pushpop(int op, int r)
+{
+	r = hw(r);
+	opc(0, r & 8 ? 0x41 : 0, op + (r & 7));
+}
+
+/* give each jump its length, starting
+ * short and growing the ones that do not
+ * reach until none change, as gas does
+ */
+static void
+relax(uint *blkfrag)
+{
+	Frag *f;
+	uint a, start;
+	int64_t d;
+	int more;
+
+	do {
+		a = 0;
+		start = 0;
+		for (f=frag; f<&frag[nfrag]; f++) {
+			f->addr = a;
+			a += f->end - start + f->len;
+			start = f->end;
+		}
+		more = 0;
+		start = 0;
+		for (f=frag; f<&frag[nfrag]; f++) {
+			if (f->len == 2) {
+				d = (int64_t)frag[blkfrag[f->blk]].addr
+					- (f->addr + f->end - start + 2);
+				if (d < -128 || d > 127) {
+					f->len = f->cc == Jmp ? 5 : 6;
+					more = 1;
+				}
+			}
+			start = f->end;
+		}
+	} while (more);
+}
+
+int
+amd64_objfn(Fn *fn)
+{
+	Blk *b, *s1, *s2;
+	Ins *i;
+	Opnd o, sp;
+	Frag *f;
+	Fix *x;
+	Loc *l;
+	uchar j[6];
+	uint *blkfrag, start, pos, end;
+	int *r, c, n;
+	uint64_t fs;
+	int64_t d;
+
+	if (!code) {
+		code = vnew(0, 1, PHeap);
+		frag = vnew(0, sizeof frag[0], PHeap);
+		fix = vnew(0, sizeof fix[0], PHeap);
+		loc = vnew(0, sizeof loc[0], PHeap);
+	}
+	ncode = 0;
+	nfrag = 0;
+	nfix = 0;
+	nloc = 0;
+	bad = 0;
+	blkfrag = alloc(fn->nblk * sizeof blkfrag[0]);
+
+	b1(0x55);
+	o = oreg(RBP);
+	sp = oreg(RSP);
+	mov(Kl, &sp, &o);
+	fs = amd64_framesz(fn);
+	if (fs > INT32_MAX)
+		return 0;
+	if (fs) {
+		o = oimm(fs);
+		alu(5, 1, &o, &sp);
+	}
+	if (fn->vararg) {
+		o.kind = OMem;
+		o.reg = RBP;
+		o.val = -176;
+		for (r=amd64_sysv_rsave; r<&amd64_sysv_rsave[6]; r++, o.val+=8)
+			rm(0, 1, 0x89, hw(*r), &o, 0, 0);
+		for (n=0; n<8; ++n, o.val+=16)
+			rm(0, 0, 0x0f29, n, &o, 0, 0);
+	}
+	for (r=amd64_sysv_rclob; r<&amd64_sysv_rclob[NCLR]; r++)
+		if (fn->reg & BIT(*r)) {
+			pushpop(0x50, *r);
+			fs += 8;
+		}
+
+	for (b=fn->start; b; b=b->link) {
+		endfrag(NoJmp, 0);
+		blkfrag[b->id] = nfrag;
+		for (i=b->ins; i!=&b->ins[b->nins]; i++)
+			encins(*i, fn);
+		switch (b->jmp.type) {
+		case Jhlt:
+			b1(0x0f);
+			b1(0x0b);
+			break;
+		case Jret0:
+			if (fn->dynalloc) {
+				o = oreg(RBP);
+				mov(Kl, &o, &sp);
+				o = oimm(fs);
+				alu(5, 1, &o, &sp);
+			}
+			for (r=&amd64_sysv_rclob[NCLR]; r>amd64_sysv_rclob;)
+				if (fn->reg & BIT(*--r))
+					pushpop(0x58, *r);
+			b1(0xc9);
+			b1(0xc3);
+			break;
+		case Jjmp:
+			if (b->s1 != b->link)
+				endfrag(Jmp, b->s1->id);
+			break;
+		default:
+			c = b->jmp.type - Jjf;
+			if (0 <= c && c <= NCmp) {
+				s1 = b->s1;
+				s2 = b->s2;
+				if (b->link == s2) {
+					s2 = s1;
+					s1 = b->link;
+				} else
+					c = cmpneg(c);
+				endfrag(ccode[c], s2->id);
+				if (s1 != b->link)
+					endfrag(Jmp, s1->id);
+				break;
+			}
+			die("unhandled jump %d", b->jmp.type);
+		}
+	}
+	endfrag(NoJmp, 0);
+	if (bad || !elf_objlnk(fn->name, &fn->lnk, ObjText))
+		return 0;
+
+	/* lay out the code and the jumps in .text */
+	relax(blkfrag);
+	pos = elf_objpos(ObjText);
+	start = 0;
+	x = fix;
+	l = loc;
+	for (f=frag; f<&frag[nfrag]; f++) {
+		for (; x<&fix[nfix] && x->off < f->end; x++)
+			elf_objrel(ObjText, pos + f->addr + x->off - start,
+				x->sym, x->type, x->add);
+		for (; l<&loc[nloc] && l->off < f->end; l++)
+			elf_objline(pos + f->addr + l->off - start, l->line);
+		elf_objbytes(ObjText, &code[start], f->end - start);
+		end = f->addr + f->end - start + f->len;
+		if (f->cc != NoJmp) {
+			d = (int64_t)frag[blkfrag[f->blk]].addr - end;
+			n = 0;
+			if (f->len == 2)
+				j[n++] = f->cc == Jmp ? 0xeb : 0x70 + f->cc;
+			else if (f->cc == Jmp)
+				j[n++] = 0xe9;
+			else {
+				j[n++] = 0x0f;
+				j[n++] = 0x80 + f->cc;
+			}
+			for (; n<f->len; n++, d>>=8)
+				j[n] = d;
+			elf_objbytes(ObjText, j, f->len);
+		}
+		start = f->end;
+	}
+	elf_objfnfin(fn->name);
+	return 1;
+}
@@ -375,6 +375,9 @@ sel(Ins i, ANum *an, Fn *fn)
 		break;
 	case Onop:
 		break;
+	case Odbgloc:
+		emiti(i);
+		break;
 	case Ostored:
 	case Ostores:
 	case Ostorel:
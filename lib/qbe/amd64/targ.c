@@ -32,6 +32,7 @@ amd64_memargs(int op)
 Target T_amd64_sysv = {
 	.name = "amd64_sysv",
 	.emitfin = elf_emitfin,
+	.objfn = amd64_objfn,
 	.asloc = ".L",
 	AMD64_COMMON
 };
@@ -377,6 +377,7 @@ emitins(Ins *i, E *e)
 		emitf(omap[o].asm, i, e);
 		break;
 	case Onop:
+	case Odbgloc:
 		break;
 	case Ocopy:
 		if (req(i->to, i->arg[0]))
@@ -291,6 +291,20 @@ uffind(Blk **pb, Blk **uf)
 	}
 }
 
+/* a block with nothing but line numbers
+ * is empty, and they are dropped with it
+ */
+static int
+emptyblk(Blk *b)
+{
+	Ins *i;
+
+	for (i=b->ins; i<&b->ins[b->nins]; i++)
+		if (i->op != Odbgloc)
+			return 0;
+	return 1;
+}
+
 /* requires rpo and no phis, breaks cfg */
 void
 simpljmp(Fn *fn)
@@ -309,7 +323,7 @@ simpljmp(Fn *fn)
 			b->jmp.type = Jjmp;
 			b->s1 = ret;
 		}
-		if (b->nins == 0)
+		if (emptyblk(b))
 		if (b->jmp.type == Jjmp) {
 			uffind(&b->s1, uf);
 			if (b->s1 != b)
@@ -329,3 +343,43 @@ simpljmp(Fn *fn)
 	*p = ret;
 	free(uf);
 }
+
+/* move the cold blocks after all the others,
+ * keeping them in the same order; a block is
+ * cold when it is marked so, or when all the
+ * blocks that reach it, other than by back
+ * edges, are cold; needs rpo and preds
+ */
+void
+sinkcold(Fn *fn)
+{
+	Blk *b, *cold, **p, **pc;
+	uint n, i, nfwd;
+	int hot;
+
+	fn->start->cold = 0;
+	for (n=1; n<fn->nblk; n++) {
+		b = fn->rpo[n];
+		if (b->cold)
+			continue;
+		nfwd = 0;
+		hot = 0;
+		for (i=0; i<b->npred; i++)
+			if (b->pred[i]->id < b->id) {
+				nfwd++;
+				hot |= !b->pred[i]->cold;
+			}
+		b->cold = nfwd && !hot;
+	}
+	cold = 0;
+	pc = &cold;
+	for (p=&fn->start; (b=*p);)
+		if (b->cold) {
+			*p = b->link;
+			*pc = b;
+			pc = &b->link;
+		} else
+			p = &b->link;
+	*pc = 0;
+	*p = cold;
+}
@@ -0,0 +1,751 @@
+#include "all.h"
+#include <ctype.h>
+#include <unistd.h>
+
+/* ELF relocatable object writer, used instead
+ * of emitdat() and an assembler when the target
+ * has an encoder (T.objfn) to put the machine
+ * code of functions in .text; data is laid out
+ * the same way emitdat() prints it; only amd64
+ * writes objects, so the relocations are x86-64;
+ * the dbgloc lines of the functions become a
+ * DWARF line table, as the assembler's -g gave
+ */
+
+typedef struct ObjSym ObjSym;
+typedef struct ObjRel ObjRel;
+typedef struct ObjSec ObjSec;
+typedef struct ObjLine ObjLine;
+
+struct ObjSym {
+	uint32_t id;  /* interned name */
+	int sec;      /* -1 while undefined */
+	uint64_t off;
+	uint64_t size;
+	char export;
+	char func;
+	uint idx;     /* index in .symtab */
+};
+
+struct ObjRel {
+	uint64_t off;
+	uint sym;
+	int type;
+	int64_t add;
+};
+
+struct ObjSec {
+	uchar *b;     /* contents, unused for .bss */
+	uint64_t n;
+	int align;
+	ObjRel *rel;
+	uint nrel;
+};
+
+struct ObjLine {
+	uint64_t off; /* in .text */
+	int line;
+};
+
+enum {
+	ShText = 1,
+	ShRelText,
+	ShData,
+	ShRelData,
+	ShBss,
+	ShSymtab,
+	ShStrtab,
+	ShShstrtab,
+	ShNote,
+	ShDbgInfo,
+	ShRelDbgInfo,
+	ShDbgAbbrev,
+	ShDbgLine,
+	ShRelDbgLine,
+	NSh,
+};
+
+enum {
+	/* section symbols after those of sec[] */
+	SymDbgAbbrev = 2 + NObjSec,
+	SymDbgLine,
+	NSecSym,
+};
+
+static ObjSec sec[NObjSec];
+static ObjSym *sym;
+static uint nsym;
+static uint *symh;  /* hash of sym, index+1 or 0 */
+static uint nsymh;
+static char *file;
+static int64_t zero;
+static ObjLine *line;
+static uint nline;
+
+static uchar *out;
+static uint64_t nout;
+
+static int reltype[] = {
+	[RelAbs64] = 1,   /* R_X86_64_64 */
+	[RelAbs32] = 10,  /* R_X86_64_32 */
+	[RelAbs32S] = 11, /* R_X86_64_32S */
+	[RelPc32] = 2,    /* R_X86_64_PC32 */
+	[RelPlt32] = 4,   /* R_X86_64_PLT32 */
+};
+
+static uint
+findsym(char *name)
+{
+	uint32_t id;
+	uint h, i, n, *h1;
+
+	id = intern(name);
+	if (2 * (nsym + 1) > nsymh) {
+		n = nsymh ? 2 * nsymh : 256;
+		h1 = emalloc(n * sizeof h1[0]);
+		for (i=0; i<nsym; i++) {
+			for (h=sym[i].id & (n-1); h1[h]; h=(h+1) & (n-1))
+				;
+			h1[h] = i + 1;
+		}
+		free(symh);
+		symh = h1;
+		nsymh = n;
+	}
+	for (h=id & (nsymh-1); symh[h]; h=(h+1) & (nsymh-1))
+		if (sym[symh[h]-1].id == id)
+			return symh[h] - 1;
+	vgrow(&sym, nsym+1);
+	memset(&sym[nsym], 0, sizeof sym[nsym]);
+	sym[nsym].id = id;
+	sym[nsym].sec = -1;
+	symh[h] = ++nsym;
+	return nsym - 1;
+}
+
+void
+elf_objinit(char *f)
+{
+	int s;
+
+	for (s=0; s<NObjSec; s++) {
+		if (!sec[s].b) {
+			sec[s].b = vnew(0, 1, PHeap);
+			sec[s].rel = vnew(0, sizeof(ObjRel), PHeap);
+		}
+		sec[s].n = 0;
+		sec[s].align = 1;
+		sec[s].nrel = 0;
+	}
+	if (!sym)
+		sym = vnew(0, sizeof sym[0], PHeap);
+	nsym = 0;
+	if (!line)
+		line = vnew(0, sizeof line[0], PHeap);
+	nline = 0;
+	if (symh)
+		memset(symh, 0, nsymh * sizeof symh[0]);
+	file = f;
+}
+
+uint64_t
+elf_objpos(int s)
+{
+	return sec[s].n;
+}
+
+void
+elf_objbytes(int s, uchar *b, uint n)
+{
+	vgrow(&sec[s].b, sec[s].n + n);
+	memcpy(&sec[s].b[sec[s].n], b, n);
+	sec[s].n += n;
+}
+
+static void
+objfill(int s, uint64_t n, int c)
+{
+	if (s == ObjBss) {
+		sec[s].n += n;
+		return;
+	}
+	vgrow(&sec[s].b, sec[s].n + n);
+	memset(&sec[s].b[sec[s].n], c, n);
+	sec[s].n += n;
+}
+
+void
+elf_objrel(int s, uint64_t off, char *name, int type, int64_t add)
+{
+	ObjRel *r;
+
+	vgrow(&sec[s].rel, sec[s].nrel + 1);
+	r = &sec[s].rel[sec[s].nrel++];
+	r->off = off;
+	r->sym = findsym(name);
+	r->type = type;
+	r->add = add;
+}
+
+/* the object counterpart of emitlnk(),
+ * returns 0 for what only the assembler
+ * can do: quoted names and other sections
+ */
+int
+elf_objlnk(char *n, Lnk *l, int s)
+{
+	ObjSym *y;
+	uint64_t a;
+	uint i;
+
+	if (n[0] == '"' || l->sec || l->thread)
+		return 0;
+	if (l->align) {
+		a = l->align;
+		if (a > (uint64_t)sec[s].align)
+			sec[s].align = a;
+		objfill(s, (a - sec[s].n % a) % a, s == ObjText ? 0x90 : 0);
+	}
+	i = findsym(n); /* may move sym */
+	y = &sym[i];
+	if (y->sec != -1)
+		err("symbol %s is already defined", n);
+	y->sec = s;
+	y->off = sec[s].n;
+	y->export = l->export;
+	return 1;
+}
+
+void
+elf_objfnfin(char *n)
+{
+	ObjSym *y;
+	uint i;
+
+	i = findsym(n);
+	y = &sym[i];
+	y->func = 1;
+	y->size = sec[ObjText].n - y->off;
+}
+
+/* the code at .text offset off on is from
+ * source line l, until the next call
+ */
+void
+elf_objline(uint64_t off, int l)
+{
+	if (nline && line[nline-1].line == l)
+		return;
+	if (nline && line[nline-1].off == off) {
+		line[nline-1].line = l;
+		return;
+	}
+	vgrow(&line, nline+1);
+	line[nline++] = (ObjLine){off, l};
+}
+
+/* put the bytes of a string literal, with
+ * the escapes that .ascii takes
+ */
+static void
+objstr(char *s)
+{
+	uchar c, buf[512];
+	int n, nb;
+
+	nb = 0;
+	for (s++; *s != '"'; s++) {
+		c = *s;
+		if (c == '\\') {
+			c = *++s;
+			switch (c) {
+			case 'n': c = '\n'; break;
+			case 't': c = '\t'; break;
+			case 'r': c = '\r'; break;
+			case 'b': c = '\b'; break;
+			case 'f': c = '\f'; break;
+			case 'x':
+				for (c=0; isxdigit((uchar)s[1]); s++)
+					c = 16 * c + (isdigit((uchar)s[1])
+						? s[1] - '0'
+						: (s[1] | 32) - 'a' + 10);
+				break;
+			default:
+				if ('0' <= c && c <= '7') {
+					c -= '0';
+					for (n=1; n<3 && '0' <= s[1] && s[1] <= '7'; n++)
+						c = 8 * c + *++s - '0';
+				}
+				break;
+			}
+		}
+		buf[nb++] = c;
+		if (nb == sizeof buf) {
+			elf_objbytes(ObjData, buf, nb);
+			nb = 0;
+		}
+	}
+	elf_objbytes(ObjData, buf, nb);
+}
+
+/* the object counterpart of emitdat() */
+int
+elf_objdat(Dat *d)
+{
+	static int dsz[] = {[DB] = 1, [DH] = 2, [DW] = 4, [DL] = 8};
+	uchar b[8];
+	int64_t v;
+	int i;
+
+	switch (d->type) {
+	case DStart:
+		zero = 0;
+		break;
+	case DEnd:
+		if (zero != -1) {
+			if (!elf_objlnk(d->name, d->lnk, ObjBss))
+				return 0;
+			objfill(ObjBss, zero, 0);
+		}
+		break;
+	case DZ:
+		if (zero != -1)
+			zero += d->u.num;
+		else
+			objfill(ObjData, d->u.num, 0);
+		break;
+	default:
+		if (zero != -1) {
+			if (!elf_objlnk(d->name, d->lnk, ObjData))
+				return 0;
+			objfill(ObjData, zero, 0);
+			zero = -1;
+		}
+		if (d->isstr) {
+			if (d->type != DB)
+				err("strings only supported for 'b' currently");
+			objstr(d->u.str);
+			break;
+		}
+		v = d->u.num;
+		if (d->isref) {
+			if (d->u.ref.name[0] == '"')
+				return 0;
+			if (d->type == DL)
+				i = RelAbs64;
+			else if (d->type == DW)
+				i = RelAbs32;
+			else
+				return 0;
+			elf_objrel(ObjData, sec[ObjData].n,
+				d->u.ref.name, i, d->u.ref.off);
+			v = 0;
+		}
+		for (i=0; i<dsz[d->type]; i++)
+			b[i] = v >> 8*i;
+		elf_objbytes(ObjData, b, dsz[d->type]);
+		break;
+	}
+	return 1;
+}
+
+static void
+put(uint64_t v, int n)
+{
+	vgrow(&out, nout + n);
+	while (n--) {
+		out[nout++] = v;
+		v >>= 8;
+	}
+}
+
+static void
+putb(uchar *b, uint64_t n)
+{
+	vgrow(&out, nout + n);
+	memcpy(&out[nout], b, n);
+	nout += n;
+}
+
+static void
+putuleb(uint64_t v)
+{
+	for (; v >= 0x80; v >>= 7)
+		put(v | 0x80, 1);
+	put(v, 1);
+}
+
+static void
+putsleb(int64_t v)
+{
+	for (; v < -64 || v > 63; v >>= 7)
+		put(v | 0x80, 1);
+	put(v & 0x7f, 1);
+}
+
+/* overwrite what put() wrote at o */
+static void
+patch(uint64_t o, uint64_t v, int n)
+{
+	while (n--) {
+		out[o++] = v;
+		v >>= 8;
+	}
+}
+
+static void
+putalign(int a)
+{
+	while (nout % a)
+		put(0, 1);
+}
+
+static uint
+putstr(char **tab, uint *n, char *s)
+{
+	uint o, l;
+
+	o = *n;
+	l = strlen(s) + 1;
+	vgrow(tab, o + l);
+	memcpy(&(*tab)[o], s, l);
+	*n = o + l;
+	return o;
+}
+
+static void
+putsh(uint name, int type, uint64_t flags, uint64_t off, uint64_t size,
+	int link, int info, uint64_t align, uint64_t entsize)
+{
+	put(name, 4);
+	put(type, 4);
+	put(flags, 8);
+	put(0, 8);
+	put(off, 8);
+	put(size, 8);
+	put(link, 4);
+	put(info, 4);
+	put(align, 8);
+	put(entsize, 8);
+}
+
+static void
+putsym(uint name, int info, int shndx, uint64_t value, uint64_t size)
+{
+	put(name, 4);
+	put(info, 1);
+	put(0, 1);
+	put(shndx, 2);
+	put(value, 8);
+	put(size, 8);
+}
+
+static void
+putrel(uint64_t off, int type, uint sym, int64_t add)
+{
+	put(off, 8);
+	put(reltype[type], 4);
+	put(sym, 4);
+	put(add, 8);
+}
+
+/* a DWARF 4 compilation unit for the code
+ * in .text, with the line table that the
+ * dbgloc lines gave; nothing if there were
+ * none, and the sections are left empty
+ */
+static void
+putdbg(uint64_t *shoff, uint64_t *shsize)
+{
+	static uchar abbrev[] = {
+		1, 0x11, 0,  /* DW_TAG_compile_unit, no children */
+		0x10, 0x17,  /* DW_AT_stmt_list, DW_FORM_sec_offset */
+		0x11, 0x01,  /* DW_AT_low_pc, DW_FORM_addr */
+		0x12, 0x07,  /* DW_AT_high_pc, DW_FORM_data8 */
+		0x03, 0x08,  /* DW_AT_name, DW_FORM_string */
+		0x1b, 0x08,  /* DW_AT_comp_dir, DW_FORM_string */
+		0x25, 0x08,  /* DW_AT_producer, DW_FORM_string */
+		0x13, 0x05,  /* DW_AT_language, DW_FORM_data2 */
+		0, 0, 0,
+	};
+	static uchar oplen[] = {0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1};
+	char dir[4096];
+	uint64_t o, h, lrel;
+	ObjLine *l;
+	int64_t n;
+
+	if (!nline)
+		return;
+	if (!getcwd(dir, sizeof dir))
+		dir[0] = 0;
+
+	o = nout;
+	shoff[ShDbgInfo] = o;
+	put(0, 4);
+	put(4, 2);
+	put(0, 4);     /* .debug_abbrev, at o+6 */
+	put(8, 1);
+	putuleb(1);
+	put(0, 4);     /* .debug_line, at o+12 */
+	put(0, 8);     /* .text, at o+16 */
+	put(sec[ObjText].n, 8);
+	putb((uchar *)file, strlen(file) + 1);
+	putb((uchar *)dir, strlen(dir) + 1);
+	putb((uchar *)"qbe", 4);
+	put(0xc, 2);   /* DW_LANG_C99 */
+	patch(o, nout - o - 4, 4);
+	shsize[ShDbgInfo] = nout - o;
+
+	shoff[ShDbgAbbrev] = nout;
+	putb(abbrev, sizeof abbrev);
+	shsize[ShDbgAbbrev] = sizeof abbrev;
+
+	o = nout;
+	shoff[ShDbgLine] = o;
+	put(0, 4);
+	put(4, 2);
+	h = nout;
+	put(0, 4);
+	put(1, 1);     /* minimum_instruction_length */
+	put(1, 1);     /* maximum_operations_per_instruction */
+	put(1, 1);     /* default_is_stmt */
+	put(-5, 1);    /* line_base */
+	put(14, 1);    /* line_range */
+	put(sizeof oplen + 1, 1);
+	putb(oplen, sizeof oplen);
+	put(0, 1);     /* no include_directories */
+	putb((uchar *)file, strlen(file) + 1);
+	put(0, 3);     /* directory, time and length */
+	put(0, 1);
+	patch(h, nout - h - 4, 4);
+	put(0, 1);     /* DW_LNE_set_address */
+	putuleb(9);
+	put(2, 1);
+	lrel = nout - o;
+	put(0, 8);
+	n = 1;
+	for (l=line; l<&line[nline]; l++) {
+		if (l != line) {
+			put(2, 1); /* DW_LNS_advance_pc */
+			putuleb(l->off - l[-1].off);
+		}
+		if (l->line != n) {
+			put(3, 1); /* DW_LNS_advance_line */
+			putsleb(l->line - n);
+			n = l->line;
+		}
+		put(1, 1);     /* DW_LNS_copy */
+	}
+	put(2, 1);
+	putuleb(sec[ObjText].n - line[nline-1].off);
+	put(0, 1);     /* DW_LNE_end_sequence */
+	putuleb(1);
+	put(1, 1);
+	patch(o, nout - o - 4, 4);
+	shsize[ShDbgLine] = nout - o;
+
+	putalign(8);
+	shoff[ShRelDbgInfo] = nout;
+	putrel(6, RelAbs32, SymDbgAbbrev, 0);
+	putrel(12, RelAbs32, SymDbgLine, 0);
+	putrel(16, RelAbs64, 2 + ObjText, 0);
+	shsize[ShRelDbgInfo] = nout - shoff[ShRelDbgInfo];
+	shoff[ShRelDbgLine] = nout;
+	putrel(lrel, RelAbs64, 2 + ObjText, line[0].off);
+	shsize[ShRelDbgLine] = nout - shoff[ShRelDbgLine];
+}
+
+/* pc-relative references to local symbols
+ * in the same section are resolved here,
+ * as the assembler does
+ */
+static void
+objlocal(int s)
+{
+	ObjRel *r, *r1;
+	ObjSym *y;
+	int64_t v;
+	int i;
+
+	r1 = sec[s].rel;
+	for (r=sec[s].rel; r<&sec[s].rel[sec[s].nrel]; r++) {
+		y = &sym[r->sym];
+		if ((r->type == RelPc32 || r->type == RelPlt32)
+		&& y->sec == s && !y->export) {
+			v = y->off + r->add - r->off;
+			for (i=0; i<4; i++)
+				sec[s].b[r->off + i] = v >> 8*i;
+			continue;
+		}
+		*r1++ = *r;
+	}
+	sec[s].nrel = r1 - sec[s].rel;
+}
+
+/* write the object, with the symbols
+ * local to it first, as ELF requires
+ */
+void
+elf_objwrite(FILE *f)
+{
+	static int shsec[] = {
+		[ObjText] = ShText,
+		[ObjData] = ShData,
+		[ObjBss] = ShBss,
+	};
+	static char *shname[NSh] = {
+		[ShText] = ".text",
+		[ShRelText] = ".rela.text",
+		[ShData] = ".data",
+		[ShRelData] = ".rela.data",
+		[ShBss] = ".bss",
+		[ShSymtab] = ".symtab",
+		[ShStrtab] = ".strtab",
+		[ShShstrtab] = ".shstrtab",
+		[ShNote] = ".note.GNU-stack",
+		[ShDbgInfo] = ".debug_info",
+		[ShRelDbgInfo] = ".rela.debug_info",
+		[ShDbgAbbrev] = ".debug_abbrev",
+		[ShDbgLine] = ".debug_line",
+		[ShRelDbgLine] = ".rela.debug_line",
+	};
+	uint64_t shoff[NSh], shsize[NSh];
+	uint shn[NSh], nstr, nshstr, *name, i, nloc, idx;
+	char *strtab, *shstrtab;
+	ObjSym *y;
+	ObjRel *r;
+	int s, g;
+
+	objlocal(ObjText);
+	strtab = vnew(0, 1, PHeap);
+	shstrtab = vnew(0, 1, PHeap);
+	name = emalloc((nsym + 1) * sizeof name[0]);
+	nstr = 0;
+	nshstr = 0;
+	putstr(&strtab, &nstr, "");
+	putstr(&shstrtab, &nshstr, "");
+	for (i=1; i<NSh; i++)
+		shn[i] = putstr(&shstrtab, &nshstr, shname[i]);
+
+	/* the null symbol, the file, the
+	 * sections, and then the symbols
+	 * local to the object come first
+	 */
+	idx = NSecSym;
+	for (g=0; g<2; g++)
+		for (y=sym; y<&sym[nsym]; y++)
+			if ((y->sec == -1 || y->export) == g) {
+				y->idx = idx++;
+				name[y-sym] = putstr(&strtab, &nstr, str(y->id));
+			}
+	nloc = NSecSym;
+	for (y=sym; y<&sym[nsym]; y++)
+		if (y->sec != -1 && !y->export)
+			nloc++;
+
+	nout = 0;
+	if (!out)
+		out = vnew(0, 1, PHeap);
+	put(0, 64);
+	memset(shoff, 0, sizeof shoff);
+	memset(shsize, 0, sizeof shsize);
+	for (s=0; s<NObjSec; s++) {
+		putalign(sec[s].align);
+		shoff[shsec[s]] = nout;
+		shsize[shsec[s]] = sec[s].n;
+		if (s != ObjBss)
+			putb(sec[s].b, sec[s].n);
+	}
+	shoff[ShBss] = nout;
+	for (s=0; s<NObjSec; s++) {
+		if (s == ObjBss)
+			continue;
+		putalign(8);
+		shoff[shsec[s]+1] = nout;
+		for (r=sec[s].rel; r<&sec[s].rel[sec[s].nrel]; r++)
+			putrel(r->off, r->type, sym[r->sym].idx, r->add);
+		shsize[shsec[s]+1] = nout - shoff[shsec[s]+1];
+	}
+	putdbg(shoff, shsize);
+
+	putalign(8);
+	shoff[ShSymtab] = nout;
+	putsym(0, 0, 0, 0, 0);
+	putsym(putstr(&strtab, &nstr, file), 4, 0xfff1, 0, 0);
+	for (s=0; s<NObjSec; s++)
+		putsym(0, 3, shsec[s], 0, 0);
+	putsym(0, 3, ShDbgAbbrev, 0, 0);
+	putsym(0, 3, ShDbgLine, 0, 0);
+	for (g=0; g<2; g++)
+		for (y=sym; y<&sym[nsym]; y++)
+			if ((y->sec == -1 || y->export) == g)
+				putsym(name[y-sym],
+					(g << 4) | (y->func ? 2 : 0),
+					y->sec == -1 ? 0 : shsec[y->sec],
+					y->off, y->size);
+	shsize[ShSymtab] = nout - shoff[ShSymtab];
+	shoff[ShStrtab] = nout;
+	putb((uchar *)strtab, nstr);
+	shsize[ShStrtab] = nstr;
+	shoff[ShShstrtab] = nout;
+	putb((uchar *)shstrtab, nshstr);
+	shsize[ShShstrtab] = nshstr;
+	shoff[ShNote] = nout;
+
+	/* section headers */
+	putalign(8);
+	i = nout;
+	putsh(0, 0, 0, 0, 0, 0, 0, 0, 0);
+	putsh(shn[ShText], 1, 6, shoff[ShText], shsize[ShText],
+		0, 0, sec[ObjText].align, 0);
+	putsh(shn[ShRelText], 4, 0x40, shoff[ShRelText], shsize[ShRelText],
+		ShSymtab, ShText, 8, 24);
+	putsh(shn[ShData], 1, 3, shoff[ShData], shsize[ShData],
+		0, 0, sec[ObjData].align, 0);
+	putsh(shn[ShRelData], 4, 0x40, shoff[ShRelData], shsize[ShRelData],
+		ShSymtab, ShData, 8, 24);
+	putsh(shn[ShBss], 8, 3, shoff[ShBss], shsize[ShBss],
+		0, 0, sec[ObjBss].align, 0);
+	putsh(shn[ShSymtab], 2, 0, shoff[ShSymtab], shsize[ShSymtab],
+		ShStrtab, nloc, 8, 24);
+	putsh(shn[ShStrtab], 3, 0, shoff[ShStrtab], shsize[ShStrtab],
+		0, 0, 1, 0);
+	putsh(shn[ShShstrtab], 3, 0, shoff[ShShstrtab], shsize[ShShstrtab],
+		0, 0, 1, 0);
+	putsh(shn[ShNote], 1, 0, shoff[ShNote], 0, 0, 0, 1, 0);
+	putsh(shn[ShDbgInfo], 1, 0, shoff[ShDbgInfo], shsize[ShDbgInfo],
+		0, 0, 1, 0);
+	putsh(shn[ShRelDbgInfo], 4, 0x40, shoff[ShRelDbgInfo],
+		shsize[ShRelDbgInfo], ShSymtab, ShDbgInfo, 8, 24);
+	putsh(shn[ShDbgAbbrev], 1, 0, shoff[ShDbgAbbrev], shsize[ShDbgAbbrev],
+		0, 0, 1, 0);
+	putsh(shn[ShDbgLine], 1, 0, shoff[ShDbgLine], shsize[ShDbgLine],
+		0, 0, 1, 0);
+	putsh(shn[ShRelDbgLine], 4, 0x40, shoff[ShRelDbgLine],
+		shsize[ShRelDbgLine], ShSymtab, ShDbgLine, 8, 24);
+
+	/* the ELF header */
+	idx = nout;
+	nout = 0;
+	putb((uchar *)"\177ELF\2\1\1", 7);
+	put(0, 9);
+	put(1, 2);     /* ET_REL */
+	put(62, 2);    /* EM_X86_64 */
+	put(1, 4);
+	put(0, 8);
+	put(0, 8);
+	put(i, 8);     /* section headers */
+	put(0, 4);
+	put(64, 2);
+	put(0, 2);
+	put(0, 2);
+	put(64, 2);
+	put(NSh, 2);
+	put(ShShstrtab, 2);
+	nout = idx;
+
+	fwrite(out, 1, nout, f);
+	vfree(strtab);
+	vfree(shstrtab);
+	free(name);
+}
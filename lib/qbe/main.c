@@ -34,12 +34,21 @@ static Target *tlist[] = {
 };
 static FILE *outf;
 static int dbg;
+static int obj;    /* writing an object, see elf.c */
+static int objbad; /* and T.objfn() gave up */
 
 static void
 data(Dat *d)
 {
 	if (dbg)
 		return;
+	if (obj) {
+		if (!objbad && !elf_objdat(d))
+			objbad = 1;
+		if (d->type == DEnd)
+			freeall();
+		return;
+	}
 	emitdat(d, outf);
 	if (d->type == DEnd) {
 		fputs("/* end data */\n\n", outf);
@@ -52,6 +61,11 @@ func(Fn *fn)
 {
 	uint n;
 
+	if (obj && objbad) {
+		/* the assembler will do it all */
+		freeall();
+		return;
+	}
 	if (dbg)
 		fprintf(stderr, "**** Function %s ****", fn->name);
 	if (debug['P']) {
@@ -99,7 +113,11 @@ func(Fn *fn)
 			break;
 		} else
 			fn->rpo[n]->link = fn->rpo[n+1];
-	if (!dbg) {
+	sinkcold(fn);
+	if (obj) {
+		if (!T.objfn(fn))
+			objbad = 1;
+	} else if (!dbg) {
 		T.emitfn(fn, outf);
 		fprintf(outf, "/* end function %s */\n\n", fn->name);
 	} else
@@ -107,6 +125,91 @@ func(Fn *fn)
 	freeall();
 }
 
+/* Entry points for front ends that link
+ * libqbe.a and hand their IL over in-process
+ * instead of running the qbe binary; they may
+ * be called for any number of modules
+ *
+ * Two limitations are deliberate:
+ *
+ * - They are not reentrant; like the rest of
+ *   QBE they keep their state in globals (T,
+ *   the pools of util.c, the tables of parse.c
+ *   and elf.c, and the statics above), so one
+ *   translation at a time per process.  The
+ *   compile server gets its parallelism from
+ *   fork() rather than threads.
+ *
+ * - The IL is still handed over as text, and
+ *   parse() reads it from a FILE.  A front end
+ *   that cannot build the Fn and Dat structures
+ *   itself (MINIC has no unions, unsigned types
+ *   or bitfields) has nothing better to give,
+ *   and the text is held in memory, so the cost
+ *   is the parse alone.
+ */
+
+int
+qbe_init(char *tgt)
+{
+	Target **t;
+
+	T = Deftgt;
+	dbg = 0;
+	obj = 0;
+	if (!tgt)
+		return 1;
+	for (t=tlist; *t; t++)
+		if (strcmp(tgt, (*t)->name) == 0) {
+			T = **t;
+			return 1;
+		}
+	return 0;
+}
+
+void
+qbe_translate(FILE *inf, char *path, FILE *f)
+{
+	outf = f;
+	parse(inf, path, data, func);
+}
+
+void
+qbe_finish(FILE *f)
+{
+	T.emitfin(f);
+}
+
+/* Between these, qbe_translate() puts the
+ * functions and data into an ELF object, with
+ * no assembler, when the target can encode
+ * them; the object for file is written to f,
+ * or 0 is returned and nothing is written if
+ * the assembly code is needed after all
+ */
+
+int
+qbe_objbegin(char *file)
+{
+	if (!T.objfn)
+		return 0;
+	obj = 1;
+	objbad = 0;
+	elf_objinit(file);
+	return 1;
+}
+
+int
+qbe_objend(FILE *f)
+{
+	obj = 0;
+	if (objbad)
+		return 0;
+	elf_objwrite(f);
+	return 1;
+}
+
+#ifndef LIBQBE
 int
 main(int ac, char *av[])
 {
@@ -190,3 +293,4 @@ main(int ac, char *av[])
 
 	exit(0);
 }
+#endif
@@ -46,6 +46,8 @@ enum Token {
 	Tjnz,
 	Tret,
 	Thlt,
+	Tcold,
+	Tdbgloc,
 	Texport,
 	Tthread,
 	Tfunc,
@@ -103,6 +105,8 @@ static char *kwmap[Ntok] = {
 	[Tjnz] = "jnz",
 	[Tret] = "ret",
 	[Thlt] = "hlt",
+	[Tcold] = "cold",
+	[Tdbgloc] = "dbgloc",
 	[Texport] = "export",
 	[Tthread] = "thread",
 	[Tfunc] = "function",
@@ -155,6 +159,7 @@ static Blk **blink;
 static Blk *blkh[BMask+1];
 static int nblk;
 static int rcls;
+static int dbgline; /* dbgloc waiting for a block */
 static uint ntyp;
 
 void
@@ -572,6 +577,15 @@ closeblk()
 	curi = insb;
 }
 
+static void
+dbgloc()
+{
+	if (curi - insb >= NIns)
+		err("too many instructions");
+	*curi++ = (Ins){.op = Odbgloc, .cls = Kw, .arg = {INT(dbgline)}};
+	dbgline = 0;
+}
+
 static PState
 parseline(PState ps)
 {
@@ -584,6 +598,18 @@ parseline(PState ps)
 	int t, op, i, k, ty;
 
 	t = nextnl();
+	if (t == Tdbgloc) {
+		/* the source line of the code that
+		 * follows; after a jump it goes to
+		 * the start of the next block
+		 */
+		expect(Tint);
+		dbgline = tokval.num;
+		expect(Tnl);
+		if (ps != PLbl)
+			dbgloc();
+		return ps;
+	}
 	if (ps == PLbl && t != Tlbl && t != Trbrace)
 		err("label or } expected");
 	switch (t) {
@@ -615,7 +641,13 @@ parseline(PState ps)
 		*blink = b;
 		curb = b;
 		plink = &curb->phi;
+		if (peek() == Tcold) {
+			next();
+			b->cold = 1;
+		}
 		expect(Tnl);
+		if (dbgline)
+			dbgloc();
 		return PPhi;
 	case Tret:
 		curb->jmp.type = Jretw + rcls;
@@ -865,6 +897,7 @@ parsefn(Lnk *lnk)
 	curb = 0;
 	nblk = 0;
 	curi = insb;
+	dbgline = 0;
 	curf = alloc(sizeof *curf);
 	curf->ntmp = 0;
 	curf->ncon = 2;
@@ -1292,7 +1325,7 @@ printfn(Fn *fn, FILE *f)
 
 	fprintf(f, "function $%s() {\n", fn->name);
 	for (b=fn->start; b; b=b->link) {
-		fprintf(f, "@%s\n", b->name);
+		fprintf(f, "@%s%s\n", b->name, b->cold ? " cold" : "");
 		for (p=b->phi; p; p=p->link) {
 			fprintf(f, "\t");
 			printref(p->to, fn, f);
@@ -367,6 +367,7 @@ emitins(Ins *i, Fn *fn, FILE *f)
 		}
 		break;
 	case Onop:
+	case Odbgloc:
 		break;
 	case Oaddr:
 		assert(rtype(i->arg[0]) == RSlot);
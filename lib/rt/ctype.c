@@ -0,0 +1,186 @@
+/**
+ * @file ctype.c
+ * @author BrunchTea
+ * @brief Character classes for the runtime, in the C locale
+ */
+#include "rt.h"
+
+// Return true if c is an upper case letter
+/**
+ * @fn isupper
+ * @brief Return true if c is an upper case letter
+ * @param c The character
+ * @return True or false
+ */
+int isupper(int c)
+{
+  return (c >= 'A' && c <= 'Z');
+}
+
+// Return true if c is a lower case letter
+/**
+ * @fn islower
+ * @brief Return true if c is a lower case letter
+ * @param c The character
+ * @return True or false
+ */
+int islower(int c)
+{
+  return (c >= 'a' && c <= 'z');
+}
+
+// Return true if c is a letter
+/**
+ * @fn isalpha
+ * @brief Return true if c is a letter
+ * @param c The character
+ * @return True or false
+ */
+int isalpha(int c)
+{
+  return (isupper(c) || islower(c));
+}
+
+// Return true if c is a decimal digit
+/**
+ * @fn isdigit
+ * @brief Return true if c is a decimal digit
+ * @param c The character
+ * @return True or false
+ */
+int isdigit(int c)
+{
+  return (c >= '0' && c <= '9');
+}
+
+// Return true if c is a letter or a digit
+/**
+ * @fn isalnum
+ * @brief Return true if c is a letter or a digit
+ * @param c The character
+ * @return True or false
+ */
+int isalnum(int c)
+{
+  return (isalpha(c) || isdigit(c));
+}
+
+// Return true if c is a hexadecimal digit
+/**
+ * @fn isxdigit
+ * @brief Return true if c is a hexadecimal digit
+ * @param c The character
+ * @return True or false
+ */
+int isxdigit(int c)
+{
+  return (isdigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
+}
+
+// Return true if c is a control character
+/**
+ * @fn iscntrl
+ * @brief Return true if c is a control character
+ * @param c The character
+ * @return True or false
+ */
+int iscntrl(int c)
+{
+  return ((c >= 0 && c < ' ') || c == 127);
+}
+
+// Return true if c is printable, including space
+/**
+ * @fn isprint
+ * @brief Return true if c is printable, including space
+ * @param c The character
+ * @return True or false
+ */
+int isprint(int c)
+{
+  return (c >= ' ' && c < 127);
+}
+
+// Return true if c is printable, except space
+/**
+ * @fn isgraph
+ * @brief Return true if c is printable, except space
+ * @param c The character
+ * @return True or false
+ */
+int isgraph(int c)
+{
+  return (c > ' ' && c < 127);
+}
+
+// Return true if c is punctuation
+/**
+ * @fn ispunct
+ * @brief Return true if c is punctuation
+ * @param c The character
+ * @return True or false
+ */
+int ispunct(int c)
+{
+  return (isgraph(c) && !isalnum(c));
+}
+
+// Return true if c is white space
+/**
+ * @fn isspace
+ * @brief Return true if c is white space
+ * @param c The character
+ * @return True or false
+ */
+int isspace(int c)
+{
+  return (c == ' ' || (c >= '\t' && c <= '\r'));
+}
+
+// Return true if c is a space or a tab
+/**
+ * @fn isblank
+ * @brief Return true if c is a space or a tab
+ * @param c The character
+ * @return True or false
+ */
+int isblank(int c)
+{
+  return (c == ' ' || c == '\t');
+}
+
+// Return true if c is a 7-bit character
+/**
+ * @fn isascii
+ * @brief Return true if c is a 7-bit character
+ * @param c The character
+ * @return True or false
+ */
+int isascii(int c)
+{
+  return (c >= 0 && c < 128);
+}
+
+// Return the upper case of a letter
+/**
+ * @fn toupper
+ * @brief Return the upper case of a letter
+ * @param c The character
+ * @return Its upper case, or c
+ */
+int toupper(int c)
+{
+  return (islower(c) ? c - 'a' + 'A' : c);
+}
+
+// Return the lower case of a letter
+/**
+ * @fn tolower
+ * @brief Return the lower case of a letter
+ * @param c The character
+ * @return Its lower case, or c
+ */
+int tolower(int c)
+{
+  return (isupper(c) ? c - 'A' + 'a' : c);
+}
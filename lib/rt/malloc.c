@@ -0,0 +1,183 @@
+/**
+ * @file malloc.c
+ * @author BrunchTea
+ * @brief Memory allocation for the runtime
+ */
+#include "rt.h"
+
+// Memory allocation.
+//
+// Each block has a 16-byte header before it which holds its
+// size class. The classes are powers of two from 16 bytes up,
+// and a freed block goes on the free list for its class, ready
+// for the next block of that class. New blocks are cut from
+// chunks of memory that we get with mmap(). A block too big
+// for the largest class gets its own mapping, which free()
+// hands back to the kernel.
+
+#define NCLASS 16		// Classes of 16 bytes to 512K
+#define HDRSIZE 16		// Bytes before each block
+#define CHUNKSIZE (1024 * 1024)	// Bytes that we map at once
+#define BIGBLOCK (-1)		// The class of a block mapped alone
+
+// The header before each block
+struct header {
+  long class;			// Its size class, or BIGBLOCK
+  long size;			// Bytes mapped for a big block
+};
+
+static void *freelist[NCLASS];	// Free blocks of each class
+static char *chunk;		// Where the next block is cut from
+static size_t chunkleft;	// Bytes left in the chunk
+
+// Map len bytes of zeroed memory
+/**
+ * @fn getpages
+ * @brief Map zeroed memory
+ * @param len The number of bytes
+ * @return The memory, or NULL
+ */
+static void *getpages(size_t len)
+{
+  long r;
+
+  // PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS
+  r = __rt_ret(__rt_syscall(SYS_mmap, 0, len, 3, 0x22, -1, 0));
+  if (r == -1)
+    return (NULL);
+  return ((void *)r);
+}
+
+// Allocate size bytes
+/**
+ * @fn malloc
+ * @brief Allocate memory
+ * @param size The number of bytes
+ * @return The memory, or NULL
+ */
+void *malloc(size_t size)
+{
+  struct header *h;
+  size_t need;
+  int class = 0;
+
+  // Find the smallest class that the block fits in
+  while (class < NCLASS && ((size_t)16 << class) < size)
+    class++;
+
+  // A big block gets its own mapping
+  if (class == NCLASS)
+  {
+    need = (size + HDRSIZE + 4095) & ~(size_t)4095;
+    if (need < size || (h = getpages(need)) == NULL)
+    {
+      errno = ENOMEM;
+      return (NULL);
+    }
+    h->class = BIGBLOCK;
+    h->size = need;
+    return ((char *)h + HDRSIZE);
+  }
+
+  // Reuse a free block of the class if there is one
+  if (freelist[class] != NULL)
+  {
+    h = freelist[class];
+    freelist[class] = *(void **)((char *)h + HDRSIZE);
+    return ((char *)h + HDRSIZE);
+  }
+
+  // Otherwise, cut one from the chunk. Any
+  // end of the old chunk is left unused
+  need = ((size_t)16 << class) + HDRSIZE;
+  if (chunkleft < need)
+  {
+    if ((chunk = getpages(CHUNKSIZE)) == NULL)
+    {
+      chunkleft = 0;
+      errno = ENOMEM;
+      return (NULL);
+    }
+    chunkleft = CHUNKSIZE;
+  }
+  h = (struct header *)chunk;
+  chunk += need;
+  chunkleft -= need;
+  h->class = class;
+  return ((char *)h + HDRSIZE);
+}
+
+// Free a block from malloc()
+/**
+ * @fn free
+ * @brief Free memory
+ * @param ptr The memory, or NULL
+ */
+void free(void *ptr)
+{
+  struct header *h;
+
+  if (ptr == NULL)
+    return;
+  h = (struct header *)((char *)ptr - HDRSIZE);
+  if (h->class == BIGBLOCK)
+  {
+    __rt_syscall(SYS_munmap, (long)h, h->size, 0, 0, 0, 0);
+    return;
+  }
+  *(void **)ptr = freelist[h->class];
+  freelist[h->class] = h;
+}
+
+// Allocate nmemb zeroed elements of size bytes
+/**
+ * @fn calloc
+ * @brief Allocate zeroed memory
+ * @param nmemb The number of elements
+ * @param size The size of each element
+ * @return The memory, or NULL
+ */
+void *calloc(size_t nmemb, size_t size)
+{
+  void *ptr;
+
+  if (size != 0 && nmemb > (size_t)-1 / size)
+  {
+    errno = ENOMEM;
+    return (NULL);
+  }
+  if ((ptr = malloc(nmemb * size)) != NULL)
+    memset(ptr, 0, nmemb * size);
+  return (ptr);
+}
+
+// Change the size of a block from malloc(),
+// moving it if it doesn't fit where it is
+/**
+ * @fn realloc
+ * @brief Change the size of a block of memory
+ * @param ptr The memory, or NULL
+ * @param size The new number of bytes
+ * @return The memory, or NULL
+ */
+void *realloc(void *ptr, size_t size)
+{
+  struct header *h;
+  size_t have;
+  void *new;
+
+  if (ptr == NULL)
+    return (malloc(size));
+  h = (struct header *)((char *)ptr - HDRSIZE);
+  if (h->class == BIGBLOCK)
+    have = h->size - HDRSIZE;
+  else
+    have = (size_t)16 << h->class;
+  if (size <= have)
+    return (ptr);
+  if ((new = malloc(size)) == NULL)
+    return (NULL);
+  memcpy(new, ptr, have);
+  free(ptr);
+  return (new);
+}
@@ -0,0 +1,420 @@
+/**
+ * @file printf.c
+ * @author BrunchTea
+ * @brief Formatted output for the runtime
+ */
+#include "rt.h"
+
+// Formatted output.
+//
+// vfprintf() does the work for the whole family. It has the
+// flags, widths, precisions and length modifiers of C99 for
+// the integer, character, string and pointer conversions.
+// MINIC has no floating point, so there are no conversions
+// for it. sprintf() and snprintf() format into a stream over
+// their buffer.
+
+// The details of one conversion
+struct spec {
+  int left;			// '-' flag: pad on the right
+  int zero;			// '0' flag: pad with zeroes
+  int plus;			// '+' flag, or ' ' flag
+  int alt;			// '#' flag
+  int width;			// Minimum width
+  int prec;			// Precision, or -1
+};
+
+// Write n copies of c to f
+/**
+ * @fn pad
+ * @brief Write copies of a character to a stream
+ * @param f The stream
+ * @param c The character
+ * @param n The number of copies
+ */
+static void pad(FILE *f, char c, int n)
+{
+  char buf[32];
+  int i;
+
+  for (i = 0; i < n && i < (int)sizeof(buf); i++)
+    buf[i] = c;
+  while (n > 0)
+  {
+    __rt_put(f, buf, (n < (int)sizeof(buf)) ? n : sizeof(buf));
+    n -= sizeof(buf);
+  }
+}
+
+// Write the len characters at s, padded out
+// to the width. Return the number written
+/**
+ * @fn padded
+ * @brief Write a string padded out to the width
+ * @param f The stream
+ * @param sp The conversion
+ * @param s The string
+ * @param len The length of the string
+ * @return The number of characters written
+ */
+static int padded(FILE *f, struct spec *sp, const char *s, int len)
+{
+  int fill = (sp->width > len) ? sp->width - len : 0;
+
+  if (!sp->left)
+    pad(f, ' ', fill);
+  __rt_put(f, s, len);
+  if (sp->left)
+    pad(f, ' ', fill);
+  return (len + fill);
+}
+
+// Write a number in the given base. neg is true if
+// it is negative, and upper gives upper case digits.
+// Return the number of characters written
+/**
+ * @fn number
+ * @brief Write a number
+ * @param f The stream
+ * @param sp The conversion
+ * @param v The magnitude of the number
+ * @param neg True if the number is negative
+ * @param base The base
+ * @param upper True for upper case digits
+ * @return The number of characters written
+ */
+static int number(FILE *f, struct spec *sp, unsigned long v, int neg,
+                  int base, int upper)
+{
+  const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  char buf[32], prefix[3];
+  int n = 0, np = 0, zeroes, fill;
+
+  // The digits go into buf backwards
+  while (v != 0)
+  {
+    buf[sizeof(buf) - 1 - n++] = digits[v % base];
+    v /= base;
+  }
+
+  // The precision is the least number of digits.
+  // Zero with a precision of zero has none
+  zeroes = (sp->prec > n) ? sp->prec - n : 0;
+  if (sp->prec < 0 && n == 0)
+    zeroes = 1;
+  if (sp->alt && base == 8 && zeroes == 0 &&
+      (n == 0 || buf[sizeof(buf) - n] != '0'))
+    zeroes = 1;
+
+  if (neg)
+    prefix[np++] = '-';
+  else if (sp->plus)
+    prefix[np++] = (char)sp->plus;
+  if (sp->alt && base == 16 && n > 0)
+  {
+    prefix[np++] = '0';
+    prefix[np++] = upper ? 'X' : 'x';
+  }
+
+  // Pad with zeroes after any sign, or else with spaces
+  fill = sp->width - np - zeroes - n;
+  if (fill < 0)
+    fill = 0;
+  if (sp->zero && !sp->left && sp->prec < 0)
+  {
+    zeroes += fill;
+    fill = 0;
+  }
+  if (!sp->left)
+    pad(f, ' ', fill);
+  __rt_put(f, prefix, np);
+  pad(f, '0', zeroes);
+  __rt_put(f, buf + sizeof(buf) - n, n);
+  if (sp->left)
+    pad(f, ' ', fill);
+  return (np + zeroes + n + fill);
+}
+
+// Format the arguments to a stream.
+// Return the number of characters written
+/**
+ * @fn vfprintf
+ * @brief Format the arguments to a stream
+ * @param f The stream
+ * @param fmt The format
+ * @param ap The arguments
+ * @return The number of characters written
+ */
+int vfprintf(FILE *f, const char *fmt, va_list ap)
+{
+  struct spec sp;
+  const char *start, *s;
+  char buf[1024], c;
+  long v;
+  unsigned long u;
+  int total = 0, len, lng;
+  FILE tmp;
+
+  // Gather the output to an unbuffered
+  // stream, so it goes in one write
+  if ((f->flags & F_UNBUF) && f->fd >= 0)
+  {
+    fflush(f);
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.fd = f->fd;
+    tmp.flags = F_WRITE;
+    tmp.last = 'w';
+    tmp.buf = buf;
+    tmp.size = sizeof(buf);
+    total = vfprintf(&tmp, fmt, ap);
+    if (fflush(&tmp) == EOF)
+      f->flags |= F_ERR;
+    return (total);
+  }
+
+  while (*fmt != '\0')
+  {
+    // Copy the text up to the next conversion
+    start = fmt;
+    while (*fmt != '\0' && *fmt != '%')
+      fmt++;
+    if (fmt > start)
+    {
+      __rt_put(f, start, fmt - start);
+      total += fmt - start;
+    }
+    if (*fmt == '\0')
+      break;
+    fmt++;
+
+    // The flags
+    memset(&sp, 0, sizeof(sp));
+    sp.prec = -1;
+    while (1)
+    {
+      if (*fmt == '-')
+        sp.left = 1;
+      else if (*fmt == '0')
+        sp.zero = 1;
+      else if (*fmt == '+')
+        sp.plus = '+';
+      else if (*fmt == ' ')
+      {
+        if (sp.plus == 0)
+          sp.plus = ' ';
+      }
+      else if (*fmt == '#')
+        sp.alt = 1;
+      else
+        break;
+      fmt++;
+    }
+
+    // The width and precision
+    if (*fmt == '*')
+    {
+      sp.width = va_arg(ap, int);
+      if (sp.width < 0)
+      {
+        sp.left = 1;
+        sp.width = -sp.width;
+      }
+      fmt++;
+    }
+    else
+      while (*fmt >= '0' && *fmt <= '9')
+        sp.width = sp.width * 10 + *fmt++ - '0';
+    if (*fmt == '.')
+    {
+      fmt++;
+      sp.prec = 0;
+      if (*fmt == '*')
+      {
+        sp.prec = va_arg(ap, int);
+        if (sp.prec < 0)
+          sp.prec = -1;
+        fmt++;
+      }
+      else
+        while (*fmt >= '0' && *fmt <= '9')
+          sp.prec = sp.prec * 10 + *fmt++ - '0';
+    }
+
+    // The length: 1 for long, -1 for short, -2 for char
+    lng = 0;
+    while (1)
+    {
+      if (*fmt == 'l' || *fmt == 'z' || *fmt == 'j' || *fmt == 't')
+        lng = 1;
+      else if (*fmt == 'h')
+        lng = (lng == -1) ? -2 : -1;
+      else
+        break;
+      fmt++;
+    }
+
+    c = *fmt;
+    if (c == '\0')
+      break;
+    fmt++;
+    if (c == 'd' || c == 'i')
+    {
+      v = lng == 1 ? va_arg(ap, long) : va_arg(ap, int);
+      if (lng == -1)
+        v = (short)v;
+      else if (lng == -2)
+        v = (signed char)v;
+      u = (v < 0) ? -(unsigned long)v : (unsigned long)v;
+      total += number(f, &sp, u, v < 0, 10, 0);
+    }
+    else if (c == 'u' || c == 'x' || c == 'X' || c == 'o')
+    {
+      u = lng == 1 ? va_arg(ap, unsigned long) : va_arg(ap, unsigned int);
+      if (lng == -1)
+        u = (unsigned short)u;
+      else if (lng == -2)
+        u = (unsigned char)u;
+      total += number(f, &sp, u, 0, (c == 'u') ? 10 : (c == 'o') ? 8 : 16,
+                      c == 'X');
+    }
+    else if (c == 'p')
+    {
+      u = (unsigned long)va_arg(ap, void *);
+      if (u == 0)
+        total += padded(f, &sp, "(nil)", 5);
+      else
+      {
+        sp.alt = 1;
+        total += number(f, &sp, u, 0, 16, 0);
+      }
+    }
+    else if (c == 'c')
+    {
+      c = (char)va_arg(ap, int);
+      total += padded(f, &sp, &c, 1);
+    }
+    else if (c == 's')
+    {
+      if ((s = va_arg(ap, const char *)) == NULL)
+        s = "(null)";
+      for (len = 0; s[len] != '\0' && (sp.prec < 0 || len < sp.prec); len++)
+        ;
+      total += padded(f, &sp, s, len);
+    }
+    else
+    {
+      // %% and anything that we don't know
+      // are written out as they are
+      if (c != '%')
+        __rt_put(f, fmt - 2, 1);
+      __rt_put(f, &c, 1);
+      total += (c != '%') ? 2 : 1;
+    }
+  }
+  return (total);
+}
+
+// Format the arguments to a stream
+/**
+ * @fn fprintf
+ * @brief Format the arguments to a stream
+ * @param f The stream
+ * @param fmt The format
+ * @return The number of characters written
+ */
+int fprintf(FILE *f, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vfprintf(f, fmt, ap);
+  va_end(ap);
+  return (n);
+}
+
+// Format the arguments to standard output
+/**
+ * @fn printf
+ * @brief Format the arguments to standard output
+ * @param fmt The format
+ * @return The number of characters written
+ */
+int printf(const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vfprintf(stdout, fmt, ap);
+  va_end(ap);
+  return (n);
+}
+
+// Format the arguments into str, writing at
+// most size bytes including the NUL at the end.
+// Return the length of the whole output
+/**
+ * @fn vsnprintf
+ * @brief Format the arguments into a buffer
+ * @param str The buffer
+ * @param size The size of the buffer
+ * @param fmt The format
+ * @param ap The arguments
+ * @return The length of the whole output
+ */
+int vsnprintf(char *str, size_t size, const char *fmt, va_list ap)
+{
+  FILE tmp;
+  int n;
+
+  memset(&tmp, 0, sizeof(tmp));
+  tmp.fd = -1;
+  tmp.flags = F_WRITE | F_MEM;
+  tmp.buf = str;
+  tmp.size = (size > 0) ? size - 1 : 0;
+  n = vfprintf(&tmp, fmt, ap);
+  if (size > 0)
+    str[(tmp.pos < tmp.size) ? tmp.pos : tmp.size] = '\0';
+  return (n);
+}
+
+// Format the arguments into str, writing at
+// most size bytes including the NUL at the end
+/**
+ * @fn snprintf
+ * @brief Format the arguments into a buffer
+ * @param str The buffer
+ * @param size The size of the buffer
+ * @param fmt The format
+ * @return The length of the whole output
+ */
+int snprintf(char *str, size_t size, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(str, size, fmt, ap);
+  va_end(ap);
+  return (n);
+}
+
+// Format the arguments into str
+/**
+ * @fn sprintf
+ * @brief Format the arguments into a buffer
+ * @param str The buffer
+ * @param fmt The format
+ * @return The number of characters written
+ */
+int sprintf(char *str, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(str, (size_t)-1 >> 1, fmt, ap);
+  va_end(ap);
+  return (n);
+}
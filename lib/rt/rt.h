@@ -0,0 +1,148 @@
+/**
+ * @file rt.h
+ * @author BrunchTea
+ * @brief Declarations shared by the parts of the runtime
+ */
+#include <stddef.h>
+#include <stdarg.h>
+
+// The runtime is built without the system headers, so
+// everything that it needs from them is declared here
+
+// Linux x86-64 system call numbers
+enum {
+  SYS_read = 0,
+  SYS_write = 1,
+  SYS_open = 2,
+  SYS_close = 3,
+  SYS_lseek = 8,
+  SYS_mmap = 9,
+  SYS_munmap = 11,
+  SYS_ioctl = 16,
+  SYS_pipe = 22,
+  SYS_dup2 = 33,
+  SYS_getpid = 39,
+  SYS_fork = 57,
+  SYS_execve = 59,
+  SYS_wait4 = 61,
+  SYS_kill = 62,
+  SYS_getcwd = 79,
+  SYS_chdir = 80,
+  SYS_rename = 82,
+  SYS_creat = 85,
+  SYS_unlink = 87,
+  SYS_clock_gettime = 228,
+  SYS_exit_group = 231
+};
+
+#define EINTR 4
+#define ENOENT 2
+#define ENOMEM 12
+#define EACCES 13
+#define EEXIST 17
+#define EINVAL 22
+
+#define O_RDONLY 00
+#define O_WRONLY 01
+#define O_RDWR 02
+#define O_CREAT 0100
+#define O_EXCL 0200
+#define O_TRUNC 01000
+#define O_APPEND 02000
+#define O_CLOEXEC 02000000
+
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+#define EOF (-1)
+
+// A stdio stream. It reads from or writes to a file
+// descriptor through buf, or is a stream in memory
+struct file {
+  int fd;			// File descriptor, or -1 in memory
+  int flags;			// F_ flags below
+  int last;			// 'r' or 'w' for the last use, or 0
+  char *buf;			// The buffer
+  size_t size;			// Size of the buffer
+  size_t pos;			// Next byte to read or write in buf
+  size_t len;			// Bytes read into buf
+  char **dynptr;		// open_memstream()'s pointers,
+  size_t *dynsize;		// updated on fflush()
+  int pid;			// The child of popen(), or 0
+  struct file *next;		// Next open stream
+};
+typedef struct file FILE;
+
+enum {
+  F_READ = 1,			// Can be read
+  F_WRITE = 2,			// Can be written
+  F_EOF = 4,			// Reached the end of the input
+  F_ERR = 8,			// Had an error
+  F_LINE = 16,			// Line buffered
+  F_UNBUF = 32,			// Not buffered
+  F_MEM = 64,			// Reads or writes a fixed buffer
+  F_DYN = 128,			// Writes a growing buffer
+  F_OWNBUF = 256,		// We allocated buf
+  F_TTYCHECK = 512		// Line buffered if a terminal
+};
+
+extern FILE *stdin;
+extern FILE *stdout;
+extern FILE *stderr;
+extern char **environ;
+
+// start.c
+int *__errno_location(void);
+#define errno (*__errno_location())
+void exit(int status);
+void _Exit(int status);
+void _exit(int status);
+
+// syscall.c
+long __rt_syscall(long n, long a, long b, long c, long d, long e, long f);
+long __rt_ret(long r);
+int open(const char *pathname, int flags, ...);
+int close(int fd);
+long read(int fd, void *buf, size_t count);
+long write(int fd, const void *buf, size_t count);
+long lseek(int fd, long offset, int whence);
+int pipe(int *pipefd);
+int dup2(int oldfd, int newfd);
+int fork(void);
+int getpid(void);
+int execve(const char *path, char **argv, char **envp);
+int execvp(const char *file, char **argv);
+int waitpid(int pid, int *wstatus, int options);
+int unlink(const char *pathname);
+int isatty(int fd);
+
+// malloc.c
+void *malloc(size_t size);
+void free(void *ptr);
+void *calloc(size_t nmemb, size_t size);
+void *realloc(void *ptr, size_t size);
+
+// string.c
+void *memcpy(void *dest, const void *src, size_t n);
+void *memmove(void *dest, const void *src, size_t n);
+void *memset(void *s, int c, size_t n);
+int memcmp(const void *s1, const void *s2, size_t n);
+void *memchr(const void *s, int c, size_t n);
+size_t strlen(const char *s);
+char *strchr(const char *s, int c);
+int strncmp(const char *s1, const char *s2, size_t n);
+
+// stdio.c
+void __rt_flushall(void);
+size_t __rt_put(FILE *f, const char *s, size_t n);
+int fflush(FILE *f);
+FILE *fdopen(int fd, const char *mode);
+int fclose(FILE *f);
+
+// printf.c
+int vfprintf(FILE *f, const char *fmt, va_list ap);
+int snprintf(char *str, size_t size, const char *fmt, ...);
+
+// stdlib.c
+char *getenv(const char *name);
+int mkstemp(char *template);
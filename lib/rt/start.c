@@ -0,0 +1,94 @@
+/**
+ * @file start.c
+ * @author BrunchTea
+ * @brief Program start and exit for the runtime
+ */
+#include "rt.h"
+
+// The minimal runtime.
+//
+// With -static, programs are linked against this small C
+// library instead of glibc. There is no dynamic loader, no
+// relocations to do at startup and no locale or thread set
+// up: _start finds argc, argv and the environment on the
+// stack and calls main(). The library has the functions
+// declared in MINIC's own headers, so that the programs
+// which MINIC can compile link against it.
+
+char **environ;
+static int errnoval;
+
+int main(int argc, char **argv, char **envp);
+
+// The kernel starts us here with argc at the top
+// of the stack, then argv and the environment
+__asm__(".text\n"
+        ".global _start\n"
+        "_start:\n"
+        "  xor %ebp, %ebp\n"
+        "  mov %rsp, %rdi\n"
+        "  and $-16, %rsp\n"
+        "  call __rt_start\n"
+        "  hlt\n");
+
+// Find the arguments and the environment
+// on the stack at sp, then run main()
+/**
+ * @fn __rt_start
+ * @brief Find the arguments and environment, then run main()
+ * @param sp The stack pointer that the kernel gave us
+ */
+void __rt_start(long *sp)
+{
+  int argc = (int)sp[0];
+  char **argv = (char **)(sp + 1);
+
+  environ = argv + argc + 1;
+  exit(main(argc, argv, environ));
+}
+
+// Return where errno is kept
+/**
+ * @fn __errno_location
+ * @brief Return where errno is kept
+ * @return A pointer to errno
+ */
+int *__errno_location(void)
+{
+  return (&errnoval);
+}
+
+// Flush the output and leave
+/**
+ * @fn exit
+ * @brief Flush the output and leave
+ * @param status The exit status
+ */
+void exit(int status)
+{
+  __rt_flushall();
+  _exit(status);
+}
+
+// Leave without flushing the output
+/**
+ * @fn _Exit
+ * @brief Leave without flushing the output
+ * @param status The exit status
+ */
+void _Exit(int status)
+{
+  _exit(status);
+}
+
+// Leave without flushing the output
+/**
+ * @fn _exit
+ * @brief Leave without flushing the output
+ * @param status The exit status
+ */
+void _exit(int status)
+{
+  while (1)
+    __rt_syscall(SYS_exit_group, status, 0, 0, 0, 0, 0);
+}
@@ -0,0 +1,845 @@
+/**
+ * @file stdio.c
+ * @author BrunchTea
+ * @brief Buffered streams for the runtime
+ */
+#include "rt.h"
+
+// Buffered streams.
+//
+// A stream on a file descriptor reads or writes through a
+// buffer, which it gets on its first use. Standard output is
+// line buffered on a terminal and standard error isn't
+// buffered. Streams in memory use the same fields: buf is the
+// memory, and there is no file descriptor to fill or empty
+// the buffer. All the open streams are on a list, so that
+// exit() can flush them.
+
+#define BUFSIZE 16384		// Size of a stream's buffer
+
+static struct file sin = { 0, F_READ };
+static struct file sout = { 1, F_WRITE | F_TTYCHECK, .next = &sin };
+static struct file serr = { 2, F_WRITE | F_UNBUF, .next = &sout };
+static FILE *files = &serr;	// All the open streams
+
+FILE *stdin = &sin;
+FILE *stdout = &sout;
+FILE *stderr = &serr;
+
+// Write all n bytes in s to fd.
+// Return 0 on success, -1 on an error
+/**
+ * @fn writeall
+ * @brief Write all of a buffer to a file descriptor
+ * @param fd The file descriptor
+ * @param s The bytes
+ * @param n The number of bytes
+ * @return 0, or -1 on an error
+ */
+static int writeall(int fd, const char *s, size_t n)
+{
+  long r;
+
+  while (n > 0)
+  {
+    r = write(fd, s, n);
+    if (r == -1 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return (-1);
+    s += r;
+    n -= r;
+  }
+  return (0);
+}
+
+// Give a stream its buffer if it hasn't got one.
+// Return 0, or -1 if there's no memory
+/**
+ * @fn getbuf
+ * @brief Give a stream its buffer
+ * @param f The stream
+ * @return 0, or -1 if there's no memory
+ */
+static int getbuf(FILE *f)
+{
+  if (f->buf != NULL)
+    return (0);
+  if ((f->buf = malloc(BUFSIZE)) == NULL)
+  {
+    f->flags |= F_ERR;
+    return (-1);
+  }
+  f->size = BUFSIZE;
+  f->flags |= F_OWNBUF;
+  return (0);
+}
+
+// Write out what is in the buffer of a stream on a
+// file descriptor. Return 0, or EOF on an error
+/**
+ * @fn flushbuf
+ * @brief Write out the buffer of a stream
+ * @param f The stream
+ * @return 0, or EOF on an error
+ */
+static int flushbuf(FILE *f)
+{
+  size_t n = f->pos;
+
+  if (f->fd < 0 || f->last != 'w' || n == 0)
+    return (0);
+  f->pos = 0;
+  if (writeall(f->fd, f->buf, n) == -1)
+  {
+    f->flags |= F_ERR;
+    return (EOF);
+  }
+  return (0);
+}
+
+// Get a stream ready to read from. Return 0,
+// or EOF if it can't be read
+/**
+ * @fn startread
+ * @brief Get a stream ready to read from
+ * @param f The stream
+ * @return 0, or EOF if it can't be read
+ */
+static int startread(FILE *f)
+{
+  if (!(f->flags & F_READ))
+  {
+    f->flags |= F_ERR;
+    return (EOF);
+  }
+  if (f->last == 'w')
+  {
+    if (flushbuf(f) == EOF)
+      return (EOF);
+    f->pos = f->len = 0;
+  }
+  f->last = 'r';
+  return (0);
+}
+
+// Fill the buffer of a stream that we are reading.
+// Return 1, or 0 at the end of the input
+/**
+ * @fn refill
+ * @brief Fill the buffer of a stream
+ * @param f The stream
+ * @return 1, or 0 at the end of the input
+ */
+static int refill(FILE *f)
+{
+  long r;
+
+  if (f->fd < 0 || getbuf(f) == -1)
+  {
+    f->flags |= F_EOF;
+    return (0);
+  }
+
+  // Show any prompt before we wait for input
+  if (f == stdin)
+    fflush(stdout);
+  do
+    r = read(f->fd, f->buf, f->size);
+  while (r == -1 && errno == EINTR);
+  if (r <= 0)
+  {
+    f->flags |= (r == 0) ? F_EOF : F_ERR;
+    return (0);
+  }
+  f->pos = 0;
+  f->len = r;
+  return (1);
+}
+
+// Write n bytes to a stream. Return the number written
+/**
+ * @fn __rt_put
+ * @brief Write bytes to a stream
+ * @param f The stream
+ * @param s The bytes
+ * @param n The number of bytes
+ * @return The number of bytes written
+ */
+size_t __rt_put(FILE *f, const char *s, size_t n)
+{
+  size_t room;
+  char *new;
+
+  if (!(f->flags & F_WRITE))
+  {
+    f->flags |= F_ERR;
+    return (0);
+  }
+
+  // A growing buffer in memory, kept NUL terminated
+  if (f->flags & F_DYN)
+  {
+    if (f->pos + n + 1 > f->size)
+    {
+      room = f->size * 2;
+      if (room < f->pos + n + 1)
+        room = f->pos + n + 1;
+      if ((new = realloc(f->buf, room)) == NULL)
+      {
+        f->flags |= F_ERR;
+        return (0);
+      }
+      f->buf = new;
+      f->size = room;
+      *f->dynptr = new;
+    }
+    memcpy(f->buf + f->pos, s, n);
+    f->pos += n;
+    f->buf[f->pos] = '\0';
+    return (n);
+  }
+
+  // A fixed buffer in memory keeps what fits, but
+  // counts it all, which snprintf() needs
+  if (f->flags & F_MEM)
+  {
+    room = (f->pos < f->size) ? f->size - f->pos : 0;
+    if (room > 0)
+      memcpy(f->buf + f->pos, s, (n < room) ? n : room);
+    f->pos += n;
+    return (n);
+  }
+
+  // Stop reading, and go back over what was read ahead
+  if (f->last == 'r')
+  {
+    if (f->len > f->pos)
+      lseek(f->fd, (long)f->pos - (long)f->len, SEEK_CUR);
+    f->pos = f->len = 0;
+  }
+  f->last = 'w';
+
+  // We only find out if standard output is a terminal
+  // when it is first used
+  if (f->flags & F_TTYCHECK)
+  {
+    f->flags &= ~F_TTYCHECK;
+    if (isatty(f->fd))
+      f->flags |= F_LINE;
+  }
+
+  if (f->flags & F_UNBUF)
+  {
+    if (writeall(f->fd, s, n) == -1)
+    {
+      f->flags |= F_ERR;
+      return (0);
+    }
+    return (n);
+  }
+
+  // Write out a full buffer, and write anything too big
+  // for the buffer straight out
+  if (getbuf(f) == -1)
+    return (0);
+  if (f->pos + n > f->size)
+  {
+    if (flushbuf(f) == EOF)
+      return (0);
+    if (n >= f->size)
+    {
+      if (writeall(f->fd, s, n) == -1)
+      {
+        f->flags |= F_ERR;
+        return (0);
+      }
+      return (n);
+    }
+  }
+  memcpy(f->buf + f->pos, s, n);
+  f->pos += n;
+  if ((f->flags & F_LINE) && memchr(s, '\n', n) != NULL)
+    if (flushbuf(f) == EOF)
+      return (0);
+  return (n);
+}
+
+// Make a stream and put it on the list
+/**
+ * @fn newfile
+ * @brief Make a stream
+ * @param fd Its file descriptor, or -1
+ * @param flags Its F_ flags
+ * @return The stream, or NULL
+ */
+static FILE *newfile(int fd, int flags)
+{
+  FILE *f;
+
+  if ((f = calloc(1, sizeof(FILE))) == NULL)
+    return (NULL);
+  f->fd = fd;
+  f->flags = flags;
+  f->next = files;
+  files = f;
+  return (f);
+}
+
+// Work out the F_ flags and the open() flags for
+// a mode like "r" or "w+". Return the F_ flags,
+// or 0 if the mode is bad
+/**
+ * @fn modeflags
+ * @brief Work out the flags for a stream's mode
+ * @param mode The mode
+ * @param oflags Where to put the open() flags, or NULL
+ * @return The F_ flags, or 0 if the mode is bad
+ */
+static int modeflags(const char *mode, int *oflags)
+{
+  int flags, o;
+
+  if (mode[0] == 'r')
+  {
+    flags = F_READ;
+    o = O_RDONLY;
+  }
+  else if (mode[0] == 'w')
+  {
+    flags = F_WRITE;
+    o = O_WRONLY | O_CREAT | O_TRUNC;
+  }
+  else if (mode[0] == 'a')
+  {
+    flags = F_WRITE;
+    o = O_WRONLY | O_CREAT | O_APPEND;
+  }
+  else
+  {
+    errno = EINVAL;
+    return (0);
+  }
+  if (strchr(mode, '+') != NULL)
+  {
+    flags = F_READ | F_WRITE;
+    o = (o & ~O_WRONLY) | O_RDWR;
+  }
+  if (oflags != NULL)
+    *oflags = o;
+  return (flags);
+}
+
+// Open a file as a stream
+/**
+ * @fn fopen
+ * @brief Open a file as a stream
+ * @param pathname The file's name
+ * @param mode How to open it
+ * @return The stream, or NULL
+ */
+FILE *fopen(const char *pathname, const char *mode)
+{
+  int flags, oflags, fd;
+  FILE *f;
+
+  if ((flags = modeflags(mode, &oflags)) == 0)
+    return (NULL);
+  if ((fd = open(pathname, oflags, 0666)) == -1)
+    return (NULL);
+  if ((f = newfile(fd, flags)) == NULL)
+    close(fd);
+  return (f);
+}
+
+// Make a stream for an open file descriptor
+/**
+ * @fn fdopen
+ * @brief Make a stream for a file descriptor
+ * @param fd The file descriptor
+ * @param mode How it was opened
+ * @return The stream, or NULL
+ */
+FILE *fdopen(int fd, const char *mode)
+{
+  int flags;
+
+  if ((flags = modeflags(mode, NULL)) == 0)
+    return (NULL);
+  return (newfile(fd, flags));
+}
+
+// Make a stream which reads or writes the size
+// bytes at buf, or new memory if buf is NULL
+/**
+ * @fn fmemopen
+ * @brief Make a stream which reads or writes memory
+ * @param buf The memory, or NULL
+ * @param size Its size
+ * @param mode How to use it
+ * @return The stream, or NULL
+ */
+FILE *fmemopen(void *buf, size_t size, const char *mode)
+{
+  int flags;
+  FILE *f;
+
+  if ((flags = modeflags(mode, NULL)) == 0)
+    return (NULL);
+  if ((f = newfile(-1, flags | F_MEM)) == NULL)
+    return (NULL);
+  if (buf == NULL)
+  {
+    if ((buf = calloc(1, size + 1)) == NULL)
+    {
+      fclose(f);
+      return (NULL);
+    }
+    f->flags |= F_OWNBUF;
+  }
+  f->buf = buf;
+  f->size = size;
+  if (mode[0] == 'r')
+  {
+    f->len = size;
+    f->last = 'r';
+  }
+  else if (mode[0] == 'a')
+  {
+    while (f->pos < size && f->buf[f->pos] != '\0')
+      f->pos++;
+  }
+  else if (size > 0)
+    f->buf[0] = '\0';
+  return (f);
+}
+
+// Make a stream which writes into memory that grows
+// as needed. On fflush() and fclose(), *ptr and
+// *sizeloc give the memory and the size written
+/**
+ * @fn open_memstream
+ * @brief Make a stream which writes into growing memory
+ * @param ptr Where to put the memory
+ * @param sizeloc Where to put the size written
+ * @return The stream, or NULL
+ */
+FILE *open_memstream(char **ptr, size_t *sizeloc)
+{
+  FILE *f;
+
+  if ((f = newfile(-1, F_WRITE | F_DYN)) == NULL)
+    return (NULL);
+  if ((f->buf = malloc(64)) == NULL)
+  {
+    fclose(f);
+    return (NULL);
+  }
+  f->buf[0] = '\0';
+  f->size = 64;
+  f->dynptr = ptr;
+  f->dynsize = sizeloc;
+  *ptr = f->buf;
+  *sizeloc = 0;
+  return (f);
+}
+
+// Make a temporary file, removed when it is closed
+/**
+ * @fn tmpfile
+ * @brief Make a temporary file
+ * @return The stream, or NULL
+ */
+FILE *tmpfile(void)
+{
+  char name[] = "/tmp/tmpfXXXXXX";
+  FILE *f;
+  int fd;
+
+  if ((fd = mkstemp(name)) == -1)
+    return (NULL);
+  unlink(name);
+  if ((f = fdopen(fd, "w+")) == NULL)
+    close(fd);
+  return (f);
+}
+
+// Run a command with its standard output or
+// standard input on a pipe to a new stream
+/**
+ * @fn popen
+ * @brief Run a command with a pipe to it or from it
+ * @param command The command, run by /bin/sh
+ * @param type "r" to read its output or "w" to write its input
+ * @return The stream, or NULL
+ */
+FILE *popen(const char *command, const char *type)
+{
+  char *args[4];
+  int fd[2], pid, mine, theirs;
+  FILE *f;
+
+  if (type[0] != 'r' && type[0] != 'w')
+  {
+    errno = EINVAL;
+    return (NULL);
+  }
+  if (pipe(fd) == -1)
+    return (NULL);
+  mine = (type[0] == 'r') ? fd[0] : fd[1];
+  theirs = (type[0] == 'r') ? fd[1] : fd[0];
+  __rt_flushall();
+  if ((pid = fork()) == -1)
+  {
+    close(fd[0]);
+    close(fd[1]);
+    return (NULL);
+  }
+  if (pid == 0)
+  {
+    dup2(theirs, (type[0] == 'r') ? 1 : 0);
+    close(fd[0]);
+    close(fd[1]);
+    args[0] = "sh";
+    args[1] = "-c";
+    args[2] = (char *)command;
+    args[3] = NULL;
+    execve("/bin/sh", args, environ);
+    _exit(127);
+  }
+  close(theirs);
+  if ((f = fdopen(mine, type)) == NULL)
+  {
+    close(mine);
+    return (NULL);
+  }
+  f->pid = pid;
+  return (f);
+}
+
+// Close a stream from popen() and wait for its
+// command. Return the command's wait status
+/**
+ * @fn pclose
+ * @brief Close a stream from popen() and wait for its command
+ * @param f The stream
+ * @return The command's wait status, or -1
+ */
+int pclose(FILE *f)
+{
+  int pid = f->pid, wstatus, r;
+
+  fclose(f);
+  do
+    r = waitpid(pid, &wstatus, 0);
+  while (r == -1 && errno == EINTR);
+  return ((r == -1) ? -1 : wstatus);
+}
+
+// Write out what is buffered for a stream, or
+// for all streams if f is NULL. Return 0, or EOF
+/**
+ * @fn fflush
+ * @brief Write out what is buffered for a stream
+ * @param f The stream, or NULL for all of them
+ * @return 0, or EOF on an error
+ */
+int fflush(FILE *f)
+{
+  if (f == NULL)
+  {
+    __rt_flushall();
+    return (0);
+  }
+  if (f->flags & F_DYN)
+  {
+    *f->dynptr = f->buf;
+    *f->dynsize = f->pos;
+    return (0);
+  }
+  if (f->flags & F_MEM)
+  {
+    if ((f->flags & F_WRITE) && f->pos < f->size)
+      f->buf[f->pos] = '\0';
+    return (0);
+  }
+
+  // Give back the input that we read ahead, so the
+  // file offset is where we are. A pipe keeps it
+  if (f->last == 'r')
+  {
+    if (f->len > f->pos &&
+        lseek(f->fd, (long)f->pos - (long)f->len, SEEK_CUR) == -1)
+      return (0);
+    f->pos = f->len = 0;
+    return (0);
+  }
+  return (flushbuf(f));
+}
+
+// Flush all the open streams
+/**
+ * @fn __rt_flushall
+ * @brief Flush all the open streams
+ */
+void __rt_flushall(void)
+{
+  FILE *f;
+
+  for (f = files; f != NULL; f = f->next)
+    if (f->flags & F_WRITE)
+      fflush(f);
+}
+
+// Flush and close a stream. Return 0, or EOF
+/**
+ * @fn fclose
+ * @brief Flush and close a stream
+ * @param f The stream
+ * @return 0, or EOF on an error
+ */
+int fclose(FILE *f)
+{
+  FILE **fp;
+  int r;
+
+  r = fflush(f);
+  if (f->fd >= 0 && close(f->fd) == -1)
+    r = EOF;
+  if (f->flags & F_OWNBUF)
+    free(f->buf);
+  for (fp = &files; *fp != NULL; fp = &(*fp)->next)
+    if (*fp == f)
+    {
+      *fp = f->next;
+      break;
+    }
+  if (f != stdin && f != stdout && f != stderr)
+    free(f);
+  else
+  {
+    f->fd = -1;
+    f->buf = NULL;
+  }
+  return (r);
+}
+
+// Read nmemb elements of size bytes from a stream.
+// Return the number of whole elements read
+/**
+ * @fn fread
+ * @brief Read from a stream
+ * @param ptr Where to put the elements
+ * @param size The size of each element
+ * @param nmemb The number of elements
+ * @param f The stream
+ * @return The number of elements read
+ */
+size_t fread(void *ptr, size_t size, size_t nmemb, FILE *f)
+{
+  size_t want = size * nmemb, got = 0, n;
+  long r;
+
+  if (want == 0 || startread(f) == EOF)
+    return (0);
+  while (got < want)
+  {
+    // Use what is in the buffer first
+    if (f->pos < f->len)
+    {
+      n = f->len - f->pos;
+      if (n > want - got)
+        n = want - got;
+      memcpy((char *)ptr + got, f->buf + f->pos, n);
+      f->pos += n;
+      got += n;
+    }
+
+    // Read big amounts straight into place
+    else if (f->fd >= 0 && want - got >= BUFSIZE)
+    {
+      r = read(f->fd, (char *)ptr + got, want - got);
+      if (r == -1 && errno == EINTR)
+        continue;
+      if (r <= 0)
+      {
+        f->flags |= (r == 0) ? F_EOF : F_ERR;
+        break;
+      }
+      got += r;
+    }
+    else if (!refill(f))
+      break;
+  }
+  return (got / size);
+}
+
+// Write nmemb elements of size bytes to a stream.
+// Return the number of whole elements written
+/**
+ * @fn fwrite
+ * @brief Write to a stream
+ * @param ptr The elements
+ * @param size The size of each element
+ * @param nmemb The number of elements
+ * @param f The stream
+ * @return The number of elements written
+ */
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *f)
+{
+  if (size == 0 || nmemb == 0)
+    return (0);
+  return (__rt_put(f, ptr, size * nmemb) / size);
+}
+
+// Read a character from a stream
+/**
+ * @fn fgetc
+ * @brief Read a character from a stream
+ * @param f The stream
+ * @return The character, or EOF
+ */
+int fgetc(FILE *f)
+{
+  if (f->last == 'r' && f->pos < f->len)
+    return ((unsigned char)f->buf[f->pos++]);
+  if (startread(f) == EOF)
+    return (EOF);
+  if (f->pos >= f->len && !refill(f))
+    return (EOF);
+  return ((unsigned char)f->buf[f->pos++]);
+}
+
+// Write a character to a stream
+/**
+ * @fn fputc
+ * @brief Write a character to a stream
+ * @param c The character
+ * @param f The stream
+ * @return The character, or EOF
+ */
+int fputc(int c, FILE *f)
+{
+  char ch = (char)c;
+
+  // Most characters just go in the buffer
+  if (f->last == 'w' && f->pos < f->size && f->fd >= 0 &&
+      !(f->flags & (F_LINE | F_UNBUF)))
+  {
+    f->buf[f->pos++] = ch;
+    return ((unsigned char)ch);
+  }
+  if (__rt_put(f, &ch, 1) != 1)
+    return (EOF);
+  return ((unsigned char)ch);
+}
+
+// Write a character to a stream
+/**
+ * @fn putc
+ * @brief Write a character to a stream
+ * @param c The character
+ * @param f The stream
+ * @return The character, or EOF
+ */
+int putc(int c, FILE *f)
+{
+  return (fputc(c, f));
+}
+
+// Write a character to standard output
+/**
+ * @fn putchar
+ * @brief Write a character to standard output
+ * @param c The character
+ * @return The character, or EOF
+ */
+int putchar(int c)
+{
+  return (fputc(c, stdout));
+}
+
+// Write a string to a stream
+/**
+ * @fn fputs
+ * @brief Write a string to a stream
+ * @param s The string
+ * @param f The stream
+ * @return 0, or EOF
+ */
+int fputs(const char *s, FILE *f)
+{
+  size_t n = strlen(s);
+
+  if (__rt_put(f, s, n) != n)
+    return (EOF);
+  return (0);
+}
+
+// Write a string and a newline to standard output
+/**
+ * @fn puts
+ * @brief Write a string and a newline to standard output
+ * @param s The string
+ * @return 0, or EOF
+ */
+int puts(const char *s)
+{
+  if (fputs(s, stdout) == EOF || fputc('\n', stdout) == EOF)
+    return (EOF);
+  return (0);
+}
+
+// Return the position in a stream
+/**
+ * @fn ftell
+ * @brief Return the position in a stream
+ * @param f The stream
+ * @return The position, or -1
+ */
+long ftell(FILE *f)
+{
+  long off;
+
+  if (f->fd < 0)
+    return ((long)f->pos);
+  if ((off = lseek(f->fd, 0, SEEK_CUR)) == -1)
+    return (-1);
+  if (f->last == 'w')
+    return (off + (long)f->pos);
+  if (f->last == 'r')
+    return (off - (long)(f->len - f->pos));
+  return (off);
+}
+
+// Go back to the start of a stream
+/**
+ * @fn rewind
+ * @brief Go back to the start of a stream
+ * @param f The stream
+ */
+void rewind(FILE *f)
+{
+  fflush(f);
+  f->flags &= ~(F_EOF | F_ERR);
+  if (f->fd >= 0)
+  {
+    lseek(f->fd, 0, SEEK_SET);
+    f->pos = f->len = 0;
+    f->last = 0;
+  }
+  else
+    f->pos = 0;
+}
+
+// Return the file descriptor of a stream
+/**
+ * @fn fileno
+ * @brief Return the file descriptor of a stream
+ * @param f The stream
+ * @return The file descriptor, or -1
+ */
+int fileno(FILE *f)
+{
+  return (f->fd);
+}
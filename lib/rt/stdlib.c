@@ -0,0 +1,152 @@
+/**
+ * @file stdlib.c
+ * @author BrunchTea
+ * @brief Conversions, the environment and temporary files for the runtime
+ */
+#include "rt.h"
+
+// Convert the start of a string to a long
+/**
+ * @fn atol
+ * @brief Convert a string to a long
+ * @param s The string
+ * @return Its value
+ */
+long atol(const char *s)
+{
+  long v = 0;
+  int neg = 0;
+
+  while (*s == ' ' || (*s >= '\t' && *s <= '\r'))
+    s++;
+  if (*s == '-' || *s == '+')
+    neg = (*s++ == '-');
+  while (*s >= '0' && *s <= '9')
+    v = v * 10 + *s++ - '0';
+  return (neg ? -v : v);
+}
+
+// Convert the start of a string to an int
+/**
+ * @fn atoi
+ * @brief Convert a string to an int
+ * @param s The string
+ * @return Its value
+ */
+int atoi(const char *s)
+{
+  return ((int)atol(s));
+}
+
+// Return the value of an environment variable
+/**
+ * @fn getenv
+ * @brief Return the value of an environment variable
+ * @param name The variable
+ * @return Its value, or NULL if it is not set
+ */
+char *getenv(const char *name)
+{
+  size_t len = strlen(name);
+  char **e;
+
+  if (environ == NULL)
+    return (NULL);
+  for (e = environ; *e != NULL; e++)
+    if (strncmp(*e, name, len) == 0 && (*e)[len] == '=')
+      return (*e + len + 1);
+  return (NULL);
+}
+
+// Run a command with the shell and wait for it.
+// Return its status as waitpid() gives it
+/**
+ * @fn system
+ * @brief Run a command with the shell
+ * @param command The command
+ * @return Its status, or -1 if it could not run
+ */
+int system(const char *command)
+{
+  char *args[4];
+  int pid, status;
+
+  if (command == NULL)
+    return (1);
+  if ((pid = fork()) == -1)
+    return (-1);
+  if (pid == 0)
+  {
+    args[0] = "sh";
+    args[1] = "-c";
+    args[2] = (char *)command;
+    args[3] = NULL;
+    execve("/bin/sh", args, environ);
+    _exit(127);
+  }
+  while (waitpid(pid, &status, 0) == -1)
+    if (errno != EINTR)
+      return (-1);
+  return (status);
+}
+
+// Make and open a new file from template, whose
+// name ends in "XXXXXX" and then suffixlen more
+// characters. The X's are replaced with letters
+/**
+ * @fn mkstemps
+ * @brief Make and open a new file with a suffix
+ * @param template The name of the file
+ * @param suffixlen The length of the suffix
+ * @return The file descriptor, or -1 on an error
+ */
+int mkstemps(char *template, int suffixlen)
+{
+  static const char letters[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  static unsigned long seed;
+  size_t len = strlen(template);
+  unsigned long v;
+  char *x;
+  int tries, i, fd;
+
+  if (suffixlen < 0 || len < (size_t)suffixlen + 6 ||
+      strncmp(template + len - suffixlen - 6, "XXXXXX", 6) != 0)
+  {
+    errno = EINVAL;
+    return (-1);
+  }
+  x = template + len - suffixlen - 6;
+
+  // Mix the process id into a sequence, so
+  // that each try gets a different name
+  if (seed == 0)
+    seed = (unsigned long)getpid() * 2654435761UL + (unsigned long)&seed;
+  for (tries = 0; tries < 1000; tries++)
+  {
+    seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    v = seed >> 16;
+    for (i = 0; i < 6; i++)
+    {
+      x[i] = letters[v % (sizeof(letters) - 1)];
+      v /= sizeof(letters) - 1;
+    }
+    fd = open(template, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd != -1 || errno != EEXIST)
+      return (fd);
+  }
+  return (-1);
+}
+
+// Make and open a new file from template,
+// whose name ends in "XXXXXX"
+/**
+ * @fn mkstemp
+ * @brief Make and open a new file
+ * @param template The name of the file
+ * @return The file descriptor, or -1 on an error
+ */
+int mkstemp(char *template)
+{
+  return (mkstemps(template, 0));
+}
@@ -0,0 +1,323 @@
+/**
+ * @file string.c
+ * @author BrunchTea
+ * @brief String and memory functions for the runtime
+ */
+#include "rt.h"
+
+// Copy n bytes between blocks which don't overlap
+/**
+ * @fn memcpy
+ * @brief Copy memory
+ * @param dest Where to copy to
+ * @param src Where to copy from
+ * @param n The number of bytes
+ * @return dest
+ */
+void *memcpy(void *dest, const void *src, size_t n)
+{
+  char *d = dest;
+  const char *s = src;
+
+  while (n-- > 0)
+    *d++ = *s++;
+  return (dest);
+}
+
+// Copy n bytes between blocks which may overlap
+/**
+ * @fn memmove
+ * @brief Copy memory which may overlap
+ * @param dest Where to copy to
+ * @param src Where to copy from
+ * @param n The number of bytes
+ * @return dest
+ */
+void *memmove(void *dest, const void *src, size_t n)
+{
+  char *d = dest;
+  const char *s = src;
+
+  if (d <= s || d >= s + n)
+    return (memcpy(dest, src, n));
+  while (n-- > 0)
+    d[n] = s[n];
+  return (dest);
+}
+
+// Set n bytes to c
+/**
+ * @fn memset
+ * @brief Fill memory with a byte
+ * @param s The memory
+ * @param c The byte
+ * @param n The number of bytes
+ * @return s
+ */
+void *memset(void *s, int c, size_t n)
+{
+  char *p = s;
+
+  while (n-- > 0)
+    *p++ = (char)c;
+  return (s);
+}
+
+// Compare n bytes
+/**
+ * @fn memcmp
+ * @brief Compare memory
+ * @param s1 The first block
+ * @param s2 The second block
+ * @param n The number of bytes
+ * @return Less than, equal to or more than 0
+ */
+int memcmp(const void *s1, const void *s2, size_t n)
+{
+  const unsigned char *a = s1, *b = s2;
+
+  for (; n > 0; n--, a++, b++)
+    if (*a != *b)
+      return (*a - *b);
+  return (0);
+}
+
+// Find the first c in n bytes
+/**
+ * @fn memchr
+ * @brief Find a byte in memory
+ * @param s The memory
+ * @param c The byte
+ * @param n The number of bytes
+ * @return Its position, or NULL
+ */
+void *memchr(const void *s, int c, size_t n)
+{
+  const unsigned char *p = s;
+
+  for (; n > 0; n--, p++)
+    if (*p == (unsigned char)c)
+      return ((void *)p);
+  return (NULL);
+}
+
+// Return the length of a string
+/**
+ * @fn strlen
+ * @brief Return the length of a string
+ * @param s The string
+ * @return Its length
+ */
+size_t strlen(const char *s)
+{
+  const char *p = s;
+
+  while (*p != '\0')
+    p++;
+  return (p - s);
+}
+
+// Copy a string
+/**
+ * @fn strcpy
+ * @brief Copy a string
+ * @param dest Where to copy to
+ * @param src The string
+ * @return dest
+ */
+char *strcpy(char *dest, const char *src)
+{
+  char *d = dest;
+
+  while ((*d++ = *src++) != '\0')
+    ;
+  return (dest);
+}
+
+// Copy at most n characters of a string,
+// filling the rest of dest with NULs
+/**
+ * @fn strncpy
+ * @brief Copy at most n characters of a string
+ * @param dest Where to copy to
+ * @param src The string
+ * @param n The size of dest
+ * @return dest
+ */
+char *strncpy(char *dest, const char *src, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n && src[i] != '\0'; i++)
+    dest[i] = src[i];
+  for (; i < n; i++)
+    dest[i] = '\0';
+  return (dest);
+}
+
+// Add a string on to the end of another
+/**
+ * @fn strcat
+ * @brief Add a string on to the end of another
+ * @param dest The string to add to
+ * @param src The string to add
+ * @return dest
+ */
+char *strcat(char *dest, const char *src)
+{
+  strcpy(dest + strlen(dest), src);
+  return (dest);
+}
+
+// Find the first c in a string
+/**
+ * @fn strchr
+ * @brief Find the first of a character in a string
+ * @param s The string
+ * @param c The character
+ * @return Its position, or NULL
+ */
+char *strchr(const char *s, int c)
+{
+  while (*s != (char)c)
+  {
+    if (*s == '\0')
+      return (NULL);
+    s++;
+  }
+  return ((char *)s);
+}
+
+// Find the last c in a string
+/**
+ * @fn strrchr
+ * @brief Find the last of a character in a string
+ * @param s The string
+ * @param c The character
+ * @return Its position, or NULL
+ */
+char *strrchr(const char *s, int c)
+{
+  const char *last = NULL;
+
+  while (1)
+  {
+    if (*s == (char)c)
+      last = s;
+    if (*s == '\0')
+      break;
+    s++;
+  }
+  return ((char *)last);
+}
+
+// Compare two strings
+/**
+ * @fn strcmp
+ * @brief Compare two strings
+ * @param s1 The first string
+ * @param s2 The second string
+ * @return Less than, equal to or more than 0
+ */
+int strcmp(const char *s1, const char *s2)
+{
+  while (*s1 != '\0' && *s1 == *s2)
+  {
+    s1++;
+    s2++;
+  }
+  return (*(unsigned char *)s1 - *(unsigned char *)s2);
+}
+
+// Compare at most n characters of two strings
+/**
+ * @fn strncmp
+ * @brief Compare at most n characters of two strings
+ * @param s1 The first string
+ * @param s2 The second string
+ * @param n The most characters to compare
+ * @return Less than, equal to or more than 0
+ */
+int strncmp(const char *s1, const char *s2, size_t n)
+{
+  for (; n > 0; n--, s1++, s2++)
+    if (*s1 == '\0' || *s1 != *s2)
+      return (*(unsigned char *)s1 - *(unsigned char *)s2);
+  return (0);
+}
+
+// Return a copy of a string in new memory
+/**
+ * @fn strdup
+ * @brief Copy a string into new memory
+ * @param s The string
+ * @return The copy, or NULL
+ */
+char *strdup(const char *s)
+{
+  size_t len = strlen(s) + 1;
+  char *d;
+
+  if ((d = malloc(len)) != NULL)
+    memcpy(d, s, len);
+  return (d);
+}
+
+// The messages for the first errno values
+static const char *errmsg[] = {
+  "Success",
+  "Operation not permitted",
+  "No such file or directory",
+  "No such process",
+  "Interrupted system call",
+  "Input/output error",
+  "No such device or address",
+  "Argument list too long",
+  "Exec format error",
+  "Bad file descriptor",
+  "No child processes",
+  "Resource temporarily unavailable",
+  "Cannot allocate memory",
+  "Permission denied",
+  "Bad address",
+  "Block device required",
+  "Device or resource busy",
+  "File exists",
+  "Invalid cross-device link",
+  "No such device",
+  "Not a directory",
+  "Is a directory",
+  "Invalid argument",
+  "Too many open files in system",
+  "Too many open files",
+  "Inappropriate ioctl for device",
+  "Text file busy",
+  "File too large",
+  "No space left on device",
+  "Illegal seek",
+  "Read-only file system",
+  "Too many links",
+  "Broken pipe",
+  "Numerical argument out of domain",
+  "Numerical result out of range",
+  "Resource deadlock avoided",
+  "File name too long"
+};
+
+// Return the message for an errno value
+/**
+ * @fn strerror
+ * @brief Return the message for an errno value
+ * @param errnum The errno value
+ * @return The message
+ */
+char *strerror(int errnum)
+{
+  static char unknown[32];
+  int n = sizeof(errmsg) / sizeof(errmsg[0]);
+
+  if (errnum >= 0 && errnum < n)
+    return ((char *)errmsg[errnum]);
+  snprintf(unknown, sizeof(unknown), "Unknown error %d", errnum);
+  return (unknown);
+}
@@ -0,0 +1,339 @@
+/**
+ * @file syscall.c
+ * @author BrunchTea
+ * @brief System calls for the runtime
+ */
+#include "rt.h"
+
+// Make system call n with up to six arguments.
+// The kernel takes the fourth one in %r10
+__asm__(".text\n"
+        ".global __rt_syscall\n"
+        "__rt_syscall:\n"
+        "  mov %rdi, %rax\n"
+        "  mov %rsi, %rdi\n"
+        "  mov %rdx, %rsi\n"
+        "  mov %rcx, %rdx\n"
+        "  mov %r8, %r10\n"
+        "  mov %r9, %r8\n"
+        "  mov 8(%rsp), %r9\n"
+        "  syscall\n"
+        "  ret\n");
+
+// Turn the result of a system call into the C
+// convention: -1 with errno set on an error
+/**
+ * @fn __rt_ret
+ * @brief Turn the result of a system call into the C convention
+ * @param r The result of the system call
+ * @return r, or -1 with errno set if r is an error
+ */
+long __rt_ret(long r)
+{
+  if (r < 0 && r > -4096)
+  {
+    errno = (int)-r;
+    return (-1);
+  }
+  return (r);
+}
+
+// Open a file. The mode is only there with O_CREAT
+/**
+ * @fn open
+ * @brief Open a file
+ * @param pathname The file's name
+ * @param flags How to open it
+ * @return The file descriptor, or -1
+ */
+int open(const char *pathname, int flags, ...)
+{
+  va_list ap;
+  int mode = 0;
+
+  if (flags & O_CREAT)
+  {
+    va_start(ap, flags);
+    mode = va_arg(ap, int);
+    va_end(ap);
+  }
+  return ((int)__rt_ret(__rt_syscall(SYS_open, (long)pathname, flags,
+                                     mode, 0, 0, 0)));
+}
+
+// Create a file, or truncate it, for writing
+/**
+ * @fn creat
+ * @brief Create a file for writing
+ * @param pathname The file's name
+ * @param mode The permissions for a new file
+ * @return The file descriptor, or -1
+ */
+int creat(const char *pathname, int mode)
+{
+  return ((int)__rt_ret(__rt_syscall(SYS_creat, (long)pathname, mode,
+                                     0, 0, 0, 0)));
+}
+
+// Close a file descriptor
+/**
+ * @fn close
+ * @brief Close a file descriptor
+ * @param fd The file descriptor
+ * @return 0, or -1
+ */
+int close(int fd)
+{
+  return ((int)__rt_ret(__rt_syscall(SYS_close, fd, 0, 0, 0, 0, 0)));
+}
+
+// Read up to count bytes from a file descriptor
+/**
+ * @fn read
+ * @brief Read from a file descriptor
+ * @param fd The file descriptor
+ * @param buf Where to put the bytes
+ * @param count The most bytes to read
+ * @return The number of bytes read, or -1
+ */
+long read(int fd, void *buf, size_t count)
+{
+  return (__rt_ret(__rt_syscall(SYS_read, fd, (long)buf, count, 0, 0, 0)));
+}
+
+// Write up to count bytes to a file descriptor
+/**
+ * @fn write
+ * @brief Write to a file descriptor
+ * @param fd The file descriptor
+ * @param buf The bytes to write
+ * @param count The number of bytes
+ * @return The number of bytes written, or -1
+ */
+long write(int fd, const void *buf, size_t count)
+{
+  return (__rt_ret(__rt_syscall(SYS_write, fd, (long)buf, count, 0, 0, 0)));
+}
+
+// Move the offset of a file descriptor
+/**
+ * @fn lseek
+ * @brief Move the offset of a file descriptor
+ * @param fd The file descriptor
+ * @param offset The offset
+ * @param whence What the offset is from
+ * @return The new offset, or -1
+ */
+long lseek(int fd, long offset, int whence)
+{
+  return (__rt_ret(__rt_syscall(SYS_lseek, fd, offset, whence, 0, 0, 0)));
+}
+
+// Make a pipe
+/**
+ * @fn pipe
+ * @brief Make a pipe
+ * @param pipefd Where to put the read and write ends
+ * @return 0, or -1
+ */
+int pipe(int *pipefd)
+{
+  return ((int)__rt_ret(__rt_syscall(SYS_pipe, (long)pipefd, 0, 0, 0, 0, 0)));
+}
+
+// Duplicate a file descriptor onto another
+/**
+ * @fn dup2
+ * @brief Duplicate a file descriptor onto another
+ * @param oldfd The file descriptor to copy
+ * @param newfd The file descriptor to replace
+ * @return newfd, or -1
+ */
+int dup2(int oldfd, int newfd)
+{
+  return ((int)__rt_ret(__rt_syscall(SYS_dup2, oldfd, newfd, 0, 0, 0, 0)));
+}
+
+// Start a child process
+/**
+ * @fn fork
+ * @brief Start a child process
+ * @return The child's process id, 0 in the child, or -1
+ */
+int fork(void)
+{
+  return ((int)__rt_ret(__rt_syscall(SYS_fork, 0, 0, 0, 0, 0, 0)));
+}
+
+// Return our process id
+/**
+ * @fn getpid
+ * @brief Return our process id
+ * @return The process id
+ */
+int getpid(void)
+{
+  return ((int)__rt_syscall(SYS_getpid, 0, 0, 0, 0, 0, 0));
+}
+
+// Run a program in place of this one
+/**
+ * @fn execve
+ * @brief Run a program in place of this one
+ * @param path The program's file
+ * @param argv Its arguments
+ * @param envp Its environment
+ * @return -1, as it only returns on an error
+ */
+int execve(const char *path, char **argv, char **envp)
+{
+  return ((int)__rt_ret(__rt_syscall(SYS_execve, (long)path, (long)argv,
+                                     (long)envp, 0, 0, 0)));
+}
+
+// Run a program in place of this one, looking
+// for it in $PATH if its name has no '/'
+/**
+ * @fn execvp
+ * @brief Run a program, looking for it in $PATH
+ * @param file The program's name
+ * @param argv Its arguments
+ * @return -1, as it only returns on an error
+ */
+int execvp(const char *file, char **argv)
+{
+  char path[4096];
+  const char *dir, *end;
+  size_t dlen, flen;
+  int denied = 0;
+
+  if (strchr(file, '/') != NULL)
+    return (execve(file, argv, environ));
+  if ((dir = getenv("PATH")) == NULL)
+    dir = "/usr/local/bin:/bin:/usr/bin";
+  flen = strlen(file);
+
+  // Try each directory in turn, and give
+  // EACCES if we found it but couldn't run it
+  while (1)
+  {
+    if ((end = strchr(dir, ':')) == NULL)
+      end = dir + strlen(dir);
+    dlen = end - dir;
+    if (dlen + flen + 2 <= sizeof(path))
+    {
+      memcpy(path, dir, dlen);
+      if (dlen > 0)
+        path[dlen++] = '/';
+      memcpy(path + dlen, file, flen + 1);
+      execve(path, argv, environ);
+      if (errno == EACCES)
+        denied = 1;
+    }
+    if (*end == '\0')
+      break;
+    dir = end + 1;
+  }
+  errno = denied ? EACCES : ENOENT;
+  return (-1);
+}
+
+// Wait for a child process to change state
+/**
+ * @fn waitpid
+ * @brief Wait for a child process
+ * @param pid The child's process id, or -1 for any
+ * @param wstatus Where to put its status, or NULL
+ * @param options Options for the wait
+ * @return The child's process id, or -1
+ */
+int waitpid(int pid, int *wstatus, int options)
+{
+  return ((int)__rt_ret(__rt_syscall(SYS_wait4, pid, (long)wstatus,
+                                     options, 0, 0, 0)));
+}
+
+// Remove a file
+/**
+ * @fn unlink
+ * @brief Remove a file
+ * @param pathname The file's name
+ * @return 0, or -1
+ */
+int unlink(const char *pathname)
+{
+  return ((int)__rt_ret(__rt_syscall(SYS_unlink, (long)pathname,
+                                     0, 0, 0, 0, 0)));
+}
+
+// Change the working directory
+/**
+ * @fn chdir
+ * @brief Change the working directory
+ * @param path The new directory
+ * @return 0, or -1
+ */
+int chdir(const char *path)
+{
+  return ((int)__rt_ret(__rt_syscall(SYS_chdir, (long)path, 0, 0, 0, 0, 0)));
+}
+
+// Put the working directory in buf. If buf is
+// NULL, allocate one of size bytes, or as many
+// as needed if size is 0
+/**
+ * @fn getcwd
+ * @brief Get the working directory
+ * @param buf Where to put the directory, or NULL
+ * @param size The size of buf
+ * @return The directory, or NULL
+ */
+char *getcwd(char *buf, size_t size)
+{
+  char *mine = NULL;
+  long r;
+
+  if (buf == NULL)
+  {
+    if (size == 0)
+      size = 4096;
+    if ((buf = mine = malloc(size)) == NULL)
+      return (NULL);
+  }
+  r = __rt_ret(__rt_syscall(SYS_getcwd, (long)buf, size, 0, 0, 0, 0));
+  if (r == -1)
+  {
+    free(mine);
+    return (NULL);
+  }
+  return (buf);
+}
+
+// Rename a file
+/**
+ * @fn rename
+ * @brief Rename a file
+ * @param oldpath The file's name
+ * @param newpath Its new name
+ * @return 0, or -1
+ */
+int rename(const char *oldpath, const char *newpath)
+{
+  return ((int)__rt_ret(__rt_syscall(SYS_rename, (long)oldpath,
+                                     (long)newpath, 0, 0, 0, 0)));
+}
+
+// Return true if fd is a terminal
+/**
+ * @fn isatty
+ * @brief Return true if a file descriptor is a terminal
+ * @param fd The file descriptor
+ * @return 1 if it is a terminal, else 0
+ */
+int isatty(int fd)
+{
+  char termios[64];
+
+  // TCGETS only works on a terminal
+  return (__rt_syscall(SYS_ioctl, fd, 0x5401, (long)termios, 0, 0, 0) == 0);
+}
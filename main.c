@@ -11,9 +11,17 @@
 #include "decl.h"
 #include <errno.h>
 #include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <signal.h>
 
 // Compiler setup and top-level execution
 
+enum
+{
+  LINKARGLEN = 65536		// Longest list of object file names
+};				// to pass to the linker as arguments
+
 // Given a string with a '.' and at least a 1-character suffix
 // after the '.', change the suffix to be the given character.
 // Return the new string or NULL if the original string could
@@ -50,56 +58,373 @@ char *alter_suffix(char *str, char suffix)
   return (newstr);
 }
 
-// Given an input filename, compile that file
-// down to assembly code. Return the new file's name
+// Return true if the input filename is a file that
+// has already been through the pre-processor
 /**
- * @fn *do_compile
- * @brief Given an input filename, compile that file down to assembly code.
+ * @fn is_preprocessed
+ * @brief Return true if the input filename has already been pre-processed
  * @param *filename The input filename
- * @return The new file's name
+ * @return True if the file ends in .i
+ */
+static int is_preprocessed(char *filename)
+{
+  char *posn;
+
+  if ((posn = strrchr(filename, '.')) == NULL)
+    return (0);
+  return (!strcmp(posn, ".i"));
+}
+
+// Append the space-separated words in cmd to the
+// argument list args at position n. Return the new
+// number of arguments
+/**
+ * @fn addwords
+ * @brief Append the space-separated words in cmd to an argument list
+ * @param **args The argument list
+ * @param n The number of arguments already in the list
+ * @param *cmd The words to append
+ * @return The new number of arguments
  */
-static char *do_compile(char *filename)
+static int addwords(char **args, int n, char *cmd)
 {
-  char cmd[TEXTLEN];
+  char *s;
 
-  // Change the input file's suffix to .q
-  Outfilename = alter_suffix(filename, 'q');
-  if (Outfilename == NULL)
+  s = strdup(cmd);
+  while (*s != '\0')
   {
-    fprintf(stderr, "Error: %s has no suffix, try .c on the end\n", filename);
-    exit(1);
+    if (*s == ' ')
+      s++;
+    else
+    {
+      // Record the word and NUL-terminate it
+      args[n++] = s;
+      while (*s != '\0' && *s != ' ')
+        s++;
+      if (*s == ' ')
+      {
+        *s = '\0';
+        s++;
+      }
+    }
   }
-  // Generate the pre-processor command
-  snprintf(cmd, TEXTLEN, "%s %s %s", CPPCMD, INCDIR, filename);
+  return (n);
+}
+
+// Run the command in args directly, without a shell.
+// Its standard input and output are infd and outfd,
+// or ours when these are -1. The command doesn't get
+// closefd, our end of any pipe to it. Return the
+// command's process id
+/**
+ * @fn spawn
+ * @brief Run a command directly, without a shell
+ * @param **args The command and its arguments, ending with NULL
+ * @param infd The command's standard input, or -1
+ * @param outfd The command's standard output, or -1
+ * @param closefd A file descriptor for the command to close, or -1
+ * @return The command's process id
+ */
+static int spawn(char **args, int infd, int outfd, int closefd)
+{
+  int i, pid;
 
-  // Open up the pre-processor pipe
-  if ((Infile = popen(cmd, "r")) == NULL)
+  if (O_verbose)
   {
-    fprintf(stderr, "Unable to open %s: %s\n", filename, strerror(errno));
+    for (i = 0; args[i] != NULL; i++)
+      printf("%s ", args[i]);
+    printf("\n");
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  if ((pid = fork()) == -1)
+  {
+    fprintf(stderr, "Unable to fork: %s\n", strerror(errno));
     exit(1);
   }
-  Infilename = filename;
+  if (pid != 0)
+  {
+    tracespawn(pid, args);
+    return (pid);
+  }
+
+  // In the child, connect up the pipes and run the command
+  if (infd != -1)
+  {
+    dup2(infd, 0);
+    close(infd);
+  }
+  if (outfd != -1)
+  {
+    dup2(outfd, 1);
+    close(outfd);
+  }
+  if (closefd != -1)
+    close(closefd);
+  execvp(args[0], args);
+  fprintf(stderr, "Unable to run %s: %s\n", args[0], strerror(errno));
+  _exit(127);
+  return (0);
+}
+
+// The resources used by the last command that we waited for
+static struct rusage Cmdusage;
+
+// Wait for the command with the given process id.
+// Return its exit status, which is zero on success
+/**
+ * @fn waitcmd
+ * @brief Wait for a command to finish
+ * @param pid The command's process id
+ * @return The command's exit status, zero on success
+ */
+static int waitcmd(int pid)
+{
+  int wstatus;
+
+  if (wait4(pid, &wstatus, 0, &Cmdusage) == -1)
+    return (-1);
+  tracewait(pid, wstatus, Cmdusage.ru_maxrss);
+  return (wstatus);
+}
+
+// Temporary object files that only the linker needs.
+// These are removed when we finish, or on an error
+/**
+ * @var Tmpobjs
+ * @brief Temporary object files that only the linker needs
+ */
+static char **Tmpobjs;
+/**
+ * @var Ntmpobjs
+ * @brief The number of temporary object files
+ */
+static int Ntmpobjs;
+/**
+ * @var Tmpobjsize
+ * @brief The number of entries allocated in Tmpobjs
+ */
+static int Tmpobjsize;
+
+// Add the name of a temporary file to the
+// list of those to remove when we finish
+/**
+ * @fn addtmpobj
+ * @brief Add a temporary file to the list of those to remove
+ * @param *name The temporary file's name
+ */
+static void addtmpobj(char *name)
+{
+  if (Ntmpobjs == Tmpobjsize)
+  {
+    Tmpobjsize = Tmpobjsize * 2 + 16;
+    Tmpobjs = (char **)realloc(Tmpobjs, Tmpobjsize * sizeof(char *));
+    if (Tmpobjs == NULL)
+    {
+      fprintf(stderr, "Unable to malloc in addtmpobj()\n");
+      exit(1);
+    }
+  }
+  Tmpobjs[Ntmpobjs++] = name;
+}
+
+// Remove any temporary object files
+/**
+ * @fn remove_tmpobjs
+ * @brief Remove any temporary object files
+ */
+void remove_tmpobjs(void)
+{
+  int i;
+
+  for (i = 0; i < Ntmpobjs; i++)
+    unlink(Tmpobjs[i]);
+  Ntmpobjs = 0;
+}
+
+// The files that the compile leaves behind, for the
+// reply from the compile server. They are noted as
+// they are named, and only mean something if the
+// compile gets to the end
+/**
+ * @var Outputs
+ * @brief The files that the compile writes, NULL-terminated
+ */
+static char **Outputs;
+/**
+ * @var Noutputs
+ * @brief The number of files in Outputs
+ */
+static int Noutputs;
+/**
+ * @var Outputsize
+ * @brief The number of entries allocated in Outputs
+ */
+static int Outputsize;
+
+// Add a file to the list of those that the compile writes
+/**
+ * @fn addoutput
+ * @brief Add a file to the list of those that the compile writes
+ * @param *name The file's name
+ */
+static void addoutput(char *name)
+{
+  if (Noutputs + 1 >= Outputsize)
+  {
+    Outputsize = Outputsize * 2 + 16;
+    Outputs = (char **)realloc(Outputs, Outputsize * sizeof(char *));
+    if (Outputs == NULL)
+    {
+      fprintf(stderr, "Unable to malloc in addoutput()\n");
+      exit(1);
+    }
+  }
+  Outputs[Noutputs++] = name;
+  Outputs[Noutputs] = NULL;
+}
+
+// Return the NULL-terminated list of the files
+// that do_command() has written, or NULL if none
+/**
+ * @fn outputs
+ * @brief Return the files that do_command() has written
+ * @return The list of file names, or NULL
+ */
+char **outputs(void)
+{
+  if (Noutputs == 0)
+    return (NULL);
+  return (Outputs);
+}
+
+// Return the name of the object file for the
+// given source file. With -c, this is the file's
+// name ending in .o. Otherwise the object file is
+// only for the linker, so make a temporary one
+/**
+ * @fn *objname
+ * @brief Return the name of the object file for the given source file
+ * @param *filename The source filename
+ * @return The object file's name
+ */
+static char *objname(char *filename)
+{
+  char *name;
+  int fd;
+
+  if (O_assemble)
+  {
+    name = alter_suffix(filename, 'o');
+    if (name == NULL)
+    {
+      fprintf(stderr, "Error: %s has no suffix, try .c on the end\n",
+              filename);
+      exit(1);
+    }
+    return (name);
+  }
 
-  // Create the output file
-  if ((Outfile = fopen(Outfilename, "w")) == NULL)
+  name = strdup(TMPOBJ);
+  if ((fd = mkstemps(name, 2)) == -1)
   {
-    fprintf(stderr, "Unable to create %s: %s\n", Outfilename,
-            strerror(errno));
+    fprintf(stderr, "Unable to create %s: %s\n", name, strerror(errno));
+    remove_tmpobjs();
     exit(1);
   }
+  close(fd);
+  addtmpobj(name);
+  return (name);
+}
+
+// Read in the pre-processed input for the given
+// file, ready for the scanner
+/**
+ * @fn do_preprocess
+ * @brief Read in the pre-processed input for the given file
+ * @param *filename The input filename
+ */
+static void do_preprocess(char *filename)
+{
+  char *args[TEXTLEN];
+  int n, pid, fd[2];
 
-  Line = 1; // Reset the scanner
-  Linestart = 1;
-  Putback = '\n';
-  clear_symtable(); // Clear the symbol table
+  // Scan a .i file as it is, otherwise use
+  // the integrated pre-processor if we can
+  tracebegin("preprocess", "stage");
+  Ctx->infilename = filename;
+  if (is_preprocessed(filename))
+  {
+    if (!openinput(filename))
+    {
+      fprintf(stderr, "Unable to open %s: %s\n", filename, strerror(errno));
+      exit(1);
+    }
+  }
+  else
+    Ctx->pptokens = preprocess(filename);
+  if (Ctx->pptokens == NULL && Ctx->inbuf == NULL)
+  {
+    // Otherwise run the external pre-processor
+    // and read in all of its output. Its line
+    // markers give us the files that it included
+    Ctx->ndeps = 0;
+    n = addwords(args, 0, CPPCMD);
+    args[n++] = INCDIR;
+    args[n++] = filename;
+    args[n] = NULL;
+    if (pipe(fd) == -1)
+    {
+      fprintf(stderr, "Unable to make a pipe: %s\n", strerror(errno));
+      exit(1);
+    }
+    pid = spawn(args, -1, fd[1], fd[0]);
+    close(fd[1]);
+    readinput(fd[0]);
+    close(fd[0]);
+    if (waitcmd(pid) != 0)
+    {
+      fprintf(stderr, "Pre-processing of %s failed\n", filename);
+      exit(1);
+    }
+  }
+  if (O_makedeps && Ctx->pptokens == NULL)
+    scandeps();
+  traceend();
+}
+
+// Given an input filename, compile that file down to
+// assembly code. The QBE back end runs in-process, so
+// no intermediate file is written. The assembly code
+// goes to Ctx->asmfile, which do_file() has set up
+/**
+ * @fn do_compile
+ * @brief Given an input filename, compile that file down to assembly code.
+ * @param *filename The input filename
+ */
+static void do_compile(char *filename)
+{
+  Ctx->line = 1; // Reset the scanner
+  Ctx->linestart = 1;
+  Ctx->putback = '\n';
+  // Clear the symbol table, or start from the
+  // symbols of the headers in a snapshot
+  if (Ctx->ppsnap != NULL)
+    use_symtables(Ctx->ppsnap);
+  else
+    clear_symtable();
   if (O_verbose)
     printf("compiling %s\n", filename);
-  scan(&Token);          // Get the first token from the input
-  Peektoken.token = 0;   // and set there is no lookahead token
-  genpreamble(filename); // Output the preamble
-  global_declarations(); // Parse the global declarations
-  genpostamble();        // Output the postamble
-  fclose(Outfile);       // Close the output file
+  tracebegin("compile", "stage");
+  scan(Ctx->token);          // Get the first token from the input
+  Ctx->peektoken->token = 0; // and set there is no lookahead token
+  genpreamble(filename);     // Output the preamble
+  global_declarations();     // Parse the global declarations
+  genpostamble();            // Output the postamble
+  closeinput();              // Release the input
+  Ctx->pptokens = NULL;
+  traceend();
 
   // Dump the symbol table if requested
   if (O_dumpsym)
@@ -110,111 +435,536 @@ static char *do_compile(char *filename)
   }
 
   freestaticsyms(); // Free any static symbols in the file
-  return (Outfilename);
 }
 
-// Given an input filename, run QBE on the file and
-// produce an assembly file. Return the object filename
+// Start the assembler making the named object file.
+// It reads the assembly code from a pipe, which
+// becomes Ctx->asmfile, while we compile
 /**
- * @fn *do_qbe
- * @brief Given an input filename, run QBE on the file and produce an assembly file.
- * @param *filename The input filename
- * @return The object filename
+ * @fn do_assemble
+ * @brief Start the assembler making the named object file
+ * @param *objfile The object filename
  */
-char *do_qbe(char *filename)
+static void do_assemble(char *objfile)
 {
-  char cmd[TEXTLEN];
-  int err;
+  char *args[TEXTLEN];
+  int n, fd[2];
 
-  char *outfilename = alter_suffix(filename, 's');
-  if (outfilename == NULL)
+  n = addwords(args, 0, ASCMD);
+  args[n++] = objfile;
+  args[n] = NULL;
+  if (pipe(fd) == -1)
   {
-    fprintf(stderr, "Error: %s has no suffix, try .qbe on the end\n",
-            filename);
+    fprintf(stderr, "Unable to make a pipe: %s\n", strerror(errno));
     exit(1);
   }
-  // Build the QBE command and run it
-  snprintf(cmd, TEXTLEN, "%s %s %s", QBECMD, outfilename, filename);
-  if (O_verbose)
-    printf("%s\n", cmd);
-  err = system(cmd);
-  if (err != 0)
+  Ctx->aspid = spawn(args, fd[0], -1, fd[1]);
+  close(fd[0]);
+  Ctx->asmfile = fdopen(fd[1], "w");
+}
+
+// Create the named output file for QBE to write
+// the assembly code or the object file into
+/**
+ * @fn open_output
+ * @brief Create the output file for QBE to write into
+ * @param *name The output filename
+ */
+static void open_output(char *name)
+{
+  if ((Ctx->asmfile = fopen(name, "w")) == NULL)
   {
-    fprintf(stderr, "QBE translation of %s failed\n", filename);
+    fprintf(stderr, "Unable to create %s: %s\n", name, strerror(errno));
     exit(1);
   }
-  return (outfilename);
 }
 
-// Given an input filename, assemble that file
-// down to object code. Return the object filename
+// Write the list of object files to a temporary response
+// file for the linker, one name per line, with a backslash
+// before each character that the linker would treat as
+// special. Return the "@file" argument which names it
 /**
- * @fn *do_assemble
- * @brief Given an input filename, assemble that file down to object code.
- * @param *filename The input filename
- * @return The object filename
+ * @fn *response_file
+ * @brief Write the list of object files to a response file for the linker
+ * @param **objlist The list of object files
+ * @return The linker argument that names the response file
  */
-char *do_assemble(char *filename)
+static char *response_file(char **objlist)
 {
-  char cmd[TEXTLEN];
-  int err;
+  char *name, *buf, *s, *arg;
+  int i, fd, len;
 
-  char *outfilename = alter_suffix(filename, 'o');
-  if (outfilename == NULL)
+  name = strdup(TMPRSP);
+  if ((fd = mkstemps(name, 4)) == -1)
   {
-    fprintf(stderr, "Error: %s has no suffix, try .s on the end\n", filename);
+    fprintf(stderr, "Unable to create %s: %s\n", name, strerror(errno));
+    remove_tmpobjs();
     exit(1);
   }
-  // Build the assembly command and run it
-  snprintf(cmd, TEXTLEN, "%s %s %s", ASCMD, outfilename, filename);
-  if (O_verbose)
-    printf("%s\n", cmd);
-  err = system(cmd);
-  if (err != 0)
+  addtmpobj(name);
+
+  // Each character may need a backslash before it
+  len = 0;
+  for (i = 0; objlist[i] != NULL; i++)
+    len = len + 2 * (int)strlen(objlist[i]) + 1;
+  buf = (char *)malloc(len);
+  if (buf == NULL)
   {
-    fprintf(stderr, "Assembly of %s failed\n", filename);
+    fprintf(stderr, "Unable to malloc in response_file()\n");
     exit(1);
   }
-  return (outfilename);
+  len = 0;
+  for (i = 0; objlist[i] != NULL; i++)
+  {
+    for (s = objlist[i]; *s != '\0'; s++)
+    {
+      if (*s == ' ' || *s == '\t' || *s == '\n' ||
+          *s == '\'' || *s == '"' || *s == '\\')
+        buf[len++] = '\\';
+      buf[len++] = *s;
+    }
+    buf[len++] = '\n';
+  }
+  if (write(fd, buf, len) != len || close(fd) == -1)
+  {
+    fprintf(stderr, "Unable to write %s: %s\n", name, strerror(errno));
+    remove_tmpobjs();
+    exit(1);
+  }
+  free(buf);
+
+  arg = (char *)malloc(strlen(name) + 2);
+  if (arg == NULL)
+  {
+    fprintf(stderr, "Unable to malloc in response_file()\n");
+    exit(1);
+  }
+  arg[0] = '@';
+  strcpy(arg + 1, name);
+  return (arg);
 }
 
 // Given a list of object files and an output filename,
-// link all of the object filenames together.
+// link all of the object filenames together. A long
+// list goes to the linker in a response file, so that
+// it doesn't exceed the limit on a command's arguments
 /**
  * @fn *do_link
  * @brief Given a list of object files and an output filename, link all of the object filenames together.
  * @param *outfilename The output filename
  * @param **objlist The list of object files
  */
-void do_link(char *outfilename, char **objlist)
+static void do_link(char *outfilename, char **objlist)
 {
-  int cnt, size = TEXTLEN;
-  char cmd[TEXTLEN], *cptr;
-  int err;
-
-  // Start with the linker command and the output file
-  cptr = cmd;
-  cnt = snprintf(cptr, size, "%s %s ", LDCMD, outfilename);
-  cptr += cnt;
-  size -= cnt;
+  char **args;
+  int i, n, len = 0;
 
-  // Now append each object file
-  while (*objlist != NULL)
+  // Make room for the linker command, the
+  // output file and each object file
+  for (n = 0; objlist[n] != NULL; n++)
+    len = len + (int)strlen(objlist[n]) + 1;
+  args = (char **)malloc((n + TEXTLEN) * sizeof(char *));
+  if (args == NULL)
   {
-    cnt = snprintf(cptr, size, "%s ", *objlist);
-    cptr += cnt;
-    size -= cnt;
-    objlist++;
+    fprintf(stderr, "Unable to malloc in do_link()\n");
+    exit(1);
   }
+  // With -static, ld links the objects to MINIC's
+  // runtime, which has _start, and no C library
+  if (O_static)
+    n = addwords(args, 0, RTLDCMD);
+  else
+    n = addwords(args, 0, LDCMD);
+  args[n++] = outfilename;
+  if (len > LINKARGLEN)
+    args[n++] = response_file(objlist);
+  else
+    for (i = 0; objlist[i] != NULL; i++)
+      args[n++] = objlist[i];
+  if (O_static)
+    args[n++] = RTLIB;
+  args[n] = NULL;
 
-  if (O_verbose)
-    printf("%s\n", cmd);
-  err = system(cmd);
-  if (err != 0)
+  tracebegin("link", "stage");
+  if (waitcmd(spawn(args, -1, -1, -1)) != 0)
   {
     fprintf(stderr, "Linking failed\n");
+    remove_tmpobjs();
+    exit(1);
+  }
+  traceend();
+  free(args);
+}
+
+// The executable that the object files are linked into
+/**
+ * @var Linkfile
+ * @brief The executable that the object files are linked into
+ */
+static char *Linkfile;
+
+// With -MD, write the dependency file for the source
+// file. The target of its rule is the file that make
+// would build: the executable when we link, or else
+// the object or assembly file
+/**
+ * @fn do_deps
+ * @brief Write the dependency file for the source file
+ * @param *filename The input filename
+ * @param *target The target of the rule
+ */
+static void do_deps(char *filename, char *target)
+{
+  char *depname = O_depfile;
+
+  if (!O_makedeps)
+    return;
+  if (O_dolink)
+    target = Linkfile;
+  if (depname == NULL)
+    depname = alter_suffix(filename, 'd');
+  if (depname == NULL || target == NULL)
+  {
+    fprintf(stderr, "Error: %s has no suffix, try .c on the end\n",
+            filename);
+    exit(1);
+  }
+  writedeps(depname, target, filename);
+}
+
+// Compile the source file. With an object filename,
+// QBE writes the object file, or we pipe the assembly
+// code straight into the assembler. Otherwise, with
+// -S, write it to a .s file. Use any cached output
+// instead when the cache is on
+/**
+ * @fn do_file
+ * @brief Compile the source file, and assemble it if given an object filename
+ * @param *filename The input filename
+ * @param *objfile The object filename, or NULL to keep the assembly code
+ */
+static void do_file(char *filename, char *objfile)
+{
+  int suffix = 'o', found;
+
+  // Each file is compiled in a fresh context
+  tracebegin(filename, "file");
+  Ctx = new_context();
+
+  // With -fsyntax-only, parse the file and
+  // make no output, so there is nothing to cache
+  if (O_syntaxonly)
+  {
+    do_preprocess(filename);
+    do_compile(filename);
+    do_deps(filename, alter_suffix(filename, 'o'));
+    free_context(Ctx);
+    Ctx = NULL;
+    traceend();
+    return;
+  }
+
+  Ctx->outfilename = objfile;
+  if (objfile == NULL)
+  {
+    // Change the input file's suffix to .s
+    suffix = 's';
+    Ctx->outfilename = alter_suffix(filename, 's');
+    if (Ctx->outfilename == NULL)
+    {
+      fprintf(stderr, "Error: %s has no suffix, try .c on the end\n",
+              filename);
+      exit(1);
+    }
+  }
+  do_preprocess(filename);
+
+  // The dumps need a real compile
+  if (O_cachedir != NULL && !O_dumpAST && !O_dumpsym)
+  {
+    tracebegin("cache lookup", "stage");
+    found = cachelookup(filename, Ctx->outfilename, suffix);
+    traceend();
+    if (found)
+    {
+      closeinput();
+      do_deps(filename, Ctx->outfilename);
+      free_context(Ctx);
+      Ctx = NULL;
+      traceend();
+      return;
+    }
+  }
+
+  // QBE writes the object file itself if it can.
+  // If not, run the assembler on the QBE code
+  Ctx->elfobj = (objfile != NULL && O_intas);
+  if (objfile != NULL && !O_intas)
+    do_assemble(objfile);
+  else
+    open_output(Ctx->outfilename);
+
+  do_compile(filename);
+  if (Ctx->needas)
+  {
+    if (O_verbose)
+      printf("assembling %s with as\n", filename);
+    fclose(Ctx->asmfile);
+    Ctx->elfobj = 0;
+    do_assemble(objfile);
+    tracebegin("replay", "stage");
+    cgreplay();
+    traceend();
+  }
+  fclose(Ctx->asmfile); // Close the output, and wait
+  if (Ctx->aspid != 0)  // for any assembler to finish
+  {
+    if (waitcmd(Ctx->aspid) != 0)
+    {
+      fprintf(stderr, "Assembly of %s failed\n", filename);
+      unlink(objfile);
+      remove_tmpobjs();
+      exit(1);
+    }
+  }
+
+  // Only a file that was looked up can be stored
+  if (Ctx->cachename != NULL)
+  {
+    tracebegin("cache store", "stage");
+    cachestore(Ctx->outfilename);
+    traceend();
+  }
+  do_deps(filename, Ctx->outfilename);
+  free_context(Ctx);
+  Ctx = NULL;
+  traceend();
+}
+
+// The standard output and error of each parallel job
+// are kept in temporary files until the job's turn comes
+static FILE **Jobout;
+static FILE **Joberr;
+
+// Copy the contents of the temporary file in
+// to the output file out, then close it
+/**
+ * @fn copy_output
+ * @brief Copy the contents of a temporary file to an output file, then close it
+ * @param in The temporary file
+ * @param out The output file
+ */
+static void copy_output(FILE *in, FILE *out)
+{
+  char buf[TEXTLEN];
+  int n;
+
+  rewind(in);
+  while ((n = (int)fread(buf, 1, TEXTLEN, in)) > 0)
+    fwrite(buf, 1, n, out);
+  fflush(out);
+  fclose(in);
+}
+
+// Compile the nfiles source files in parallel, running up
+// to O_jobs child processes at a time. The output of each
+// child is printed in the order of the files, so we get
+// what a serial build prints. Like a serial build, stop at
+// the first file which fails and exit, removing anything
+// that the files after it made.
+/**
+ * @fn do_parallel
+ * @brief Compile the source files in parallel, running up to O_jobs child processes at a time.
+ * @param **files The source filenames
+ * @param **objs The object filenames, or NULLs with -S
+ * @param nfiles The number of source files
+ */
+static void do_parallel(char **files, char **objs, int nfiles)
+{
+  int *pids;
+  int i, pid, wstatus;
+  int next = 0, running = 0, printed = 0, failed = nfiles;
+
+  pids = (int *)malloc(nfiles * sizeof(int));
+  Jobout = malloc(nfiles * sizeof(FILE *));
+  Joberr = malloc(nfiles * sizeof(FILE *));
+  if (pids == NULL || Jobout == NULL || Joberr == NULL)
+  {
+    fprintf(stderr, "Unable to malloc in do_parallel()\n");
+    exit(1);
+  }
+
+  while (running > 0 || (next < nfiles && next < failed))
+  {
+    // Start as many jobs as we can, but none for files
+    // after one which has failed. Don't get too far ahead
+    // of the output that we have printed, as each job
+    // holds two open files until its output is printed
+    while (running < O_jobs && next < nfiles && next < failed &&
+           next - printed < 4 * O_jobs)
+    {
+      Jobout[next] = tmpfile();
+      Joberr[next] = tmpfile();
+      if (Jobout[next] == NULL || Joberr[next] == NULL)
+      {
+        fprintf(stderr, "Unable to create temporary file: %s\n",
+                strerror(errno));
+        exit(1);
+      }
+      fflush(stdout);
+      fflush(stderr);
+      if ((pid = fork()) == -1)
+      {
+        fprintf(stderr, "Unable to fork: %s\n", strerror(errno));
+        exit(1);
+      }
+
+      // The child sends its output to the temporary files,
+      // and leaves the temporary objects for us to remove
+      if (pid == 0)
+      {
+        dup2(fileno(Jobout[next]), 1);
+        dup2(fileno(Joberr[next]), 2);
+        Ntmpobjs = 0;
+        traceprocess("MINIC job", 0);
+        do_file(files[next], objs[next]);
+        exit(0);
+      }
+      pids[next] = pid;
+      next++;
+      running++;
+    }
+
+    // Wait for a job to finish and note if it failed
+    if ((pid = wait(&wstatus)) == -1)
+    {
+      fprintf(stderr, "Unable to wait for a job: %s\n", strerror(errno));
+      exit(1);
+    }
+    running--;
+    for (i = 0; i < next; i++)
+      if (pids[i] == pid)
+      {
+        pids[i] = 0;
+        if (wstatus != 0 && i < failed)
+          failed = i;
+      }
+
+    // Print the output of the finished jobs in order
+    while (printed < next && pids[printed] == 0 && printed <= failed)
+    {
+      copy_output(Jobout[printed], stdout);
+      copy_output(Joberr[printed], stderr);
+      printed++;
+    }
+  }
+
+  // Print the output of the rest of the jobs up to any
+  // failure. Remove anything made by the jobs after it
+  for (i = printed; i < next; i++)
+  {
+    if (i <= failed)
+    {
+      copy_output(Jobout[i], stdout);
+      copy_output(Joberr[i], stderr);
+    }
+    else
+    {
+      fclose(Jobout[i]);
+      fclose(Joberr[i]);
+      if (objs[i] != NULL)
+        unlink(objs[i]);
+      else if (!O_syntaxonly)
+        unlink(alter_suffix(files[i], 's'));
+    }
+  }
+  if (failed < nfiles)
+  {
+    remove_tmpobjs();
+    exit(1);
+  }
+}
+
+// Return true if the input filename is an object
+// file or library that goes straight to the linker
+/**
+ * @fn is_linkinput
+ * @brief Return true if the input filename is an object file or library that goes straight to the linker
+ * @param *filename The input filename
+ * @return True if the file is only used when linking
+ */
+static int is_linkinput(char *filename)
+{
+  char *posn;
+
+  if ((posn = strrchr(filename, '.')) == NULL)
+    return (0);
+  return (!strcmp(posn, ".o") || !strcmp(posn, ".a"));
+}
+
+// Compile the nfiles source files as one program into
+// objfile, leaving out the functions and data which
+// can't be reached from main(). If keepexports is true,
+// other object files are linked in which may use any
+// of the exported functions and data, so keep those
+/**
+ * @fn do_whole
+ * @brief Compile the source files as one program into one object file
+ * @param **files The source filenames
+ * @param *objfile The object filename
+ * @param nfiles The number of source files
+ * @param keepexports If true, keep all exported functions and data
+ */
+static void do_whole(char **files, char *objfile, int nfiles, int keepexports)
+{
+  int i;
+
+  // Parse each file and keep its QBE code
+  for (i = 0; i < nfiles; i++)
+  {
+    tracebegin(files[i], "file");
+    Ctx = new_context();
+    do_preprocess(files[i]);
+    do_compile(files[i]);
+    do_deps(files[i], NULL);
+    free_context(Ctx);
+    Ctx = NULL;
+    traceend();
+  }
+
+  // Translate what is used into an object file,
+  // running the assembler if QBE can't write it
+  tracebegin("whole program", "stage");
+  Ctx = new_context();
+  Ctx->infilename = files[0];
+  Ctx->outfilename = objfile;
+  if (O_intas)
+  {
+    Ctx->elfobj = 1;
+    open_output(objfile);
+    if (wpfinish(keepexports))
+    {
+      fclose(Ctx->asmfile);
+      free_context(Ctx);
+      Ctx = NULL;
+      traceend();
+      return;
+    }
+    fclose(Ctx->asmfile);
+    Ctx->elfobj = 0;
+  }
+  do_assemble(objfile);
+  wpfinish(keepexports);
+  fclose(Ctx->asmfile);
+  if (waitcmd(Ctx->aspid) != 0)
+  {
+    fprintf(stderr, "Assembly of the whole program failed\n");
+    remove_tmpobjs();
     exit(1);
   }
+  free_context(Ctx);
+  Ctx = NULL;
+  traceend();
 }
 
 // Print out a usage if started incorrectly
@@ -225,37 +975,61 @@ void do_link(char *outfilename, char **objlist)
  */
 static void usage(char *prog)
 {
-  fprintf(stderr, "Usage: %s [-vcSTM] [-o outfile] file [file ...]\n", prog);
+  fprintf(stderr, "Usage: %s [-vcSTM] [-j jobs] [-o outfile] file [file ...]\n",
+          prog);
+  fprintf(stderr,
+          "       files ending in .o or .a are passed on to the linker\n");
   fprintf(stderr,
           "       -v give verbose output of the compilation stages\n");
   fprintf(stderr, "       -c generate object files but don't link them\n");
   fprintf(stderr, "       -S generate assembly files but don't link them\n");
   fprintf(stderr, "       -T dump the AST trees for each input file\n");
   fprintf(stderr, "       -M dump the symbol table for each input file\n");
+  fprintf(stderr,
+          "       -fsyntax-only check the syntax and types, with no output\n");
+  fprintf(stderr,
+          "       -fwhole-program compile the files as one program and\n");
+  fprintf(stderr,
+          "                       drop what can't be reached from main()\n");
+  fprintf(stderr,
+          "       -fno-integrated-as run as to make the object files\n");
+  fprintf(stderr,
+          "       -fno-builtin always call memcpy(), strlen(), isdigit() etc.\n");
+  fprintf(stderr,
+          "       -MD write the files that each file includes to a .d file\n");
+  fprintf(stderr, "       -MF depfile, name the .d file\n");
   fprintf(stderr, "       -o outfile, produce the outfile executable file\n");
+  fprintf(stderr, "       -j jobs, compile up to jobs files at the same time\n");
+  fprintf(stderr,
+          "       -static link with MINIC's runtime, not the C library\n");
+  fprintf(stderr,
+          "       --trace=file write a timeline of the compile to file\n");
+  fprintf(stderr,
+          "       MINIC_CACHE=dir in the environment caches output in dir\n");
+  fprintf(stderr, "   or: %s -d socket\n", prog);
+  fprintf(stderr,
+          "       run a compile server listening on the Unix socket\n");
+  fprintf(stderr,
+          "       MINIC_SERVER=socket in the environment uses the server\n");
   exit(1);
 }
 
-// Main program: check arguments and print a usage
-// if we don't have an argument. Open up the input
-// file and call scanfile() to scan the tokens in it.
-enum
-{
-  MAXOBJ = 100
-};
+// Run the compiler with the given arguments: check
+// them and print a usage if we don't have an input
+// file, then compile, assemble and link the files.
 /**
- * @fn main
- * @brief Main program: check arguments and print a usage if we don't have an argument.
+ * @fn do_command
+ * @brief Run the compiler with the given arguments
  * @param argc The number of arguments
  * @param **argv The arguments
  * @return 0
  */
-int main(int argc, char **argv)
+int do_command(int argc, char **argv)
 {
   char *outfilename = AOUT;
-  char *qbefile, *asmfile, *objfile;
-  char *objlist[MAXOBJ];
-  int i, j, objcnt = 0;
+  char *objfile;
+  char **objlist, **srclist, **srcobjs;
+  int i, j, n, objcnt = 0, srccnt = 0, keepexports = 0;
 
   // Initialise our variables
   O_dumpAST = 0;
@@ -264,6 +1038,22 @@ int main(int argc, char **argv)
   O_assemble = 0;
   O_verbose = 0;
   O_dolink = 1;
+  O_jobs = 1;
+  O_syntaxonly = 0;
+  O_wholeprog = 0;
+  O_intas = 1;
+  O_makedeps = 0;
+  O_depfile = NULL;
+  O_tracefile = NULL;
+  O_static = 0;
+  O_nobuiltin = 0;
+  Noutputs = 0;
+
+  // The cache is only used if there's a directory for it
+  O_cachedir = getenv("MINIC_CACHE");
+  O_cachesize = CACHESIZE;
+  if (getenv("MINIC_CACHE_SIZE") != NULL)
+    O_cachesize = atol(getenv("MINIC_CACHE_SIZE")) * 1024 * 1024;
 
   // Scan for command-line options
   for (i = 1; i < argc; i++)
@@ -284,7 +1074,28 @@ int main(int argc, char **argv)
         O_dumpAST = 1;
         break;
       case 'M':
-        O_dumpsym = 1;
+        // -MD writes a dependency file, -MF names it.
+        // Otherwise, dump the symbol table
+        if (argv[i][j + 1] == 'D')
+        {
+          O_makedeps = 1;
+          j++;
+        }
+        else if (argv[i][j + 1] == 'F')
+        {
+          if (argv[i][j + 2])
+          {
+            O_depfile = argv[i] + j + 2;
+            while (argv[i][j + 1])
+              j++;
+          }
+          else if (i + 1 < argc)
+            O_depfile = argv[++i];
+          else
+            usage(argv[0]);
+        }
+        else
+          O_dumpsym = 1;
         break;
       case 'c':
         O_assemble = 1;
@@ -299,55 +1110,215 @@ int main(int argc, char **argv)
       case 'v':
         O_verbose = 1;
         break;
+      case 'f':
+        // Only check the syntax and types of the files,
+        // compile all of them as one program,
+        // always run the assembler to make objects,
+        // or never do the library builtins inline
+        if (!strcmp(argv[i] + j, "fsyntax-only"))
+        {
+          O_syntaxonly = 1;
+          O_keepasm = 0;
+          O_assemble = 0;
+          O_dolink = 0;
+        }
+        else if (!strcmp(argv[i] + j, "fwhole-program"))
+          O_wholeprog = 1;
+        else if (!strcmp(argv[i] + j, "fno-integrated-as"))
+          O_intas = 0;
+        else if (!strcmp(argv[i] + j, "fno-builtin"))
+          O_nobuiltin = 1;
+        else
+          usage(argv[0]);
+        while (argv[i][j + 1])
+          j++;
+        break;
+      case 'j':
+        // Take the number of jobs from the rest
+        // of this argument or from the next one
+        if (argv[i][j + 1])
+        {
+          O_jobs = atoi(argv[i] + j + 1);
+          while (argv[i][j + 1])
+            j++;
+        }
+        else if (i + 1 < argc)
+          O_jobs = atoi(argv[++i]);
+        else
+          usage(argv[0]);
+        if (O_jobs < 1)
+          usage(argv[0]);
+        break;
+      case 's':
+        // -static links against our own runtime
+        if (strcmp(argv[i] + j, "static"))
+          usage(argv[0]);
+        O_static = 1;
+        while (argv[i][j + 1])
+          j++;
+        break;
+      case '-':
+        // --trace=file writes a timeline of the compile
+        if (!strncmp(argv[i] + j, "-trace=", 7) && argv[i][j + 7])
+          O_tracefile = argv[i] + j + 7;
+        else
+          usage(argv[0]);
+        while (argv[i][j + 1])
+          j++;
+        break;
       default:
         usage(argv[0]);
       }
     }
   }
 
+  Linkfile = outfilename;
+
+  // The whole program has to be linked
+  if (O_syntaxonly)
+    O_wholeprog = 0;
+  if (O_wholeprog && !O_dolink)
+  {
+    fprintf(stderr, "-fwhole-program can't be used with -c or -S\n");
+    exit(1);
+  }
+
   // Ensure we have at lease one input file argument
   if (i >= argc)
     usage(argv[0]);
 
+  // Start the timeline, which covers everything from here
+  if (O_tracefile != NULL)
+  {
+    traceopen(O_tracefile);
+    tracebegin("MINIC", "driver");
+  }
+
+  // A dependency file named by -MF is for one source file
+  if (O_depfile != NULL)
+  {
+    n = 0;
+    for (j = i; j < argc; j++)
+      if (!is_linkinput(argv[j]))
+        n++;
+    if (n > 1)
+    {
+      fprintf(stderr, "-MF can't be used with more than one source file\n");
+      exit(1);
+    }
+  }
+
+  // There can't be more files than arguments
+  objlist = (char **)malloc((argc + 1) * sizeof(char *));
+  srclist = (char **)malloc((argc + 1) * sizeof(char *));
+  srcobjs = (char **)malloc((argc + 1) * sizeof(char *));
+  if (objlist == NULL || srclist == NULL || srcobjs == NULL)
+  {
+    fprintf(stderr, "Unable to malloc in do_command()\n");
+    exit(1);
+  }
+  objlist[0] = NULL;
+
   // Work on each input file in turn
   while (i < argc)
   {
-    qbefile = do_compile(argv[i]); // Compile the source file
-    asmfile = do_qbe(qbefile);
+    // Objects and libraries are only needed by the linker.
+    // Other object files may use anything that we export
+    if (is_linkinput(argv[i]))
+    {
+      if (!strcmp(strrchr(argv[i], '.'), ".o"))
+        keepexports = 1;
+      objlist[objcnt++] = argv[i];
+      objlist[objcnt] = NULL;
+      i++;
+      continue;
+    }
 
+    // Compile the file now, or save it for do_parallel()
+    // or do_whole() to compile with the others. The whole
+    // program goes into the first file's object file
+    objfile = NULL;
     if (O_dolink || O_assemble)
+      if (!O_wholeprog || srccnt == 0)
+        objfile = objname(argv[i]);
+    if (O_jobs > 1 || O_wholeprog)
+    {
+      srclist[srccnt] = argv[i];
+      srcobjs[srccnt++] = objfile;
+    }
+    else
+      do_file(argv[i], objfile);
+
+    if (objfile != NULL)
     {
-      objfile = do_assemble(asmfile); // Assemble it to object forma
-      if (objcnt == (MAXOBJ - 2))
-      {
-        fprintf(stderr, "Too many object files for the compiler to handle\n");
-        exit(1);
-      }
       objlist[objcnt++] = objfile; // Add the object file's name
       objlist[objcnt] = NULL;      // to the list of object files
     }
 
-    if (!O_keepasm)
-    {                  // Remove the QBE and assembly files
-      unlink(qbefile); // if we don't need to keep them
-      unlink(asmfile);
-    }
+    // Note the files that are kept for this one
+    if (O_assemble)
+      addoutput(objfile);
+    if (O_keepasm)
+      addoutput(alter_suffix(argv[i], 's'));
+    if (O_makedeps && O_depfile != NULL)
+      addoutput(O_depfile);
+    else if (O_makedeps)
+      addoutput(alter_suffix(argv[i], 'd'));
     i++;
   }
 
-  // Now link all the object files together
+  if (O_wholeprog && srccnt > 0)
+    do_whole(srclist, srcobjs[0], srccnt, keepexports);
+  else if (srccnt > 0)
+    do_parallel(srclist, srcobjs, srccnt);
+
+  // Now link all the object files together,
+  // then remove the ones that we made for it
   if (O_dolink)
   {
     do_link(outfilename, objlist);
-
-    // If we don't need to keep the object
-    // files, then remove them
-    if (!O_assemble)
-    {
-      for (i = 0; objlist[i] != NULL; i++)
-        unlink(objlist[i]);
-    }
+    addoutput(outfilename);
   }
+  if (O_tracefile != NULL)
+    addoutput(O_tracefile);
+  remove_tmpobjs();
+  traceend();
+  traceclose();
 
   return (0);
 }
+
+// Main program: run a compile server, pass the
+// arguments to one, or run the compiler ourselves.
+/**
+ * @fn main
+ * @brief Main program: run a compile server, pass the arguments to one, or run the compiler
+ * @param argc The number of arguments
+ * @param **argv The arguments
+ * @return The exit status
+ */
+int main(int argc, char **argv)
+{
+  char *server;
+  int status;
+
+  lexinit();
+
+  // If the assembler fails, we find out from its exit
+  // status rather than being killed writing to its pipe
+  signal(SIGPIPE, SIG_IGN);
+
+  if (argc == 3 && !strcmp(argv[1], "-d"))
+    serve(argv[2]);
+
+  // Use the compile server if there is one
+  server = getenv("MINIC_SERVER");
+  if (server != NULL)
+  {
+    status = forward(server, argc, argv);
+    if (status != -1)
+      return (status);
+  }
+
+  return (do_command(argc, argv));
+}
@@ -9,6 +9,8 @@
 #include "decl.h"
 #include <stdio.h>
 #include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
 
 // Miscellaneous functions
 
@@ -24,8 +26,8 @@
  * @return void
 */
 void match(int t, char *what) {
-  if (Token.token == t) {
-    scan(&Token);
+  if (Ctx->token->token == t) {
+    scan(Ctx->token);
   } else {
     fatals("Expected", what);
   }
@@ -94,6 +96,29 @@ void comma(void) {
   match(T_COMMA, "comma");
 }
 
+// Give up on the file we are compiling. Stop any
+// assembler reading our output, then remove the
+// output file and any temporary objects, and exit
+/**
+ * @fn abandon
+ * @brief Give up on the file we are compiling and exit
+ */
+static void abandon(void)
+{
+  // There is no output with -fsyntax-only
+  if (Ctx->outfile != NULL)
+    fclose(Ctx->outfile);
+  if (Ctx->aspid != 0)
+  {
+    kill(Ctx->aspid, SIGKILL);
+    waitpid(Ctx->aspid, NULL, 0);
+  }
+  if (Ctx->outfilename != NULL)
+    unlink(Ctx->outfilename);
+  remove_tmpobjs();
+  exit(1);
+}
+
 // Print out fatal messages
 /**
  * @fn fatal
@@ -102,10 +127,8 @@ void comma(void) {
  * @return void
 */
 void fatal(char *s) {
-  fprintf(stderr, "%s on line %d of %s\n", s, Line, Infilename);
-  fclose(Outfile);
-  unlink(Outfilename);
-  exit(1);
+  fprintf(stderr, "%s on line %d of %s\n", s, Ctx->line, Ctx->infilename);
+  abandon();
 }
 
 /**
@@ -115,10 +138,8 @@ void fatal(char *s) {
  * @param s2 The message to be printed
 */
 void fatals(char *s1, char *s2) {
-  fprintf(stderr, "%s:%s on line %d of %s\n", s1, s2, Line, Infilename);
-  fclose(Outfile);
-  unlink(Outfilename);
-  exit(1);
+  fprintf(stderr, "%s:%s on line %d of %s\n", s1, s2, Ctx->line, Ctx->infilename);
+  abandon();
 }
 
 /**
@@ -128,10 +149,8 @@ void fatals(char *s1, char *s2) {
  * @param d The message to be printed
 */
 void fatald(char *s, int d) {
-  fprintf(stderr, "%s:%d on line %d of %s\n", s, d, Line, Infilename);
-  fclose(Outfile);
-  unlink(Outfilename);
-  exit(1);
+  fprintf(stderr, "%s:%d on line %d of %s\n", s, d, Ctx->line, Ctx->infilename);
+  abandon();
 }
 
 /**
@@ -141,8 +160,227 @@ void fatald(char *s, int d) {
  * @param c The message to be printed
 */
 void fatalc(char *s, int c) {
-  fprintf(stderr, "%s:%c on line %d of %s\n", s, c, Line, Infilename);
-  fclose(Outfile);
-  unlink(Outfilename);
-  exit(1);
+  fprintf(stderr, "%s:%c on line %d of %s\n", s, c, Ctx->line, Ctx->infilename);
+  abandon();
+}
+
+enum {
+  ARENABLOCK = 65536		// Usual size of an arena block
+};
+
+// Create a new, empty arena
+/**
+ * @fn newarena
+ * @brief Create a new, empty arena
+ * @return The new arena
+*/
+struct arena *newarena(void) {
+  struct arena *a;
+
+  a = (struct arena *)calloc(1, sizeof(struct arena));
+  if (a == NULL) {
+    fprintf(stderr, "Unable to malloc in newarena()\n");
+    exit(1);
+  }
+  return (a);
+}
+
+// Return size bytes of memory from the arena,
+// starting a new block if the newest one is full.
+// The memory is aligned for any of our types
+/**
+ * @fn arenaalloc
+ * @brief Return size bytes of memory from the arena
+ * @param a The arena
+ * @param size The number of bytes needed
+ * @return The memory
+*/
+void *arenaalloc(struct arena *a, int size) {
+  struct arenablock *b;
+  char *p;
+
+  size = (size + 7) / 8 * 8;
+  if (a->blocks == NULL || a->used + size > a->size) {
+    b = (struct arenablock *)malloc(sizeof(struct arenablock));
+    if (b == NULL)
+      fatal("Unable to malloc in arenaalloc()");
+    a->size = ARENABLOCK;
+    if (size > a->size)
+      a->size = size;
+    b->mem = (char *)malloc(a->size);
+    if (b->mem == NULL)
+      fatal("Unable to malloc in arenaalloc()");
+    b->next = a->blocks;
+    a->blocks = b;
+    a->used = 0;
+  }
+  p = a->blocks->mem + a->used;
+  a->used = a->used + size;
+  return ((void *)p);
+}
+
+// Free all the memory handed out by the arena
+/**
+ * @fn resetarena
+ * @brief Free all the memory handed out by the arena
+ * @param a The arena
+*/
+void resetarena(struct arena *a) {
+  struct arenablock *b, *next;
+
+  for (b = a->blocks; b != NULL; b = next) {
+    next = b->next;
+    free(b->mem);
+    free(b);
+  }
+  a->blocks = NULL;
+  a->used = 0;
+  a->size = 0;
+}
+
+// Free the arena and all of its memory
+/**
+ * @fn freearena
+ * @brief Free the arena and all of its memory
+ * @param a The arena
+*/
+void freearena(struct arena *a) {
+  resetarena(a);
+  free(a);
+}
+
+// Allocate a symbol list for a new context
+/**
+ * @fn newsymlist
+ * @brief Allocate an empty symbol list for a new context
+ * @return The new list
+*/
+static struct symlist *newsymlist(void) {
+  struct symlist *l;
+
+  l = (struct symlist *)calloc(1, sizeof(struct symlist));
+  if (l == NULL) {
+    fprintf(stderr, "Unable to malloc in newsymlist()\n");
+    exit(1);
+  }
+  return (l);
+}
+
+// Free a symbol list from a context
+/**
+ * @fn freesymlist
+ * @brief Free a symbol list from a context
+ * @param l The list to free
+*/
+static void freesymlist(struct symlist *l) {
+  free(l->hash);
+  free(l);
+}
+
+// Create a context to compile a new file with.
+// The scanner starts at line 1 and the symbol
+// tables are all empty
+/**
+ * @fn new_context
+ * @brief Create a context to compile a new file with
+ * @return The new context
+*/
+struct context *new_context(void) {
+  struct context *c;
+
+  c = (struct context *)calloc(1, sizeof(struct context));
+  if (c == NULL) {
+    fprintf(stderr, "Unable to malloc in new_context()\n");
+    exit(1);
+  }
+  c->token = (struct token *)calloc(1, sizeof(struct token));
+  c->peektoken = (struct token *)calloc(1, sizeof(struct token));
+  c->rawtoken = (struct token *)calloc(1, sizeof(struct token));
+  c->text = (char *)calloc(1, TEXTLEN + 1);
+  c->qbebuf = (char **)calloc(1, sizeof(char *));
+  c->qbelen = calloc(1, sizeof(long));
+  c->keepbuf = (char **)calloc(1, sizeof(char *));
+  c->keeplen = calloc(1, sizeof(long));
+  if (c->token == NULL || c->peektoken == NULL ||
+      c->rawtoken == NULL || c->text == NULL ||
+      c->qbebuf == NULL || c->qbelen == NULL ||
+      c->keepbuf == NULL || c->keeplen == NULL) {
+    fprintf(stderr, "Unable to malloc in new_context()\n");
+    exit(1);
+  }
+
+  c->globsyms = newsymlist();
+  c->loclsyms = newsymlist();
+  c->parmsyms = newsymlist();
+  c->membsyms = newsymlist();
+  c->structsyms = newsymlist();
+  c->unionsyms = newsymlist();
+  c->enumsyms = newsymlist();
+  c->typesyms = newsymlist();
+  c->funcarena = newarena();
+  c->tuarena = newarena();
+
+  c->line = 1;
+  c->linestart = 1;
+  c->putback = '\n';
+  c->labelid = 1;
+  c->dumpid = 1;
+  return (c);
+}
+
+// Free a context once its file has been compiled,
+// along with the AST nodes and symbols in its arenas
+/**
+ * @fn free_context
+ * @brief Free a context once its file has been compiled
+ * @param c The context to free
+*/
+void free_context(struct context *c) {
+  freesymlist(c->globsyms);
+  freesymlist(c->loclsyms);
+  freesymlist(c->parmsyms);
+  freesymlist(c->membsyms);
+  freesymlist(c->structsyms);
+  freesymlist(c->unionsyms);
+  freesymlist(c->enumsyms);
+  freesymlist(c->typesyms);
+  freearena(c->funcarena);
+  freearena(c->tuarena);
+  free(c->deps);
+  free(c->token);
+  free(c->peektoken);
+  free(c->rawtoken);
+  free(c->text);
+  free(c->nodestack);
+  free(c->qbebuf);
+  free(c->qbelen);
+  free(c->keepbuf);
+  free(c->keeplen);
+  free(c);
+}
+
+// Start the current context from the global symbols
+// of c, which has parsed some headers. The symbols
+// stay in c's arena, which becomes ours, so c can
+// only be used like this once
+/**
+ * @fn use_symtables
+ * @brief Start the current context from the global symbols of another,
+ * and from the labels already given to its functions
+ * @param c The context with the symbols
+*/
+void use_symtables(struct context *c) {
+  freesymlist(Ctx->globsyms);
+  freesymlist(Ctx->structsyms);
+  freesymlist(Ctx->unionsyms);
+  freesymlist(Ctx->enumsyms);
+  freesymlist(Ctx->typesyms);
+  freearena(Ctx->tuarena);
+  Ctx->globsyms = c->globsyms;
+  Ctx->structsyms = c->structsyms;
+  Ctx->unionsyms = c->unionsyms;
+  Ctx->enumsyms = c->enumsyms;
+  Ctx->typesyms = c->typesyms;
+  Ctx->tuarena = c->tuarena;
+  Ctx->labelid = c->labelid;
 }
@@ -9,6 +9,8 @@
 
 // AST Tree Optimisation Code
 
+static struct ASTnode *fold(struct ASTnode *n);
+
 // Fold an AST tree with a binary operator
 // and two A_INTLIT children. Return either
 // the original tree or a new leaf node.
@@ -89,6 +91,35 @@ static struct ASTnode *fold1(struct ASTnode *n)
   return (mkastleaf(A_INTLIT, n->type, NULL, NULL, val));
 }
 
+// Fold the node n, whose left child
+// has already been folded
+/**
+ * @fn foldnode
+ * @brief Fold a node whose left child has already been folded
+ * @param n The AST node to be folded
+ * @return folded AST node
+ */
+static struct ASTnode *foldnode(struct ASTnode *n)
+{
+  // Fold the right child
+  if (n->nkids == 0)
+    return (n);
+  if (n->nkids > 1)
+    n->right = fold(n->right);
+
+  // If both children are A_INTLITs, do a fold2()
+  if (n->left && n->left->op == A_INTLIT)
+  {
+    if (n->nkids > 1 && n->right && n->right->op == A_INTLIT)
+      n = fold2(n);
+    else
+      // If only the left is A_INTLIT, do a fold1()
+      n = fold1(n);
+  }
+  // Return the possibly modified tree
+  return (n);
+}
+
 // Attempt to do constant folding on
 // the AST tree with the root node n
 /**
@@ -99,25 +130,31 @@ static struct ASTnode *fold1(struct ASTnode *n)
  */
 static struct ASTnode *fold(struct ASTnode *n)
 {
+  struct ASTnode *parent;
+  int base;
 
   if (n == NULL)
     return (NULL);
 
-  // Fold on the left child, then
-  // do the same on the right child
-  n->left = fold(n->left);
-  n->right = fold(n->right);
+  // Statement lists and expressions lean to the left,
+  // so walk down the left children on the node stack
+  // rather than recursing once for each of them
+  base = nodedepth();
+  while (n->nkids > 0 && n->left != NULL && n->left->nkids > 0)
+  {
+    pushnode(n);
+    n = n->left;
+  }
 
-  // If both children are A_INTLITs, do a fold2()
-  if (n->left && n->left->op == A_INTLIT)
+  // Fold the lowest node, then each node back up the
+  // stack with the folded tree as its left child
+  n = foldnode(n);
+  while (nodedepth() > base)
   {
-    if (n->right && n->right->op == A_INTLIT)
-      n = fold2(n);
-    else
-      // If only the left is A_INTLIT, do a fold1()
-      n = fold1(n);
+    parent = popnode();
+    parent->left = n;
+    n = foldnode(parent);
   }
-  // Return the possibly modified tree
   return (n);
 }
 
@@ -6,25 +6,277 @@
 #include "defs.h"
 #include "data.h"
 #include "decl.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 // Lexical scanning
 
-// Return the position of character c
-// in string s, or -1 if c not found
+// When the preprocessor is scanning a source file, the scanner
+// returns '#' tokens, notes which tokens start a line and holds
+// back lexical errors instead of stopping
+
+// Report a lexical error with an optional character.
+// The preprocessor gets to see it later as a T_LEXERR
 /**
- * @fn chrpos
- * @brief Return the position of character c in string s, or -1 if c not found
- * @param s String to search
- * @param c Character to search for
- * @return Position of character c in string s, or -1 if c not found
+ * @fn lexerror
+ * @brief Report a lexical error with an optional character
+ * @param s The error message
+ * @param c The character to print, or zero
  */
-static int chrpos(char *s, int c)
+static void lexerror(char *s, int c)
 {
-  int i;
-  for (i = 0; s[i] != '\0'; i++)
-    if (s[i] == (char)c)
-      return (i);
-  return (-1);
+  if (!Ctx->rawscan)
+  {
+    if (c)
+      fatalc(s, c);
+    fatal(s);
+  }
+  if (Ctx->lexerrmsg == NULL)
+  {
+    Ctx->lexerrmsg = s;
+    Ctx->lexerrchar = c;
+    Ctx->lexerrline = Ctx->line;
+  }
+}
+
+// Character classes for the lexer
+#define CC_ALPHA 1		// Letter or underscore
+#define CC_DIGIT 2		// Decimal digit
+#define CC_HEX 4		// Hexadecimal digit
+#define CC_SPACE 8		// Whitespace skipped between tokens
+#define CC_IDENT 16		// Letter, underscore or digit
+
+// The class and digit value of each character. Both
+// tables are indexed by the character plus one, so
+// that EOF has an entry with no class
+/**
+ * @var Cclass
+ * @brief The CC_ classes of each character plus one
+ */
+static char Cclass[257];
+/**
+ * @var Digitval
+ * @brief The value of each hexadecimal digit plus one
+ */
+static char Digitval[257];
+
+// The keywords and their tokens
+/**
+ * @var Kwlist
+ * @brief The keywords, ending with NULL
+ */
+static char *Kwlist[] = {
+  "break", "case", "char", "continue", "default", "else",
+  "enum", "extern", "for", "if", "int", "long", "return",
+  "sizeof", "static", "struct", "switch", "typedef",
+  "union", "void", "while", NULL
+};
+/**
+ * @var Kwtokens
+ * @brief The token for each keyword in Kwlist
+ */
+static int Kwtokens[] = {
+  T_BREAK, T_CASE, T_CHAR, T_CONTINUE, T_DEFAULT, T_ELSE,
+  T_ENUM, T_EXTERN, T_FOR, T_IF, T_INT, T_LONG, T_RETURN,
+  T_SIZEOF, T_STATIC, T_STRUCT, T_SWITCH, T_TYPEDEF,
+  T_UNION, T_VOID, T_WHILE
+};
+
+// The keywords hashed on their length and first and last
+// characters. The hash is perfect for this set of keywords,
+// so each word needs at most one strcmp() to look it up
+#define KWHASHSIZE 64
+#define KWHASH(s, len) ((len * 4 + s[0] + s[len - 1]) & (KWHASHSIZE - 1))
+/**
+ * @var Kwname
+ * @brief The keyword at each hash position, or NULL
+ */
+static char *Kwname[KWHASHSIZE];
+/**
+ * @var Kwtoken
+ * @brief The token for the keyword at each hash position
+ */
+static int Kwtoken[KWHASHSIZE];
+
+// Build the character class and keyword tables
+/**
+ * @fn lexinit
+ * @brief Build the character class and keyword tables
+ */
+void lexinit(void)
+{
+  int c, cl, i, h, len;
+
+  for (c = 0; c < 256; c++)
+  {
+    cl = 0;
+    if (isalpha(c) || c == '_')
+      cl = CC_ALPHA;
+    if (isdigit(c))
+      cl = CC_DIGIT;
+    if (isxdigit(c))
+    {
+      cl = cl + CC_HEX;
+      if (isdigit(c))
+        Digitval[c + 1] = (char)(c - '0');
+      else
+        Digitval[c + 1] = (char)(tolower(c) - 'a' + 10);
+    }
+    if (isalnum(c) || c == '_')
+      cl = cl + CC_IDENT;
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f')
+      cl = CC_SPACE;
+    Cclass[c + 1] = (char)cl;
+  }
+
+  for (i = 0; Kwlist[i] != NULL; i++)
+  {
+    len = (int)strlen(Kwlist[i]);
+    h = KWHASH(Kwlist[i], len);
+    if (Kwname[h] != NULL)
+      fatals("Keyword hash collision for", Kwlist[i]);
+    Kwname[h] = Kwlist[i];
+    Kwtoken[h] = Kwtokens[i];
+  }
+}
+
+// The scanner reads the whole of its input into one buffer:
+// a source file is mapped into memory, and a pipe from the
+// external pre-processor is read in large blocks. next()
+// then only has to index the buffer, and identifiers,
+// numbers and blanks are scanned straight out of it
+
+#define INBLOCK 65536		// Size of each read from a pipe
+
+// Read everything from the file descriptor,
+// e.g. a pipe, in as the scanner's input
+/**
+ * @fn readinput
+ * @brief Read everything from the file descriptor in as the scanner's input
+ * @param fd The file descriptor to read
+ */
+void readinput(int fd)
+{
+  int n, size = INBLOCK;
+
+  Ctx->inbuf = (char *)malloc(size);
+  if (Ctx->inbuf == NULL)
+    fatal("Unable to malloc in readinput()");
+  Ctx->inlen = 0;
+  Ctx->inpos = 0;
+  Ctx->inmapped = 0;
+
+  // Keep room for a whole block after the data
+  while (1)
+  {
+    if (Ctx->inlen + INBLOCK > size)
+    {
+      size = size * 2;
+      Ctx->inbuf = (char *)realloc(Ctx->inbuf, size);
+      if (Ctx->inbuf == NULL)
+        fatal("Unable to realloc in readinput()");
+    }
+    n = read(fd, Ctx->inbuf + Ctx->inlen, INBLOCK);
+    if (n <= 0)
+      break;
+    Ctx->inlen = Ctx->inlen + n;
+  }
+}
+
+// Map the named file in as the scanner's input.
+// Return 1 on success, 0 if the file can't be opened
+/**
+ * @fn openinput
+ * @brief Map the named file in as the scanner's input
+ * @param name The name of the file
+ * @return 1 on success, 0 if the file can't be opened
+ */
+int openinput(char *name)
+{
+  int fd;
+  long size;
+  char *p;
+
+  if ((fd = open(name, O_RDONLY)) == -1)
+    return (0);
+
+  // Map in a non-empty regular file
+  size = lseek(fd, 0, SEEK_END);
+  if (size > 0)
+  {
+    p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      close(fd);
+      Ctx->inbuf = p;
+      Ctx->inlen = (int)size;
+      Ctx->inpos = 0;
+      Ctx->inmapped = 1;
+      return (1);
+    }
+  }
+
+  // Otherwise read it in like a pipe
+  lseek(fd, 0, SEEK_SET);
+  readinput(fd);
+  close(fd);
+  return (1);
+}
+
+// Release the scanner's input buffer
+/**
+ * @fn closeinput
+ * @brief Release the scanner's input buffer
+ */
+void closeinput(void)
+{
+  if (Ctx->inbuf == NULL)
+    return;
+  if (Ctx->inmapped)
+    munmap(Ctx->inbuf, Ctx->inlen);
+  else
+    free(Ctx->inbuf);
+  Ctx->inbuf = NULL;
+  Ctx->inlen = 0;
+  Ctx->inpos = 0;
+  Ctx->inmapped = 0;
+}
+
+// Get the next raw character from the input buffer
+/**
+ * @fn nextraw
+ * @brief Get the next raw character from the input buffer
+ * @return The next character, or EOF at the end of the input
+ */
+static int nextraw(void)
+{
+  int c;
+
+  if (Ctx->inpos >= Ctx->inlen)
+    return (EOF);
+  c = Ctx->inbuf[Ctx->inpos] & 0xff;
+  Ctx->inpos = Ctx->inpos + 1;
+  return (c);
+}
+
+// Skip the rest of a run of blanks in the input buffer
+/**
+ * @fn skipblanks
+ * @brief Skip the rest of a run of blanks in the input buffer
+ */
+static void skipblanks(void)
+{
+  int c;
+
+  while (Ctx->inpos < Ctx->inlen)
+  {
+    c = Ctx->inbuf[Ctx->inpos];
+    if (c != ' ' && c != '\t')
+      break;
+    Ctx->inpos = Ctx->inpos + 1;
+    Ctx->linestart = 0;
+  }
 }
 
 // Get the next character from the input file.
@@ -37,45 +289,45 @@ static int next(void)
 {
   int c, l;
 
-  if (Putback)
+  if (Ctx->putback)
   {              // Use the character put
-    c = Putback; // back if there is one
-    Putback = 0;
+    c = Ctx->putback; // back if there is one
+    Ctx->putback = 0;
     return (c);
   }
 
-  c = fgetc(Infile); // Read from input file
+  c = nextraw(); // Read from the input buffer
 
-  while (Linestart && c == '#')
+  while (Ctx->linestart && c == '#' && !Ctx->rawscan)
   {                // We've hit a pre-processor statement
-    Linestart = 0; // No longer at the start of the line
-    scan(&Token);  // Get the line number into l
-    if (Token.token != T_INTLIT)
-      fatals("Expecting pre-processor line number, got:", Text);
-    l = Token.intvalue;
+    Ctx->linestart = 0; // No longer at the start of the line
+    scan(Ctx->token);  // Get the line number into l
+    if (Ctx->token->token != T_INTLIT)
+      fatals("Expecting pre-processor line number, got:", Ctx->text);
+    l = Ctx->token->intvalue;
 
-    scan(&Token); // Get the filename in Text
-    if (Token.token != T_STRLIT)
-      fatals("Expecting pre-processor file name, got:", Text);
+    scan(Ctx->token); // Get the filename in Text
+    if (Ctx->token->token != T_STRLIT)
+      fatals("Expecting pre-processor file name, got:", Ctx->text);
 
-    if (Text[0] != '<')
+    if (Ctx->text[0] != '<')
     {                               // If this is a real filename
-      if (strcmp(Text, Infilename)) // and not the one we have now
-        Infilename = strdup(Text);  // save it. Then update the line num
-      Line = l;
+      if (strcmp(Ctx->text, Ctx->infilename)) // and not the one we have now
+        Ctx->infilename = strdup(Ctx->text);  // save it. Then update the line num
+      Ctx->line = l;
     }
 
-    while ((c = fgetc(Infile)) != '\n')
+    while ((c = nextraw()) != '\n' && c != EOF)
       ;                // Skip to the end of the line
-    c = fgetc(Infile); // and get the next character
-    Linestart = 1;     // Now back at the start of the line
+    c = nextraw();     // and get the next character
+    Ctx->linestart = 1;     // Now back at the start of the line
   }
 
-  Linestart = 0; // No longer at the start of the line
+  Ctx->linestart = 0; // No longer at the start of the line
   if ('\n' == c)
   {
-    Line++;        // Increment line count
-    Linestart = 1; // Now back at the start of the line
+    Ctx->line = Ctx->line + 1;        // Increment line count
+    Ctx->linestart = 1; // Now back at the start of the line
   }
   return (c);
 }
@@ -88,24 +340,83 @@ static int next(void)
  */
 static void putback(int c)
 {
-  Putback = c;
+  Ctx->putback = c;
 }
 
 // Skip past input that we don't need to deal with,
-// i.e. whitespace, newlines. Return the first
-// character we do need to deal with.
+// i.e. whitespace, newlines, comments and escaped
+// newlines. Return the first character we do need
+// to deal with.
 /**
  * @fn skip
- * @brief Skip past input that we don't need to deal with, i.e. whitespace, newlines. Return the first character we do need to deal with.
+ * @brief Skip past input that we don't need to deal with, i.e. whitespace, newlines, comments and escaped newlines. Return the first character we do need to deal with.
  * @return The first character we do need to deal with.
  */
 static int skip(void)
 {
-  int c;
+  int c, c2;
 
   c = next();
-  while (' ' == c || '\t' == c || '\n' == c || '\r' == c || '\f' == c)
+  while (1)
   {
+    if ('\n' == c)
+      Ctx->sawnewline = 1;
+    if (Cclass[c + 1] & CC_SPACE)
+    {
+      Ctx->sawspace = 1;
+      if (Ctx->putback == 0)
+        skipblanks();
+      c = next();
+      continue;
+    }
+
+    // Comments and escaped newlines. Put back the
+    // second character if it isn't one of these
+    if (c == '/')
+    {
+      c2 = next();
+      if (c2 == '/')
+      {
+        // Skip to the end of the line
+        while ((c = next()) != '\n' && c != EOF)
+          ;
+        Ctx->sawspace = 1;
+        continue;
+      }
+      if (c2 != '*')
+      {
+        putback(c2);
+        return (c);
+      }
+
+      // Skip to the closing "*/"
+      c = next();
+      while (1)
+      {
+        if (c == EOF)
+        {
+          lexerror("Unterminated comment", 0);
+          return (c);
+        }
+        if (c != '*')
+          c = next();
+        else if ((c = next()) == '/')
+          break;
+      }
+      Ctx->sawspace = 1;
+      c = next();
+      continue;
+    }
+
+    // Anything else starts a token
+    if (c != '\\')
+      break;
+    c2 = next();
+    if (c2 != '\n')
+    {
+      putback(c2);
+      break;
+    }
     c = next();
   }
   return (c);
@@ -122,10 +433,10 @@ static int hexchar(void)
   int c, h, n = 0, f = 0;
 
   // Loop getting characters
-  while (isxdigit(c = next()))
+  while (Cclass[(c = next()) + 1] & CC_HEX)
   {
     // Convert from char to int value
-    h = chrpos("0123456789abcdef", tolower(c));
+    h = Digitval[c + 1];
 
     // Add to running hex value
     n = n * 16 + h;
@@ -137,9 +448,9 @@ static int hexchar(void)
 
   // Flag tells us we never saw any hex characters
   if (!f)
-    fatal("missing digits after '\\x'");
+    lexerror("missing digits after '\\x'", 0);
   if (n > 255)
-    fatal("value out of range after '\\x'");
+    lexerror("value out of range after '\\x'", 0);
 
   return (n);
 }
@@ -195,7 +506,7 @@ static int scanch(void)
     case '5':
     case '6':
     case '7':
-      for (i = c2 = 0; isdigit(c) && c < '8'; c = next())
+      for (i = c2 = 0; (Cclass[c + 1] & CC_DIGIT) && c < '8'; c = next())
       {
         if (++i > 3)
           break;
@@ -207,7 +518,7 @@ static int scanch(void)
     case 'x':
       return (hexchar());
     default:
-      fatalc("unknown escape sequence", c);
+      lexerror("unknown escape sequence", c);
     }
   }
   return (c); // Just an ordinary old character!
@@ -239,11 +550,23 @@ static int scanint(int c)
       radix = 8;
   }
   // Convert each character into an int value
-  while ((k = chrpos("0123456789abcdef", tolower(c))) >= 0)
+  while (Cclass[c + 1] & CC_HEX)
   {
+    k = Digitval[c + 1];
     if (k >= radix)
-      fatalc("invalid digit in integer literal", c);
+      lexerror("invalid digit in integer literal", c);
     val = val * radix + k;
+
+    // Take any more decimal digits straight
+    // out of the input buffer
+    while (radix == 10 && Ctx->putback == 0 && Ctx->inpos < Ctx->inlen)
+    {
+      k = Ctx->inbuf[Ctx->inpos] - '0';
+      if (k < 0 || k > 9)
+        break;
+      val = val * 10 + k;
+      Ctx->inpos = Ctx->inpos + 1;
+    }
     c = next();
   }
 
@@ -279,7 +602,8 @@ static int scanstr(char *buf)
   }
 
   // Ran out of buf[] space
-  fatal("String literal too long");
+  buf[i] = 0;
+  lexerror("String literal too long", 0);
   return (0);
 }
 
@@ -298,18 +622,29 @@ static int scanident(int c, char *buf, int lim)
   int i = 0;
 
   // Allow digits, alpha and underscores
-  while (isalpha(c) || isdigit(c) || '_' == c)
+  while (Cclass[c + 1] & CC_IDENT)
   {
     // Error if we hit the identifier length limit,
     // else append to buf[] and get next character
     if (lim - 1 == i)
     {
-      fatal("Identifier too long");
+      lexerror("Identifier too long", 0);
     }
     else if (i < lim - 1)
     {
       buf[i++] = (char)c;
     }
+
+    // Copy the rest of the identifier straight out of
+    // the input buffer, leaving its end to next()
+    while (Ctx->putback == 0 && Ctx->inpos < Ctx->inlen && i < lim - 1)
+    {
+      c = Ctx->inbuf[Ctx->inpos] & 0xff;
+      if ((Cclass[c + 1] & CC_IDENT) == 0)
+        break;
+      buf[i++] = (char)c;
+      Ctx->inpos = Ctx->inpos + 1;
+    }
     c = next();
   }
 
@@ -320,92 +655,63 @@ static int scanident(int c, char *buf, int lim)
   return (i);
 }
 
-// Given a word from the input, return the matching
-// keyword token number or 0 if it's not a keyword.
-// Switch on the first letter so that we don't have
-// to waste time strcmp()ing against all the keywords.
+// Given a word from the input and its length, return
+// the matching keyword token number or 0 if it's not
+// a keyword. The perfect hash means that at most one
+// strcmp() is needed
 /**
  * @fn keyword
  * @brief Given a word from the input, return the matching keyword token number or 0 if it's not a keyword.
  * @param s Word to check
+ * @param len Length of the word
  * @return The matching keyword token number or 0 if it's not a keyword
  */
-static int keyword(char *s)
+static int keyword(char *s, int len)
 {
-  switch (*s)
-  {
-  case 'b':
-    if (!strcmp(s, "break"))
-      return (T_BREAK);
-    break;
-  case 'c':
-    if (!strcmp(s, "case"))
-      return (T_CASE);
-    if (!strcmp(s, "char"))
-      return (T_CHAR);
-    if (!strcmp(s, "continue"))
-      return (T_CONTINUE);
-    break;
-  case 'd':
-    if (!strcmp(s, "default"))
-      return (T_DEFAULT);
-    break;
-  case 'e':
-    if (!strcmp(s, "else"))
-      return (T_ELSE);
-    if (!strcmp(s, "enum"))
-      return (T_ENUM);
-    if (!strcmp(s, "extern"))
-      return (T_EXTERN);
-    break;
-  case 'f':
-    if (!strcmp(s, "for"))
-      return (T_FOR);
-    break;
-  case 'i':
-    if (!strcmp(s, "if"))
-      return (T_IF);
-    if (!strcmp(s, "int"))
-      return (T_INT);
-    break;
-  case 'l':
-    if (!strcmp(s, "long"))
-      return (T_LONG);
-    break;
-  case 'r':
-    if (!strcmp(s, "return"))
-      return (T_RETURN);
-    break;
-  case 's':
-    if (!strcmp(s, "sizeof"))
-      return (T_SIZEOF);
-    if (!strcmp(s, "static"))
-      return (T_STATIC);
-    if (!strcmp(s, "struct"))
-      return (T_STRUCT);
-    if (!strcmp(s, "switch"))
-      return (T_SWITCH);
-    break;
-  case 't':
-    if (!strcmp(s, "typedef"))
-      return (T_TYPEDEF);
-    break;
-  case 'u':
-    if (!strcmp(s, "union"))
-      return (T_UNION);
-    break;
-  case 'v':
-    if (!strcmp(s, "void"))
-      return (T_VOID);
-    break;
-  case 'w':
-    if (!strcmp(s, "while"))
-      return (T_WHILE);
-    break;
-  }
+  int h;
+
+  h = KWHASH(s, len);
+  if (Kwname[h] != NULL && !strcmp(Kwname[h], s))
+    return (Kwtoken[h]);
   return (0);
 }
 
+// Return the next token from the preprocessor's list,
+// setting the line number and filename to match it
+/**
+ * @fn scanpptoken
+ * @brief Return the next token from the preprocessor's list
+ * @param t Token to fill in
+ * @return 1 if token valid, 0 if no tokens left
+ */
+static int scanpptoken(struct token *t)
+{
+  struct pptoken *p = Ctx->pptokens;
+
+  Ctx->line = p->line;
+  Ctx->infilename = p->file;
+  t->token = p->token;
+  t->tokstr = Tstring[p->token];
+  t->intvalue = p->intvalue;
+
+  // Like scanident() and scanstr(), leave any
+  // keyword, identifier or string in Text.
+  // Also leave the name of an #embed file there
+  if (p->token == T_IDENT || p->token == T_STRLIT || p->token == T_EMBED ||
+      (p->token >= T_VOID && p->token <= T_STATIC))
+    strcpy(Ctx->text, p->text);
+
+  // Identifiers were interned by scanpp()
+  if (p->token == T_IDENT)
+    t->name = Ctx->ident = p->text;
+
+  // Stay on the T_EOF at the end of the list
+  if (p->token == T_EOF)
+    return (0);
+  Ctx->pptokens = p->next;
+  return (1);
+}
+
 // List of token strings, for debugging purposes
 /**
  * @fn Tstring
@@ -423,7 +729,7 @@ char *Tstring[] = {
     "case", "default", "sizeof", "static",
     "intlit", "strlit", ";", "identifier",
     "{", "}", "(", ")", "[", "]", ",", ".",
-    "->", ":"};
+    "->", ":", "#embed", "#", "lexerr"};
 
 // Scan and return the next token found in the input.
 // Return 1 if token valid, 0 if no tokens left.
@@ -435,19 +741,26 @@ char *Tstring[] = {
  */
 int scan(struct token *t)
 {
-  int c, tokentype;
+  int c, len, tokentype;
 
   // If we have a lookahead token, return this token
-  if (Peektoken.token != 0)
+  if (Ctx->peektoken->token != 0 && !Ctx->rawscan)
   {
-    t->token = Peektoken.token;
-    t->tokstr = Peektoken.tokstr;
-    t->intvalue = Peektoken.intvalue;
-    Peektoken.token = 0;
+    t->token = Ctx->peektoken->token;
+    t->tokstr = Ctx->peektoken->tokstr;
+    t->intvalue = Ctx->peektoken->intvalue;
+    t->name = Ctx->peektoken->name;
+    Ctx->peektoken->token = 0;
     return (1);
   }
+
+  // Take the token from the preprocessor if it's running
+  if (Ctx->pptokens != NULL && !Ctx->rawscan)
+    return (scanpptoken(t));
+
   // Skip whitespace
   c = skip();
+  Ctx->tokline = Ctx->line;
 
   // Determine the token based on
   // the input character
@@ -484,7 +797,7 @@ int scan(struct token *t)
     {
       t->token = T_ASMINUS;
     }
-    else if (isdigit(c))
+    else if (Cclass[c + 1] & CC_DIGIT)
     { // Negative int literal
       t->intvalue = -scanint(c);
       t->token = T_INTLIT;
@@ -648,42 +961,116 @@ int scan(struct token *t)
     t->intvalue = scanch();
     t->token = T_INTLIT;
     if (next() != '\'')
-      fatal("Expected '\\'' at end of char literal");
+      lexerror("Expected '\\'' at end of char literal", 0);
+    break;
+  case '#':
+    // Only the preprocessor deals with these
+    if (!Ctx->rawscan)
+      fatalc("Unrecognised character", c);
+    t->token = T_HASH;
     break;
   case '"':
     // Scan in a literal string
-    scanstr(Text);
+    scanstr(Ctx->text);
     t->token = T_STRLIT;
     break;
   default:
     // If it's a digit, scan the
     // literal integer value in
-    if (isdigit(c))
+    if (Cclass[c + 1] & CC_DIGIT)
     {
       t->intvalue = scanint(c);
       t->token = T_INTLIT;
       break;
     }
-    else if (isalpha(c) || '_' == c)
+    else if (Cclass[c + 1] & CC_ALPHA)
     {
       // Read in a keyword or identifier
-      scanident(c, Text, TEXTLEN);
+      len = scanident(c, Ctx->text, TEXTLEN);
 
       // If it's a recognised keyword, return that token
-      if ((tokentype = keyword(Text)) != 0)
+      if ((tokentype = keyword(Ctx->text, len)) != 0)
       {
         t->token = tokentype;
         break;
       }
       // Not a recognised keyword, so it must be an identifier
       t->token = T_IDENT;
+      t->name = Ctx->ident = internid(Ctx->text);
       break;
     }
     // The character isn't part of any recognised token, error
-    fatalc("Unrecognised character", c);
+    lexerror("Unrecognised character", c);
+    t->token = T_LEXERR;
   }
 
   // We found a token
   t->tokstr = Tstring[t->token];
   return (1);
 }
+
+// Scan the next token from the scanner's input for the
+// preprocessor and return it in a new pptoken. The token's
+// line number is the one that scan() would leave in Line,
+// i.e. the next line for a token that read ahead to the newline
+/**
+ * @fn scanpp
+ * @brief Scan the next token from the scanner's input for the preprocessor
+ * @return The new pptoken, with T_EOF at the end of the file and T_LEXERR on an error
+ */
+struct pptoken *scanpp(void)
+{
+  struct pptoken *p;
+
+  Ctx->rawscan = 1;
+  Ctx->sawnewline = 0;
+  Ctx->sawspace = 0;
+  Ctx->lexerrmsg = NULL;
+  scan(Ctx->rawtoken);
+  Ctx->rawscan = 0;
+
+  p = (struct pptoken *)malloc(sizeof(struct pptoken));
+  if (p == NULL)
+    fatal("Unable to malloc in scanpp()");
+  p->token = Ctx->rawtoken->token;
+  p->intvalue = 0;
+  if (p->token == T_INTLIT)
+    p->intvalue = Ctx->rawtoken->intvalue;
+  p->text = Tstring[p->token];
+  if (p->token == T_IDENT)
+    p->text = Ctx->rawtoken->name;
+  if (p->token == T_STRLIT)
+    p->text = strdup(Ctx->text);
+  p->file = Ctx->infilename;
+  p->line = Ctx->tokline;
+  p->bol = Ctx->sawnewline;
+  p->space = Ctx->sawspace;
+  p->noexpand = 0;
+  p->next = NULL;
+
+  // The previous token read ahead, but not as far
+  // as the newline. Real cpp output has no spaces
+  // or comments before the newline, so it would have
+  if (Ctx->lastpp != NULL && (Ctx->sawnewline || p->token == T_EOF))
+    Ctx->lastpp->line = Ctx->lastpp->line + 1;
+  Ctx->lastpp = NULL;
+  if (p->token == T_EOF)
+    p->line = Ctx->line;
+  else if (Ctx->putback)
+  {
+    if (Ctx->putback == '\n')
+      p->line = Ctx->line;
+    else
+      Ctx->lastpp = p;
+  }
+
+  if (Ctx->lexerrmsg != NULL)
+  {
+    p->token = T_LEXERR;
+    p->text = Ctx->lexerrmsg;
+    p->intvalue = Ctx->lexerrchar;
+    p->line = Ctx->lexerrline;
+    Ctx->lastpp = NULL;
+  }
+  return (p);
+}
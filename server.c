@@ -0,0 +1,700 @@
+/**
+ * @file server.c
+ * @author BrunchTea
+ * @brief Compile server and its client
+ */
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+
+// Compile server and its client.
+//
+// "MINIC -d socket" runs a server that listens on a Unix
+// domain socket. It tokenises the system headers once, then
+// forks a child for each request, so each compile starts with
+// the headers ready and no process or cpp to start up. The
+// socket is only for our own user.
+//
+// Once it has replied, the child for a request parses the run
+// of system headers that the request's source file starts by
+// including. If they parse, it tells the server, which parses
+// them again when no client is waiting and keeps their symbols.
+// A later file that starts with the same headers then doesn't
+// parse them again.
+//
+// When MINIC_SERVER names the socket, MINIC is a thin client:
+// it sends its working directory and arguments to the server,
+// then prints the output that comes back and exits with the
+// status of the compile. If it can't connect, it compiles the
+// files itself.
+//
+// A request is a list of NUL-terminated strings: the working
+// directory, the arguments starting with the program name, and
+// then an empty string. The reply is a line "status outlen
+// errlen pathlen" followed by outlen bytes of standard output,
+// errlen bytes of standard error, and pathlen bytes holding
+// the NUL-terminated names of the files that the compile wrote.
+
+#define SUNPATHLEN 108		// Size of sun_path in a sockaddr_un
+#define SUNLEN 110		// Size of a sockaddr_un
+#define READTIMEOUT 10		// Seconds to wait for a request
+#define MAXLEAD 32		// Most headers in a snapshot
+#define LEADLEN 4096		// Bytes of a file to look for them in
+#define PIPEBUF 4096		// Most bytes in one whole write to a pipe
+
+// Build a Unix domain socket address for path. We can't
+// declare a struct with an array in it, so fill in the bytes:
+// a little-endian short AF_UNIX, then the NUL-terminated path
+/**
+ * @fn sockaddr
+ * @brief Build a Unix domain socket address
+ * @param path The socket's path
+ * @return The address, SUNLEN bytes long
+ */
+static char *sockaddr(char *path)
+{
+  char *addr;
+
+  if (strlen(path) >= SUNPATHLEN)
+  {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    exit(1);
+  }
+  addr = (char *)calloc(1, SUNLEN);
+  if (addr == NULL)
+  {
+    fprintf(stderr, "Unable to malloc in sockaddr()\n");
+    exit(1);
+  }
+  addr[0] = (char)AF_UNIX;
+  strcpy(addr + 2, path);
+  return (addr);
+}
+
+// Write all len bytes in buf to fd.
+// Return 1 on success, 0 on failure
+/**
+ * @fn sendall
+ * @brief Write all of a buffer to a file descriptor
+ * @param fd The file descriptor
+ * @param buf The buffer
+ * @param len The number of bytes to write
+ * @return 1 on success, 0 on failure
+ */
+static int sendall(int fd, char *buf, int len)
+{
+  int n;
+
+  while (len > 0)
+  {
+    n = write(fd, buf, len);
+    if (n <= 0)
+      return (0);
+    buf = buf + n;
+    len = len - n;
+  }
+  return (1);
+}
+
+// Copy len bytes from the file descriptor in to out,
+// or up to the end of in if len is -1. Return the
+// number of bytes copied
+/**
+ * @fn copyfd
+ * @brief Copy bytes from one file descriptor to another
+ * @param in The file descriptor to read
+ * @param out The file descriptor to write
+ * @param len The number of bytes to copy, or -1 for all
+ * @return The number of bytes copied
+ */
+static int copyfd(int in, int out, int len)
+{
+  char buf[TEXTLEN];
+  int n, want, total = 0;
+
+  while (len == -1 || total < len)
+  {
+    want = TEXTLEN;
+    if (len != -1 && len - total < want)
+      want = len - total;
+    n = read(in, buf, want);
+    if (n <= 0)
+      break;
+    sendall(out, buf, n);
+    total = total + n;
+  }
+  return (total);
+}
+
+// Read everything from fd into a new buffer
+// and set *lenptr to its length
+/**
+ * @fn readall
+ * @brief Read everything from a file descriptor into a new buffer
+ * @param fd The file descriptor
+ * @param lenptr Where to put the number of bytes read
+ * @return The buffer
+ */
+static char *readall(int fd, int *lenptr)
+{
+  char *buf;
+  int n, len = 0, size = TEXTLEN;
+
+  buf = (char *)malloc(size);
+  while (buf != NULL)
+  {
+    if (len == size)
+    {
+      size = size * 2;
+      buf = (char *)realloc(buf, size);
+      if (buf == NULL)
+        break;
+    }
+    n = read(fd, buf + len, size - len);
+    if (n <= 0)
+      break;
+    len = len + n;
+  }
+  if (buf == NULL)
+  {
+    fprintf(stderr, "Unable to malloc in readall()\n");
+    exit(1);
+  }
+  *lenptr = len;
+  return (buf);
+}
+
+// Make a temporary file that is removed when closed.
+// Return its file descriptor
+/**
+ * @fn tmpfd
+ * @brief Make a temporary file that is removed when closed
+ * @return The file descriptor
+ */
+static int tmpfd(void)
+{
+  char *name;
+  int fd;
+
+  name = strdup("/tmp/minicXXXXXX");
+  if ((fd = mkstemp(name)) == -1)
+  {
+    fprintf(stderr, "Unable to create temporary file: %s\n",
+            strerror(errno));
+    exit(1);
+  }
+  unlink(name);
+  free(name);
+  return (fd);
+}
+
+// Split the request in buf, which is len bytes long and
+// starts with the directory, into a NULL-terminated list
+// of the arguments. Return NULL if it is badly formed
+/**
+ * @fn reqargs
+ * @brief Split a request into its arguments
+ * @param buf The request
+ * @param len The length of the request
+ * @return The arguments, or NULL
+ */
+static char **reqargs(char *buf, int len)
+{
+  char **args;
+  int i, argc = 0;
+
+  if (len == 0 || buf[len - 1] != '\0')
+    return (NULL);
+  args = (char **)malloc((len + 2) * sizeof(char *));
+  if (args == NULL)
+    return (NULL);
+  for (i = (int)strlen(buf) + 1; i < len && buf[i] != '\0'; i++)
+  {
+    args[argc++] = buf + i;
+    i = i + (int)strlen(buf + i);
+  }
+  args[argc] = NULL;
+  if (argc == 0)
+  {
+    free(args);
+    return (NULL);
+  }
+  return (args);
+}
+
+// Find the #include <header> lines at the start of the
+// file at path, skipping blank lines and comments. Put
+// the header names in names and return how many there
+// are. The preprocessor checks them again properly
+/**
+ * @fn leadheaders
+ * @brief Find the system headers that a file starts by including
+ * @param path The file's path
+ * @param names Where to put the header names
+ * @return The number of headers found
+ */
+static int leadheaders(char *path, char **names)
+{
+  char *buf;
+  int fd, len, i = 0, start, n = 0;
+
+  if ((fd = open(path, O_RDONLY)) == -1)
+    return (0);
+  buf = (char *)malloc(LEADLEN);
+  if (buf == NULL)
+  {
+    close(fd);
+    return (0);
+  }
+  len = (int)read(fd, buf, LEADLEN);
+  close(fd);
+
+  while (i < len && n < MAXLEAD)
+  {
+    if (buf[i] == ' ' || buf[i] == '\t' || buf[i] == '\n' || buf[i] == '\r')
+      i++;
+    else if (buf[i] == '/' && i + 1 < len && buf[i + 1] == '/')
+    {
+      while (i < len && buf[i] != '\n')
+        i++;
+    }
+    else if (buf[i] == '/' && i + 1 < len && buf[i + 1] == '*')
+    {
+      i = i + 2;
+      while (i + 1 < len && (buf[i] != '*' || buf[i + 1] != '/'))
+        i++;
+      i = i + 2;
+    }
+    else if (buf[i] == '#')
+    {
+      // Get the name from # include <name>
+      i++;
+      while (i < len && (buf[i] == ' ' || buf[i] == '\t'))
+        i++;
+      if (i + 7 > len || strncmp(buf + i, "include", 7))
+        break;
+      i = i + 7;
+      while (i < len && (buf[i] == ' ' || buf[i] == '\t'))
+        i++;
+      if (i == len || buf[i] != '<')
+        break;
+      start = i + 1;
+      while (i < len && buf[i] != '>' && buf[i] != '\n')
+        i++;
+      if (i == len || buf[i] != '>')
+        break;
+      names[n] = (char *)malloc(i - start + 1);
+      if (names[n] == NULL)
+        break;
+      strncpy(names[n], buf + start, i - start);
+      names[n][i - start] = 0;
+      n++;
+      i++;
+    }
+    else
+      break;
+  }
+  free(buf);
+  return (n);
+}
+
+// In the child that dealt with a request, try parsing the
+// system headers that the first source file in the request
+// args starts by including, unless the server has them. If
+// they parse, send their names down fd to the server, as
+// NUL-terminated strings and then an empty one
+/**
+ * @fn snapheaders
+ * @brief Parse the headers that a request's first source file starts with
+ * @param cwd The directory of the request
+ * @param args The arguments of the request
+ * @param homedir The directory that the server started in
+ * @param fd The pipe to the server
+ */
+static void snapheaders(char *cwd, char **args, char *homedir, int fd)
+{
+  char **names;
+  char *path = NULL, *s, *msg;
+  int i, n, len = 0;
+
+  // The headers were found from our own directory
+  // if the include directory is a relative one
+  if (INCDIR[0] != '/' && strcmp(cwd, homedir))
+    return;
+
+  // Find the first C file that isn't an output
+  for (i = 1; args[i] != NULL && path == NULL; i++)
+  {
+    s = strrchr(args[i], '.');
+    if (s != NULL && !strcmp(s, ".c") && strcmp(args[i - 1], "-o"))
+    {
+      path = (char *)malloc(strlen(cwd) + strlen(args[i]) + 2);
+      if (path == NULL)
+        return;
+      path[0] = 0;
+      if (args[i][0] != '/')
+      {
+        strcpy(path, cwd);
+        strcat(path, "/");
+      }
+      strcat(path, args[i]);
+    }
+  }
+  if (path == NULL)
+    return;
+  names = (char **)malloc(MAXLEAD * sizeof(char *));
+  if (names == NULL)
+    return;
+  n = leadheaders(path, names);
+
+  // An error in a header is only the end of this
+  // process. The names go in one write, so that
+  // they can't be mixed up with another child's
+  if (n == 0 || !ppwantsnap(names, n) || !ppsnapshot(names, n))
+    return;
+  msg = (char *)malloc(PIPEBUF);
+  if (msg == NULL)
+    return;
+  for (i = 0; i < n; i++)
+  {
+    if (len + (int)strlen(names[i]) + 2 > PIPEBUF)
+      return;
+    strcpy(msg + len, names[i]);
+    len = len + (int)strlen(names[i]) + 1;
+  }
+  msg[len] = 0;
+  write(fd, msg, len + 1);
+}
+
+// In the server, read the names of some headers that
+// parsed in a child from the pipe fd, and keep a
+// snapshot of them unless we have one
+/**
+ * @fn keepheaders
+ * @brief Keep a snapshot of the headers that a child could parse
+ * @param fd The pipe from the children
+ */
+static void keepheaders(int fd)
+{
+  char **names;
+  char name[TEXTLEN];
+  int i, len, n = 0;
+
+  names = (char **)malloc(MAXLEAD * sizeof(char *));
+  if (names == NULL)
+    return;
+
+  // Read each name up to its NUL, and stop at
+  // the empty one. The write was a whole one
+  while (n < MAXLEAD)
+  {
+    len = 0;
+    while (len < TEXTLEN - 1 && read(fd, name + len, 1) == 1 &&
+           name[len] != 0)
+      len++;
+    name[len] = 0;
+    if (len == 0)
+      break;
+    names[n++] = strdup(name);
+  }
+
+  if (n == 0 || !ppwantsnap(names, n) || !ppsnapshot(names, n))
+  {
+    for (i = 0; i < n; i++)
+      free(names[i]);
+    free(names);
+  }
+}
+
+// Deal with the request from a client on the socket
+// conn. Run the compile in a child process, with its
+// output going to temporary files, then send the exit
+// status, the output and the files written to the client
+/**
+ * @fn serve_request
+ * @brief Deal with the request from a client
+ * @param conn The socket connected to the client
+ * @param homedir The directory that the server started in
+ * @param cwd The directory of the request
+ * @param args The arguments of the request
+ */
+static void serve_request(int conn, char *homedir, char *cwd, char **args)
+{
+  char header[TEXTLEN];
+  char **files;
+  int i, n, argc, pid, wstatus, status, out, err, paths;
+
+  argc = 0;
+  while (args[argc] != NULL)
+    argc++;
+
+  out = tmpfd();
+  err = tmpfd();
+  paths = tmpfd();
+  fflush(stdout);
+  fflush(stderr);
+  if ((pid = fork()) == -1)
+    return;
+  if (pid == 0)
+  {
+    dup2(out, 1);
+    dup2(err, 2);
+    close(conn);
+    if (chdir(cwd) == -1)
+    {
+      fprintf(stderr, "Unable to change to %s: %s\n", cwd, strerror(errno));
+      exit(1);
+    }
+
+    // The headers were found from our own directory
+    // if the include directory is a relative one
+    if (INCDIR[0] != '/' && strcmp(cwd, homedir))
+      ppforget();
+    status = do_command(argc, args);
+
+    // A compile that fails exits before here
+    files = outputs();
+    for (i = 0; files != NULL && files[i] != NULL; i++)
+      sendall(paths, files[i], (int)strlen(files[i]) + 1);
+    exit(status);
+  }
+
+  // Send back the exit status, the output
+  // and the names of the files written
+  status = 1;
+  if (waitpid(pid, &wstatus, 0) != -1 && WIFEXITED(wstatus))
+    status = WEXITSTATUS(wstatus);
+  n = snprintf(header, TEXTLEN, "%d %d %d %d\n", status,
+               (int)lseek(out, 0, SEEK_END), (int)lseek(err, 0, SEEK_END),
+               (int)lseek(paths, 0, SEEK_END));
+  if (sendall(conn, header, n))
+  {
+    lseek(out, 0, SEEK_SET);
+    copyfd(out, conn, -1);
+    lseek(err, 0, SEEK_SET);
+    copyfd(err, conn, -1);
+    lseek(paths, 0, SEEK_SET);
+    copyfd(paths, conn, -1);
+  }
+  close(out);
+  close(err);
+  close(paths);
+}
+
+// Run a compile server listening on the Unix domain
+// socket at path. This never returns
+/**
+ * @fn serve
+ * @brief Run a compile server on a Unix domain socket
+ * @param path The socket's path
+ */
+void serve(char *path)
+{
+  char *homedir, *buf, **args;
+  long timeout[2];
+  int fds[4];
+  int sock, conn, pid, len;
+  int snap[2];
+
+  if ((homedir = getcwd(NULL, 0)) == NULL)
+  {
+    fprintf(stderr, "Unable to get the current directory\n");
+    exit(1);
+  }
+
+  // Only our own user can connect: the socket
+  // is made private before anyone can use it
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  if (sock == -1 || bind(sock, (void *)sockaddr(path), SUNLEN) == -1 ||
+      chmod(path, 384) == -1 || listen(sock, 16) == -1)
+  {
+    fprintf(stderr, "Unable to listen on %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+
+  // The children tell us about headers on this pipe
+  if (pipe(snap) == -1)
+  {
+    fprintf(stderr, "Unable to make a pipe: %s\n", strerror(errno));
+    exit(1);
+  }
+
+  // Get the headers ready for every request. The
+  // children that deal with requests are never waited for
+  ppwarm();
+  signal(SIGCHLD, SIG_IGN);
+
+  // A client that doesn't send its whole
+  // request soon doesn't hold up its child
+  timeout[0] = READTIMEOUT;
+  timeout[1] = 0;
+  while (1)
+  {
+    // Wait for a client or for some headers. Clients
+    // come first, so a parse only holds up the ones
+    // that arrive while we do it
+    fds[0] = sock;
+    fds[1] = POLLIN;
+    fds[2] = snap[0];
+    fds[3] = POLLIN;
+    if (poll((void *)fds, 2, -1) <= 0)
+      continue;
+    if ((fds[1] >> 16) == 0)
+    {
+      keepheaders(snap[0]);
+      continue;
+    }
+    if ((conn = accept(sock, NULL, NULL)) == -1)
+      continue;
+
+    // Deal with each request in its own process,
+    // which waits for the compile that it starts
+    fflush(stdout);
+    fflush(stderr);
+    pid = fork();
+    if (pid == 0)
+    {
+      signal(SIGCHLD, SIG_DFL);
+      close(sock);
+      close(snap[0]);
+      setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, timeout, 16);
+      buf = readall(conn, &len);
+      args = reqargs(buf, len);
+      if (args != NULL)
+      {
+        serve_request(conn, homedir, buf, args);
+        close(conn);
+        snapheaders(buf, args, homedir, snap[1]);
+      }
+      _exit(0);
+    }
+    close(conn);
+  }
+  return;
+}
+
+// Parse the reply header "status outlen errlen pathlen"
+// into the four numbers in vals. Return 1 if it is
+// well formed, else 0
+/**
+ * @fn replyheader
+ * @brief Parse the header of a reply from the compile server
+ * @param header The header line, without its newline
+ * @param vals Where to put the four numbers
+ * @return 1 if the header is well formed, else 0
+ */
+static int replyheader(char *header, int *vals)
+{
+  int i, k;
+
+  i = 0;
+  for (k = 0; k < 4; k++)
+  {
+    if (k > 0)
+    {
+      if (header[i] != ' ')
+        return (0);
+      i++;
+    }
+    if (header[i] < '0' || header[i] > '9')
+      return (0);
+    vals[k] = 0;
+    while (header[i] >= '0' && header[i] <= '9')
+    {
+      if (vals[k] > 100000000)
+        return (0);
+      vals[k] = vals[k] * 10 + header[i] - '0';
+      i++;
+    }
+  }
+  return (header[i] == '\0');
+}
+
+// Send the arguments to the compile server on the
+// socket at path, and copy its output to our own.
+// With -v, also list the files that it wrote.
+// Return the exit status of the compile, or -1 if
+// we couldn't use the server
+/**
+ * @fn forward
+ * @brief Send the arguments to a compile server
+ * @param path The server's socket
+ * @param argc The number of arguments
+ * @param argv The arguments, including the program name
+ * @return The exit status of the compile, or -1
+ */
+int forward(char *path, int argc, char **argv)
+{
+  char header[TEXTLEN];
+  char *cwd, *paths;
+  int vals[4];
+  int sock, i, n, verbose = 0;
+
+  if ((cwd = getcwd(NULL, 0)) == NULL)
+    return (-1);
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock == -1)
+    return (-1);
+  if (connect(sock, (void *)sockaddr(path), SUNLEN) == -1)
+  {
+    close(sock);
+    return (-1);
+  }
+
+  // Send the directory and the arguments
+  sendall(sock, cwd, (int)strlen(cwd) + 1);
+  for (i = 0; i < argc; i++)
+  {
+    sendall(sock, argv[i], (int)strlen(argv[i]) + 1);
+    if (!strcmp(argv[i], "-v"))
+      verbose = 1;
+  }
+  sendall(sock, "", 1);
+  shutdown(sock, SHUT_WR);
+
+  // Read the header line, then the output
+  for (i = 0; i < TEXTLEN - 1; i++)
+  {
+    if (read(sock, header + i, 1) != 1 || header[i] == '\n')
+      break;
+  }
+  header[i] = '\0';
+  if (i == TEXTLEN - 1 || !replyheader(header, vals))
+  {
+    fprintf(stderr, "Bad reply from the compile server on %s\n", path);
+    close(sock);
+    return (1);
+  }
+  copyfd(sock, 1, vals[1]);
+  copyfd(sock, 2, vals[2]);
+
+  // Then the names of the files written
+  paths = (char *)malloc(vals[3] + 1);
+  if (paths == NULL)
+  {
+    close(sock);
+    return (vals[0]);
+  }
+  n = 0;
+  while (n < vals[3] && (i = read(sock, paths + n, vals[3] - n)) > 0)
+    n = n + i;
+  paths[n] = '\0';
+  i = 0;
+  while (verbose && i < n)
+  {
+    printf("wrote %s\n", paths + i);
+    i = i + (int)strlen(paths + i) + 1;
+  }
+  free(paths);
+  close(sock);
+  return (vals[0]);
+}
@@ -42,6 +42,7 @@ static struct ASTnode *single_statement(void);
 static struct ASTnode *if_statement(void)
 {
   struct ASTnode *condAST, *trueAST, *falseAST = NULL;
+  int hint;
 
   // Ensure we have 'if' '('
   match(T_IF, "if");
@@ -51,7 +52,8 @@ static struct ASTnode *if_statement(void)
   // and the ')' following. Force a
   // non-comparison to be boolean
   // the tree's operation is a comparison.
-  condAST = binexpr(0);
+  // Keep any branch hint for the A_IF node
+  condAST = expecthint(binexpr(0), &hint);
   if (condAST->op < A_EQ || condAST->op > A_GE)
     condAST =
         mkastunary(A_TOBOOL, condAST->type, condAST->ctype, condAST, NULL, 0);
@@ -62,13 +64,14 @@ static struct ASTnode *if_statement(void)
 
   // If we have an 'else', skip it
   // and get the AST for the statement
-  if (Token.token == T_ELSE)
+  if (Ctx->token->token == T_ELSE)
   {
-    scan(&Token);
+    scan(Ctx->token);
     falseAST = single_statement();
   }
   // Build and return the AST for this statement
-  return (mkastnode(A_IF, P_NONE, NULL, condAST, trueAST, falseAST, NULL, 0));
+  return (mkastnode(A_IF, P_NONE, NULL, condAST, trueAST, falseAST, NULL,
+                    hint));
 }
 
 // while_statement: 'while' '(' true_false_expression ')' statement  ;
@@ -82,6 +85,7 @@ static struct ASTnode *if_statement(void)
 static struct ASTnode *while_statement(void)
 {
   struct ASTnode *condAST, *bodyAST;
+  int hint;
 
   // Ensure we have 'while' '('
   match(T_WHILE, "while");
@@ -91,7 +95,8 @@ static struct ASTnode *while_statement(void)
   // and the ')' following. Force a
   // non-comparison to be boolean
   // the tree's operation is a comparison.
-  condAST = binexpr(0);
+  // Keep any branch hint for the A_WHILE node
+  condAST = expecthint(binexpr(0), &hint);
   if (condAST->op < A_EQ || condAST->op > A_GE)
     condAST =
         mkastunary(A_TOBOOL, condAST->type, condAST->ctype, condAST, NULL, 0);
@@ -99,12 +104,13 @@ static struct ASTnode *while_statement(void)
 
   // Get the AST for the statement.
   // Update the loop depth in the process
-  Looplevel++;
+  Ctx->looplevel = Ctx->looplevel + 1;
   bodyAST = single_statement();
-  Looplevel--;
+  Ctx->looplevel = Ctx->looplevel - 1;
 
   // Build and return the AST for this statement
-  return (mkastnode(A_WHILE, P_NONE, NULL, condAST, NULL, bodyAST, NULL, 0));
+  return (mkastnode(A_WHILE, P_NONE, NULL, condAST, NULL, bodyAST, NULL,
+                    hint));
 }
 
 // for_statement: 'for' '(' expression_list ';'
@@ -122,6 +128,7 @@ static struct ASTnode *for_statement(void)
   struct ASTnode *condAST, *bodyAST;
   struct ASTnode *preopAST, *postopAST;
   struct ASTnode *tree;
+  int hint;
 
   // Ensure we have 'for' '('
   match(T_FOR, "for");
@@ -134,7 +141,8 @@ static struct ASTnode *for_statement(void)
   // Get the condition and the ';'.
   // Force a non-comparison to be boolean
   // the tree's operation is a comparison.
-  condAST = binexpr(0);
+  // Keep any branch hint for the A_WHILE node
+  condAST = expecthint(binexpr(0), &hint);
   if (condAST->op < A_EQ || condAST->op > A_GE)
     condAST =
         mkastunary(A_TOBOOL, condAST->type, condAST->ctype, condAST, NULL, 0);
@@ -146,15 +154,15 @@ static struct ASTnode *for_statement(void)
 
   // Get the statement which is the body
   // Update the loop depth in the process
-  Looplevel++;
+  Ctx->looplevel = Ctx->looplevel + 1;
   bodyAST = single_statement();
-  Looplevel--;
+  Ctx->looplevel = Ctx->looplevel - 1;
 
   // Glue the statement and the postop tree
   tree = mkastnode(A_GLUE, P_NONE, NULL, bodyAST, NULL, postopAST, NULL, 0);
 
   // Make a WHILE loop with the condition and this new body
-  tree = mkastnode(A_WHILE, P_NONE, NULL, condAST, NULL, tree, NULL, 0);
+  tree = mkastnode(A_WHILE, P_NONE, NULL, condAST, NULL, tree, NULL, hint);
 
   // And glue the preop tree to the A_WHILE tree
   return (mkastnode(A_GLUE, P_NONE, NULL, preopAST, NULL, tree, NULL, 0));
@@ -176,10 +184,10 @@ static struct ASTnode *return_statement(void)
   match(T_RETURN, "return");
 
   // See if we have a return value
-  if (Token.token == T_LPAREN)
+  if (Ctx->token->token == T_LPAREN)
   {
     // Can't return a value if function returns P_VOID
-    if (Functionid->type == P_VOID)
+    if (Ctx->functionid->type == P_VOID)
       fatal("Can't return from a void function");
 
     // Skip the left parenthesis
@@ -189,7 +197,7 @@ static struct ASTnode *return_statement(void)
     tree = binexpr(0);
 
     // Ensure this is compatible with the function's type
-    tree = modify_type(tree, Functionid->type, Functionid->ctype, 0);
+    tree = modify_type(tree, Ctx->functionid->type, Ctx->functionid->ctype, 0);
     if (tree == NULL)
       fatal("Incompatible type to return");
 
@@ -215,9 +223,9 @@ static struct ASTnode *return_statement(void)
 static struct ASTnode *break_statement(void)
 {
 
-  if (Looplevel == 0 && Switchlevel == 0)
+  if (Ctx->looplevel == 0 && Ctx->switchlevel == 0)
     fatal("no loop or switch to break out from");
-  scan(&Token);
+  scan(Ctx->token);
   semi();
   return (mkastleaf(A_BREAK, P_NONE, NULL, NULL, 0));
 }
@@ -233,9 +241,9 @@ static struct ASTnode *break_statement(void)
 static struct ASTnode *continue_statement(void)
 {
 
-  if (Looplevel == 0)
+  if (Ctx->looplevel == 0)
     fatal("no loop to continue to");
-  scan(&Token);
+  scan(Ctx->token);
   semi();
   return (mkastleaf(A_CONTINUE, P_NONE, NULL, NULL, 0));
 }
@@ -255,7 +263,7 @@ static struct ASTnode *switch_statement(void)
   int ASTop, casevalue = 0;
 
   // Skip the 'switch' and '('
-  scan(&Token);
+  scan(Ctx->token);
   lparen();
 
   // Get the switch expression, the ')' and the '{'
@@ -268,14 +276,14 @@ static struct ASTnode *switch_statement(void)
     fatal("Switch expression is not of integer type");
 
   // Build an A_SWITCH subtree with the expression as
-  // the child
-  n = mkastunary(A_SWITCH, P_NONE, NULL, left, NULL, 0);
+  // the left child. The cases go on the right later
+  n = mkastnode(A_SWITCH, P_NONE, NULL, left, NULL, NULL, NULL, 0);
 
   // Now parse the cases
-  Switchlevel++;
+  Ctx->switchlevel = Ctx->switchlevel + 1;
   while (inloop)
   {
-    switch (Token.token)
+    switch (Ctx->token->token)
     {
       // Leave the loop when we hit a '}'
     case T_RBRACE:
@@ -290,16 +298,16 @@ static struct ASTnode *switch_statement(void)
         fatal("case or default after existing default");
 
       // Set the AST operation. Scan the case value if required
-      if (Token.token == T_DEFAULT)
+      if (Ctx->token->token == T_DEFAULT)
       {
         ASTop = A_DEFAULT;
         seendefault = 1;
-        scan(&Token);
+        scan(Ctx->token);
       }
       else
       {
         ASTop = A_CASE;
-        scan(&Token);
+        scan(Ctx->token);
         left = binexpr(0);
 
         // Ensure the case value is an integer literal
@@ -320,7 +328,7 @@ static struct ASTnode *switch_statement(void)
 
       // If the next token is a T_CASE, the existing case will fall
       // into the next case. Otherwise, parse the case body.
-      if (Token.token == T_CASE)
+      if (Ctx->token->token == T_CASE)
         body = NULL;
       else
         body = compound_statement(1);
@@ -330,20 +338,20 @@ static struct ASTnode *switch_statement(void)
       if (casetree == NULL)
       {
         casetree = casetail =
-            mkastunary(ASTop, P_NONE, NULL, body, NULL, casevalue);
+            mkastnode(ASTop, P_NONE, NULL, body, NULL, NULL, NULL, casevalue);
       }
       else
       {
         casetail->right =
-            mkastunary(ASTop, P_NONE, NULL, body, NULL, casevalue);
+            mkastnode(ASTop, P_NONE, NULL, body, NULL, NULL, NULL, casevalue);
         casetail = casetail->right;
       }
       break;
     default:
-      fatals("Unexpected token in switch", Token.tokstr);
+      fatals("Unexpected token in switch", Ctx->token->tokstr);
     }
   }
-  Switchlevel--;
+  Ctx->switchlevel = Ctx->switchlevel - 1;
 
   // We have a sub-tree with the cases and any default. Put the
   // case count into the A_SWITCH node and attach the case tree.
@@ -364,9 +372,9 @@ static struct ASTnode *single_statement(void)
 {
   struct ASTnode *stmt;
   struct symtable *ctype;
-  int linenum = Line;
+  int linenum = Ctx->line;
 
-  switch (Token.token)
+  switch (Ctx->token->token)
   {
   case T_SEMI:
     // An empty statement
@@ -383,7 +391,7 @@ static struct ASTnode *single_statement(void)
     // We have to see if the identifier matches a typedef.
     // If not, treat it as an expression.
     // Otherwise, fall down to the parse_type() call.
-    if (findtypedef(Text) == NULL)
+    if (findtypedef(Ctx->ident) == NULL)
     {
       stmt = binexpr(0);
       stmt->linenum = linenum;
@@ -460,9 +468,9 @@ struct ASTnode *compound_statement(int inswitch)
   {
     // Leave if we've hit the end token. We do this first to allow
     // an empty compound statement
-    if (Token.token == T_RBRACE)
+    if (Ctx->token->token == T_RBRACE)
       return (left);
-    if (inswitch && (Token.token == T_CASE || Token.token == T_DEFAULT))
+    if (inswitch && (Ctx->token->token == T_CASE || Ctx->token->token == T_DEFAULT))
       return (left);
 
     // Parse a single statement
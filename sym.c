@@ -9,33 +9,221 @@
 
 // Symbol table functions
 
-// Append a node to the singly-linked list pointed to by head or tail
+// Identifier names are interned: each different name
+// is stored once, so two names are the same exactly
+// when they are the same pointer. The table lasts for
+// the whole run as cached header tokens share the names
+static char **Idtable;		// Open-addressed table of names
+static int Idsize;		// Size of the table, a power of 2
+static int Idcount;		// Number of names in the table
+
+enum {
+  IDTABLESIZE = 1024		// Initial size of the name table
+};
+
+// Return the hash value for a name
+/**
+ * @fn strhash
+ * @brief Return the hash value for a name
+ * @param s The name
+ * @return The hash value
+ */
+static int strhash(char *s)
+{
+  int h = 0;
+
+  for (; *s; s++)
+    h = (h * 31 + *s) & 0xffffff;
+  return (h);
+}
+
+// Put a name in the slot for it in the name table
+/**
+ * @fn idinsert
+ * @brief Put a name in the slot for it in the name table
+ * @param s The name
+ */
+static void idinsert(char *s)
+{
+  int i;
+
+  i = strhash(s) & (Idsize - 1);
+  while (Idtable[i] != NULL)
+    i = (i + 1) & (Idsize - 1);
+  Idtable[i] = s;
+}
+
+// Make the name table twice as big
+/**
+ * @fn idgrow
+ * @brief Make the name table twice as big
+ */
+static void idgrow(void)
+{
+  char **old = Idtable;
+  int i, oldsize = Idsize;
+
+  if (Idsize == 0)
+    Idsize = IDTABLESIZE;
+  else
+    Idsize = 2 * Idsize;
+  Idtable = (char **)calloc(Idsize, sizeof(char *));
+  if (Idtable == NULL)
+    fatal("Unable to malloc in idgrow()");
+  for (i = 0; i < oldsize; i++)
+    if (old[i] != NULL)
+      idinsert(old[i]);
+  free(old);
+}
+
+// Return the interned copy of the name s,
+// adding it to the name table if it is new
+/**
+ * @fn internid
+ * @brief Return the interned copy of a name, adding it to the name table if it is new
+ * @param s The name
+ * @return The interned name
+ */
+char *internid(char *s)
+{
+  int i;
+
+  // Keep the table no more than half full
+  if (2 * (Idcount + 1) > Idsize)
+    idgrow();
+
+  i = strhash(s) & (Idsize - 1);
+  while (Idtable[i] != NULL)
+  {
+    if (!strcmp(Idtable[i], s))
+      return (Idtable[i]);
+    i = (i + 1) & (Idsize - 1);
+  }
+  Idtable[i] = strdup(s);
+  if (Idtable[i] == NULL)
+    fatal("Unable to malloc in internid()");
+  Idcount = Idcount + 1;
+  return (Idtable[i]);
+}
+
+// Each symbol list has a hash table on the symbol
+// names, so that a symbol can be found without
+// walking the list. The hash chains keep the symbols
+// in the order they were added, and the list itself
+// is kept so that the symbols can be dumped in order
+
+enum {
+  SYMHASHSIZE = 64		// Initial number of hash chains
+};
+
+// Add a node to the end of its hash chain in the list
+/**
+ * @fn hashsym
+ * @brief Add a node to the end of its hash chain in the list
+ * @param list The list holding the node
+ * @param node The node to be added
+ */
+static void hashsym(struct symlist *list, struct symtable *node)
+{
+  struct symtable *s;
+  int h;
+
+  node->hnext = NULL;
+  if (node->name == NULL)
+    return;
+  h = strhash(node->name) & (list->nbuckets - 1);
+  if (list->hash[h] == NULL)
+  {
+    list->hash[h] = node;
+    return;
+  }
+  for (s = list->hash[h]; s->hnext != NULL; s = s->hnext)
+    ;
+  s->hnext = node;
+}
+
+// Rebuild the hash table for a list with the given
+// number of hash chains, and recount its symbols
+/**
+ * @fn rehashsyms
+ * @brief Rebuild the hash table for a list with the given number of hash chains
+ * @param list The list to rebuild
+ * @param nbuckets The number of hash chains, a power of 2
+ */
+static void rehashsyms(struct symlist *list, int nbuckets)
+{
+  struct symtable *s;
+
+  free(list->hash);
+  list->hash =
+      (struct symtable **)calloc(nbuckets, sizeof(struct symtable *));
+  if (list->hash == NULL)
+    fatal("Unable to malloc in rehashsyms()");
+  list->nbuckets = nbuckets;
+  list->count = 0;
+  for (s = list->head; s != NULL; s = s->next)
+  {
+    hashsym(list, s);
+    list->count = list->count + 1;
+  }
+}
+
+// Append a node to the end of a symbol list
 /**
  * @fn appendsym
- * @brief Append a node to the singly-linked list pointed to by head or tail
- * @param head The head of the list
- * @param tail The tail of the list
+ * @brief Append a node to the end of a symbol list
+ * @param list The list to append to
  * @param node The node to be appended
  * @return void
- * @note head, tail or node is NULL in appendsym
+ * @note list or node is NULL in appendsym
  */
-void appendsym(struct symtable **head, struct symtable **tail,
-               struct symtable *node)
+void appendsym(struct symlist *list, struct symtable *node)
 {
 
   // Check for valid pointers
-  if (head == NULL || tail == NULL || node == NULL)
-    fatal("Either head, tail or node is NULL in appendsym");
+  if (list == NULL || node == NULL)
+    fatal("Either list or node is NULL in appendsym");
 
   // Append to the list
-  if (*tail)
+  if (list->tail)
   {
-    (*tail)->next = node;
-    *tail = node;
+    list->tail->next = node;
+    list->tail = node;
   }
   else
-    *head = *tail = node;
+    list->head = list->tail = node;
   node->next = NULL;
+
+  // Add it to the hash table, making
+  // the table bigger if it gets too full
+  if (list->hash == NULL)
+    rehashsyms(list, SYMHASHSIZE);
+  else if (list->count >= 2 * list->nbuckets)
+    rehashsyms(list, 2 * list->nbuckets);
+  else
+  {
+    hashsym(list, node);
+    list->count = list->count + 1;
+  }
+}
+
+// Empty a symbol list. The symbols are
+// left alone as other lists may use them
+/**
+ * @fn clearsymlist
+ * @brief Empty a symbol list
+ * @param list The list to empty
+ */
+static void clearsymlist(struct symlist *list)
+{
+  struct symtable *s;
+
+  if (list->hash != NULL)
+    for (s = list->head; s != NULL; s = s->next)
+      if (s->name != NULL)
+        list->hash[strhash(s->name) & (list->nbuckets - 1)] = NULL;
+  list->head = list->tail = NULL;
+  list->count = 0;
 }
 
 // Create a symbol node to be added to a symbol table list.
@@ -61,17 +249,24 @@ void appendsym(struct symtable **head, struct symtable **tail,
 struct symtable *newsym(char *name, int type, struct symtable *ctype,
                         int stype, int class, int nelems, int posn)
 {
+  struct symtable *node;
 
-  // Get a new node
-  struct symtable *node = (struct symtable *)malloc(sizeof(struct symtable));
-  if (node == NULL)
-    fatal("Unable to malloc a symbol table node in newsym");
+  // Get a new node. Local variables only last as long as
+  // their function, the other symbols last for the whole
+  // file. A function declared inside another function
+  // is also C_LOCAL, but it goes in the global list
+  if (class == C_LOCAL && stype != S_FUNCTION)
+    node = (struct symtable *)arenaalloc(Ctx->funcarena,
+                                         sizeof(struct symtable));
+  else
+    node = (struct symtable *)arenaalloc(Ctx->tuarena,
+                                         sizeof(struct symtable));
 
   // Fill in the values
   if (name == NULL)
     node->name = NULL;
   else
-    node->name = strdup(name);
+    node->name = internid(name);
   node->type = type;
   node->ctype = ctype;
   node->stype = stype;
@@ -86,11 +281,69 @@ struct symtable *newsym(char *name, int type, struct symtable *ctype,
 
   node->st_posn = posn;
   node->next = NULL;
+  node->hnext = NULL;
   node->member = NULL;
   node->initlist = NULL;
   return (node);
 }
 
+// A symbol's initial values are kept packed, each as
+// big as one element: a byte, a word or a long.
+// Store val as element i of the initial values at list
+/**
+ * @fn setinitval
+ * @brief Store a value in a packed list of initial values
+ * @param list The list of initial values
+ * @param size The size of each element
+ * @param i The element's position in the list
+ * @param val The value
+ */
+void setinitval(char *list, int size, int i, int val)
+{
+  int *wlist;
+  long *llist;
+
+  switch (size)
+  {
+  case 1:
+    list[i] = (char)val;
+    break;
+  case 4:
+    wlist = (int *)list;
+    wlist[i] = val;
+    break;
+  default:
+    llist = (long *)list;
+    llist[i] = val;
+  }
+}
+
+// Return element i of the initial values at list
+/**
+ * @fn getinitval
+ * @brief Return a value from a packed list of initial values
+ * @param list The list of initial values
+ * @param size The size of each element
+ * @param i The element's position in the list
+ * @return The value
+ */
+int getinitval(char *list, int size, int i)
+{
+  int *wlist;
+  long *llist;
+
+  switch (size)
+  {
+  case 1:
+    return (list[i] & 0xff);
+  case 4:
+    wlist = (int *)list;
+    return (wlist[i]);
+  }
+  llist = (long *)list;
+  return ((int)llist[i]);
+}
+
 // Add a symbol to the global symbol list
 /**
  * @fn addglob
@@ -112,7 +365,7 @@ struct symtable *addglob(char *name, int type, struct symtable *ctype,
   // For structs and unions, copy the size from the type node
   if (type == P_STRUCT || type == P_UNION)
     sym->size = ctype->size;
-  appendsym(&Globhead, &Globtail, sym);
+  appendsym(Ctx->globsyms, sym);
   return (sym);
 }
 
@@ -135,7 +388,7 @@ struct symtable *addlocl(char *name, int type, struct symtable *ctype,
   // For structs and unions, copy the size from the type node
   if (type == P_STRUCT || type == P_UNION)
     sym->size = ctype->size;
-  appendsym(&Loclhead, &Locltail, sym);
+  appendsym(Ctx->loclsyms, sym);
   return (sym);
 }
 
@@ -153,7 +406,7 @@ struct symtable *addparm(char *name, int type, struct symtable *ctype,
                          int stype)
 {
   struct symtable *sym = newsym(name, type, ctype, stype, C_PARAM, 1, 0);
-  appendsym(&Parmhead, &Parmtail, sym);
+  appendsym(Ctx->parmsyms, sym);
   return (sym);
 }
 
@@ -177,7 +430,7 @@ struct symtable *addmemb(char *name, int type, struct symtable *ctype,
   // For structs and unions, copy the size from the type node
   if (type == P_STRUCT || type == P_UNION)
     sym->size = ctype->size;
-  appendsym(&Membhead, &Membtail, sym);
+  appendsym(Ctx->membsyms, sym);
   return (sym);
 }
 
@@ -191,7 +444,7 @@ struct symtable *addmemb(char *name, int type, struct symtable *ctype,
 struct symtable *addstruct(char *name)
 {
   struct symtable *sym = newsym(name, P_STRUCT, NULL, 0, C_STRUCT, 0, 0);
-  appendsym(&Structhead, &Structtail, sym);
+  appendsym(Ctx->structsyms, sym);
   return (sym);
 }
 
@@ -205,7 +458,7 @@ struct symtable *addstruct(char *name)
 struct symtable *addunion(char *name)
 {
   struct symtable *sym = newsym(name, P_UNION, NULL, 0, C_UNION, 0, 0);
-  appendsym(&Unionhead, &Uniontail, sym);
+  appendsym(Ctx->unionsyms, sym);
   return (sym);
 }
 
@@ -223,7 +476,7 @@ struct symtable *addunion(char *name)
 struct symtable *addenum(char *name, int class, int value)
 {
   struct symtable *sym = newsym(name, P_INT, NULL, 0, class, 0, value);
-  appendsym(&Enumhead, &Enumtail, sym);
+  appendsym(Ctx->enumsyms, sym);
   return (sym);
 }
 
@@ -239,29 +492,35 @@ struct symtable *addenum(char *name, int class, int value)
 struct symtable *addtypedef(char *name, int type, struct symtable *ctype)
 {
   struct symtable *sym = newsym(name, type, ctype, 0, C_TYPEDEF, 0, 0);
-  appendsym(&Typehead, &Typetail, sym);
+  appendsym(Ctx->typesyms, sym);
   return (sym);
 }
 
-// Search for a symbol in a specific list.
+// Search for a symbol in a specific list. The name s
+// must be interned, as names are compared by pointer.
 // Return a pointer to the found node or NULL if not found.
 // If class is not zero, also match on the given class
 /**
  * @fn findsyminlist
  * @brief Search for a symbol in a specific list
- * @param s The name of the symbol
+ * @param s The interned name of the symbol
  * @param list The list to search
  * @param class The class of the symbol
  * @return The pointer to the found node or NULL if not found
  * @note If class is not zero, also match on the given class
  */
-static struct symtable *findsyminlist(char *s, struct symtable *list,
+static struct symtable *findsyminlist(char *s, struct symlist *list,
                                       int class)
 {
-  for (; list != NULL; list = list->next)
-    if ((list->name != NULL) && !strcmp(s, list->name))
-      if (class == 0 || class == list->class)
-        return (list);
+  struct symtable *node;
+
+  if (list->hash == NULL)
+    return (NULL);
+  node = list->hash[strhash(s) & (list->nbuckets - 1)];
+  for (; node != NULL; node = node->hnext)
+    if (node->name == s)
+      if (class == 0 || class == node->class)
+        return (node);
   return (NULL);
 }
 
@@ -275,7 +534,7 @@ static struct symtable *findsyminlist(char *s, struct symtable *list,
  */
 struct symtable *findglob(char *s)
 {
-  return (findsyminlist(s, Globhead, 0));
+  return (findsyminlist(s, Ctx->globsyms, 0));
 }
 
 // Determine if the symbol s is in the local symbol table.
@@ -290,14 +549,11 @@ struct symtable *findlocl(char *s)
 {
   struct symtable *node;
 
-  // Look for a parameter if we are in a function's body
-  if (Functionid)
-  {
-    node = findsyminlist(s, Functionid->member, 0);
-    if (node)
-      return (node);
-  }
-  return (findsyminlist(s, Loclhead, 0));
+  // Look for a parameter first
+  node = findsyminlist(s, Ctx->parmsyms, 0);
+  if (node)
+    return (node);
+  return (findsyminlist(s, Ctx->loclsyms, 0));
 }
 
 // Determine if the symbol s is in the symbol table.
@@ -312,18 +568,15 @@ struct symtable *findsymbol(char *s)
 {
   struct symtable *node;
 
-  // Look for a parameter if we are in a function's body
-  if (Functionid)
-  {
-    node = findsyminlist(s, Functionid->member, 0);
-    if (node)
-      return (node);
-  }
+  // Look for a parameter first
+  node = findsyminlist(s, Ctx->parmsyms, 0);
+  if (node)
+    return (node);
   // Otherwise, try the local and global symbol lists
-  node = findsyminlist(s, Loclhead, 0);
+  node = findsyminlist(s, Ctx->loclsyms, 0);
   if (node)
     return (node);
-  return (findsyminlist(s, Globhead, 0));
+  return (findsyminlist(s, Ctx->globsyms, 0));
 }
 
 // Find a member in the member list
@@ -336,7 +589,7 @@ struct symtable *findsymbol(char *s)
  */
 struct symtable *findmember(char *s)
 {
-  return (findsyminlist(s, Membhead, 0));
+  return (findsyminlist(s, Ctx->membsyms, 0));
 }
 
 // Find a struct in the struct list
@@ -349,7 +602,7 @@ struct symtable *findmember(char *s)
  */
 struct symtable *findstruct(char *s)
 {
-  return (findsyminlist(s, Structhead, 0));
+  return (findsyminlist(s, Ctx->structsyms, 0));
 }
 
 // Find a struct in the union list
@@ -362,7 +615,7 @@ struct symtable *findstruct(char *s)
  */
 struct symtable *findunion(char *s)
 {
-  return (findsyminlist(s, Unionhead, 0));
+  return (findsyminlist(s, Ctx->unionsyms, 0));
 }
 
 // Find an enum type in the enum list
@@ -375,7 +628,7 @@ struct symtable *findunion(char *s)
  */
 struct symtable *findenumtype(char *s)
 {
-  return (findsyminlist(s, Enumhead, C_ENUMTYPE));
+  return (findsyminlist(s, Ctx->enumsyms, C_ENUMTYPE));
 }
 
 // Find an enum value in the enum list
@@ -388,7 +641,7 @@ struct symtable *findenumtype(char *s)
  */
 struct symtable *findenumval(char *s)
 {
-  return (findsyminlist(s, Enumhead, C_ENUMVAL));
+  return (findsyminlist(s, Ctx->enumsyms, C_ENUMVAL));
 }
 
 // Find a type in the tyedef list
@@ -401,7 +654,7 @@ struct symtable *findenumval(char *s)
  */
 struct symtable *findtypedef(char *s)
 {
-  return (findsyminlist(s, Typehead, 0));
+  return (findsyminlist(s, Ctx->typesyms, 0));
 }
 
 // Reset the contents of the symbol table
@@ -411,26 +664,68 @@ struct symtable *findtypedef(char *s)
  */
 void clear_symtable(void)
 {
-  Globhead = Globtail = NULL;
-  Loclhead = Locltail = NULL;
-  Parmhead = Parmtail = NULL;
-  Membhead = Membtail = NULL;
-  Structhead = Structtail = NULL;
-  Unionhead = Uniontail = NULL;
-  Enumhead = Enumtail = NULL;
-  Typehead = Typetail = NULL;
+  clearsymlist(Ctx->globsyms);
+  clearsymlist(Ctx->loclsyms);
+  clearsymlist(Ctx->parmsyms);
+  clearsymlist(Ctx->membsyms);
+  clearsymlist(Ctx->structsyms);
+  clearsymlist(Ctx->unionsyms);
+  clearsymlist(Ctx->enumsyms);
+  clearsymlist(Ctx->typesyms);
+}
+
+// Clear the list of parameters being declared
+/**
+ * @fn clearparms
+ * @brief Clear the list of parameters being declared
+ */
+void clearparms(void)
+{
+  clearsymlist(Ctx->parmsyms);
+}
+
+// Clear the temporary list of struct/union members
+/**
+ * @fn clearmembs
+ * @brief Clear the temporary list of struct/union members
+ */
+void clearmembs(void)
+{
+  clearsymlist(Ctx->membsyms);
 }
 
-// Clear all the entries in the local symbol table
+// Start the scope of a function's body. Its
+// parameters become visible until popscope()
 /**
- * @fn freeloclsyms
- * @brief Clear all the entries in the local symbol table
+ * @fn pushscope
+ * @brief Start the scope of a function's body
+ * @param func The function's symbol
  */
-void freeloclsyms(void)
+void pushscope(struct symtable *func)
 {
-  Loclhead = Locltail = NULL;
-  Parmhead = Parmtail = NULL;
-  Functionid = NULL;
+  struct symtable *sym, *next;
+
+  Ctx->functionid = func;
+  clearsymlist(Ctx->parmsyms);
+  clearsymlist(Ctx->loclsyms);
+  for (sym = func->member; sym != NULL; sym = next)
+  {
+    next = sym->next;
+    appendsym(Ctx->parmsyms, sym);
+  }
+}
+
+// End the scope of a function's body, clearing
+// all the entries in the local symbol table
+/**
+ * @fn popscope
+ * @brief End the scope of a function's body, clearing all the entries in the local symbol table
+ */
+void popscope(void)
+{
+  clearsymlist(Ctx->loclsyms);
+  clearsymlist(Ctx->parmsyms);
+  Ctx->functionid = NULL;
 }
 
 // Remove all static symbols from the global symbol table
@@ -444,7 +739,7 @@ void freestaticsyms(void)
   struct symtable *g, *prev = NULL;
 
   // Walk the global table looking for static entries
-  for (g = Globhead; g != NULL; g = g->next)
+  for (g = Ctx->globsyms->head; g != NULL; g = g->next)
   {
     if (g->class == C_STATIC)
     {
@@ -455,22 +750,26 @@ void freestaticsyms(void)
       if (prev != NULL)
         prev->next = g->next;
       else
-        Globhead->next = g->next;
+        Ctx->globsyms->head->next = g->next;
 
       // If g is the tail, point Globtail at the previous node
       // (if there is one), or Globhead
-      if (g == Globtail)
+      if (g == Ctx->globsyms->tail)
       {
         if (prev != NULL)
-          Globtail = prev;
+          Ctx->globsyms->tail = prev;
         else
-          Globtail = Globhead;
+          Ctx->globsyms->tail = Ctx->globsyms->head;
       }
     }
   }
 
   // Point prev at g before we move up to the next node
   prev = g;
+
+  // Rebuild the hash table without the removed symbols
+  if (Ctx->globsyms->hash != NULL)
+    rehashsyms(Ctx->globsyms, Ctx->globsyms->nbuckets);
 }
 
 // Dump a single symbol
@@ -628,9 +927,9 @@ void dumptable(struct symtable *head, char *name, int indent)
  */
 void dumpsymtables(void)
 {
-  dumptable(Globhead, "Global", 0);
+  dumptable(Ctx->globsyms->head, "Global", 0);
   printf("\n");
-  dumptable(Enumhead, "Enums", 0);
+  dumptable(Ctx->enumsyms->head, "Enums", 0);
   printf("\n");
-  dumptable(Typehead, "Typedefs", 0);
+  dumptable(Ctx->typesyms->head, "Typedefs", 0);
 }
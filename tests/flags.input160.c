@@ -0,0 +1 @@
+-fwhole-program
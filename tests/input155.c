@@ -0,0 +1,44 @@
+#include <stdio.h>
+
+// The integrated preprocessor: object-like and
+// function-like macros, conditionals and comments
+#define TEN 10
+#define TWICE(x) ((x) * 2)
+#define ADD(a, b) ((a) + (b))
+#define NESTED ADD(TEN, TWICE(3))
+#define SELF SELF
+
+#if TWICE(TEN) > 15 && defined(TEN)
+int big = 1;
+#elif defined NOTHING
+int big = 2;
+#else
+int big = 3;
+#endif
+
+#ifndef TEN
+int missing;
+#else
+# ifdef NOTHING
+int missing;
+# endif
+#endif
+
+#undef TEN
+#define TEN 100
+
+int main() {
+  int SELF;
+  SELF = 7;
+  /* A comment across
+     more than one line */
+  printf("%d\n", big);
+  printf("%d\n", TEN);
+  printf("%d\n", ADD(TEN, 1));
+  printf("%d\n", NESTED);
+  printf("%d\n", SELF);
+#if 0
+  printf("not printed\n");
+#endif
+  return(0);
+}
@@ -0,0 +1,36 @@
+#include <stdio.h>
+
+// Symbol lookup across scopes: parameters and
+// locals hide globals, each function gets its own
+// locals, and enum types and values share names
+enum colour { red, green, blue };
+enum shade { colour, dark };
+int x = 1;
+int y = 2;
+
+int sum(int x, int z);
+
+int sum(int x, int z) {
+  int y;
+
+  y = 10;
+  return (x + y + z);
+}
+
+int other(void) {
+  int z;
+
+  z = 100;
+  return (x + y + z);
+}
+
+int main() {
+  enum colour c;
+
+  c = blue;
+  printf("%d\n", sum(5, 6));
+  printf("%d\n", other());
+  printf("%d\n", x + y);
+  printf("%d\n", c + colour + dark);
+  return (0);
+}
@@ -0,0 +1,26 @@
+#include <stdio.h>
+
+// #embed puts the bytes of a file in an initialiser
+// list, and there can be other values around them
+char text[] = {
+#embed "input157.dat"
+};
+char line[] = {
+#embed "input157.dat"
+, 0 };
+int words[20] = { -1,
+#embed "input157.dat"
+};
+
+int main() {
+  int i;
+
+  for (i = 0; line[i] != 0; i++)
+    putchar(line[i]);
+  for (i = 16; i < 19; i++)
+    printf("%d\n", text[i] & 0xff);
+  for (i = 0; i < 20; i++)
+    printf("%d ", words[i]);
+  printf("\n");
+  return (0);
+}
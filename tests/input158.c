@@ -0,0 +1,33 @@
+#include <stdio.h>
+
+// __builtin_expect() gives the same values with and
+// without the hints on if, while, for and ?:
+int bad;
+
+int check(int x) {
+  if (__builtin_expect(x < 0, 0)) {
+    bad = bad + 1;
+    printf("negative %d\n", x);
+    return (-1);
+  }
+  return (x * 2);
+}
+
+int pick(int x) {
+  return (__builtin_expect(x == 7, 1) ? 70 : x + 1);
+}
+
+int main() {
+  int i, sum = 0;
+
+  for (i = -2; __builtin_expect(i < 5, 1); i++)
+    sum = sum + check(i);
+  while (__builtin_expect(sum > 10, 0))
+    sum = sum - 10;
+  if (__builtin_expect(sum, 1))
+    printf("sum %d\n", sum);
+  else
+    printf("zero\n");
+  printf("%d %d %d %d\n", bad, pick(7), pick(3), __builtin_expect(sum + 1, 5));
+  return (0);
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+// memcpy() and memset() of a small constant size, the
+// ctype queries and strlen() of a literal are done inline
+struct pair {
+  long a;
+  int b;
+  char c;
+};
+
+char buf[40];
+
+int main() {
+  struct pair p, q;
+  int c, n;
+  char *s;
+
+  p.a = 1234567890;
+  p.a = p.a * 1000 + 123;
+  p.b = -5;
+  p.c = 'x';
+  memcpy(&q, &p, sizeof(struct pair));
+  printf("%ld %d %c\n", q.a, q.b, q.c);
+
+  // Fill all but the ends of buf, with a size that
+  // needs every width of store
+  memset(buf, '-', 39);
+  memset(buf + 1, 'a', 15);
+  memset(buf + 20, 0x142, 7);
+  buf[39] = 0;
+  printf("%s\n", buf);
+  printf("%s\n", buf + 20);
+  s = memset(buf, 0, 0);
+  printf("%d\n", s == buf);
+
+  // Count each class over all the characters and EOF
+  n = 0;
+  for (c = -1; c < 256; c++) {
+    if (isalnum(c)) n = n + 1;
+    if (isalpha(c)) n = n + 10;
+    if (iscntrl(c)) n = n + 100;
+    if (isdigit(c)) n = n + 1000;
+    if (isgraph(c)) n = n + 10000;
+    if (islower(c)) n = n + 100000;
+  }
+  printf("%d\n", n);
+  n = 0;
+  for (c = -1; c < 256; c++) {
+    if (isprint(c)) n = n + 1;
+    if (ispunct(c)) n = n + 100;
+    if (isspace(c)) n = n + 10000;
+    if (isupper(c)) n = n + 100000;
+    if (isxdigit(c)) n = n + 1000000;
+  }
+  printf("%d\n", n);
+  printf("%d %d %d\n", !!isdigit('7'), !!isspace('\t'), !!isupper('q'));
+
+  printf("%d %d\n", (int) strlen("hello"), (int) strlen("two " "parts"));
+  s = "runtime";
+  printf("%d\n", (int) strlen(s));
+  return (0);
+}
@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+// Bytes that spell out a symbol name must
+// stay as they are in a whole-program build
+static int helper(int x) {
+  return (x + 1);
+}
+
+char name[] = { 36, 104, 101, 108, 112, 101, 114, 0 };
+char text[] = {
+#embed "input160.dat"
+, 0 };
+
+int main() {
+  printf("%s\n", name);
+  printf("%s", text);
+  printf("%d\n", helper(41));
+  return (0);
+}
@@ -0,0 +1,5 @@
+1
+100
+101
+106
+7
@@ -0,0 +1,4 @@
+21
+103
+3
+3
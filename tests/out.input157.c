@@ -0,0 +1,5 @@
+Hello, "world"\
+0
+1
+255
+-1 72 101 108 108 111 44 32 34 119 111 114 108 100 34 92 10 0 1 255 
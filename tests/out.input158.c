@@ -0,0 +1,4 @@
+negative -2
+negative -1
+sum 8
+2 70 4 9
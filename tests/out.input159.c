@@ -0,0 +1,9 @@
+1234567890123 -5 x
+-aaaaaaaaaaaaaaa----BBBBBBB------------
+BBBBBBB------------
+1
+3553882
+24663295
+1 1 0
+5 9
+7
@@ -0,0 +1,3 @@
+$helper
+$helper and $main
+42
@@ -0,0 +1,405 @@
+/**
+ * @file trace.c
+ * @author BrunchTea
+ * @brief Timeline of the compile in Chrome trace-event format
+ */
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+// Timeline of the compile.
+//
+// With --trace=file, we write an event when each stage of the
+// driver, each input file and each function starts and ends,
+// and one for each command that we run with its wall time and
+// peak memory use. The file is a JSON array of Chrome trace
+// events, which chrome://tracing or Perfetto can show.
+//
+// Each event goes out in one write() to a file opened for
+// appending, so the parallel jobs of -j can share the file.
+// Each event ends in a comma, and the last one that we write
+// ends the array. If the compile fails, the array is left
+// open, which the trace viewers allow.
+
+#define TRACELEN 4096		// Most bytes in one event
+#define TRACETAIL 64		// Room kept for the end of the event
+
+static int Tracefd = -1;	// The trace file
+static char Tracebuf[TRACELEN];	// The event being built
+static int Tracelen;		// Length of the event
+static int Traceargs;		// True once it has an args object
+static struct tracecmd *Tracecmds;	// Commands still running
+static struct timespec Tracetime;	// The time from the clock
+static struct rusage Traceusage;	// Our own resource use
+
+// Return the time in microseconds
+/**
+ * @fn tracenow
+ * @brief Return the time in microseconds
+ * @return The time from the monotonic clock, in microseconds
+ */
+static long tracenow(void)
+{
+  clock_gettime(CLOCK_MONOTONIC, &Tracetime);
+  return (Tracetime.tv_sec * 1000000 + Tracetime.tv_nsec / 1000);
+}
+
+// Add a character to the event being built
+/**
+ * @fn traceputc
+ * @brief Add a character to the event being built
+ * @param c The character
+ */
+static void traceputc(int c)
+{
+  if (Tracelen < TRACELEN)
+    Tracebuf[Tracelen++] = (char)c;
+}
+
+// Add a string to the event being built
+/**
+ * @fn traceputs
+ * @brief Add a string to the event being built
+ * @param s The string
+ */
+static void traceputs(char *s)
+{
+  while (*s != '\0')
+  {
+    traceputc(*s);
+    s++;
+  }
+}
+
+// Add a string to the event as a JSON
+// string, in quotes and with any escapes.
+// If the rest of the string won't fit in
+// the buffer with room to end the event,
+// it is cut short with "..." at the end
+/**
+ * @fn tracestr
+ * @brief Add a string to the event as a JSON string
+ * @param s The string
+ */
+static void tracestr(char *s)
+{
+  char hex[8];
+
+  traceputc('"');
+  while (*s != '\0')
+  {
+    if (Tracelen > TRACELEN - TRACETAIL)
+    {
+      traceputs("...");
+      break;
+    }
+    if (*s == '"' || *s == '\\')
+    {
+      traceputc('\\');
+      traceputc(*s);
+    }
+    else if (*s >= 0 && *s < ' ')
+    {
+      snprintf(hex, 8, "\\u%04x", *s);
+      traceputs(hex);
+    }
+    else
+      traceputc(*s);
+    s++;
+  }
+  traceputc('"');
+}
+
+// Add a key of an object to the event,
+// after a comma if first is false
+/**
+ * @fn tracekey
+ * @brief Add the key of an object to the event
+ * @param key The key
+ * @param first True if it is the first key in the object
+ */
+static void tracekey(char *key, int first)
+{
+  if (!first)
+    traceputc(',');
+  tracestr(key);
+  traceputc(':');
+}
+
+// Add a number to the event
+/**
+ * @fn tracenum
+ * @brief Add a number to the event
+ * @param n The number
+ */
+static void tracenum(long n)
+{
+  char num[32];
+
+  snprintf(num, 32, "%ld", n);
+  traceputs(num);
+}
+
+// Start building an event of the given phase
+// at time ts, for the thread tid of our process
+/**
+ * @fn tracestart
+ * @brief Start building an event
+ * @param ph The event's phase, e.g. "B" or "E"
+ * @param name The event's name, or NULL
+ * @param cat The event's category, or NULL
+ * @param ts The time of the event in microseconds
+ * @param tid The thread for the event
+ */
+static void tracestart(char *ph, char *name, char *cat, long ts, int tid)
+{
+  Tracelen = 0;
+  Traceargs = 0;
+  traceputc('{');
+  tracekey("ph", 1);
+  tracestr(ph);
+  if (name != NULL)
+  {
+    tracekey("name", 0);
+    tracestr(name);
+  }
+  if (cat != NULL)
+  {
+    tracekey("cat", 0);
+    tracestr(cat);
+  }
+  tracekey("ts", 0);
+  tracenum(ts);
+  tracekey("pid", 0);
+  tracenum(getpid());
+  tracekey("tid", 0);
+  tracenum(tid);
+}
+
+// Add a key to the args object of the event,
+// starting the object if there isn't one yet
+/**
+ * @fn tracearg
+ * @brief Add a key to the args object of the event
+ * @param key The key
+ */
+static void tracearg(char *key)
+{
+  if (Traceargs)
+    tracekey(key, 0);
+  else
+  {
+    tracekey("args", 0);
+    traceputc('{');
+    tracekey(key, 1);
+    Traceargs = 1;
+  }
+}
+
+// Finish the event and write it to the trace
+// file. If last is true, it ends the array
+/**
+ * @fn tracewrite
+ * @brief Finish the event and write it to the trace file
+ * @param last True if this is the last event
+ */
+static void tracewrite(int last)
+{
+  if (Traceargs)
+    traceputc('}');
+  traceputc('}');
+  if (last)
+    traceputs("\n]");
+  else
+    traceputc(',');
+  traceputc('\n');
+
+  // Strings are cut short to leave room for
+  // the end, but an event too long for the
+  // buffer would spoil the file, so leave it out
+  if (Tracelen < TRACELEN)
+    write(Tracefd, Tracebuf, Tracelen);
+}
+
+// Create the trace file and start the array of events
+/**
+ * @fn traceopen
+ * @brief Create the trace file
+ * @param name The name of the trace file
+ */
+void traceopen(char *name)
+{
+  int fd;
+
+  fd = creat(name, 0644);
+  if (fd != -1 && write(fd, "[\n", 2) == 2)
+  {
+    close(fd);
+    Tracefd = open(name, O_WRONLY | O_APPEND);
+  }
+  if (Tracefd == -1)
+  {
+    fprintf(stderr, "Unable to create %s: %s\n", name, strerror(errno));
+    exit(1);
+  }
+}
+
+// Name our process in the trace, and end
+// the array of events if last is true
+/**
+ * @fn traceprocess
+ * @brief Name our process in the trace
+ * @param name The name for the process
+ * @param last True if this is the last event
+ */
+void traceprocess(char *name, int last)
+{
+  if (Tracefd == -1)
+    return;
+  tracestart("M", "process_name", NULL, 0, getpid());
+  tracearg("name");
+  tracestr(name);
+  tracewrite(last);
+}
+
+// Close the trace file, once the last event is written
+/**
+ * @fn traceclose
+ * @brief Close the trace file
+ */
+void traceclose(void)
+{
+  if (Tracefd == -1)
+    return;
+  traceprocess("MINIC", 1);
+  close(Tracefd);
+  Tracefd = -1;
+}
+
+// Note that a stage of the compile begins. The
+// stages that begin must end in the reverse order
+/**
+ * @fn tracebegin
+ * @brief Note that a stage of the compile begins
+ * @param name The name of the stage
+ * @param cat The kind of stage, e.g. "file" or "function"
+ */
+void tracebegin(char *name, char *cat)
+{
+  if (Tracefd == -1)
+    return;
+  tracestart("B", name, cat, tracenow(), getpid());
+  tracewrite(0);
+}
+
+// Note that the stage which began most recently
+// ends, with our peak memory use so far
+/**
+ * @fn traceend
+ * @brief Note that the most recent stage of the compile ends
+ */
+void traceend(void)
+{
+  if (Tracefd == -1)
+    return;
+  getrusage(RUSAGE_SELF, &Traceusage);
+  tracestart("E", NULL, NULL, tracenow(), getpid());
+  tracearg("maxrss_kb");
+  tracenum(Traceusage.ru_maxrss);
+  tracewrite(0);
+}
+
+// Note that we started the command in args
+// as process pid, ready for tracewait()
+/**
+ * @fn tracespawn
+ * @brief Note that we started a command
+ * @param pid The command's process id
+ * @param args The command and its arguments, ending with NULL
+ */
+void tracespawn(int pid, char **args)
+{
+  struct tracecmd *c;
+  int i, len = 0;
+
+  if (Tracefd == -1)
+    return;
+  for (i = 0; args[i] != NULL; i++)
+    len = len + (int)strlen(args[i]) + 1;
+  c = (struct tracecmd *)malloc(sizeof(struct tracecmd));
+  if (c == NULL || (c->cmd = (char *)malloc(len + 1)) == NULL)
+  {
+    fprintf(stderr, "Unable to malloc in tracespawn()\n");
+    exit(1);
+  }
+  c->cmd[0] = '\0';
+  for (i = 0; args[i] != NULL; i++)
+  {
+    if (i > 0)
+      strcat(c->cmd, " ");
+    strcat(c->cmd, args[i]);
+  }
+
+  // Name it after the program that runs
+  c->name = strrchr(args[0], '/');
+  if (c->name == NULL)
+    c->name = args[0];
+  else
+    c->name = c->name + 1;
+  c->name = strdup(c->name);
+  c->pid = pid;
+  c->start = tracenow();
+  c->next = Tracecmds;
+  Tracecmds = c;
+}
+
+// The command with process id pid has finished.
+// Write an event for the time that it ran, on
+// a thread of its own as it ran alongside us
+/**
+ * @fn tracewait
+ * @brief Write an event for a command that has finished
+ * @param pid The command's process id
+ * @param wstatus The command's wait status
+ * @param maxrss The command's peak memory use in kilobytes
+ */
+void tracewait(int pid, int wstatus, long maxrss)
+{
+  struct tracecmd *c, *prev = NULL;
+
+  if (Tracefd == -1)
+    return;
+  for (c = Tracecmds; c != NULL; c = c->next)
+  {
+    if (c->pid == pid)
+      break;
+    prev = c;
+  }
+  if (c == NULL)
+    return;
+  if (prev == NULL)
+    Tracecmds = c->next;
+  else
+    prev->next = c->next;
+
+  tracestart("X", c->name, "command", c->start, pid);
+  tracekey("dur", 0);
+  tracenum(tracenow() - c->start);
+  tracearg("status");
+  tracenum(wstatus);
+  tracearg("maxrss_kb");
+  tracenum(maxrss);
+
+  // A long command is cut short, so it goes last
+  tracearg("command");
+  tracestr(c->cmd);
+  tracewrite(0);
+  free(c->name);
+  free(c->cmd);
+  free(c);
+}
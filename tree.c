@@ -11,7 +11,43 @@
 // AST tree functions
 
 
-// Build and return a generic AST node
+// Get a new AST node with room for nkids child
+// pointers from the function's arena, and fill in
+// all but the children
+/**
+ * @fn newnode
+ * @brief Get a new AST node with room for nkids child pointers
+ * @param op The operator
+ * @param type The type
+ * @param ctype The ctype
+ * @param nkids The number of child pointers
+ * @param sym The symbol table
+ * @param intvalue The integer value
+ * @return The AST node
+*/
+static struct ASTnode *newnode(int op, int type,
+			       struct symtable *ctype, int nkids,
+			       struct symtable *sym, int intvalue) {
+  struct ASTnode *n;
+  int unused;
+
+  // Leave off the child pointers that the node doesn't have
+  unused = (3 - nkids) * sizeof(struct ASTnode *);
+  n = (struct ASTnode *) arenaalloc(Ctx->funcarena,
+				    sizeof(struct ASTnode) - unused);
+  n->op = (char) op;
+  n->rvalue = 0;
+  n->nkids = (char) nkids;
+  n->type = type;
+  n->a_intvalue = intvalue;
+  n->linenum = 0;
+  n->ctype = ctype;
+  n->sym = sym;
+  return (n);
+}
+
+// Build and return a generic AST node. Only A_IF and
+// A_TERNARY nodes, or ones with a mid child, get a mid
 /**
  * @fn mkastnode
  * @brief Build and return a generic AST node
@@ -33,21 +69,13 @@ struct ASTnode *mkastnode(int op, int type,
 			  struct symtable *sym, int intvalue) {
   struct ASTnode *n;
 
-  // Malloc a new ASTnode
-  n = (struct ASTnode *) malloc(sizeof(struct ASTnode));
-  if (n == NULL)
-    fatal("Unable to malloc in mkastnode()");
-
-  // Copy in the field values and return it
-  n->op = op;
-  n->type = type;
-  n->ctype = ctype;
+  if (mid != NULL || op == A_IF || op == A_TERNARY) {
+    n = newnode(op, type, ctype, 3, sym, intvalue);
+    n->mid = mid;
+  } else
+    n = newnode(op, type, ctype, 2, sym, intvalue);
   n->left = left;
-  n->mid = mid;
   n->right = right;
-  n->sym = sym;
-  n->a_intvalue = intvalue;
-  n->linenum = 0;
   return (n);
 }
 
@@ -66,7 +94,7 @@ struct ASTnode *mkastnode(int op, int type,
 struct ASTnode *mkastleaf(int op, int type,
 			  struct symtable *ctype,
 			  struct symtable *sym, int intvalue) {
-  return (mkastnode(op, type, ctype, NULL, NULL, NULL, sym, intvalue));
+  return (newnode(op, type, ctype, 0, sym, intvalue));
 }
 
 // Make a unary AST node: only one child
@@ -85,7 +113,56 @@ struct ASTnode *mkastunary(int op, int type,
 			   struct symtable *ctype,
 			   struct ASTnode *left,
 			   struct symtable *sym, int intvalue) {
-  return (mkastnode(op, type, ctype, left, NULL, NULL, sym, intvalue));
+  struct ASTnode *n;
+
+  n = newnode(op, type, ctype, 1, sym, intvalue);
+  n->left = left;
+  return (n);
+}
+
+// Statement lists and most expressions are chains of nodes
+// that lean to the left, so the tree walkers follow the left
+// children with a stack in the context instead of the C stack.
+// Each walk remembers the depth it started at and pops back
+// down to it
+
+// Push an AST node on the walkers' stack
+/**
+ * @fn pushnode
+ * @brief Push an AST node on the walkers' stack
+ * @param n The AST node
+*/
+void pushnode(struct ASTnode *n) {
+  if (Ctx->nodecount == Ctx->nodemax) {
+    Ctx->nodemax = Ctx->nodemax * 2 + 256;
+    Ctx->nodestack = (struct ASTnode **) realloc(Ctx->nodestack,
+				Ctx->nodemax * sizeof(struct ASTnode *));
+    if (Ctx->nodestack == NULL)
+      fatal("Unable to realloc in pushnode()");
+  }
+  Ctx->nodestack[Ctx->nodecount] = n;
+  Ctx->nodecount = Ctx->nodecount + 1;
+}
+
+// Pop an AST node off the walkers' stack
+/**
+ * @fn popnode
+ * @brief Pop an AST node off the walkers' stack
+ * @return The AST node
+*/
+struct ASTnode *popnode(void) {
+  Ctx->nodecount = Ctx->nodecount - 1;
+  return (Ctx->nodestack[Ctx->nodecount]);
+}
+
+// Return the number of nodes on the walkers' stack
+/**
+ * @fn nodedepth
+ * @brief Return the number of nodes on the walkers' stack
+ * @return The number of nodes
+*/
+int nodedepth(void) {
+  return (Ctx->nodecount);
 }
 
 // Generate and return a new label number
@@ -95,9 +172,9 @@ struct ASTnode *mkastunary(int op, int type,
  * @brief Generate and return a new label number just for AST dumping purposes
  * @return The label number
 */
-static int dumpid = 1;
 static int gendumplabel(void) {
-  return (dumpid++);
+  Ctx->dumpid = Ctx->dumpid + 1;
+  return (Ctx->dumpid - 1);
 }
 
 // List of AST node names
@@ -116,9 +193,85 @@ static char *astname[] = { NULL,
   "FUNCCALL", "DEREF", "ADDR", "SCALE",
   "PREINC", "PREDEC", "POSTINC", "POSTDEC",
   "NEGATE", "INVERT", "LOGNOT", "TOBOOL", "BREAK",
-  "CONTINUE", "SWITCH", "CASE", "DEFAULT", "CAST"
+  "CONTINUE", "SWITCH", "CASE", "DEFAULT", "CAST", "EXPECT"
 };
 
+// Print the branch hint that an AST node has, if any
+/**
+ * @fn dumphint
+ * @brief Print the branch hint that an AST node has
+ * @param n The AST node
+*/
+static void dumphint(struct ASTnode *n) {
+  if (n->op == A_EXPECT)
+    fprintf(stdout, " %d", n->a_intvalue);
+  else if (n->a_intvalue == H_LIKELY)
+    fprintf(stdout, " likely");
+  else if (n->a_intvalue == H_UNLIKELY)
+    fprintf(stdout, " unlikely");
+}
+
+// Print out the line for one general AST node
+/**
+ * @fn dumpnode
+ * @brief Print out the line for one general AST node
+ * @param n The AST node
+ * @param level The level
+*/
+static void dumpnode(struct ASTnode *n, int level) {
+  int i;
+
+  if (n == NULL)
+    fatal("NULL AST node");
+  if (n->op > A_EXPECT)
+    fatald("Unknown dumpAST operator", n->op);
+
+  for (i = 0; i < level; i++)
+    fprintf(stdout, " ");
+  i = n->op;
+  fprintf(stdout, "%s", astname[i]);
+  switch (n->op) {
+    case A_FUNCTION:
+    case A_FUNCCALL:
+    case A_ADDR:
+    case A_PREINC:
+    case A_PREDEC:
+      if (n->sym != NULL)
+	fprintf(stdout, " %s", n->sym->name);
+      break;
+    case A_INTLIT:
+      fprintf(stdout, " %d", n->a_intvalue);
+      break;
+    case A_STRLIT:
+      fprintf(stdout, " rval label L%d", n->a_intvalue);
+      break;
+    case A_IDENT:
+      if (n->rvalue)
+	fprintf(stdout, " rval %s", n->sym->name);
+      else
+	fprintf(stdout, " %s", n->sym->name);
+      break;
+    case A_DEREF:
+      if (n->rvalue)
+	fprintf(stdout, " rval");
+      break;
+    case A_SCALE:
+      fprintf(stdout, " %d", n->a_size);
+      break;
+    case A_CASE:
+      fprintf(stdout, " %d", n->a_intvalue);
+      break;
+    case A_CAST:
+      fprintf(stdout, " %d", n->type);
+      break;
+    case A_EXPECT:
+    case A_TERNARY:
+      dumphint(n);
+      break;
+  }
+  fprintf(stdout, "\n");
+}
+
 // Given an AST tree, print it out and follow the
 // traversal of the tree that genAST() follows
 /**
@@ -130,11 +283,11 @@ static char *astname[] = { NULL,
 */
 void dumpAST(struct ASTnode *n, int label, int level) {
   int Lfalse, Lstart, Lend;
-  int i;
+  int i, base;
 
   if (n == NULL)
     fatal("NULL AST node");
-  if (n->op > A_CAST)
+  if (n->op > A_EXPECT)
     fatald("Unknown dumpAST operator", n->op);
 
   // Deal with IF and WHILE statements specifically
@@ -148,6 +301,7 @@ void dumpAST(struct ASTnode *n, int label, int level) {
 	Lend = gendumplabel();
 	fprintf(stdout, ", end L%d", Lend);
       }
+      dumphint(n);
       fprintf(stdout, "\n");
       dumpAST(n->left, Lfalse, level + 2);
       dumpAST(n->mid, NOLABEL, level + 2);
@@ -158,7 +312,9 @@ void dumpAST(struct ASTnode *n, int label, int level) {
       Lstart = gendumplabel();
       for (i = 0; i < level; i++)
 	fprintf(stdout, " ");
-      fprintf(stdout, "WHILE, start L%d\n", Lstart);
+      fprintf(stdout, "WHILE, start L%d", Lstart);
+      dumphint(n);
+      fprintf(stdout, "\n");
       Lend = gendumplabel();
       dumpAST(n->left, Lend, level + 2);
       if (n->right)
@@ -166,58 +322,47 @@ void dumpAST(struct ASTnode *n, int label, int level) {
       return;
   }
 
-  // Reset level to -2 for A_GLUE nodes
+  // A_GLUE nodes aren't printed, and their children are
+  // at the same level. Statement lists lean to the left,
+  // so walk down them on the node stack
+  base = nodedepth();
   if (n->op == A_GLUE) {
-    level -= 2;
-  } else {
-
-    // General AST node handling
-    for (i = 0; i < level; i++)
-      fprintf(stdout, " ");
-    fprintf(stdout, "%s", astname[n->op]);
-    switch (n->op) {
-      case A_FUNCTION:
-      case A_FUNCCALL:
-      case A_ADDR:
-      case A_PREINC:
-      case A_PREDEC:
-	if (n->sym != NULL)
-	  fprintf(stdout, " %s", n->sym->name);
-	break;
-      case A_INTLIT:
-	fprintf(stdout, " %d", n->a_intvalue);
-	break;
-      case A_STRLIT:
-	fprintf(stdout, " rval label L%d", n->a_intvalue);
-	break;
-      case A_IDENT:
-	if (n->rvalue)
-	  fprintf(stdout, " rval %s", n->sym->name);
-	else
-	  fprintf(stdout, " %s", n->sym->name);
-	break;
-      case A_DEREF:
-	if (n->rvalue)
-	  fprintf(stdout, " rval");
-	break;
-      case A_SCALE:
-	fprintf(stdout, " %d", n->a_size);
-	break;
-      case A_CASE:
-	fprintf(stdout, " %d", n->a_intvalue);
-	break;
-      case A_CAST:
-	fprintf(stdout, " %d", n->type);
-	break;
+    while (n != NULL && n->op == A_GLUE) {
+      pushnode(n);
+      n = n->left;
+    }
+    if (n != NULL)
+      dumpAST(n, NOLABEL, level);
+    while (nodedepth() > base) {
+      n = popnode();
+      if (n->right)
+	dumpAST(n->right, NOLABEL, level);
     }
-    fprintf(stdout, "\n");
+    return;
   }
 
-  // General AST node handling
-  if (n->left)
+  // General AST node handling. Print each node on the
+  // way down the left children, and the rest of each
+  // node's children on the way back up
+  while (1) {
+    dumpnode(n, level);
+    if (n->nkids == 0 || n->left == NULL || n->left->op == A_GLUE ||
+	n->left->op == A_IF || n->left->op == A_WHILE)
+      break;
+    pushnode(n);
+    n = n->left;
+    level += 2;
+  }
+  if (n->nkids > 0 && n->left)
     dumpAST(n->left, NOLABEL, level + 2);
-  if (n->mid)
-    dumpAST(n->mid, NOLABEL, level + 2);
-  if (n->right)
-    dumpAST(n->right, NOLABEL, level + 2);
+  while (1) {
+    if (n->nkids > 2 && n->mid)
+      dumpAST(n->mid, NOLABEL, level + 2);
+    if (n->nkids > 1 && n->right)
+      dumpAST(n->right, NOLABEL, level + 2);
+    if (nodedepth() == base)
+      break;
+    n = popnode();
+    level -= 2;
+  }
 }
@@ -0,0 +1,363 @@
+/**
+ * @file whole.c
+ * @author BrunchTea
+ * @brief Whole-program compilation
+ */
+#include "defs.h"
+#include "data.h"
+#include "decl.h"
+
+// Whole-program compilation.
+//
+// With -fwhole-program, the QBE code for each function and
+// each piece of data in every source file is kept, rather than
+// handed to the back end at once. The names of the things that
+// aren't exported get the file's number after them, so that
+// all the files share one name space. Once every file has been
+// parsed, we follow the references to other names from main()
+// outwards and translate only what can be reached, giving one
+// assembly file for the whole program.
+
+#define WPHASHSIZE 4096		// Number of chains in the name table
+
+static struct wpitem *Wphead;	// All the items in the program
+static struct wpitem *Wptail;	// The last item in the program
+static struct wpitem *Wpfirst;	// The first item of the current file
+static struct wpitem **Wphash;	// Table of the items by their name
+static int Wpfiles;		// Number of files seen so far
+
+// The QBE code for an item as we rename things in it
+static char *Wpbuf;
+static size_t Wplen;
+static FILE *Wpout;
+static FILE *Wpin;		// An item's code going to QBE
+
+// Return the chain in the name table for a name
+/**
+ * @fn wphashname
+ * @brief Return the chain in the name table for a name
+ * @param name The name
+ * @return The chain's position in Wphash
+ */
+static int wphashname(char *name)
+{
+  int h = 0;
+
+  while (*name != '\0')
+  {
+    h = (h * 31 + *name) % WPHASHSIZE;
+    name++;
+  }
+  return (h);
+}
+
+// Find the item with the given name, or return NULL
+/**
+ * @fn wpfind
+ * @brief Find the item with the given name
+ * @param name The name
+ * @return The item, or NULL if there isn't one
+ */
+static struct wpitem *wpfind(char *name)
+{
+  struct wpitem *w;
+
+  if (Wphash == NULL)
+    return (NULL);
+  for (w = Wphash[wphashname(name)]; w != NULL; w = w->hnext)
+    if (!strcmp(w->name, name))
+      return (w);
+  return (NULL);
+}
+
+// Return true if c can be in a QBE name
+/**
+ * @fn wpnamechar
+ * @brief Return true if the character can be in a QBE name
+ * @param c The character
+ * @return True if c can be in a name
+ */
+static int wpnamechar(int c)
+{
+  if (c >= 'a' && c <= 'z')
+    return (1);
+  if (c >= 'A' && c <= 'Z')
+    return (1);
+  if (c >= '0' && c <= '9')
+    return (1);
+  return (c == '_' || c == '.');
+}
+
+// Copy the name after the '$' at s into name,
+// and return the number of characters in it
+/**
+ * @fn wpname
+ * @brief Copy the name after a '$' in the QBE code
+ * @param s The position of the '$'
+ * @param name Where to put the name, TEXTLEN long
+ * @return The length of the name
+ */
+static int wpname(char *s, char *name)
+{
+  int len = 0;
+
+  s++;
+  while (len < TEXTLEN - 1 && wpnamechar(*s))
+  {
+    name[len++] = *s;
+    s++;
+  }
+  name[len] = '\0';
+  return (len);
+}
+
+// Return the next '$' at or after s that starts a
+// name, or NULL if there are no more. A '$' in a
+// "..." string is part of the data, not a name
+/**
+ * @fn wpnextsym
+ * @brief Find the next name in the QBE code, skipping strings
+ * @param s Where to start looking, outside any string
+ * @return The position of the '$', or NULL
+ */
+static char *wpnextsym(char *s)
+{
+  int quoted = 0;
+
+  while (*s != '\0')
+  {
+    if (*s == '"')
+      quoted = !quoted;
+    else if (quoted && *s == '\\' && s[1] != '\0')
+      s++;
+    else if (!quoted && *s == '$')
+      return (s);
+    s++;
+  }
+  return (NULL);
+}
+
+// Add one item of QBE code from the current file. Its
+// first line names the function or data that it defines
+/**
+ * @fn wpnewitem
+ * @brief Add one item of QBE code from the current file
+ * @param text The QBE code
+ * @param len The length of the QBE code
+ */
+static void wpnewitem(char *text, int len)
+{
+  char name[TEXTLEN];
+  struct wpitem *w;
+  char *s;
+
+  w = (struct wpitem *)calloc(1, sizeof(struct wpitem));
+  if (w == NULL)
+    fatal("Unable to malloc in wpnewitem()");
+  w->text = (char *)malloc(len + 1);
+  if (w->text == NULL)
+    fatal("Unable to malloc in wpnewitem()");
+  strncpy(w->text, text, len);
+  w->text[len] = '\0';
+  w->len = len;
+  w->file = Ctx->infilename;
+  w->exported = !strncmp(text, "export", 6);
+
+  if ((s = strchr(w->text, '$')) == NULL)
+    fatal("No name for some QBE code in wpnewitem()");
+  wpname(s, name);
+  w->name = strdup(name);
+
+  if (Wptail == NULL)
+    Wphead = w;
+  else
+    Wptail->next = w;
+  Wptail = w;
+  if (Wpfirst == NULL)
+    Wpfirst = w;
+}
+
+// Keep the QBE code for a declaration in the current
+// file, split up into its functions and pieces of data
+/**
+ * @fn wpadd
+ * @brief Keep the QBE code for a declaration in the current file
+ * @param text The QBE code
+ * @param len The length of the QBE code
+ */
+void wpadd(char *text, int len)
+{
+  int i, start = -1;
+
+  // Each item starts at a line which
+  // begins with export, function or data
+  for (i = 0; i < len; i++)
+  {
+    if (i == 0 || text[i - 1] == '\n')
+    {
+      if (!strncmp(text + i, "export ", 7) ||
+          !strncmp(text + i, "function ", 9) ||
+          !strncmp(text + i, "data ", 5))
+      {
+        if (start != -1)
+          wpnewitem(text + start, i - start);
+        start = i;
+      }
+    }
+  }
+  if (start != -1)
+    wpnewitem(text + start, len - start);
+}
+
+// Put the current file's items in the name table.
+// Any name that the file doesn't export gets the
+// file's number after it, here and where it's used
+/**
+ * @fn wpendfile
+ * @brief Give the current file's items their names in the program
+ */
+void wpendfile(void)
+{
+  char name[TEXTLEN + 16];
+  struct wpitem *w;
+  char *s, *t;
+  int h, len;
+
+  Wpfiles = Wpfiles + 1;
+  if (Wphash == NULL)
+  {
+    Wphash = (struct wpitem **)calloc(WPHASHSIZE, sizeof(struct wpitem *));
+    if (Wphash == NULL)
+      fatal("Unable to malloc in wpendfile()");
+  }
+
+  // Rename the file's own names and add them
+  for (w = Wpfirst; w != NULL; w = w->next)
+  {
+    if (!w->exported)
+    {
+      snprintf(name, TEXTLEN + 16, "%s.%d", w->name, Wpfiles);
+      w->name = strdup(name);
+    }
+    h = wphashname(w->name);
+    w->hnext = Wphash[h];
+    Wphash[h] = w;
+  }
+
+  // Now rename the uses of them
+  for (w = Wpfirst; w != NULL; w = w->next)
+  {
+    if ((Wpout = open_memstream(&Wpbuf, &Wplen)) == NULL)
+      fatal("Unable to malloc in wpendfile()");
+    s = w->text;
+    while ((t = wpnextsym(s)) != NULL)
+    {
+      while (s != t)
+      {
+        fputc(*s, Wpout);
+        s++;
+      }
+      fputc('$', Wpout);
+      len = wpname(s, name);
+      fputs(name, Wpout);
+      s = s + len + 1;
+      snprintf(name + len, 16, ".%d", Wpfiles);
+      if (wpfind(name) != NULL)
+        fputs(name + len, Wpout);
+    }
+    fputs(s, Wpout);
+    fclose(Wpout);
+    free(w->text);
+    w->text = Wpbuf;
+    w->len = (int)Wplen;
+  }
+  Wpfirst = NULL;
+}
+
+// Mark the item as reachable, and everything that it
+// uses. The items still to look at are on a list
+// linked through their work fields
+/**
+ * @fn wpmark
+ * @brief Mark an item and everything that it uses as reachable
+ * @param w The item
+ */
+static void wpmark(struct wpitem *w)
+{
+  char name[TEXTLEN];
+  struct wpitem *todo, *used;
+  char *s;
+
+  if (w == NULL || w->live)
+    return;
+  w->live = 1;
+  todo = w;
+  while (todo != NULL)
+  {
+    w = todo;
+    todo = w->work;
+    for (s = wpnextsym(w->text); s != NULL; s = wpnextsym(s + 1))
+    {
+      wpname(s, name);
+      used = wpfind(name);
+      if (used != NULL && !used->live)
+      {
+        used->live = 1;
+        used->work = todo;
+        todo = used;
+      }
+    }
+  }
+}
+
+// Translate the items reachable from main() into
+// assembly code in Ctx->asmfile, or into an object
+// file if Ctx->elfobj is set. If keepexports is
+// true, other object files may use any exported
+// name, so keep everything reachable from those too.
+// Return 0 if QBE couldn't write the object file
+/**
+ * @fn wpfinish
+ * @brief Translate the reachable items in the program into assembly code
+ * @param keepexports If true, keep everything that is exported
+ * @return 1, or 0 if QBE couldn't write the object file
+ */
+int wpfinish(int keepexports)
+{
+  struct wpitem *w;
+  int kept = 0, total = 0;
+
+  wpmark(wpfind("main"));
+  if (keepexports)
+    for (w = Wphead; w != NULL; w = w->next)
+      if (w->exported)
+        wpmark(w);
+
+  // Name the first source file, as cgpreamble() does
+  qbe_init(NULL);
+  if (!Ctx->elfobj)
+    cgasmfile(Ctx->infilename);
+  else if (!qbe_objbegin(Ctx->infilename))
+    return (0);
+  for (w = Wphead; w != NULL; w = w->next)
+  {
+    total++;
+    if (w->live)
+    {
+      kept++;
+      if ((Wpin = fmemopen(w->text, w->len, "r")) == NULL)
+        fatal("Unable to read the QBE code in wpfinish()");
+      tracebegin(w->name, "qbe");
+      qbe_translate(Wpin, w->file, Ctx->asmfile);
+      traceend();
+      fclose(Wpin);
+    }
+  }
+  if (!Ctx->elfobj)
+    qbe_finish(Ctx->asmfile);
+  else if (!qbe_objend(Ctx->asmfile))
+    return (0);
+  if (O_verbose)
+    printf("whole program: kept %d of %d functions and data\n", kept, total);
+  return (1);
+}